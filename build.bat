@@ -1 +1 @@
-emcc -Os -Werror -s EXPORT_NAME=\"M64\"  -s MODULARIZE=1 -s EXPORTED_FUNCTIONS=["_m64_init","_m64_setCharacterROM","_m64_setBASICROM","_m64_setKernalROM","_m64_getPixelBuffer","_m64_getPixelBufferWidth","_m64_getPixelBufferHeight","_m64_update","_m64_reset","_m64_keyPush","_m64_keyRelease","_m64_joystickPush","_m64_joystickRelease","_m64_injectAndRunPrg","_m64_injectPrg","_m64_loadCartridge","_m64_setColor","_m64_audioInit","_m64_getAudioBuffer","_m64_getAudioBufferLength","_m64_getAudioSamplesAvailable","_m64_setSIDModel","_m64_cpuWrite","_m64_cpuRead"]  -s EXPORTED_RUNTIME_METHODS=["ccall","cwrap"]  -s ALLOW_MEMORY_GROWTH=1 src/m64.c src/memory/pla.c src/memory/basicROM.c src/memory/characterROM.c src/memory/colorRAM.c src/memory/disconnectedBusBank.c src/memory/ioBank.c src/memory/kernalROM.c src/memory/sidBank.c src/memory/systemRAM.c src/memory/zeroPageRAM.c src/cartridge/cartridge.c  src/clock/clock.c  src/iec/iecBus.c src/joystick/joystick.c src/keyboard/keyboard.c src/vic/m6569.c src/vic/m6567.c src/vic/sprite.c src/vic/vic.c  src/cpu/m6510.c  src/cia/cia1.c src/cia/cia2.c src/cia/interrupts.c src/cia/timer.c src/cia/m6526.c src/cia/timerA.c src/cia/timerB.c src/cia/tod.c src/sid/sid.c src/sid/filters.c src/sid/wavetable.c src/sid/voice.c src/sid/envelope.c -o build/m64.js
\ No newline at end of file
+emcc -Os -Werror -s EXPORT_NAME=\"M64\"  -s MODULARIZE=1 -s EXPORTED_FUNCTIONS=["_m64_init","_m64_setCharacterROM","_m64_setBASICROM","_m64_setKernalROM","_m64_setKernalLoadTrap","_m64_getPixelBuffer","_m64_getPixelBufferWidth","_m64_getPixelBufferHeight","_m64_update","_m64_runForSamples","_m64_setAudioTargetLatency","_m64_reset","_m64_keyPush","_m64_keyRelease","_m64_setKeyboardState32","_m64_queueInputAfter","_m64_queueInputAtRaster","_m64_getInputQueueLength","_m64_clearInputQueue","_m64_setPotDevice","_m64_setPaddle","_m64_mouseMove","_m64_setLightpen","_m64_joystickPush","_m64_joystickRelease","_m64_injectAndRunPrg","_m64_injectPrg","_m64_loadCartridge","_m64_setColor","_m64_audioInit","_m64_getAudioBuffer","_m64_getAudioBufferLength","_m64_getAudioSamplesAvailable","_m64_getAudioRingBuffer","_m64_getAudioRingBufferLength","_m64_getAudioReadIndex","_m64_getAudioWriteIndex","_m64_setAudioReadIndex","_m64_getAudioReadIndexPointer","_m64_getAudioWriteIndexPointer","_m64_setAudioFormat","_m64_setAudioStems","_m64_getAudioStemBuffer","_m64_setSIDModel","_m64_setSIDModelAt","_m64_setSIDCount","_m64_getSIDCount","_m64_setSIDAddress","_m64_setCIAFastTimerReads","_m64_setCIALazyTOD","_m64_sdrAttach","_m64_sdrWrite","_m64_sdrRead","_m64_vdriveAttach","_m64_vdriveDetach","_m64_vdriveInsertD64","_m64_vdriveEject","_m64_vdriveAddFile","_m64_vdriveClearFiles","_m64_driveSetROM","_m64_driveAttach","_m64_driveDetach","_m64_driveInsertD64","_m64_driveEject","_m64_driveGetState","_m64_cpuWrite","_m64_cpuRead","_m64_getStateLength","_m64_saveState","_m64_loadState","_m64_setRewind","_m64_rewind","_m64_getRewindFrames","_m64_movieRecord","_m64_movieStop","_m64_movieGetData","_m64_movieGetLength","_m64_moviePlay","_m64_movieGetStatus","_m64_movieGetFrame","_m64_getCycleLow","_m64_getCycleHigh","_m64_setSeekCheckpoints","_m64_seek32","_m64_getSeekCheckpointCount","_m64_fork","_m64_forkLoad","_m64_forkFree","_m64_forkGetPageCount","_m64_getStateHashLow","_m64_getStateHashHigh","_m64_setRollback","_m64_rollbackInput32","_m64_getRollbackFrames","_m64_setBootCache","_m64_archiveGetRecordLength","_m64_archiveSaveRecord","_m64_archiveLoadRecord","_m64_archiveInit"]  -s EXPORTED_RUNTIME_METHODS=["ccall","cwrap"]  -s ALLOW_MEMORY_GROWTH=1 src/m64.c src/memory/pla.c src/memory/basicROM.c src/memory/characterROM.c src/memory/colorRAM.c src/memory/disconnectedBusBank.c src/memory/ioBank.c src/memory/kernalROM.c src/memory/sidBank.c src/memory/systemRAM.c src/memory/zeroPageRAM.c src/cartridge/cartridge.c  src/clock/clock.c src/state/state.c src/state/hash.c src/state/rewind.c src/state/movie.c src/state/seek.c src/state/fork.c src/state/rollback.c src/state/boot.c src/state/archive.c  src/iec/iecBus.c src/iec/vdrive.c src/drive/m6522.c src/drive/drive.c src/drive/gcr.c src/joystick/joystick.c src/keyboard/keyboard.c src/input/input.c src/input/pot.c src/vic/m6569.c src/vic/m6567.c src/vic/sprite.c src/vic/vic.c  src/cpu/m6510.c  src/cia/cia1.c src/cia/cia2.c src/cia/interrupts.c src/cia/timer.c src/cia/m6526.c src/cia/timerA.c src/cia/timerB.c src/cia/tod.c src/cia/sdr.c src/sid/sid.c src/sid/filters.c src/sid/wavetable.c src/sid/voice.c src/sid/envelope.c -o build/m64.js
\ No newline at end of file
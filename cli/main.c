@@ -0,0 +1,583 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+// m64: run a prg or crt headless, as fast as it will go, until a stop condition is met,
+// then write out the last frame, the audio and the ram. for testing c64 software from scripts and ci
+//
+// the exit status is 0 when a -pc, -ram or -exit condition was met (or -cycles/-frames ran out and
+// there were no other conditions), the value written for -exit, 2 when -cycles/-frames ran out first
+// and 1 for errors
+
+#include "../src/m64.h"
+
+#define CLI_STOP_CYCLES 1
+#define CLI_STOP_FRAMES 2
+#define CLI_STOP_PC     3
+#define CLI_STOP_RAM    4
+#define CLI_STOP_EXIT   5
+
+// stop conditions, -1 when not set
+int64_t cli_stopCycles = -1;
+int64_t cli_stopFrames = -1;
+int32_t cli_stopPC = -1;
+int32_t cli_stopRamAddress = -1;
+int32_t cli_stopRamValue = -1;
+int32_t cli_exitAddress = -1;
+
+// set by cli_cpuWrite when the cpu writes to the exit address
+bool_t cli_exitWritten = false;
+uint8_t cli_exitValue = 0;
+
+// the stop condition that was met, 0 while running
+uint32_t cli_stop = 0;
+uint32_t cli_pc = 0;
+int64_t cli_frames = 0;
+bool_t cli_frameCounted = false;
+
+uint32_t cli_sampleRate = 44100;
+
+// the audio made so far, int16 with one channel for each sid
+int16_t *cli_audio = NULL;
+uint32_t cli_audioFrames = 0;
+uint32_t cli_audioCapacity = 0;
+uint32_t cli_audioChannels = 1;
+
+// the help goes to stdout when it's asked for, to stderr after a mistake
+static void cli_usage(FILE *out) {
+  fprintf(out,
+    "usage: m64 [options] program.prg|program.crt\n"
+    "\n"
+    "  -h, --help         this text\n"
+    "\n"
+    "machine\n"
+    "  -ntsc              ntsc machine (pal by default)\n"
+    "  -sid 6581|8580     sid model (8580 by default)\n"
+    "  -kernal file       kernal rom (the m64 kernal by default)\n"
+    "  -basic file        basic rom\n"
+    "  -chars file        character rom\n"
+    "  -samplerate n      audio sample rate (44100 by default)\n"
+    "\n"
+    "stop conditions, at least one is needed, numbers can be decimal, 0x or $ hex\n"
+    "  -cycles n          after n cycles since reset\n"
+    "  -frames n          after n frames since the program started\n"
+    "  -pc address        when the cpu is about to run the instruction at address\n"
+    "  -ram address=value when the system ram at address holds value\n"
+    "  -exit address      when the cpu writes to address, the value written is the exit status\n"
+    "\n"
+    "output\n"
+    "  -screen file       the last frame, as png if the name ends in .png, ppm otherwise\n"
+    "  -wav file          the audio, 16 bit with a channel for each sid\n"
+    "  -dumpram file      the 64k of system ram\n");
+}
+
+static int64_t cli_parseNumber(const char *text) {
+  char *end;
+  int64_t value;
+
+  if(text[0] == '$') {
+    value = strtoll(text + 1, &end, 16);
+  } else {
+    value = strtoll(text, &end, 0);
+  }
+
+  if(end == text || *end != '\0' || value < 0) {
+    fprintf(stderr, "m64: bad number '%s'\n", text);
+    exit(1);
+  }
+  return value;
+}
+
+static int64_t cli_parseAddress(const char *text) {
+  int64_t address = cli_parseNumber(text);
+
+  if(address > 0xffff) {
+    fprintf(stderr, "m64: bad address '%s'\n", text);
+    exit(1);
+  }
+  return address;
+}
+
+// the whole file, the buffer is as long as the file
+static uint8_t *cli_readFile(const char *filename, uint32_t *length) {
+  FILE *file;
+  uint8_t *data;
+  long size;
+
+  file = fopen(filename, "rb");
+  if(file == NULL) {
+    fprintf(stderr, "m64: can't open '%s'\n", filename);
+    exit(1);
+  }
+
+  if(fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0) {
+    fprintf(stderr, "m64: can't read '%s'\n", filename);
+    exit(1);
+  }
+
+  data = malloc(size ? size : 1);
+  if(data == NULL) {
+    fprintf(stderr, "m64: out of memory\n");
+    exit(1);
+  }
+  if(fread(data, 1, size, file) != (size_t)size) {
+    fprintf(stderr, "m64: can't read '%s'\n", filename);
+    exit(1);
+  }
+  fclose(file);
+
+  *length = size;
+  return data;
+}
+
+static FILE *cli_createFile(const char *filename) {
+  FILE *file = fopen(filename, "wb");
+
+  if(file == NULL) {
+    fprintf(stderr, "m64: can't write '%s'\n", filename);
+    exit(1);
+  }
+  return file;
+}
+
+static bool_t cli_endsWith(const char *text, const char *ending) {
+  size_t textLength = strlen(text);
+  size_t endingLength = strlen(ending);
+
+  return textLength >= endingLength && strcmp(text + textLength - endingLength, ending) == 0;
+}
+
+// the cpu's writes go through here so a write to the exit address can be seen
+static void cli_cpuWrite(uint16_t address, uint8_t value) {
+  pla_cpuWrite(address, value);
+
+  if(address == cli_exitAddress) {
+    cli_exitWritten = true;
+    cli_exitValue = value;
+  }
+}
+
+// move the samples in the ring buffer to the end of cli_audio
+static void cli_takeAudio() {
+  int16_t *ring = (int16_t *)m64_getAudioRingBuffer();
+  uint32_t mask = m64_getAudioRingBufferLength() - 1;
+  uint32_t readIndex = m64_getAudioReadIndex();
+  uint32_t writeIndex = m64_getAudioWriteIndex();
+  uint32_t frames = writeIndex - readIndex;
+  uint32_t capacity;
+  int16_t *audio;
+  uint32_t i, j;
+
+  if(cli_audioFrames + frames > cli_audioCapacity) {
+    capacity = (cli_audioCapacity + frames) * 2;
+    audio = realloc(cli_audio, sizeof(int16_t) * cli_audioChannels * capacity);
+    if(audio == NULL) {
+      fprintf(stderr, "m64: out of memory\n");
+      exit(1);
+    }
+    cli_audio = audio;
+    cli_audioCapacity = capacity;
+  }
+
+  for(i = 0; i < frames; i++) {
+    for(j = 0; j < cli_audioChannels; j++) {
+      cli_audio[(cli_audioFrames + i) * cli_audioChannels + j] = ring[((readIndex + i) & mask) * cli_audioChannels + j];
+    }
+  }
+  cli_audioFrames += frames;
+  m64_setAudioReadIndex(writeIndex);
+}
+
+// the step hook, checks the stop conditions after every clock step
+static bool_t cli_step() {
+  if(vic_rasterY == 0) {
+    if(!cli_frameCounted) {
+      cli_frameCounted = true;
+      cli_frames++;
+      if(cli_stopFrames >= 0 && cli_frames >= cli_stopFrames) {
+        cli_stop = CLI_STOP_FRAMES;
+        return true;
+      }
+    }
+  } else {
+    cli_frameCounted = false;
+  }
+
+  if(m64_cpu.nextOpcodeLocation != cli_pc) {
+    cli_pc = m64_cpu.nextOpcodeLocation;
+    if(cli_pc == (uint32_t)cli_stopPC) {
+      cli_stop = CLI_STOP_PC;
+      return true;
+    }
+  }
+
+  if(cli_exitWritten) {
+    cli_stop = CLI_STOP_EXIT;
+    return true;
+  }
+
+  if(cli_stopRamAddress >= 0 && systemram_array()[cli_stopRamAddress] == cli_stopRamValue) {
+    cli_stop = CLI_STOP_RAM;
+    return true;
+  }
+
+  if(cli_stopCycles >= 0 && m64_getCycle() >= (uint64_t)cli_stopCycles) {
+    cli_stop = CLI_STOP_CYCLES;
+    return true;
+  }
+  return false;
+}
+
+// run until a stop condition is met, returns which one
+// m64_runForSamples runs the machine, so the frames go through the same hooks (rewind, hashes, movies...) as a host's
+static uint32_t cli_run() {
+  cli_pc = m64_cpu.nextOpcodeLocation;
+  cli_frameCounted = m64_screenDrawn;
+  m64_setStepHook(&cli_step);
+
+  while(cli_stop == 0) {
+    m64_runForSamples(m64_getAudioRingBufferLength() / 2);
+    cli_takeAudio();
+  }
+
+  m64_setStepHook(NULL);
+  return cli_stop;
+}
+
+static void cli_writePPM(const char *filename) {
+  uint32_t width = m64_getPixelBufferWidth();
+  uint32_t height = m64_getPixelBufferHeight();
+  uint8_t *pixels = m64_getPixelBuffer();
+  FILE *file = cli_createFile(filename);
+  uint32_t i;
+
+  fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+  // the pixel buffer is rgba
+  for(i = 0; i < width * height; i++) {
+    fwrite(pixels + i * 4, 1, 3, file);
+  }
+  fclose(file);
+}
+
+static uint32_t cli_crc32(uint32_t crc, uint8_t *data, uint32_t length) {
+  uint32_t i, j;
+
+  crc = ~crc;
+  for(i = 0; i < length; i++) {
+    crc ^= data[i];
+    for(j = 0; j < 8; j++) {
+      crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+static void cli_writeBigEndian32(uint8_t *data, uint32_t value) {
+  data[0] = value >> 24;
+  data[1] = value >> 16;
+  data[2] = value >> 8;
+  data[3] = value;
+}
+
+static void cli_writePNGChunk(FILE *file, const char *type, uint8_t *data, uint32_t length) {
+  uint8_t header[8];
+  uint8_t crc[4];
+
+  cli_writeBigEndian32(header, length);
+  memcpy(header + 4, type, 4);
+  cli_writeBigEndian32(crc, cli_crc32(cli_crc32(0, header + 4, 4), data, length));
+
+  fwrite(header, 1, 8, file);
+  fwrite(data, 1, length, file);
+  fwrite(crc, 1, 4, file);
+}
+
+// a png without compression: each row is a filter byte and rgb, the zlib stream is one stored block per row
+static void cli_writePNG(const char *filename) {
+  static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  uint32_t width = m64_getPixelBufferWidth();
+  uint32_t height = m64_getPixelBufferHeight();
+  uint8_t *pixels = m64_getPixelBuffer();
+  uint32_t rowLength = 1 + width * 3;
+  uint32_t length = 2 + height * (5 + rowLength) + 4;
+  uint32_t adlerA = 1, adlerB = 0;
+  uint8_t header[13];
+  uint8_t *data, *row;
+  uint32_t x, y, i;
+  FILE *file;
+
+  data = malloc(length);
+  if(data == NULL) {
+    fprintf(stderr, "m64: out of memory\n");
+    exit(1);
+  }
+
+  // zlib header, no compression
+  data[0] = 0x78;
+  data[1] = 0x01;
+
+  for(y = 0; y < height; y++) {
+    row = data + 2 + y * (5 + rowLength);
+    row[0] = y == height - 1 ? 1 : 0;
+    row[1] = rowLength & 0xff;
+    row[2] = rowLength >> 8;
+    row[3] = ~rowLength & 0xff;
+    row[4] = (~rowLength >> 8) & 0xff;
+
+    row += 5;
+    row[0] = 0;
+    for(x = 0; x < width; x++) {
+      memcpy(row + 1 + x * 3, pixels + (y * width + x) * 4, 3);
+    }
+
+    for(i = 0; i < rowLength; i++) {
+      adlerA = (adlerA + row[i]) % 65521;
+      adlerB = (adlerB + adlerA) % 65521;
+    }
+  }
+  cli_writeBigEndian32(data + length - 4, (adlerB << 16) | adlerA);
+
+  cli_writeBigEndian32(header, width);
+  cli_writeBigEndian32(header + 4, height);
+  header[8] = 8;    // bits per channel
+  header[9] = 2;    // rgb
+  header[10] = 0;
+  header[11] = 0;
+  header[12] = 0;
+
+  file = cli_createFile(filename);
+  fwrite(signature, 1, 8, file);
+  cli_writePNGChunk(file, "IHDR", header, 13);
+  cli_writePNGChunk(file, "IDAT", data, length);
+  cli_writePNGChunk(file, "IEND", NULL, 0);
+  fclose(file);
+  free(data);
+}
+
+static void cli_writeLittleEndian(FILE *file, uint32_t value, uint32_t bytes) {
+  uint32_t i;
+
+  for(i = 0; i < bytes; i++) {
+    fputc((value >> (i * 8)) & 0xff, file);
+  }
+}
+
+static void cli_writeWAV(const char *filename) {
+  uint32_t dataLength = cli_audioFrames * cli_audioChannels * 2;
+  FILE *file = cli_createFile(filename);
+  uint32_t i;
+
+  fwrite("RIFF", 1, 4, file);
+  cli_writeLittleEndian(file, 36 + dataLength, 4);
+  fwrite("WAVEfmt ", 1, 8, file);
+  cli_writeLittleEndian(file, 16, 4);
+  cli_writeLittleEndian(file, 1, 2);    // pcm
+  cli_writeLittleEndian(file, cli_audioChannels, 2);
+  cli_writeLittleEndian(file, cli_sampleRate, 4);
+  cli_writeLittleEndian(file, cli_sampleRate * cli_audioChannels * 2, 4);
+  cli_writeLittleEndian(file, cli_audioChannels * 2, 2);
+  cli_writeLittleEndian(file, 16, 2);
+  fwrite("data", 1, 4, file);
+  cli_writeLittleEndian(file, dataLength, 4);
+
+  for(i = 0; i < cli_audioFrames * cli_audioChannels; i++) {
+    cli_writeLittleEndian(file, (uint16_t)cli_audio[i], 2);
+  }
+  fclose(file);
+}
+
+static void cli_writeRAM(const char *filename) {
+  FILE *file = cli_createFile(filename);
+
+  fwrite(systemram_array(), 1, SYSTEM_RAM_LENGTH, file);
+  fclose(file);
+}
+
+int main(int argc, char **argv) {
+  const char *programFilename = NULL;
+  const char *kernalFilename = NULL;
+  const char *basicFilename = NULL;
+  const char *charsFilename = NULL;
+  const char *screenFilename = NULL;
+  const char *wavFilename = NULL;
+  const char *ramFilename = NULL;
+  int32_t model = M64_MODEL_PAL;
+  int32_t sidModel = SID_8580;
+  uint8_t *data;
+  uint32_t dataLength;
+  uint32_t stop;
+  const char *value;
+  char *equals;
+  int status;
+  int i;
+
+  for(i = 1; i < argc; i++) {
+    if(argv[i][0] != '-') {
+      programFilename = argv[i];
+      continue;
+    }
+
+    if(strcmp(argv[i], "-ntsc") == 0) {
+      model = M64_MODEL_NTSC;
+      continue;
+    }
+    if(strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "--help") == 0) {
+      cli_usage(stdout);
+      return 0;
+    }
+
+    // the rest take a value
+    if(i + 1 >= argc) {
+      fprintf(stderr, "m64: %s needs a value\n", argv[i]);
+      return 1;
+    }
+    value = argv[i + 1];
+
+    if(strcmp(argv[i], "-sid") == 0) {
+      if(strcmp(value, "6581") == 0) {
+        sidModel = SID_6581;
+      } else if(strcmp(value, "8580") == 0) {
+        sidModel = SID_8580;
+      } else {
+        fprintf(stderr, "m64: the sid model is 6581 or 8580\n");
+        return 1;
+      }
+    } else if(strcmp(argv[i], "-kernal") == 0) {
+      kernalFilename = value;
+    } else if(strcmp(argv[i], "-basic") == 0) {
+      basicFilename = value;
+    } else if(strcmp(argv[i], "-chars") == 0) {
+      charsFilename = value;
+    } else if(strcmp(argv[i], "-samplerate") == 0) {
+      cli_sampleRate = cli_parseNumber(value);
+    } else if(strcmp(argv[i], "-cycles") == 0) {
+      cli_stopCycles = cli_parseNumber(value);
+    } else if(strcmp(argv[i], "-frames") == 0) {
+      cli_stopFrames = cli_parseNumber(value);
+    } else if(strcmp(argv[i], "-pc") == 0) {
+      cli_stopPC = cli_parseAddress(value);
+    } else if(strcmp(argv[i], "-ram") == 0) {
+      equals = strchr(value, '=');
+      if(equals == NULL) {
+        fprintf(stderr, "m64: -ram needs address=value\n");
+        return 1;
+      }
+      *equals = '\0';
+      cli_stopRamAddress = cli_parseAddress(value);
+      cli_stopRamValue = cli_parseNumber(equals + 1) & 0xff;
+    } else if(strcmp(argv[i], "-exit") == 0) {
+      cli_exitAddress = cli_parseAddress(value);
+    } else if(strcmp(argv[i], "-screen") == 0) {
+      screenFilename = value;
+    } else if(strcmp(argv[i], "-wav") == 0) {
+      wavFilename = value;
+    } else if(strcmp(argv[i], "-dumpram") == 0) {
+      ramFilename = value;
+    } else {
+      fprintf(stderr, "m64: unknown option %s\n", argv[i]);
+      cli_usage(stderr);
+      return 1;
+    }
+    i++;
+  }
+
+  if(programFilename == NULL) {
+    cli_usage(stderr);
+    return 1;
+  }
+  if(cli_stopCycles < 0 && cli_stopFrames < 0 && cli_stopPC < 0 && cli_stopRamAddress < 0 && cli_exitAddress < 0) {
+    fprintf(stderr, "m64: no stop condition, give at least one of -cycles, -frames, -pc, -ram or -exit\n");
+    return 1;
+  }
+
+  m64_init(model, sidModel);
+  m64_setSIDModel(sidModel);
+  m64_audioInit(4096, cli_sampleRate);
+  m64_setAudioFormat(SID_AUDIOFORMAT_INT16);
+  m6510_setMemoryHandler(&m64_cpu, &pla_cpuRead, &cli_cpuWrite);
+
+  if(kernalFilename != NULL) {
+    data = cli_readFile(kernalFilename, &dataLength);
+    m64_setKernalROM(data, dataLength);
+    free(data);
+  }
+  if(basicFilename != NULL) {
+    data = cli_readFile(basicFilename, &dataLength);
+    m64_setBASICROM(data, dataLength);
+    free(data);
+  }
+  if(charsFilename != NULL) {
+    data = cli_readFile(charsFilename, &dataLength);
+    m64_setCharacterROM(data, dataLength);
+    free(data);
+  }
+
+  data = cli_readFile(programFilename, &dataLength);
+  if(cli_endsWith(programFilename, ".crt") || cli_endsWith(programFilename, ".CRT")) {
+    m64_loadCartridge(data, dataLength);
+    if(m64_cartridge.type == CARTRIDGE_NULL) {
+      fprintf(stderr, "m64: '%s' isn't a cartridge m64 can load\n", programFilename);
+      return 1;
+    }
+  } else {
+    if(dataLength < 3) {
+      fprintf(stderr, "m64: '%s' is too short to be a prg\n", programFilename);
+      return 1;
+    }
+    if(dataLength - 2 > 0x10000 - (data[0] | (data[1] << 8))) {
+      fprintf(stderr, "m64: '%s' doesn't fit in memory at $%04x\n", programFilename, data[0] | (data[1] << 8));
+      return 1;
+    }
+    m64_injectAndRunPrg(data, dataLength, 0);
+  }
+  free(data);
+
+  cli_audioChannels = m64_getSIDCount();
+  m64_setAudioReadIndex(m64_getAudioWriteIndex());
+
+  stop = cli_run();
+  sid_update();
+  cli_takeAudio();
+
+  status = 0;
+  switch(stop) {
+    case CLI_STOP_CYCLES:
+    case CLI_STOP_FRAMES:
+      printf("stopped: %s ran out", stop == CLI_STOP_CYCLES ? "cycles" : "frames");
+      if(cli_stopPC >= 0 || cli_stopRamAddress >= 0 || cli_exitAddress >= 0) {
+        status = 2;
+      }
+      break;
+    case CLI_STOP_PC:
+      printf("stopped: pc $%04x", cli_stopPC);
+      break;
+    case CLI_STOP_RAM:
+      printf("stopped: ram $%04x = $%02x", cli_stopRamAddress, cli_stopRamValue);
+      break;
+    case CLI_STOP_EXIT:
+      printf("stopped: $%02x written to $%04x", cli_exitValue, cli_exitAddress);
+      status = cli_exitValue;
+      break;
+  }
+  printf(" at cycle %llu\n", (unsigned long long)m64_getCycle());
+
+  if(screenFilename != NULL) {
+    if(cli_endsWith(screenFilename, ".png") || cli_endsWith(screenFilename, ".PNG")) {
+      cli_writePNG(screenFilename);
+    } else {
+      cli_writePPM(screenFilename);
+    }
+  }
+  if(wavFilename != NULL) {
+    cli_writeWAV(wavFilename);
+  }
+  if(ramFilename != NULL) {
+    cli_writeRAM(ramFilename);
+  }
+
+  return status;
+}
@@ -47,18 +47,29 @@ function m64_pushAudio() {
     m64_pushAudio();
   });
 
-  var soundBuffer = m64_audioContext.createBuffer(1, m64_audioBufferSize, m64_audioSampleFrequency);
+  // one channel for each sid, a build from before m64_getSIDCount was exported only has one
+  var channels = typeof m64._m64_getSIDCount === 'function' ? m64_getSIDCount() : 1;
+  var soundBuffer = m64_audioContext.createBuffer(channels, m64_audioBufferSize, m64_audioSampleFrequency);
   bufferSource.connect(m64_audioGainNode);
 
   // get the pointer into the heap for the audio buffer
   var ptr = m64_getAudioBuffer();
 
   // get a float32 array view of the audio buffer
-  var view = new Float32Array(m64.HEAPF32.subarray( (ptr >> 2), (ptr >> 2) + m64_audioBufferSize));
+  var view = new Float32Array(m64.HEAPF32.subarray( (ptr >> 2), (ptr >> 2) + m64_audioBufferSize * channels));
 
   // set the channel data with the data from the sound buffer
-  var channelData = soundBuffer.getChannelData(0);
-  channelData.set(view);
+  if(channels == 1) {
+    soundBuffer.getChannelData(0).set(view);
+  } else {
+    // samples are interleaved
+    for(var c = 0; c < channels; c++) {
+      var channelData = soundBuffer.getChannelData(c);
+      for(var i = 0; i < m64_audioBufferSize; i++) {
+        channelData[i] = view[i * channels + c];
+      }
+    }
+  }
 
   // set the buffer for tthe buffer source and tell it when to play
   bufferSource.buffer = soundBuffer;
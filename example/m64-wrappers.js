@@ -53,6 +53,42 @@ var m64_keyPush = m64.cwrap('m64_keyPush', null, ['number']);
 // m64_keyRelease(keyCode)
 var m64_keyRelease = m64.cwrap('m64_keyRelease', null, ['number']);
 
+// m64_setKeyboardState32(keysLow, keysHigh)
+// set every key at once (eg once per frame), bit n is 1 if the key with keyCode n is down
+// keysLow : keyCodes 0 - 31, keysHigh : keyCodes 32 - 63, restore is not changed
+// (from C, m64_setKeyboardState(keys) takes a uint64)
+var m64_setKeyboardState32 = m64.cwrap('m64_setKeyboardState32', null, ['number', 'number']);
+
+// input can be queued to happen at an exact emulated cycle instead of when m64_keyPush etc are called
+// type : 0 = key down, 1 = key up (code is the keyCode), 2 = joystick push, 3 = joystick release (code is the port 0/1, value is the direction)
+//        4 = mouse move (code is the port, value is (dx & 0xffff) | (dy << 16)), 5 = paddle (code is port * 2 + paddle, value is 0-255)
+// all return 0 if queued, -1 if not (the queue holds 256), the queue is cleared by m64_reset
+// m64_queueInputAfter(cycles, type, code, value) : queue input for cycles from now
+// m64_queueInputAtRaster(frames, rasterLine, lineCycle, type, code, value) : queue input for when the beam reaches 
+//   lineCycle (1 - 63 on PAL, 1 - 65 on NTSC) of rasterLine, frames = 0 is the next time it gets there, 1 the frame after that, etc
+// m64_getInputQueueLength() : the number of input events waiting
+// m64_clearInputQueue() : throw away anything waiting
+// (from C, m64_queueInput(cycle, type, code, value) takes an absolute cycle since reset)
+var m64_queueInputAfter = m64.cwrap('m64_queueInputAfter', 'number', ['number', 'number', 'number', 'number']);
+var m64_queueInputAtRaster = m64.cwrap('m64_queueInputAtRaster', 'number', ['number', 'number', 'number', 'number', 'number', 'number']);
+var m64_getInputQueueLength = m64.cwrap('m64_getInputQueueLength', 'number');
+var m64_clearInputQueue = m64.cwrap('m64_clearInputQueue', null);
+
+// paddles and the 1351 mouse, read by the c64 through the sid's POTX/POTY in 512 cycle windows
+// m64_setPotDevice(port, device) : port 0 or 1, device 0 = nothing, 1 = paddles, 2 = 1351 mouse
+// m64_setPaddle(port, paddle, value) : paddle 0 (POTX) or 1 (POTY), value 0 - 255. the fire buttons are joystick left and right
+// m64_mouseMove(port, dx, dy) : move the mouse, dy is down the screen. the buttons are joystick fire (left) and up (right)
+// a batch of moves can be queued with m64_queueInputAfter/AtRaster (type 4), spread over the frame so the c64 sees them all
+var m64_setPotDevice = m64.cwrap('m64_setPotDevice', null, ['number', 'number']);
+var m64_setPaddle = m64.cwrap('m64_setPaddle', null, ['number', 'number', 'number']);
+var m64_mouseMove = m64.cwrap('m64_mouseMove', null, ['number', 'number', 'number']);
+
+// m64_setLightpen(x, y, button)
+// point a light pen or light gun at pixel x, y of the pixel buffer, x or y = -1 takes it off the screen
+// each frame when the beam reaches that pixel the vic latches the position in $d013/$d014 and sets the light pen interrupt flag
+// button : 1 if the pen's button is pressed (joystick port 1 up). a light gun only sees bright pixels, check the pixel before pointing it
+var m64_setLightpen = m64.cwrap('m64_setLightpen', null, ['number', 'number', 'number']);
+
 // m64_joystickPush(port, direction)
 // port      : 0 for port 1, 1 for port 2
 // direction : 1 = up, 2 = down, 4 = left, 8 = right, 16 = fire button
@@ -67,6 +103,182 @@ var m64_joystickRelease = m64.cwrap('m64_joystickRelease', null, ['number', 'num
 // model : 0 = 6581, 1 = 8580, 2 = 8580 with digiboost
 var m64_setSIDModel = m64.cwrap('m64_setSIDModel', null, ['number']);
 
+// m64_setSIDCount(count)
+// count : number of SIDs, 1 to 4, the audio buffer will have one interleaved channel for each SID
+// m64_getSIDCount() returns the number of SIDs
+var m64_setSIDCount = m64.cwrap('m64_setSIDCount', null, ['number']);
+var m64_getSIDCount = m64.cwrap('m64_getSIDCount', 'number');
+
+// m64_setSIDAddress(index, address)
+// index   : SID 1 to 3, SID 0 is always at $d400
+// address : a multiple of $20 in $d420-$d7e0 or $de00-$dfe0, defaults are $d420, $d500, $de00
+var m64_setSIDAddress = m64.cwrap('m64_setSIDAddress', null, ['number', 'number']);
+
+// m64_setSIDModelAt(index, model)
+// index : SID 0 to 3
+// model : 0 = 6581, 1 = 8580, 2 = 8580 with digiboost
+var m64_setSIDModelAt = m64.cwrap('m64_setSIDModelAt', null, ['number', 'number']);
+
+// m64_setCIAFastTimerReads(enabled)
+// enabled : 1 (the default) to work out CIA timer values from the current cycle when reading a CIA register,
+// 0 to always sync the timers (slower, for comparing)
+var m64_setCIAFastTimerReads = m64.cwrap('m64_setCIAFastTimerReads', null, ['number']);
+
+// m64_setCIALazyTOD(enabled)
+// enabled : 1 (the default) to only work out the CIA time of day clocks when they are read or written or the alarm is due,
+// 0 to run them with an event every 1/10th sec (slower, for comparing)
+var m64_setCIALazyTOD = m64.cwrap('m64_setCIALazyTOD', null, ['number']);
+
+// a device can be attached to the serial port (CNT/SP) of CIA 1 or 2 to send and receive bytes through the SDR register
+// m64_sdrAttach(cia, cyclesPerBit) : cia is 1 or 2, the device sends a bit every cyclesPerBit cycles, 0 detaches it
+// m64_sdrWrite(cia, byte) : the device sends a byte, it is shifted in while the CIA is in input mode 
+//   (bit 6 of CRA = 0), then the SDR is loaded and the serial port interrupt triggered. returns -1 if the queue (256 bytes) is full
+// m64_sdrRead(cia) : returns the next byte the CIA has shifted out in output mode (bit 6 of CRA = 1), or -1 if there isn't one
+// to link the two CIAs, move the bytes read from one to the other
+var m64_sdrAttach = m64.cwrap('m64_sdrAttach', null, ['number', 'number']);
+var m64_sdrWrite = m64.cwrap('m64_sdrWrite', 'number', ['number', 'number']);
+var m64_sdrRead = m64.cwrap('m64_sdrRead', 'number', ['number']);
+
+// a virtual disk drive on the serial bus, for programs that load with the kernal routines (needs a real kernal, see m64_setKernalROM)
+// it serves files from a d64 image and/or files added with m64_vdriveAddFile, files saved by the c64 are added to the same table
+// there is no 1541 cpu, so fast loaders that run their own code in the drive won't work
+// m64_vdriveAttach(device) : attach the drive as device (usually 8), the emulated 1541 is detached if it has the same number
+// m64_vdriveDetach() : remove the drive from the bus
+// m64_vdriveInsertD64(data, length) : data is a pointer to a d64 image in the heap (it is copied), returns -1 if it is too short
+// m64_vdriveEject() : remove the d64 image
+// m64_vdriveAddFile(name, data, length) : add a file (a Uint8Array with a prg including its load address), the name is converted to upper case, returns -1 if the table (64 files) is full
+// m64_vdriveClearFiles() : remove all the added files
+// inserting a d64 or adding a file attaches the drive as device 8 if it isn't attached and the emulated 1541 isn't device 8
+var m64_vdriveAttach = m64.cwrap('m64_vdriveAttach', null, ['number']);
+var m64_vdriveDetach = m64.cwrap('m64_vdriveDetach');
+var m64_vdriveInsertD64 = m64.cwrap('m64_vdriveInsertD64', 'number', ['number', 'number']);
+var m64_vdriveEject = m64.cwrap('m64_vdriveEject');
+var m64_vdriveAddFile = m64.cwrap('m64_vdriveAddFile', 'number', ['string', 'array', 'number']);
+var m64_vdriveClearFiles = m64.cwrap('m64_vdriveClearFiles');
+
+// an emulated 1541: the drive's own 6502, VIAs and dos rom run alongside the c64, so fast loaders and drive code work
+// off by default. attaching it as the virtual drive's device number detaches the virtual drive
+// m64_driveSetROM(romData, romDataLength) : the 16KB 1541 rom ($c000-$ffff), returns -1 if it is too short
+// m64_driveAttach(device) : attach the drive as device 8-11 and reset it, returns -1 if there is no rom
+// m64_driveDetach() : remove the drive from the bus
+// m64_driveInsertD64(data, length) : data is a pointer to a d64 image in the heap (it is converted to GCR, writes go to the GCR copy only)
+// m64_driveEject() : remove the disk
+// m64_driveGetState() : bit 0 LED, bit 1 motor, bit 2 asleep (the drive stops running when it is idle), bits 8-15 the half track the head is on
+var m64_driveSetROM = m64.cwrap('m64_driveSetROM', 'number', ['array', 'number']);
+var m64_driveAttach = m64.cwrap('m64_driveAttach', 'number', ['number']);
+var m64_driveDetach = m64.cwrap('m64_driveDetach');
+var m64_driveInsertD64 = m64.cwrap('m64_driveInsertD64', 'number', ['number', 'number']);
+var m64_driveEject = m64.cwrap('m64_driveEject');
+var m64_driveGetState = m64.cwrap('m64_driveGetState', 'number');
+
+// save states, the whole machine including the 1541 and the disk in it if it is attached
+// roms, the cartridge image, the virtual drive's d64 and files aren't saved, load the same ones before loading a state
+// a state only loads into the same build of m64 with the same model, the pixel and audio buffers aren't saved
+// m64_getStateLength() : the number of bytes a state needs right now (it changes with the input queue, the drive, etc)
+// m64_saveState(data, length) : save into data (a pointer into the heap), returns the number of bytes used, -1 if length is too short
+// m64_loadState(data, length) : returns 0, or -1 if the state is from another version or model or is damaged
+var m64_getStateLength = m64.cwrap('m64_getStateLength', 'number');
+var m64_saveState = m64.cwrap('m64_saveState', 'number', ['number', 'number']);
+var m64_loadState = m64.cwrap('m64_loadState', 'number', ['number', 'number']);
+
+// rewind, a save state is kept every few frames (counted by m64_update and m64_runForSamples) as a delta against the one before it
+// m64_setRewind(framesPerSnapshot, budget) : keep a snapshot every framesPerSnapshot frames in budget bytes, the oldest are dropped when it is full
+//   0 for either turns rewind off and frees the memory
+// m64_rewind(frames) : go back to the newest snapshot at least frames frames ago (or the oldest one), the snapshots after it are dropped
+//   returns the number of frames gone back, -1 if there are no snapshots. the pixel buffer is updated at the end of the next frame
+// m64_getRewindFrames() : how many frames back the oldest snapshot is
+// the snapshots are dropped by a reset, loading a state, fork or archive record, a seek back and a rollback
+var m64_setRewind = m64.cwrap('m64_setRewind', null, ['number', 'number']);
+var m64_rewind = m64.cwrap('m64_rewind', 'number', ['number']);
+var m64_getRewindFrames = m64.cwrap('m64_getRewindFrames', 'number');
+
+// movies, a save state and every input call made after it (keys, joysticks, paddles, the input queue, prgs, cartridges, resets,
+// ram writes, the serial port, the drives and their disks and files, the kernal load trap) stamped with the cycle it was made on,
+// and a hash of the ram and the frame at the end of each frame. roms and the disks and files in the drives when recording
+// started have to be loaded again before playing
+// calls are played back between cycles in m64_update and m64_runForSamples, so play with either of those like when recording
+// m64_movieRecord() : start recording from now, returns -1 if the state can't be saved
+// m64_movieStop() : stop recording or playing, a recording stays in m64_movieGetData until the next movie is started
+//   loading a state, m64_rewind, m64_forkLoad, m64_archiveLoadRecord, a seek and a rollback stop the movie too
+// m64_movieGetData(), m64_movieGetLength() : the recorded movie (a pointer into the heap)
+// m64_moviePlay(data, length) : load the movie's state and play it (the data is copied), returns -1 if it isn't a movie
+//   or is for another model or version. the same roms and disks have to be loaded as when it was recorded
+// m64_movieGetStatus() : 0 idle, 1 recording, 2 playing, 3 played to the end, 4 desync (a frame hash didn't match)
+// m64_movieGetFrame() : frames since the movie started, after a desync the frame it went wrong on
+var m64_movieRecord = m64.cwrap('m64_movieRecord', 'number');
+var m64_movieStop = m64.cwrap('m64_movieStop');
+var m64_movieGetData = m64.cwrap('m64_movieGetData', 'number');
+var m64_movieGetLength = m64.cwrap('m64_movieGetLength', 'number');
+var m64_moviePlay = m64.cwrap('m64_moviePlay', 'number', ['number', 'number']);
+var m64_movieGetStatus = m64.cwrap('m64_movieGetStatus', 'number');
+var m64_movieGetFrame = m64.cwrap('m64_movieGetFrame', 'number');
+
+// seeking, a whole save state is kept every few frames so any cycle since the first one can be reached quickly
+// when the checkpoints are full every other one is dropped, so they cover the whole run. resetting or loading a state drops them
+// m64_setSeekCheckpoints(framesPerCheckpoint, maxCheckpoints) : 0 for either turns them off, the first is taken straight away
+// m64_seek32(cycleLow, cycleHigh) : go to a cycle since reset (see m64_getCycleLow/High), from the newest checkpoint before it
+//   if it is behind the machine. frames aren't drawn to the pixel buffer and the audio is dropped on the way, a movie is stopped
+//   returns 0, or -1 if the cycle is before the oldest checkpoint. (from C, m64_seek(cycle) takes a uint64)
+// m64_getSeekCheckpointCount() : the number of checkpoints kept
+var m64_setSeekCheckpoints = m64.cwrap('m64_setSeekCheckpoints', null, ['number', 'number']);
+var m64_seek32 = m64.cwrap('m64_seek32', 'number', ['number', 'number']);
+var m64_getSeekCheckpointCount = m64.cwrap('m64_getSeekCheckpointCount', 'number');
+
+// forks, copies of the machine to try different input from. the ram is kept in 256 byte pages shared between forks,
+// a fork only holds the pages that changed since the fork the machine came from. roms and cartridge banks are never copied
+// m64_fork() : fork the machine as it is now (it carries on running), returns the fork's id or -1 if there are 64 already
+// m64_forkLoad(id) : make the machine a copy of the fork, the fork is kept. returns 0, or -1 if there is no such fork
+// m64_forkFree(id) : let the fork go
+// m64_forkGetPageCount() : the number of ram pages the forks hold between them
+var m64_fork = m64.cwrap('m64_fork', 'number');
+var m64_forkLoad = m64.cwrap('m64_forkLoad', 'number', ['number']);
+var m64_forkFree = m64.cwrap('m64_forkFree', null, ['number']);
+var m64_forkGetPageCount = m64.cwrap('m64_forkGetPageCount', 'number');
+
+// state hash, a 64 bit hash of the ram, colour ram, cpu and chip registers worked out at the end of every frame
+// two machines running in step can compare it once a frame. only the ram pages written during the frame are hashed again
+// m64_getStateHashLow(), m64_getStateHashHigh() : the two halves of the hash as of the end of the last frame
+// (from C, m64_getStateHash() returns a uint64)
+var m64_getStateHashLow = m64.cwrap('m64_getStateHashLow', 'number');
+var m64_getStateHashHigh = m64.cwrap('m64_getStateHashHigh', 'number');
+
+// rollback, for two players on different hosts. a state is saved at the end of every frame, input from both hosts goes
+// through m64_rollbackInput stamped with the cycle it was made on (see m64_getCycleLow/High). input for a cycle that has
+// already been run sends the machine back to the frame before it and runs the frames since again, without drawing or audio
+// (a movie being recorded or played is stopped when that happens)
+// m64_setRollback(maxFrames) : keep the last maxFrames frames (the memory is allocated here), 0 turns it off. returns 0 or -1
+// m64_rollbackInput32(cycleLow, cycleHigh, type, code, value) : type, code and value as for m64_queueInputAfter
+//   returns the number of frames run again, or -1 if the cycle is older than the frames kept
+// m64_getRollbackFrames() : how many frames back input can go now
+var m64_setRollback = m64.cwrap('m64_setRollback', 'number', ['number']);
+var m64_rollbackInput32 = m64.cwrap('m64_rollbackInput32', 'number', ['number', 'number', 'number', 'number', 'number']);
+var m64_getRollbackFrames = m64.cwrap('m64_getRollbackFrames', 'number');
+
+// the boot cache, the state the kernal startup gets to in m64_reset(1) and m64_injectAndRunPrg is kept, and loaded instead
+// of running the startup the next time the machine starts from the same state with the same roms (up to 4 are kept)
+// m64_setBootCache(enabled) : 1 to keep them (the default), 0 turns it off and frees them
+var m64_setBootCache = m64.cwrap('m64_setBootCache', null, ['number']);
+
+// snapshot archives, a header page then records that are all the same length, so record n is at 4096 + n * recordLength.
+// in a record the system ram is at 0x1000 (64k), the colour ram at 0x800, the cpu registers at 0x100, the vic's at 0x200,
+// the sids' at 0x300 (0x20 each) and the cias' at 0x400 and 0x410, the rest of the machine is a save state at 0x11000
+// m64_archiveGetRecordLength() : the record length to use for the machine as it is now (a whole number of 4096 byte pages)
+// m64_archiveSaveRecord(record, recordLength, tag) : write the machine into a record, tag is kept for the host. returns 0 or -1
+// m64_archiveLoadRecord(record, recordLength) : make the machine the one in the record, returns 0 or -1
+//   the ram, colour ram and registers are taken from their pages, a register changed there is written to its chip
+// m64_archiveInit(archive, recordLength) : write the header page of an empty archive, returns 0 or -1
+//   (from C, m64_archiveAppend adds the machine to an archive, m64_archiveIndex and m64_archiveFind find a record by its hash)
+var m64_archiveGetRecordLength = m64.cwrap('m64_archiveGetRecordLength', 'number');
+var m64_archiveSaveRecord = m64.cwrap('m64_archiveSaveRecord', 'number', ['number', 'number', 'number']);
+var m64_archiveLoadRecord = m64.cwrap('m64_archiveLoadRecord', 'number', ['number', 'number']);
+var m64_archiveInit = m64.cwrap('m64_archiveInit', 'number', ['number', 'number']);
+
+// m64_setKernalLoadTrap(enabled)
+// enabled : 1 to serve LOAD ($ffd5) from the virtual drive's files and d64 straight into memory, without running the serial bus routines
+// only works with a real kernal (see m64_setKernalROM) and for the virtual drive's device number. files the drive doesn't have
+// are left to the kernal. call after m64_init
+var m64_setKernalLoadTrap = m64.cwrap('m64_setKernalLoadTrap', null, ['number']);
+
 // m64_reset(runUntilKernalIsReady)
 // runUntilKernalIsReady : after reset, run the kernal until it is ready for user input
 var m64_reset = m64.cwrap('m64_reset');
@@ -84,6 +296,11 @@ var m64_getPixelBufferWidth = m64.cwrap('m64_getPixelBufferWidth', 'number');
 // the actual height of pixels to be displayed will depend on the model seleceted (NTSC or PAL)
 var m64_getPixelBufferHeight = m64.cwrap('m64_getPixelBufferHeight', 'number');
 
+// m64_getCycleLow(), m64_getCycleHigh() : the two halves of the number of cycles since reset
+// (from C, m64_getCycle() returns a uint64)
+var m64_getCycleLow = m64.cwrap('m64_getCycleLow', 'number');
+var m64_getCycleHigh = m64.cwrap('m64_getCycleHigh', 'number');
+
 // m64_setColor(colorIndex, colorABGR)
 // colorIndex: the color index to set (0-15)
 // colorABGR: the color in ABGR8888 format (Alpha is highest byte, Red is Lowest)
@@ -91,10 +308,54 @@ var m64_setColor = m64.cwrap('m64_setColor', null, ['number','number']);
 
 // m64_getAudioBuffer
 // returns a poinetr to the location of the audio buffer in the heap
-// autio buffer is a float32 array
+// autio buffer is a float32 array (or int16, see m64_setAudioFormat), with more than one SID the channels are interleaved
 var m64_getAudioBuffer = m64.cwrap('m64_getAudioBuffer', 'number');
 
+// m64_setAudioFormat(format)
+// format : 0 = float32, 1 = int16, used for the ring buffer and the audio buffer, clears the ring buffer
+var m64_setAudioFormat = m64.cwrap('m64_setAudioFormat', null, ['number']);
+
+// the SID writes samples into a ring buffer, m64_getAudioBuffer copies out of it
+// instead of m64_getAudioBuffer, a consumer (eg an AudioWorklet sharing the wasm memory) can read the ring directly:
+// samples for frame n are at (n & (ringLength - 1)) * sidCount in the ring, frames from the read index up to the write index are ready
+// after reading, the consumer moves the read index on, only the emulator moves the write index
+// indexes count up forever and wrap at 2^32
+// m64_getAudioRingBuffer()       : returns a pointer to the ring buffer in the heap
+// m64_getAudioRingBufferLength() : returns the length of the ring in frames
+// m64_getAudioReadIndex(), m64_getAudioWriteIndex() : return the indexes
+// m64_setAudioReadIndex(index)   : set the read index after reading up to index
+// m64_getAudioReadIndexPointer(), m64_getAudioWriteIndexPointer() : return pointers to the uint32 indexes in the heap, 
+//   for use with Atomics.load/Atomics.store from another thread
+var m64_getAudioRingBuffer = m64.cwrap('m64_getAudioRingBuffer', 'number');
+var m64_getAudioRingBufferLength = m64.cwrap('m64_getAudioRingBufferLength', 'number');
+var m64_getAudioReadIndex = m64.cwrap('m64_getAudioReadIndex', 'number');
+var m64_getAudioWriteIndex = m64.cwrap('m64_getAudioWriteIndex', 'number');
+var m64_setAudioReadIndex = m64.cwrap('m64_setAudioReadIndex', null, ['number']);
+var m64_getAudioReadIndexPointer = m64.cwrap('m64_getAudioReadIndexPointer', 'number');
+var m64_getAudioWriteIndexPointer = m64.cwrap('m64_getAudioWriteIndexPointer', 'number');
+
+// m64_setAudioStems(enabled)
+// enabled : 1 to also write stems (voice 1, voice 2, voice 3 before the filter, filter output, final mix) in the same pass, 0 to turn them off
+// clears the ring buffer when turned on
+// m64_getAudioStemBuffer() : returns a pointer to the planar float32 stem buffer in the heap, 0 if stems are off
+//   there are 5 planes per SID, each ringLength frames long, using the same indexes as the ring buffer
+//   stem s (0-4) of SID n for frame f is at (n * 5 + s) * ringLength + (f & (ringLength - 1))
+var m64_setAudioStems = m64.cwrap('m64_setAudioStems', null, ['number']);
+var m64_getAudioStemBuffer = m64.cwrap('m64_getAudioStemBuffer', 'number');
+
 // m64_update(dTime)
 // run the m64 for dTime miliseconds, returns 1 if pixelbuffer has been updated, 0 otherwise
 var m64_update = m64.cwrap('m64_update','number', ['number']);
 
+// m64_runForSamples(samples)
+// audio driven pacing, use instead of m64_update when the audio output is the clock (eg from an AudioWorklet asking for more samples)
+// runs the m64 for exactly as long as it takes to write samples more frames into the ring buffer (limited to the free space in the ring)
+// returns the number of video frames completed, the pixel buffer holds the last one
+var m64_runForSamples = m64.cwrap('m64_runForSamples', 'number', ['number']);
+
+// m64_setAudioTargetLatency(frames)
+// dynamic rate control, the resampling ratio is nudged by up to 0.5% each m64_runForSamples call
+// to keep about frames samples waiting in the ring buffer, 0 turns it off (the default)
+// eg 480 frames at 48000 for 10ms of latency
+var m64_setAudioTargetLatency = m64.cwrap('m64_setAudioTargetLatency', null, ['number']);
+
@@ -408,6 +408,30 @@ void cartridge_ultimaxWrite(uint16_t address, uint8_t value) {
   disconnectedbus_write(address, value);
 }
 
+// the banks that are switched in, the cartridge itself has to be loaded again before loading a state
+void cartridge_serialize(state_t *state) {
+  int32_t type = m64_cartridge.type;
+  int32_t romlCount = m64_cartridge.romlbank_count;
+  int32_t romhCount = m64_cartridge.romhbank_count;
+
+  STATE_VALUE(state, type);
+  STATE_VALUE(state, romlCount);
+  STATE_VALUE(state, romhCount);
+  if(type != m64_cartridge.type || romlCount != m64_cartridge.romlbank_count || romhCount != m64_cartridge.romhbank_count) {
+    state->error = true;
+    return;
+  }
+
+  STATE_VALUE(state, m64_cartridge.nmiState);
+  STATE_VALUE(state, m64_cartridge.irqState);
+  STATE_VALUE(state, m64_cartridge.has_roml);
+  STATE_VALUE(state, m64_cartridge.romlbank);
+  STATE_VALUE(state, m64_cartridge.has_romh);
+  STATE_VALUE(state, m64_cartridge.romhbank);
+  STATE_VALUE(state, m64_cartridge.game);
+  STATE_VALUE(state, m64_cartridge.exrom);
+}
+
 void cartridge_reset() {
   m64_cartridge.nmiState = false;
   m64_cartridge.irqState = false;
@@ -55,6 +55,7 @@ void cartridge_io2Write(uint16_t address, uint8_t value);
 uint8_t cartridge_io2Read(uint16_t address);
 
 void cartridge_reset();
+void cartridge_serialize(state_t *state);
 void cartridge_setNMI(bool_t state);
 void cartridge_setIRQ(bool_t state);
 
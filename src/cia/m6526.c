@@ -18,6 +18,11 @@
 
 #include "../m64.h"
 
+// when set, reading a register doesn't sync a timer that is stopped or cycle skipping,
+// the timer value is worked out from the current cycle instead
+// (syncing cancels the cycle skipping event and ticks the timer every cycle until it can skip again)
+bool_t m6526_fastTimerReads = true;
+
 void m6526_init(m6526_t *m6526, uint32_t model) {
   m6526->model = model;
 
@@ -28,6 +33,7 @@ void m6526_init(m6526_t *m6526, uint32_t model) {
   m6526->todStopped = false;
   m6526->todCycles = 0;
   m6526->todPeriod = 0xffffffff;
+  m6526->todNextTick = 0;
 
   m6526_interrupt_init(m6526);
 
@@ -37,16 +43,61 @@ void m6526_init(m6526_t *m6526, uint32_t model) {
   m6526->todEvent.context = (void *)m6526;
   m6526->todEvent.event = &todEventFunction;
 
+  sdr_init(m6526);
+
   m6526_reset(m6526);
 }
 
 
+// the sdr fifos are saved too, the device on the serial port is still attached after loading
+// m64_setCIALazyTOD is the host's and isn't saved: the tod event is whichever the saving host had on the clock
+// (the next tick, or the alarm's), both sync the tod when they fire and reschedule it the loading host's way
+void m6526_serialize(state_t *state, m6526_t *m6526) {
+  state_event(state, &(m6526->todEvent));
+  state_event(state, &(m6526->sdrEvent));
+  state_event(state, &(m6526->interruptSourceEvent));
+  timer_serialize(state, &(m6526->timerA));
+  timer_serialize(state, &(m6526->timerB));
+
+  STATE_VALUE(state, m6526->model);
+  STATE_VALUE(state, m6526->regs);
+
+  STATE_VALUE(state, m6526->sdrOut);
+  STATE_VALUE(state, m6526->sdrBuffered);
+  STATE_VALUE(state, m6526->sdrCount);
+  STATE_VALUE(state, m6526->sdrCyclesPerBit);
+  STATE_VALUE(state, m6526->sdrShifting);
+  STATE_VALUE(state, m6526->sdrInput);
+  STATE_VALUE(state, m6526->sdrInputStart);
+  STATE_VALUE(state, m6526->sdrInputLength);
+  STATE_VALUE(state, m6526->sdrOutput);
+  STATE_VALUE(state, m6526->sdrOutputStart);
+  STATE_VALUE(state, m6526->sdrOutputLength);
+
+  STATE_VALUE(state, m6526->read_time);
+
+  STATE_VALUE(state, m6526->todLatched);
+  STATE_VALUE(state, m6526->todStopped);
+  STATE_VALUE(state, m6526->todClock);
+  STATE_VALUE(state, m6526->todAlarm);
+  STATE_VALUE(state, m6526->todLatch);
+  STATE_VALUE(state, m6526->todCycles);
+  STATE_VALUE(state, m6526->todPeriod);
+  STATE_VALUE(state, m6526->todNextTick);
+
+  STATE_VALUE(state, m6526->scheduled);
+  STATE_VALUE(state, m6526->icrWrite);
+  STATE_VALUE(state, m6526->icrRead);
+}
+
 void m6526_reset(m6526_t *m6526) {
   timer_reset(&(m6526->timerA));
   timer_reset(&(m6526->timerB));
   m6526->sdrOut = 0;
   m6526->sdrCount = 0;
   m6526->sdrBuffered = false;
+  m6526->read_time = 0;
+  sdr_reset(m6526);
   m6526_interrupt_reset(m6526);
 
   memset(m6526->regs, 0, 0x10);
@@ -66,7 +117,10 @@ void m6526_reset(m6526_t *m6526) {
   m6526->todClock[M6526_REG_TODHR - M6526_REG_TOD10TH] = 1;
   m6526->todCycles = 0;
 
-  clock_scheduleEvent(&m64_clock, &(m6526->todEvent), 0, PHASE_PHI1);
+  // first tick on the next phi1
+  m6526->todNextTick = clock_getTimeAndPhase(&m64_clock);
+  m6526->todNextTick += m6526->todNextTick & 1;
+  tod_schedule(m6526);
 }
 
 
@@ -77,11 +131,15 @@ uint8_t m6526_read(m6526_t *m6526, uint32_t addr) {
   
   addr &= 0xf;
 
-  timer_syncWithCpu(&(m6526->timerA));
-  timer_wakeUpAfterSyncWithCpu(&(m6526->timerA));
+  if (!m6526_fastTimerReads || !timer_canReadWithoutSync(&(m6526->timerA))) {
+    timer_syncWithCpu(&(m6526->timerA));
+    timer_wakeUpAfterSyncWithCpu(&(m6526->timerA));
+  }
 
-  timer_syncWithCpu(&(m6526->timerB));
-  timer_wakeUpAfterSyncWithCpu(&(m6526->timerB));
+  if (!m6526_fastTimerReads || !timer_canReadWithoutSync(&(m6526->timerB))) {
+    timer_syncWithCpu(&(m6526->timerB));
+    timer_wakeUpAfterSyncWithCpu(&(m6526->timerB));
+  }
 
   switch(addr) {
     case M6526_REG_PRA:  // 0xd_00
@@ -129,16 +187,16 @@ uint8_t m6526_read(m6526_t *m6526, uint32_t addr) {
       return data;
     case M6526_REG_TIMERALO: // 0xd_04
       // Timer A Low Byte
-      return (uint8_t)(timer_getTimer(&(m6526->timerA)) & 0xff) ;
+      return (uint8_t)(timer_getTimerNow(&(m6526->timerA)) & 0xff) ;
     case M6526_REG_TIMERAHI: // 0xd_05
       // Timer A High Byte
-      return (uint8_t)(timer_getTimer(&(m6526->timerA)) >> 8);
+      return (uint8_t)(timer_getTimerNow(&(m6526->timerA)) >> 8);
     case M6526_REG_TIMERBLO: // 0xd_06
       // Timer B Low Byte
-      return (uint8_t)(timer_getTimer(&(m6526->timerB)) & 0xff);
+      return (uint8_t)(timer_getTimerNow(&(m6526->timerB)) & 0xff);
     case M6526_REG_TIMERBHI: // 0xd_07
       // Timer B High Byte
-      return (uint8_t)(timer_getTimer(&(m6526->timerB)) >> 8);
+      return (uint8_t)(timer_getTimerNow(&(m6526->timerB)) >> 8);
     case M6526_REG_TOD10TH:  // 0xd_08
     case M6526_TOD_SEC:    // 0xd_09
     case M6526_REG_TODMIN:   // 0xd_0a
@@ -146,6 +204,8 @@ uint8_t m6526_read(m6526_t *m6526, uint32_t addr) {
       // Time Of Day Registers
       // see notes/04-time-of-day.txt
 
+      tod_sync(m6526);
+
       // if not currently latched, copy time of day into the latch
       if (!m6526->todLatched) {
         memcpy(m6526->todLatch, m6526->todClock, sizeof(uint8_t) * 4);
@@ -195,6 +255,11 @@ uint8_t m6526_read(m6526_t *m6526, uint32_t addr) {
   }
 }
 
+// turn fast timer reads on or off (on by default)
+void m64_setCIAFastTimerReads(uint32_t enabled) {
+  m6526_fastTimerReads = enabled != 0;
+}
+
 // write CIA register
 void m6526_write(m6526_t *m6526, uint32_t addr, uint8_t data) {
   // 16 registers (0-f)
@@ -204,6 +269,12 @@ void m6526_write(m6526_t *m6526, uint32_t addr, uint8_t data) {
   timer_syncWithCpu(&(m6526->timerA));
   timer_syncWithCpu(&(m6526->timerB));  
 
+  // bring the time of day up to date before its registers or the 50/60 hz flag change
+  bool_t todChanged = (addr >= M6526_REG_TOD10TH && addr <= M6526_REG_TODHR) || addr == M6526_REG_CRA;
+  if (todChanged) {
+    tod_sync(m6526);
+  }
+
   // store old value, used when setting control register A and B
   // to see if start bit going from 0 to 1
   uint8_t oldData = m6526->regs[addr];
@@ -344,6 +415,9 @@ void m6526_write(m6526_t *m6526, uint32_t addr, uint8_t data) {
                 timer_setControlRegister(t, (uint8_t)(data | (data & 0x40) >> 1));
             } else {
                 timer_setControlRegister(t, data);
+
+                // serial port may have gone back to input mode with a byte from the device waiting
+                sdr_schedule(m6526);
             }
             break;
         }
@@ -351,6 +425,10 @@ void m6526_write(m6526_t *m6526, uint32_t addr, uint8_t data) {
         break;
   }
 
+  if (todChanged) {
+    tod_schedule(m6526);
+  }
+
   timer_wakeUpAfterSyncWithCpu(&(m6526->timerA));
   timer_wakeUpAfterSyncWithCpu(&(m6526->timerB));
 }
@@ -50,6 +50,9 @@
 #define M6526_INTERRUPT_SP           (1 << 3)    // serial port
 #define M6526_INTERRUPT_FLAG         (1 << 4)    // external
 
+// size of the queues between the serial port and the device attached to it
+#define SDR_FIFO_LENGTH 256
+
 typedef struct m6526_s m6526_t;
 
 // function pointers, used for cia1/2 specific functions
@@ -83,6 +86,20 @@ struct m6526_s {
   bool_t   sdrBuffered;
   uint32_t sdrCount;
 
+  // device on CNT/SP, see sdr.c
+  // cycles per bit, 0 if no device is attached
+  uint32_t sdrCyclesPerBit;
+  // event for when a byte from the device has been shifted in
+  event_t  sdrEvent;
+  bool_t   sdrShifting;
+  // bytes from the device waiting to be shifted in, and bytes shifted out waiting for the device
+  uint8_t  sdrInput[SDR_FIFO_LENGTH];
+  uint32_t sdrInputStart;
+  uint32_t sdrInputLength;
+  uint8_t  sdrOutput[SDR_FIFO_LENGTH];
+  uint32_t sdrOutputStart;
+  uint32_t sdrOutputLength;
+
   // used for 6526 timer b bug:
   uint64_t read_time;
 
@@ -97,6 +114,9 @@ struct m6526_s {
   int64_t todCycles;
   int64_t todPeriod;
 
+  // half cycle time of the next tick of the tod clock
+  uint64_t todNextTick;
+
   event_t interruptSourceEvent;
   bool_t scheduled;
   
@@ -135,13 +155,27 @@ struct m6526_s {
 
 void m6526_write(m6526_t *m6526, uint32_t addr, uint8_t data);
 uint8_t m6526_read(m6526_t *m6526, uint32_t addr);
+void m64_setCIAFastTimerReads(uint32_t enabled);
 
 void m6526_init(m6526_t *m6526, uint32_t model);
 void m6526_reset(m6526_t *m6526);
+void m6526_serialize(state_t *state, m6526_t *m6526);
 
 void m6526_setDayOfTimeRate(m6526_t *m6526, double clock);
 void rescheduleToDEventFunction(void *context);
 void todEventFunction(void *context);
+void tod_sync(m6526_t *m6526);
+void tod_schedule(m6526_t *m6526);
+void m64_setCIALazyTOD(uint32_t enabled);
+
+// serial port functions
+void sdr_init(m6526_t *m6526);
+void sdr_reset(m6526_t *m6526);
+void sdr_schedule(m6526_t *m6526);
+void sdr_output(m6526_t *m6526, uint8_t data);
+void m64_sdrAttach(uint32_t cia, uint32_t cyclesPerBit);
+int32_t m64_sdrWrite(uint32_t cia, uint8_t data);
+int32_t m64_sdrRead(uint32_t cia);
 
 // interrupt functions
 void m6526_interrupt_event(void *context);
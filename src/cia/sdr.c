@@ -0,0 +1,132 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ * 
+ * Author: nopsta 2022
+ * 
+ * See the cia/notes directory from more about the cia chip
+ * 
+ */
+
+// serial port (SDR) and a stand-in device on CNT/SP
+//
+// output mode (bit 6 of CRA = 1): timer A underflows clock the bits out (timerA_serialPort),
+// when a byte has been shifted out it is passed to the device
+//
+// input mode (bit 6 of CRA = 0): the device shifts bytes in on CNT, cyclesPerBit apart.
+// instead of an event for each bit, there is one event when the 8th bit of the byte is in,
+// which loads the SDR and triggers the serial port interrupt
+
+#include "../m64.h"
+
+void sdr_inputEventFunction(void *context);
+
+void sdr_init(m6526_t *m6526) {
+  m6526->sdrEvent.context = (void *)m6526;
+  m6526->sdrEvent.event = &sdr_inputEventFunction;
+  m6526->sdrCyclesPerBit = 0;
+
+  sdr_reset(m6526);
+}
+
+void sdr_reset(m6526_t *m6526) {
+  m6526->sdrInputStart = 0;
+  m6526->sdrInputLength = 0;
+  m6526->sdrOutputStart = 0;
+  m6526->sdrOutputLength = 0;
+  m6526->sdrShifting = false;
+}
+
+static bool_t sdr_isInputMode(m6526_t *m6526) {
+  return (m6526->regs[M6526_REG_CRA] & 0x40) == 0;
+}
+
+// start shifting in the next byte from the device, if there is one and the cia is listening
+void sdr_schedule(m6526_t *m6526) {
+  if (m6526->sdrShifting || m6526->sdrCyclesPerBit == 0 || m6526->sdrInputLength == 0 || !sdr_isInputMode(m6526)) {
+    return;
+  }
+
+  m6526->sdrShifting = true;
+  clock_scheduleEvent(&m64_clock, &(m6526->sdrEvent), m6526->sdrCyclesPerBit * 8, PHASE_PHI1);
+}
+
+// the 8th bit of a byte has been clocked in
+void sdr_inputEventFunction(void *context) {
+  m6526_t *m6526 = (m6526_t *)context;
+
+  m6526->sdrShifting = false;
+
+  // if the port was switched to output while shifting, the byte waits until it is back in input mode
+  if (!sdr_isInputMode(m6526)) {
+    return;
+  }
+
+  m6526->regs[M6526_REG_SDR] = m6526->sdrInput[m6526->sdrInputStart];
+  m6526->sdrInputStart = (m6526->sdrInputStart + 1) & (SDR_FIFO_LENGTH - 1);
+  m6526->sdrInputLength--;
+
+  m6526_interrupt_trigger(m6526, M6526_INTERRUPT_SP);
+
+  sdr_schedule(m6526);
+}
+
+// a byte has been shifted out, pass it to the device
+void sdr_output(m6526_t *m6526, uint8_t data) {
+  if (m6526->sdrCyclesPerBit == 0 || m6526->sdrOutputLength == SDR_FIFO_LENGTH) {
+    return;
+  }
+
+  m6526->sdrOutput[(m6526->sdrOutputStart + m6526->sdrOutputLength) & (SDR_FIFO_LENGTH - 1)] = data;
+  m6526->sdrOutputLength++;
+}
+
+static m6526_t *sdr_getCIA(uint32_t cia) {
+  return cia == 2 ? &cia2 : &cia1;
+}
+
+// attach a device to the serial port of cia 1 or 2, it sends a bit every cyclesPerBit
+// cyclesPerBit = 0 detaches it
+void m64_sdrAttach(uint32_t cia, uint32_t cyclesPerBit) {
+  m6526_t *m6526 = sdr_getCIA(cia);
+
+  movie_record(MOVIE_SDR_ATTACH, cia, cyclesPerBit, 0, 0, NULL, 0);
+  clock_cancelEvent(&m64_clock, &(m6526->sdrEvent));
+  sdr_reset(m6526);
+  m6526->sdrCyclesPerBit = cyclesPerBit;
+}
+
+// the device sends a byte to the cia, returns 0 if queued, -1 if the queue is full or no device is attached
+int32_t m64_sdrWrite(uint32_t cia, uint8_t data) {
+  m6526_t *m6526 = sdr_getCIA(cia);
+
+  movie_record(MOVIE_SDR_WRITE, cia, data, 0, 0, NULL, 0);
+  if (m6526->sdrCyclesPerBit == 0 || m6526->sdrInputLength == SDR_FIFO_LENGTH) {
+    return -1;
+  }
+
+  m6526->sdrInput[(m6526->sdrInputStart + m6526->sdrInputLength) & (SDR_FIFO_LENGTH - 1)] = data;
+  m6526->sdrInputLength++;
+
+  sdr_schedule(m6526);
+  return 0;
+}
+
+// the next byte the cia has sent to the device, -1 if there isn't one
+int32_t m64_sdrRead(uint32_t cia) {
+  m6526_t *m6526 = sdr_getCIA(cia);
+  uint8_t data;
+
+  // reading makes room for the cia's next byte, so it's part of the movie too
+  movie_record(MOVIE_SDR_READ, cia, 0, 0, 0, NULL, 0);
+  if (m6526->sdrOutputLength == 0) {
+    return -1;
+  }
+
+  data = m6526->sdrOutput[m6526->sdrOutputStart];
+  m6526->sdrOutputStart = (m6526->sdrOutputStart + 1) & (SDR_FIFO_LENGTH - 1);
+  m6526->sdrOutputLength--;
+  return data;
+}
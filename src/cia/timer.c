@@ -57,6 +57,19 @@ void timer_init(timer_t *timer) {
 
 }
 
+void timer_serialize(state_t *state, timer_t *timer) {
+  state_event(state, &(timer->timer_event));
+  state_event(state, &(timer->cycleSkippingEvent));
+  state_event(state, &(timer->bTick_event));
+
+  STATE_VALUE(state, timer->state);
+  STATE_VALUE(state, timer->lastControlValue);
+  STATE_VALUE(state, timer->timer);
+  STATE_VALUE(state, timer->latch);
+  STATE_VALUE(state, timer->pbToggle);
+  STATE_VALUE(state, timer->ciaEventPauseTime);
+}
+
 // Set CRA/CRB control register.
 void timer_setControlRegister(timer_t *timer, uint8_t cr) {
   timer->state &= ~TIMER_CIAT_CR_MASK;
@@ -69,6 +82,25 @@ int32_t timer_getTimer(timer_t *timer) {
   return timer->timer;
 }
 
+// true if the timer can be read without syncWithCpu:
+// it is either stopped, or cycle skipping with its state steady until the cycleSkippingEvent
+bool_t timer_canReadWithoutSync(timer_t *timer) {
+  return timer->ciaEventPauseTime != 0;
+}
+
+// Get current timer value, worked out from the current cycle if cycle skipping.
+// gives the same value syncWithCpu would leave in timer->timer: the skipped cycles plus the
+// timer_clock in syncWithCpu. the cycleSkippingEvent runs before the underflow so it can't wrap here
+int32_t timer_getTimerNow(timer_t *timer) {
+  if (timer->ciaEventPauseTime > 0) {
+    int64_t elapsed = clock_getTime(&m64_clock, PHASE_PHI2) - timer->ciaEventPauseTime;
+    if (elapsed >= 0) {
+      return (uint16_t)(timer->timer - elapsed - 1);
+    }
+  }
+  return timer->timer;
+}
+
 // Get PB6/PB7 Flipflop state.
 bool_t timer_getPbToggle(timer_t *timer) {
   return timer->pbToggle;
@@ -105,6 +137,7 @@ void timer_reset(timer_t *timer) {
   clock_cancelEvent(&m64_clock, &(timer->timer_event));
 
   timer->timer = timer->latch = (uint16_t) 0xffff;
+  timer->lastControlValue = 0;
   timer->pbToggle = false;
   timer->state = 0;
   timer->ciaEventPauseTime = 0;
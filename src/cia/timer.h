@@ -84,11 +84,14 @@ void timerB_init(timer_t *timer, m6526_t *m6526);
 
 void timer_init(timer_t *timer);
 void timer_reset(timer_t *timer);
+void timer_serialize(state_t *state, timer_t *timer);
 
 void timer_clock(timer_t *timer) ;
 void timer_reschedule(timer_t *timer);
 
 int32_t timer_getTimer(timer_t *timer);
+bool_t timer_canReadWithoutSync(timer_t *timer);
+int32_t timer_getTimerNow(timer_t *timer);
 void timer_wakeUpAfterSyncWithCpu(timer_t *timer);
 void timer_syncWithCpu(timer_t *timer);
 
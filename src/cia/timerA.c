@@ -35,6 +35,7 @@ void timerA_serialPort(timer_t *timer) {
     if (m6526->sdrCount != 0) {
       if (--m6526->sdrCount == 0) {
         m6526_interrupt_trigger(m6526, M6526_INTERRUPT_SP);
+        sdr_output(m6526, m6526->sdrOut);
       }
     }
     if (m6526->sdrCount == 0 && m6526->sdrBuffered) {
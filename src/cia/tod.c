@@ -18,20 +18,72 @@
 
 #include "../m64.h"
 
-void todEventFunction(void *context) {
-  m6526_t *m6526 = (m6526_t *)context;
+// when set, the time of day is only worked out when it is needed (register access, the alarm) instead of
+// by an event every 1/10th sec. the tick times and the bcd time follow the same arithmetic as the event,
+// an event is only scheduled for the tick that matches the alarm.
+// if the clock or alarm isn't a valid time, it goes back to an event every tick
+bool_t m6526_lazyTOD = true;
 
-  // Reload divider according to 50/60 Hz flag
-  // Only performed on expiry according to Frodo
-  // bit 7 of timer a control register is 50/60 hz flag
+// number of 1/10th secs in the 24 hours of am/pm time
+#define TOD_TICKS_PER_DAY 864000
+
+// 1/10ths per tick with fixed precision 25.7, depends on the 50/60 hz flag (bit 7 of control register a)
+static int64_t tod_getStep(m6526_t *m6526) {
   if ((m6526->regs[M6526_REG_CRA] & 0x80) != 0) {
-    m6526->todCycles += m6526->todPeriod * 5;
-  } else {
-    m6526->todCycles += m6526->todPeriod * 6;
+    return m6526->todPeriod * 5;
+  }
+  return m6526->todPeriod * 6;
+}
+
+// convert bcd time to number of 1/10ths since 12:00:00.0 am, false if it isn't a valid time
+static bool_t tod_toTicks(uint8_t *bcd, int32_t *ticks) {
+  int32_t tenth = bcd[0];
+  int32_t secs = bcd[1];
+  int32_t mins = bcd[2];
+  int32_t hrs = bcd[3] & 0x7f;
+
+  if (tenth > 9 
+      || (secs & 0x0f) > 9 || secs > 0x59 
+      || (mins & 0x0f) > 9 || mins > 0x59 
+      || (hrs & 0x0f) > 9 || hrs > 0x12 || hrs == 0) {
+    return false;
+  }
+
+  hrs = ((hrs >> 4) * 10 + (hrs & 0x0f)) % 12;
+  if (bcd[3] & 0x80) {
+    hrs += 12;
+  }
+
+  *ticks = tenth 
+         + 10 * ((secs >> 4) * 10 + (secs & 0x0f)) 
+         + 600 * ((mins >> 4) * 10 + (mins & 0x0f)) 
+         + 36000 * hrs;
+  return true;
+}
+
+static void tod_fromTicks(uint8_t *bcd, int32_t ticks) {
+  int32_t secs = (ticks / 10) % 60;
+  int32_t mins = (ticks / 600) % 60;
+  int32_t hrs = ticks / 36000;
+  uint8_t amPm = hrs >= 12 ? 0x80 : 0;
+
+  hrs = hrs % 12;
+  if (hrs == 0) {
+    hrs = 12;
   }
 
+  bcd[0] = ticks % 10;
+  bcd[1] = ((secs / 10) << 4) | (secs % 10);
+  bcd[2] = ((mins / 10) << 4) | (mins % 10);
+  bcd[3] = ((hrs / 10) << 4) | (hrs % 10) | amPm;
+}
+
+// one tick of the tod clock at time todNextTick
+static void tod_tick(m6526_t *m6526) {
+  m6526->todCycles += tod_getStep(m6526);
+
   // Fixed precision 25.7
-  clock_scheduleEvent(&m64_clock, &(m6526->todEvent), m6526->todCycles >> 7, -1);
+  m6526->todNextTick += (uint64_t)(m6526->todCycles >> 7) * 2;
 
   m6526->todCycles &= 0x7f; // Just keep the decimal part
 
@@ -111,23 +163,120 @@ void todEventFunction(void *context) {
   }
 }
 
+// run the tod clock up to the current time
+// ticks are one at a time until the tick fraction is normalised, then if the time is valid they are done all at once:
+// after n more ticks the accumulator has gone up by n * step, so tick n is at todNextTick + (todCycles + (n - 1) * step) >> 7
+void tod_sync(m6526_t *m6526) {
+  uint64_t now = clock_getTimeAndPhase(&m64_clock);
+  int64_t step = tod_getStep(m6526);
+  int32_t clockTicks, alarmTicks;
+
+  while (m6526->todNextTick <= now) {
+    if (m6526->todCycles >= 0x80 || step <= 0) {
+      tod_tick(m6526);
+      continue;
+    }
+
+    bool_t valid = tod_toTicks(m6526->todClock, &clockTicks);
+    if (!m6526->todStopped && !valid) {
+      tod_tick(m6526);
+      continue;
+    }
+
+    // number of ticks up to now
+    int64_t cycles = (int64_t)(now - m6526->todNextTick) / 2;
+    int64_t count = ((cycles + 1) * 128 - 1 - m6526->todCycles) / step + 1;
+    int64_t accumulator = m6526->todCycles + count * step;
+
+    m6526->todNextTick += (uint64_t)(accumulator >> 7) * 2;
+    m6526->todCycles = accumulator & 0x7f;
+
+    if (!m6526->todStopped) {
+      int32_t newTicks = (int32_t)((clockTicks + count) % TOD_TICKS_PER_DAY);
+      tod_fromTicks(m6526->todClock, newTicks);
+
+      // did it pass the alarm
+      if (tod_toTicks(m6526->todAlarm, &alarmTicks)) {
+        int64_t untilAlarm = (alarmTicks - clockTicks + TOD_TICKS_PER_DAY) % TOD_TICKS_PER_DAY;
+        if (untilAlarm == 0) {
+          untilAlarm = TOD_TICKS_PER_DAY;
+        }
+        if (untilAlarm <= count) {
+          m6526_interrupt_trigger(m6526, M6526_INTERRUPT_ALARM);
+        }
+      }
+    }
+  }
+}
+
+// schedule the tod event for the next time something needs to happen
+void tod_schedule(m6526_t *m6526) {
+  int32_t clockTicks, alarmTicks;
+  int64_t step = tod_getStep(m6526);
+
+  clock_cancelEvent(&m64_clock, &(m6526->todEvent));
+
+  if (m6526_lazyTOD && m6526->todCycles < 0x80 && step > 0) {
+    if (m6526->todStopped) {
+      // nothing changes until a register is written
+      return;
+    }
+
+    if (tod_toTicks(m6526->todClock, &clockTicks)) {
+      if (!tod_toTicks(m6526->todAlarm, &alarmTicks)) {
+        // a valid time never reaches an invalid alarm
+        return;
+      }
+
+      // the tick the alarm matches on
+      int64_t untilAlarm = (alarmTicks - clockTicks + TOD_TICKS_PER_DAY) % TOD_TICKS_PER_DAY;
+      if (untilAlarm == 0) {
+        untilAlarm = TOD_TICKS_PER_DAY;
+      }
+
+      uint64_t alarmTime = m6526->todNextTick + (uint64_t)((m6526->todCycles + (untilAlarm - 1) * step) >> 7) * 2;
+      clock_scheduleEventAt(&m64_clock, &(m6526->todEvent), alarmTime >> 1, (alarmTime & 1) ? PHASE_PHI2 : PHASE_PHI1);
+      return;
+    }
+  }
+
+  // an event every tick
+  clock_scheduleEventAt(&m64_clock, &(m6526->todEvent), m6526->todNextTick >> 1, (m6526->todNextTick & 1) ? PHASE_PHI2 : PHASE_PHI1);
+}
+
+void todEventFunction(void *context) {
+  m6526_t *m6526 = (m6526_t *)context;
+
+  tod_sync(m6526);
+  tod_schedule(m6526);
+}
+
 // tod counter supposed to restart when clock goes from stopped to started
 void rescheduleToDEventFunction(void *context) {
   m6526_t *m6526 = (m6526_t *)context;
 
+  tod_sync(m6526);
+
   // The TOD clock's internal circuitry is designed to be driven by either 50 or 60 Hz clock signal, 
   // which can be inexpensively derived from the mains power source AC
   // Only performed on expiry according to Frodo
   // bit 7 of timer a control register is 50/60 hz flag
-  if ((m6526->regs[M6526_REG_CRA] & 0x80) != 0) {
-    m6526->todCycles += m6526->todPeriod * 5;
-  } else {
-    m6526->todCycles += m6526->todPeriod * 6;
-  }
+  m6526->todCycles += tod_getStep(m6526);
 
-  clock_cancelEvent(&m64_clock, &(m6526->todEvent));
   // Fixed precision 25.7
-  clock_scheduleEvent(&m64_clock, &(m6526->todEvent), m6526->todCycles >> 7, -1);
+  m6526->todNextTick = clock_getTimeAndPhase(&m64_clock) + (uint64_t)(m6526->todCycles >> 7) * 2;
+  tod_schedule(m6526);
+}
+
+// turn lazy time of day on or off (on by default)
+void m64_setCIALazyTOD(uint32_t enabled) {
+  tod_sync(&cia1);
+  tod_sync(&cia2);
+
+  m6526_lazyTOD = enabled != 0;
+
+  tod_schedule(&cia1);
+  tod_schedule(&cia2);
 }
 
 
@@ -135,4 +284,3 @@ void rescheduleToDEventFunction(void *context) {
 void m6526_setDayOfTimeRate(m6526_t *m6526, double clock) {
   m6526->todPeriod = (int64_t)(clock * (1 << 7));
 }
-
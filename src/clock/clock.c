@@ -49,17 +49,8 @@ void clock_reset(clock_t *clock) {
   clock->firstEvent.next = &(clock->lastEvent);
 }
 
-// schedule an event relative to current time
-void clock_scheduleEvent(clock_t *clock, event_t *event, uint32_t cycles, uint32_t phase) {
-  if(phase != -1) {
-    event->triggerTime = (cycles * 2) 
-                         + clock->clock_currentTime 
-                         + ( (clock->clock_currentTime & 1) ^ (phase == PHASE_PHI1 ? 0 : 1));
-  } else {
-    event->triggerTime = (cycles * 2) + clock->clock_currentTime;
-  }
-
-  // insert the event into linked list of events
+// insert an event into the linked list of events, after any events with the same trigger time
+static void clock_insertEvent(clock_t *clock, event_t *event) {
   event_t *scan = &(clock->firstEvent);
 
   uint32_t count = 0;
@@ -80,6 +71,31 @@ void clock_scheduleEvent(clock_t *clock, event_t *event, uint32_t cycles, uint32
   }
 }
 
+// schedule an event relative to current time
+void clock_scheduleEvent(clock_t *clock, event_t *event, uint32_t cycles, uint32_t phase) {
+  if(phase != -1) {
+    event->triggerTime = (cycles * 2) 
+                         + clock->clock_currentTime 
+                         + ( (clock->clock_currentTime & 1) ^ (phase == PHASE_PHI1 ? 0 : 1));
+  } else {
+    event->triggerTime = (cycles * 2) + clock->clock_currentTime;
+  }
+
+  clock_insertEvent(clock, event);
+}
+
+// schedule an event for an absolute cycle and phase (since the clock was reset)
+// if that time has passed, the event is scheduled for the current time
+void clock_scheduleEventAt(clock_t *clock, event_t *event, uint64_t cycle, uint32_t phase) {
+  event->triggerTime = cycle * 2 + (phase == PHASE_PHI1 ? 0 : 1);
+
+  if(event->triggerTime < clock->clock_currentTime) {
+    event->triggerTime = clock->clock_currentTime;
+  }
+
+  clock_insertEvent(clock, event);
+}
+
 
 void clock_cancelEvent(clock_t *clock, event_t *event) {
   event_t *prev = &(clock->firstEvent);
@@ -62,6 +62,7 @@ uint32_t clock_getPhase(clock_t *clock);
 uint64_t clock_getTimeAndPhase(clock_t *clock);
 
 void clock_scheduleEvent(clock_t *clock, event_t *event, uint32_t cycles, uint32_t phase);
+void clock_scheduleEventAt(clock_t *clock, event_t *event, uint64_t cycle, uint32_t phase);
 void clock_runNextEvent(clock_t *clock);
 void clock_cancelEvent(clock_t *clock, event_t *event);
 
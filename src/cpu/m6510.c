@@ -61,6 +61,19 @@ void m6510_initRegistersAndFlags(m6510_t *cpu) {
   cpu->flagI = false;
 
 
+  cpu->registerA = 0;
+  cpu->registerX = 0;
+  cpu->registerY = 0;
+
+  // left over from the last instruction
+  cpu->lastCycleCount = 0;
+  cpu->lastCycleCountAddress = 0;
+  cpu->Cycle_EffectiveAddress = 0;
+  cpu->Cycle_HighByteWrongEffectiveAddress = 0;
+  cpu->Cycle_Pointer = 0;
+  cpu->cycleData = 0;
+  cpu->nextOpcodeLocation = 0;
+
   cpu->Register_ProgramCounter = 0;
   cpu->irqAssertedOnPin = false;
   cpu->nmiFlag = false;
@@ -78,6 +91,44 @@ void m6510_init(m6510_t *cpu, clock_t *clock) {
 
   cpu->eventWithoutSteals.event = &eventWithoutSteals_function;
   cpu->eventWithoutSteals.context = (void *)cpu;
+
+  cpu->trap = NULL;
+  cpu->trapAddress = 0;
+}
+
+// save or load the registers and the state of the current instruction (the trap and memory handlers are set up by the host)
+void m6510_serialize(state_t *state, m6510_t *cpu) {
+  state_event(state, &(cpu->eventWithSteals));
+  state_event(state, &(cpu->eventWithoutSteals));
+
+  STATE_VALUE(state, cpu->rdy);
+  STATE_VALUE(state, cpu->cycleCount);
+  STATE_VALUE(state, cpu->lastCycleCount);
+  STATE_VALUE(state, cpu->branchCycleCount);
+  STATE_VALUE(state, cpu->lastCycleCountAddress);
+  STATE_VALUE(state, cpu->interruptCycle);
+  STATE_VALUE(state, cpu->Cycle_EffectiveAddress);
+  STATE_VALUE(state, cpu->Cycle_HighByteWrongEffectiveAddress);
+  STATE_VALUE(state, cpu->Register_ProgramCounter);
+  STATE_VALUE(state, cpu->nextOpcodeLocation);
+  STATE_VALUE(state, cpu->gotoAddress);
+  STATE_VALUE(state, cpu->Cycle_Pointer);
+  STATE_VALUE(state, cpu->cycleData);
+  STATE_VALUE(state, cpu->registerA);
+  STATE_VALUE(state, cpu->registerX);
+  STATE_VALUE(state, cpu->registerY);
+  STATE_VALUE(state, cpu->registerSP);
+  STATE_VALUE(state, cpu->flagN);
+  STATE_VALUE(state, cpu->flagC);
+  STATE_VALUE(state, cpu->flagD);
+  STATE_VALUE(state, cpu->flagZ);
+  STATE_VALUE(state, cpu->flagV);
+  STATE_VALUE(state, cpu->flagI);
+  STATE_VALUE(state, cpu->flagU);
+  STATE_VALUE(state, cpu->flagB);
+  STATE_VALUE(state, cpu->irqAssertedOnPin);
+  STATE_VALUE(state, cpu->nmiFlag);
+  STATE_VALUE(state, cpu->rstFlag);
 }
 
 // Evaluate when to execute an interrupt. Calling this method can also
@@ -117,12 +168,21 @@ void m6510_setPC(m6510_t *cpu, uint16_t address) {
   cpu->gotoAddress = address;
 }
 
+void m6510_setTrap(m6510_t *cpu, uint32_t address, cpu_trap_function trap) {
+  cpu->trapAddress = address;
+  cpu->trap = trap;
+}
+
 void m6510_fetchNextOpcode(m6510_t *cpu) {
   if(cpu->gotoAddress != false) {
     cpu->Register_ProgramCounter = cpu->gotoAddress;
     cpu->gotoAddress = false;
   } 
 
+  if(cpu->Register_ProgramCounter == cpu->trapAddress && cpu->trap) {
+    (cpu->trap)(cpu);
+  }
+
   cpu->lastCycleCountAddress =  cpu->nextOpcodeLocation;
   // store the cycles of the last instruction, with hack to account for extra cycles if branch taken
   cpu->lastCycleCount = (cpu->cycleCount & 0x7) + cpu->branchCycleCount;
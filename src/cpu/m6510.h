@@ -286,6 +286,8 @@
 
 typedef uint8_t (*cpu_read_function)(uint16_t address);
 typedef void (*cpu_write_function)(uint16_t address, uint8_t value);
+struct m6510;
+typedef void (*cpu_trap_function)(struct m6510 *cpu);
 
 struct m6510 {
 
@@ -321,6 +323,10 @@ struct m6510 {
 
   bool_t gotoAddress;
 
+  // called before the opcode at trapAddress is fetched, the trap can change the registers and the program counter
+  uint32_t trapAddress;
+  cpu_trap_function trap;
+
   uint32_t Cycle_Pointer;
 
   uint8_t cycleData;
@@ -374,6 +380,7 @@ typedef struct m6510 m6510_t;
 void m6510_init(m6510_t *cpu, clock_t *clock);
 void m6510_triggerRST(m6510_t *cpu);
 void m6510_setMemoryHandler(m6510_t *cpu, cpu_read_function read, cpu_write_function write);
+void m6510_serialize(state_t *state, m6510_t *cpu);
 
 
 void m6510_calculateInterruptTriggerCycle(m6510_t *cpu);
@@ -381,6 +388,7 @@ void m6510_interruptsAndNextOpcode(m6510_t *cpu);
 void m6510_interrupt(m6510_t *cpu);
 void m6510_interruptEnd(m6510_t *cpu);
 void m6510_setPC(m6510_t *cpu, uint16_t address);
+void m6510_setTrap(m6510_t *cpu, uint32_t address, cpu_trap_function trap);
 void m6510_fetchNextOpcode(m6510_t *cpu);
 
 uint8_t m6510_getStatusRegister(m6510_t *cpu);
@@ -0,0 +1,526 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+// the drive runs on its own clock, which is only brought up to the c64's time when the c64 reads or
+// writes the serial bus or another device changes it (through the iecBus sync callback) and every DRIVE_SYNC_CYCLES.
+// the drive can only affect the c64 through the bus, so this is exact.
+//
+// when the motor is off and the bus has been quiet for a while, the drive sleeps: its clock stops
+// and it costs nothing until the c64 changes a bus line. the time asleep is skipped, the drive just
+// carries on from where it was (in the rom's idle loop)
+
+#include "../m64.h"
+
+m6510_t drive_cpu;
+clock_t drive_clock;
+m6522_t drive_via1;
+m6522_t drive_via2;
+
+uint8_t drive_ram[DRIVE_RAM_LENGTH];
+uint8_t drive_rom[DRIVE_ROM_LENGTH];
+bool_t drive_hasROM = false;
+
+iecDevice_t drive_device;
+bool_t drive_attached = false;
+
+// keeping up with the c64
+event_t drive_syncEvent;
+double drive_cyclesPerC64HalfCycle = 1;
+uint64_t drive_skippedTime = 0;
+bool_t drive_sleeping = false;
+// set while drive_sync is stepping the drive, so a device answering the drive doesn't step it again
+bool_t drive_syncing = false;
+uint64_t drive_lastActivity = 0;
+bool_t drive_irq = false;
+
+// the disk
+uint8_t *drive_gcr = NULL;
+uint32_t drive_trackLengths[DRIVE_MAX_TRACKS];
+bool_t drive_diskInserted = false;
+
+uint32_t drive_halfTrack = 36;
+uint32_t drive_headPosition = 0;
+uint8_t drive_stepperPhase = 0;
+bool_t drive_motorOn = false;
+uint8_t drive_readByte = 0;
+uint8_t drive_lastByte = 0;
+bool_t drive_syncFound = false;
+event_t drive_diskEvent;
+bool_t drive_diskEventPending = false;
+
+void drive_syncEventFunction(void *context);
+void drive_diskEventFunction(void *context);
+void drive_busChanged(iecDevice_t *device, uint8_t bus);
+
+
+// --- memory ---
+
+uint8_t drive_read(uint16_t address) {
+  if(address < 0x1800) {
+    return drive_ram[address & (DRIVE_RAM_LENGTH - 1)];
+  }
+  if(address < 0x1c00) {
+    return m6522_read(&drive_via1, address);
+  }
+  if(address < 0x2000) {
+    return m6522_read(&drive_via2, address);
+  }
+  if(address >= 0x8000) {
+    return drive_rom[address & (DRIVE_ROM_LENGTH - 1)];
+  }
+
+  // nothing there
+  return address >> 8;
+}
+
+void drive_write(uint16_t address, uint8_t value) {
+  if(address < 0x1800) {
+    drive_ram[address & (DRIVE_RAM_LENGTH - 1)] = value;
+  } else if(address < 0x1c00) {
+    m6522_write(&drive_via1, address, value);
+  } else if(address < 0x2000) {
+    m6522_write(&drive_via2, address, value);
+  }
+}
+
+static uint64_t drive_now() {
+  return clock_getTime(&drive_clock, PHASE_PHI2);
+}
+
+// both VIAs share the cpu's irq line
+void drive_viaInterrupt(m6522_t *m6522, bool_t state) {
+  bool_t irq = drive_via1.irq || drive_via2.irq;
+
+  if(irq != drive_irq) {
+    drive_irq = irq;
+    if(irq) {
+      m6510_triggerIRQ(&drive_cpu);
+    } else {
+      m6510_clearIRQ(&drive_cpu);
+    }
+  }
+}
+
+
+// --- VIA1, serial bus ---
+// PB0: DATA in, PB1: DATA out, PB2: CLK in, PB3: CLK out, PB4: ATN acknowledge, PB5-6: device number, PB7: ATN in
+// the inputs read 1 when the line is low, the outputs pull the line low when they are 1.
+// CA1 is ATN in, so an interrupt can be raised when ATN is pulled
+
+// the drive pulls DATA when PB1 is set, or when ATN acknowledge doesn't match ATN (so it answers ATN without the cpu)
+static void drive_updateBusLines() {
+  uint8_t pb = m6522_getPB(&drive_via1);
+  bool_t atn = (iecBus_getLines() & IECBUS_ATN) == 0;
+  uint8_t lines = IECBUS_RELEASED;
+
+  if(pb & 0x08) {
+    lines &= ~IECBUS_CLK;
+  }
+  if((pb & 0x02) || (((pb & 0x10) != 0) != atn)) {
+    lines &= ~IECBUS_DATA;
+  }
+
+  if(lines != (drive_device.lines & IECBUS_RELEASED)) {
+    drive_lastActivity = drive_now();
+    iecBus_setDeviceLines(&drive_device, lines);
+  }
+}
+
+uint8_t drive_via1ReadPB(m6522_t *m6522) {
+  uint8_t bus = iecBus_getLines();
+  uint8_t value = ((drive_device.number - 8) & 3) << 5;
+
+  if(!(bus & IECBUS_DATA)) {
+    value |= 0x01;
+  }
+  if(!(bus & IECBUS_CLK)) {
+    value |= 0x04;
+  }
+  if(!(bus & IECBUS_ATN)) {
+    value |= 0x80;
+  }
+  return value;
+}
+
+void drive_via1WritePB(m6522_t *m6522, uint8_t data) {
+  if(drive_attached) {
+    drive_updateBusLines();
+  }
+}
+
+uint8_t drive_via1ReadPA(m6522_t *m6522) {
+  return 0xff;
+}
+
+void drive_via1WritePA(m6522_t *m6522, uint8_t data) {
+}
+
+
+// --- VIA2, disk ---
+// PA: the byte under the head
+// PB0-1: stepper motor phase, PB2: motor, PB3: LED, PB4: write protect (1 = writable),
+// PB5-6: density (bit rate zone), PB7: sync (0 = sync mark under the head)
+// CA1: byte ready, CA2: byte ready sets the cpu's overflow flag when high, CB2: 0 = write, 1 = read
+
+static uint32_t drive_byteCycles() {
+  // zone 3 (the outside tracks) is the fastest
+  return 32 - ((m6522_getPB(&drive_via2) >> 5) & 3) * 2;
+}
+
+static uint8_t *drive_currentTrack(uint32_t *length) {
+  uint32_t track = drive_halfTrack / 2;
+
+  if(!drive_diskInserted || (drive_halfTrack & 1) || track < 1 || track > DRIVE_MAX_TRACKS || drive_trackLengths[track - 1] == 0) {
+    return NULL;
+  }
+  *length = drive_trackLengths[track - 1];
+  return drive_gcr + (track - 1) * DRIVE_MAX_TRACK_LENGTH;
+}
+
+static void drive_scheduleDisk() {
+  if(drive_motorOn && !drive_diskEventPending) {
+    drive_diskEventPending = true;
+    clock_scheduleEvent(&drive_clock, &drive_diskEvent, drive_byteCycles(), PHASE_PHI1);
+  }
+}
+
+// the next byte comes round under the head
+void drive_diskEventFunction(void *context) {
+  uint32_t length = 0;
+  uint8_t *track = drive_currentTrack(&length);
+  bool_t byteReady = false;
+
+  drive_diskEventPending = false;
+  if(!drive_motorOn) {
+    return;
+  }
+
+  if(track) {
+    drive_headPosition = (drive_headPosition + 1) % length;
+
+    if((drive_via2.regs[M6522_REG_PCR] & 0xe0) == 0xc0) {
+      // write mode
+      track[drive_headPosition] = m6522_getPA(&drive_via2);
+      drive_syncFound = false;
+      byteReady = true;
+    } else {
+      // 10 or more 1 bits is a sync mark, gcr data never has two $ff bytes in a row
+      uint8_t byte = track[drive_headPosition];
+      drive_syncFound = byte == 0xff && drive_lastByte == 0xff;
+      drive_lastByte = byte;
+      if(!drive_syncFound) {
+        drive_readByte = byte;
+        byteReady = true;
+      }
+    }
+  }
+
+  if(byteReady) {
+    if((drive_via2.regs[M6522_REG_PCR] & 0x0e) == 0x0e) {
+      drive_cpu.flagV = true;
+    }
+    m6522_setCA1(&drive_via2, false);
+    m6522_setCA1(&drive_via2, true);
+  }
+
+  drive_scheduleDisk();
+}
+
+uint8_t drive_via2ReadPA(m6522_t *m6522) {
+  return drive_readByte;
+}
+
+void drive_via2WritePA(m6522_t *m6522, uint8_t data) {
+}
+
+uint8_t drive_via2ReadPB(m6522_t *m6522) {
+  return (drive_syncFound ? 0 : 0x80) | 0x10;
+}
+
+void drive_via2WritePB(m6522_t *m6522, uint8_t data) {
+  uint8_t phase = data & 3;
+  uint32_t length;
+
+  // the head moves half a track each time the stepper phase goes up (in) or down (out) by one
+  if(phase == ((drive_stepperPhase + 1) & 3) && drive_halfTrack < DRIVE_MAX_HALFTRACK) {
+    drive_halfTrack++;
+  } else if(phase == ((drive_stepperPhase - 1) & 3) && drive_halfTrack > DRIVE_MIN_HALFTRACK) {
+    drive_halfTrack--;
+  }
+  drive_stepperPhase = phase;
+
+  if(drive_currentTrack(&length)) {
+    drive_headPosition %= length;
+  }
+
+  drive_motorOn = (data & 0x04) != 0;
+  if(drive_motorOn) {
+    drive_scheduleDisk();
+  }
+}
+
+
+// --- keeping up with the c64 ---
+
+static uint64_t drive_targetTime() {
+  return (uint64_t)(clock_getTimeAndPhase(&m64_clock) * drive_cyclesPerC64HalfCycle) - drive_skippedTime;
+}
+
+// run the drive up to the c64's time
+void drive_sync(iecDevice_t *device) {
+  uint64_t target;
+
+  if(drive_sleeping || drive_syncing) {
+    return;
+  }
+
+  target = drive_targetTime();
+  drive_syncing = true;
+  while(clock_getTimeAndPhase(&drive_clock) < target) {
+    clock_step(&drive_clock);
+  }
+  drive_syncing = false;
+}
+
+static void drive_wake() {
+  if(drive_sleeping) {
+    // skip the time spent asleep
+    drive_skippedTime = (uint64_t)(clock_getTimeAndPhase(&m64_clock) * drive_cyclesPerC64HalfCycle) - clock_getTimeAndPhase(&drive_clock);
+    drive_sleeping = false;
+    drive_lastActivity = drive_now();
+    clock_scheduleEvent(&m64_clock, &drive_syncEvent, DRIVE_SYNC_CYCLES, PHASE_PHI1);
+  }
+}
+
+void drive_syncEventFunction(void *context) {
+  drive_sync(&drive_device);
+
+  // sleep if the motor is off and the bus is quiet
+  if(!drive_motorOn && (drive_device.lines & IECBUS_RELEASED) == IECBUS_RELEASED && (iecBus_getLines() & IECBUS_ATN)
+     && drive_now() - drive_lastActivity > DRIVE_IDLE_CYCLES) {
+    drive_sleeping = true;
+    return;
+  }
+
+  clock_scheduleEvent(&m64_clock, &drive_syncEvent, DRIVE_SYNC_CYCLES, PHASE_PHI1);
+}
+
+// the c64 (or another device) has changed the bus, the drive has already caught up to now (iecBus syncs it first)
+void drive_busChanged(iecDevice_t *device, uint8_t bus) {
+  drive_wake();
+  drive_lastActivity = drive_now();
+
+  m6522_setCA1(&drive_via1, (bus & IECBUS_ATN) == 0);
+  drive_updateBusLines();
+}
+
+
+// --- setup ---
+
+void drive_init() {
+  drive_device.number = 8;
+  drive_device.lines = IECBUS_RELEASED;
+  drive_device.busChanged = &drive_busChanged;
+  drive_device.reset = &drive_reset;
+  drive_device.sync = &drive_sync;
+  drive_device.context = NULL;
+  drive_attached = false;
+
+  clock_init(&drive_clock, DRIVE_CYCLES_PER_SECOND);
+  drive_cyclesPerC64HalfCycle = DRIVE_CYCLES_PER_SECOND / clock_getCyclesPerSecond(&m64_clock);
+
+  m6510_init(&drive_cpu, &drive_clock);
+  m6510_setMemoryHandler(&drive_cpu, &drive_read, &drive_write);
+
+  drive_syncEvent.event = &drive_syncEventFunction;
+  drive_syncEvent.context = NULL;
+  drive_diskEvent.event = &drive_diskEventFunction;
+  drive_diskEvent.context = NULL;
+  drive_diskEventPending = false;
+
+  drive_via1.readPA = &drive_via1ReadPA;
+  drive_via1.readPB = &drive_via1ReadPB;
+  drive_via1.writePA = &drive_via1WritePA;
+  drive_via1.writePB = &drive_via1WritePB;
+  drive_via1.interrupt = &drive_viaInterrupt;
+  m6522_init(&drive_via1, &drive_clock);
+
+  drive_via2.readPA = &drive_via2ReadPA;
+  drive_via2.readPB = &drive_via2ReadPB;
+  drive_via2.writePA = &drive_via2WritePA;
+  drive_via2.writePB = &drive_via2WritePB;
+  drive_via2.interrupt = &drive_viaInterrupt;
+  m6522_init(&drive_via2, &drive_clock);
+}
+
+void drive_reset(iecDevice_t *device) {
+  clock_cancelEvent(&m64_clock, &drive_syncEvent);
+  clock_reset(&drive_clock);
+  drive_diskEventPending = false;
+  drive_irq = false;
+
+  memset(drive_ram, 0, DRIVE_RAM_LENGTH);
+  drive_halfTrack = 36;
+  drive_stepperPhase = 0;
+  drive_motorOn = false;
+  drive_syncFound = false;
+  drive_lastByte = 0;
+
+  m6522_reset(&drive_via1);
+  m6522_reset(&drive_via2);
+  m6510_clearIRQ(&drive_cpu);
+  m6510_triggerRST(&drive_cpu);
+
+  // the drive's time starts now
+  drive_sleeping = false;
+  drive_skippedTime = (uint64_t)(clock_getTimeAndPhase(&m64_clock) * drive_cyclesPerC64HalfCycle);
+  drive_lastActivity = 0;
+  clock_scheduleEvent(&m64_clock, &drive_syncEvent, DRIVE_SYNC_CYCLES, PHASE_PHI1);
+
+  drive_updateBusLines();
+}
+
+// the drive and the disk in it (the drive can write to the disk), the rom has to be set again before loading
+// (the device number and lines are saved with the bus)
+void drive_serialize(state_t *state) {
+  uint32_t track;
+
+  state_event(state, &drive_syncEvent);
+
+  STATE_VALUE(state, drive_attached);
+  if(!drive_attached || state->error) {
+    return;
+  }
+  if(!drive_hasROM) {
+    state->error = true;
+    return;
+  }
+
+  m6510_serialize(state, &drive_cpu);
+  m6522_serialize(state, &drive_via1);
+  m6522_serialize(state, &drive_via2);
+  state_event(state, &drive_diskEvent);
+
+  STATE_VALUE(state, drive_ram);
+  STATE_VALUE(state, drive_skippedTime);
+  STATE_VALUE(state, drive_sleeping);
+  STATE_VALUE(state, drive_lastActivity);
+  STATE_VALUE(state, drive_irq);
+  STATE_VALUE(state, drive_halfTrack);
+  STATE_VALUE(state, drive_headPosition);
+  STATE_VALUE(state, drive_stepperPhase);
+  STATE_VALUE(state, drive_motorOn);
+  STATE_VALUE(state, drive_readByte);
+  STATE_VALUE(state, drive_lastByte);
+  STATE_VALUE(state, drive_syncFound);
+  STATE_VALUE(state, drive_diskEventPending);
+
+  STATE_VALUE(state, drive_diskInserted);
+  if(drive_diskInserted && !state->error) {
+    STATE_VALUE(state, drive_trackLengths);
+    if(state->loading && drive_gcr == NULL) {
+      drive_gcr = malloc(sizeof(uint8_t) * DRIVE_MAX_TRACKS * DRIVE_MAX_TRACK_LENGTH);
+      if(drive_gcr == NULL) {
+        state->error = true;
+        return;
+      }
+    }
+    for(track = 0; track < DRIVE_MAX_TRACKS && !state->error; track++) {
+      if(drive_trackLengths[track] > DRIVE_MAX_TRACK_LENGTH) {
+        state->error = true;
+        return;
+      }
+      state_value(state, drive_gcr + track * DRIVE_MAX_TRACK_LENGTH, drive_trackLengths[track]);
+    }
+  }
+
+  state_clock(state, &drive_clock);
+}
+
+// the 16KB 1541 dos rom ($c000-$ffff), or the two 8KB halves one after the other
+int32_t m64_driveSetROM(uint8_t *data, uint32_t dataLength) {
+  if(dataLength < DRIVE_ROM_LENGTH) {
+    return -1;
+  }
+  memcpy(drive_rom, data, DRIVE_ROM_LENGTH);
+  drive_hasROM = true;
+  return 0;
+}
+
+// attach the drive to the serial bus as deviceNumber (8-11), needs the rom
+int32_t m64_driveAttach(uint32_t deviceNumber) {
+  movie_record(MOVIE_DRIVE_ATTACH, deviceNumber, 0, 0, 0, NULL, 0);
+  if(!drive_hasROM || deviceNumber < 8 || deviceNumber > 11) {
+    return -1;
+  }
+
+  drive_detach();
+
+  // only one device can answer to a number, the virtual drive gives it up
+  if(iecBus_getDevice(deviceNumber) != NULL) {
+    vdrive_detach();
+  }
+
+  drive_device.number = deviceNumber;
+  iecBus_attachDevice(&drive_device);
+  drive_attached = true;
+  drive_reset(&drive_device);
+  return 0;
+}
+
+// take the drive off the bus, without recording it in a movie (for the other device taking its number)
+void drive_detach() {
+  if(drive_attached) {
+    clock_cancelEvent(&m64_clock, &drive_syncEvent);
+    iecBus_detachDevice(&drive_device);
+    drive_attached = false;
+  }
+}
+
+void m64_driveDetach() {
+  movie_record(MOVIE_DRIVE_DETACH, 0, 0, 0, 0, NULL, 0);
+  drive_detach();
+}
+
+// insert a d64 image (35 or 40 tracks, with or without error bytes), it is converted to GCR
+int32_t m64_driveInsertD64(uint8_t *data, uint32_t dataLength) {
+  movie_record(MOVIE_DRIVE_INSERT_D64, 0, 0, 0, 0, data, dataLength);
+  if(dataLength < VDRIVE_D64_LENGTH) {
+    return -1;
+  }
+
+  if(drive_gcr == NULL) {
+    drive_gcr = malloc(sizeof(uint8_t) * DRIVE_MAX_TRACKS * DRIVE_MAX_TRACK_LENGTH);
+    if(drive_gcr == NULL) {
+      return -1;
+    }
+  }
+  gcr_encodeD64(data, dataLength >= VDRIVE_D64_LENGTH_40 ? 40 : 35, drive_gcr, drive_trackLengths);
+  drive_diskInserted = true;
+  drive_headPosition = 0;
+
+  if(drive_attached) {
+    drive_sync(&drive_device);
+    drive_wake();
+  }
+  return 0;
+}
+
+void m64_driveEject() {
+  movie_record(MOVIE_DRIVE_EJECT, 0, 0, 0, 0, NULL, 0);
+  if(drive_attached) {
+    drive_sync(&drive_device);
+  }
+  drive_diskInserted = false;
+}
+
+// bit 0: LED on, bit 1: motor on, bit 2: asleep, bits 8-15: the half track the head is on
+uint32_t m64_driveGetState() {
+  uint8_t pb = m6522_getPB(&drive_via2);
+
+  return ((pb & 0x08) ? 1 : 0) | (drive_motorOn ? 2 : 0) | (drive_sleeping ? 4 : 0) | (drive_halfTrack << 8);
+}
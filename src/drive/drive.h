@@ -0,0 +1,51 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ *
+ * An optional 1541 disk drive: a second 6502 with its own 1MHz clock, 2KB of ram, the dos rom,
+ * two 6522 VIAs (VIA1 for the serial bus at $1800, VIA2 for the disk at $1c00) and a GCR disk.
+ * Off by default, it needs the 1541 rom (m64_driveSetROM)
+ */
+
+#ifndef DRIVE_H
+#define DRIVE_H
+
+#define DRIVE_CYCLES_PER_SECOND 1000000.0
+
+#define DRIVE_RAM_LENGTH 0x800
+#define DRIVE_ROM_LENGTH 0x4000
+
+#define DRIVE_MAX_TRACKS 42
+#define DRIVE_MAX_TRACK_LENGTH 7928
+
+// half tracks the head can be on (track 1 is half track 2)
+#define DRIVE_MIN_HALFTRACK 2
+#define DRIVE_MAX_HALFTRACK (DRIVE_MAX_TRACKS * 2)
+
+// how often (in c64 cycles) the drive catches up when the c64 isn't using the serial bus
+#define DRIVE_SYNC_CYCLES 20000
+
+// the drive goes to sleep when the motor is off and nothing has happened on the bus for this many drive cycles
+#define DRIVE_IDLE_CYCLES 2000000
+
+extern uint8_t drive_rom[DRIVE_ROM_LENGTH];
+
+void drive_init();
+void drive_reset(iecDevice_t *device);
+void drive_serialize(state_t *state);
+void drive_sync(iecDevice_t *device);
+void drive_detach();
+
+void gcr_encodeD64(uint8_t *data, uint32_t tracks, uint8_t *gcr, uint32_t *trackLengths);
+uint32_t gcr_trackLength(uint32_t track);
+
+int32_t m64_driveSetROM(uint8_t *data, uint32_t dataLength);
+int32_t m64_driveAttach(uint32_t deviceNumber);
+void m64_driveDetach();
+int32_t m64_driveInsertD64(uint8_t *data, uint32_t dataLength);
+void m64_driveEject();
+uint32_t m64_driveGetState();
+
+#endif
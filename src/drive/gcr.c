@@ -0,0 +1,130 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+// converts a d64 image to the GCR bytes the 1541 head reads, one buffer per track
+// each sector is: sync, header block, gap, sync, data block, gap
+
+#include "../m64.h"
+
+#define GCR_SYNC_LENGTH 5
+#define GCR_HEADER_GAP 9
+#define GCR_SECTOR_GAP 8
+
+static const uint8_t gcr_nybbles[16] = {
+  0x0a, 0x0b, 0x12, 0x13, 0x0e, 0x0f, 0x16, 0x17,
+  0x09, 0x19, 0x1a, 0x1b, 0x0d, 0x1d, 0x1e, 0x15
+};
+
+static uint32_t gcr_sectorsPerTrack(uint32_t track) {
+  if(track <= 17) {
+    return 21;
+  }
+  if(track <= 24) {
+    return 19;
+  }
+  if(track <= 30) {
+    return 18;
+  }
+  return 17;
+}
+
+// bytes on a track at the speed of its zone
+uint32_t gcr_trackLength(uint32_t track) {
+  if(track <= 17) {
+    return 7692;
+  }
+  if(track <= 24) {
+    return 7142;
+  }
+  if(track <= 30) {
+    return 6666;
+  }
+  return 6250;
+}
+
+// 4 bytes become 5 GCR bytes
+static void gcr_encode4(uint8_t *in, uint8_t *out) {
+  uint64_t bits = 0;
+  uint32_t i;
+
+  for(i = 0; i < 4; i++) {
+    bits = (bits << 10) | (gcr_nybbles[in[i] >> 4] << 5) | gcr_nybbles[in[i] & 0x0f];
+  }
+  for(i = 0; i < 5; i++) {
+    out[i] = (bits >> (32 - i * 8)) & 0xff;
+  }
+}
+
+static uint32_t gcr_encodeBlock(uint8_t *in, uint32_t length, uint8_t *out) {
+  uint32_t i;
+  for(i = 0; i < length; i += 4) {
+    gcr_encode4(in + i, out + (i / 4) * 5);
+  }
+  return (length / 4) * 5;
+}
+
+static uint32_t gcr_fill(uint8_t *out, uint8_t value, uint32_t length) {
+  memset(out, value, length);
+  return length;
+}
+
+void gcr_encodeD64(uint8_t *data, uint32_t tracks, uint8_t *gcr, uint32_t *trackLengths) {
+  uint8_t header[8];
+  uint8_t block[260];
+  uint32_t offset = 0;
+  uint32_t bam = 0;
+  uint32_t track, sector, i;
+
+  // the disk id is in the bam (track 18, sector 0)
+  for(track = 1; track < 18; track++) {
+    bam += gcr_sectorsPerTrack(track) * 256;
+  }
+
+  for(track = 1; track <= tracks; track++) {
+    uint8_t *out = gcr + (track - 1) * DRIVE_MAX_TRACK_LENGTH;
+    uint32_t length = gcr_trackLength(track);
+    uint32_t position = 0;
+
+    for(sector = 0; sector < gcr_sectorsPerTrack(track); sector++) {
+      uint8_t *in = data + offset;
+      offset += 256;
+
+      header[0] = 0x08;
+      header[2] = sector;
+      header[3] = track;
+      header[4] = data[bam + 0xa3];
+      header[5] = data[bam + 0xa2];
+      header[6] = 0x0f;
+      header[7] = 0x0f;
+      header[1] = header[2] ^ header[3] ^ header[4] ^ header[5];
+
+      block[0] = 0x07;
+      block[257] = 0;
+      for(i = 0; i < 256; i++) {
+        block[i + 1] = in[i];
+        block[257] ^= in[i];
+      }
+      block[258] = 0;
+      block[259] = 0;
+
+      position += gcr_fill(out + position, 0xff, GCR_SYNC_LENGTH);
+      position += gcr_encodeBlock(header, 8, out + position);
+      position += gcr_fill(out + position, 0x55, GCR_HEADER_GAP);
+      position += gcr_fill(out + position, 0xff, GCR_SYNC_LENGTH);
+      position += gcr_encodeBlock(block, 260, out + position);
+      position += gcr_fill(out + position, 0x55, GCR_SECTOR_GAP);
+    }
+
+    // the rest of the track is gap
+    gcr_fill(out + position, 0x55, length - position);
+    trackLengths[track - 1] = length;
+  }
+
+  for(; track <= DRIVE_MAX_TRACKS; track++) {
+    trackLengths[track - 1] = 0;
+  }
+}
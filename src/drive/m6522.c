@@ -0,0 +1,269 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#include "../m64.h"
+
+void m6522_t1EventFunction(void *context);
+void m6522_t2EventFunction(void *context);
+
+static uint64_t m6522_now(m6522_t *m6522) {
+  return clock_getTime(m6522->clock, PHASE_PHI2);
+}
+
+static void m6522_updateInterrupt(m6522_t *m6522) {
+  bool_t irq = (m6522->ifr & m6522->ier & 0x7f) != 0;
+
+  if(irq != m6522->irq) {
+    m6522->irq = irq;
+    if(m6522->interrupt) {
+      m6522->interrupt(m6522, irq);
+    }
+  }
+}
+
+static void m6522_setFlags(m6522_t *m6522, uint8_t flags) {
+  m6522->ifr |= flags;
+  m6522_updateInterrupt(m6522);
+}
+
+static void m6522_clearFlags(m6522_t *m6522, uint8_t flags) {
+  m6522->ifr &= ~flags;
+  m6522_updateInterrupt(m6522);
+}
+
+void m6522_init(m6522_t *m6522, clock_t *clock) {
+  m6522->clock = clock;
+
+  m6522->t1Event.event = &m6522_t1EventFunction;
+  m6522->t1Event.context = (void *)m6522;
+  m6522->t2Event.event = &m6522_t2EventFunction;
+  m6522->t2Event.context = (void *)m6522;
+
+  m6522->t1Armed = false;
+  m6522->t2Armed = false;
+  m6522->irq = false;
+
+  m6522_reset(m6522);
+}
+
+void m6522_serialize(state_t *state, m6522_t *m6522) {
+  state_event(state, &(m6522->t1Event));
+  state_event(state, &(m6522->t2Event));
+
+  STATE_VALUE(state, m6522->regs);
+  STATE_VALUE(state, m6522->ifr);
+  STATE_VALUE(state, m6522->ier);
+  STATE_VALUE(state, m6522->irq);
+  STATE_VALUE(state, m6522->t1Latch);
+  STATE_VALUE(state, m6522->t1Value);
+  STATE_VALUE(state, m6522->t1Start);
+  STATE_VALUE(state, m6522->t1Armed);
+  STATE_VALUE(state, m6522->t2Value);
+  STATE_VALUE(state, m6522->t2Start);
+  STATE_VALUE(state, m6522->t2Armed);
+  STATE_VALUE(state, m6522->ca1);
+}
+
+void m6522_reset(m6522_t *m6522) {
+  if(m6522->t1Armed) {
+    clock_cancelEvent(m6522->clock, &(m6522->t1Event));
+  }
+  if(m6522->t2Armed) {
+    clock_cancelEvent(m6522->clock, &(m6522->t2Event));
+  }
+
+  memset(m6522->regs, 0, sizeof(m6522->regs));
+  m6522->ifr = 0;
+  m6522->ier = 0;
+  m6522->ca1 = false;
+
+  m6522->t1Latch = 0xffff;
+  m6522->t1Value = 0xffff;
+  m6522->t1Start = 0;
+  m6522->t1Armed = false;
+  m6522->t2Value = 0xffff;
+  m6522->t2Start = 0;
+  m6522->t2Armed = false;
+
+  m6522_updateInterrupt(m6522);
+
+  // all pins are inputs
+  if(m6522->writePA) {
+    m6522->writePA(m6522, 0xff);
+  }
+  if(m6522->writePB) {
+    m6522->writePB(m6522, 0xff);
+  }
+}
+
+// the value of a counter that was value at cycle start, it carries on counting down past zero
+static uint16_t m6522_counter(m6522_t *m6522, uint16_t value, uint64_t start) {
+  uint64_t now = m6522_now(m6522);
+  if(now < start) {
+    return value;
+  }
+  return (uint16_t)(value - (now - start));
+}
+
+static void m6522_startTimer1(m6522_t *m6522, uint64_t start) {
+  if(m6522->t1Armed) {
+    clock_cancelEvent(m6522->clock, &(m6522->t1Event));
+  }
+  m6522->t1Value = m6522->t1Latch;
+  m6522->t1Start = start;
+  m6522->t1Armed = true;
+
+  // the flag is set when the counter goes past zero
+  clock_scheduleEventAt(m6522->clock, &(m6522->t1Event), start + m6522->t1Value + 1, PHASE_PHI1);
+}
+
+void m6522_t1EventFunction(void *context) {
+  m6522_t *m6522 = (m6522_t *)context;
+  uint64_t now = clock_getTime(m6522->clock, PHASE_PHI1);
+
+  m6522->t1Armed = false;
+
+  // continuous mode reloads the latch on the next cycle
+  if(m6522->regs[M6522_REG_ACR] & 0x40) {
+    m6522_startTimer1(m6522, now + 1);
+  }
+
+  m6522_setFlags(m6522, M6522_INTERRUPT_T1);
+}
+
+void m6522_t2EventFunction(void *context) {
+  m6522_t *m6522 = (m6522_t *)context;
+
+  // one shot, the counter carries on from $ffff without another interrupt
+  m6522->t2Armed = false;
+  m6522_setFlags(m6522, M6522_INTERRUPT_T2);
+}
+
+uint8_t m6522_getPA(m6522_t *m6522) {
+  return m6522->regs[M6522_REG_ORA] | ~m6522->regs[M6522_REG_DDRA];
+}
+
+uint8_t m6522_getPB(m6522_t *m6522) {
+  return m6522->regs[M6522_REG_ORB] | ~m6522->regs[M6522_REG_DDRB];
+}
+
+uint8_t m6522_read(m6522_t *m6522, uint8_t reg) {
+  uint8_t ddr;
+
+  switch(reg & 0x0f) {
+    case M6522_REG_ORB:
+      m6522_clearFlags(m6522, M6522_INTERRUPT_CB1 | M6522_INTERRUPT_CB2);
+      ddr = m6522->regs[M6522_REG_DDRB];
+      return (m6522->regs[M6522_REG_ORB] & ddr) | (m6522->readPB(m6522) & ~ddr);
+    case M6522_REG_ORA:
+      m6522_clearFlags(m6522, M6522_INTERRUPT_CA1 | M6522_INTERRUPT_CA2);
+      // fall through
+    case M6522_REG_ORA_NH:
+      ddr = m6522->regs[M6522_REG_DDRA];
+      return (m6522->regs[M6522_REG_ORA] & ddr) | (m6522->readPA(m6522) & ~ddr);
+    case M6522_REG_T1CL:
+      m6522_clearFlags(m6522, M6522_INTERRUPT_T1);
+      return m6522_counter(m6522, m6522->t1Value, m6522->t1Start) & 0xff;
+    case M6522_REG_T1CH:
+      return m6522_counter(m6522, m6522->t1Value, m6522->t1Start) >> 8;
+    case M6522_REG_T1LL:
+      return m6522->t1Latch & 0xff;
+    case M6522_REG_T1LH:
+      return m6522->t1Latch >> 8;
+    case M6522_REG_T2CL:
+      m6522_clearFlags(m6522, M6522_INTERRUPT_T2);
+      return m6522_counter(m6522, m6522->t2Value, m6522->t2Start) & 0xff;
+    case M6522_REG_T2CH:
+      return m6522_counter(m6522, m6522->t2Value, m6522->t2Start) >> 8;
+    case M6522_REG_IFR:
+      return m6522->ifr | (m6522->irq ? 0x80 : 0);
+    case M6522_REG_IER:
+      return m6522->ier | 0x80;
+    default:
+      return m6522->regs[reg & 0x0f];
+  }
+}
+
+void m6522_write(m6522_t *m6522, uint8_t reg, uint8_t data) {
+  reg &= 0x0f;
+
+  switch(reg) {
+    case M6522_REG_ORB:
+    case M6522_REG_DDRB:
+      m6522->regs[reg] = data;
+      if(reg == M6522_REG_ORB) {
+        m6522_clearFlags(m6522, M6522_INTERRUPT_CB1 | M6522_INTERRUPT_CB2);
+      }
+      m6522->writePB(m6522, m6522_getPB(m6522));
+      break;
+    case M6522_REG_ORA:
+    case M6522_REG_ORA_NH:
+    case M6522_REG_DDRA:
+      if(reg == M6522_REG_ORA) {
+        m6522_clearFlags(m6522, M6522_INTERRUPT_CA1 | M6522_INTERRUPT_CA2);
+      }
+      m6522->regs[reg == M6522_REG_ORA_NH ? M6522_REG_ORA : reg] = data;
+      m6522->writePA(m6522, m6522_getPA(m6522));
+      break;
+    case M6522_REG_T1CL:
+    case M6522_REG_T1LL:
+      m6522->t1Latch = (m6522->t1Latch & 0xff00) | data;
+      break;
+    case M6522_REG_T1CH:
+      // load the counter from the latch and start counting on the next cycle
+      m6522->t1Latch = (m6522->t1Latch & 0x00ff) | (data << 8);
+      m6522_clearFlags(m6522, M6522_INTERRUPT_T1);
+      m6522_startTimer1(m6522, m6522_now(m6522) + 1);
+      break;
+    case M6522_REG_T1LH:
+      m6522->t1Latch = (m6522->t1Latch & 0x00ff) | (data << 8);
+      m6522_clearFlags(m6522, M6522_INTERRUPT_T1);
+      break;
+    case M6522_REG_T2CL:
+      m6522->regs[M6522_REG_T2CL] = data;
+      break;
+    case M6522_REG_T2CH:
+      if(m6522->t2Armed) {
+        clock_cancelEvent(m6522->clock, &(m6522->t2Event));
+      }
+      m6522->t2Value = m6522->regs[M6522_REG_T2CL] | (data << 8);
+      m6522->t2Start = m6522_now(m6522) + 1;
+      m6522->t2Armed = true;
+      m6522_clearFlags(m6522, M6522_INTERRUPT_T2);
+      clock_scheduleEventAt(m6522->clock, &(m6522->t2Event), m6522->t2Start + m6522->t2Value + 1, PHASE_PHI1);
+      break;
+    case M6522_REG_IFR:
+      // writing a 1 clears a flag
+      m6522_clearFlags(m6522, data & 0x7f);
+      break;
+    case M6522_REG_IER:
+      if(data & 0x80) {
+        m6522->ier |= data & 0x7f;
+      } else {
+        m6522->ier &= ~data;
+      }
+      m6522_updateInterrupt(m6522);
+      break;
+    default:
+      m6522->regs[reg] = data;
+      break;
+  }
+}
+
+// the CA1 input, the edge that sets the flag is chosen by bit 0 of the PCR (0 = falling, 1 = rising)
+void m6522_setCA1(m6522_t *m6522, bool_t state) {
+  bool_t rising = (m6522->regs[M6522_REG_PCR] & 0x01) != 0;
+
+  if(state == m6522->ca1) {
+    return;
+  }
+  m6522->ca1 = state;
+
+  if(state == rising) {
+    m6522_setFlags(m6522, M6522_INTERRUPT_CA1);
+  }
+}
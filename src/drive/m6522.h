@@ -0,0 +1,91 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ *
+ * The 6522 VIA, as used in the 1541 drive
+ * the timers are worked out from the clock when they are read and only use an event when they reach zero,
+ * pulse counting, the shift register and PB7 timer output are not implemented (the 1541 rom doesn't use them)
+ */
+
+#ifndef M6522_H
+#define M6522_H
+
+#define M6522_REG_ORB   0x00     // port B
+#define M6522_REG_ORA   0x01     // port A, with handshake
+#define M6522_REG_DDRB  0x02
+#define M6522_REG_DDRA  0x03
+#define M6522_REG_T1CL  0x04     // timer 1 counter low (write to latch low)
+#define M6522_REG_T1CH  0x05     // timer 1 counter high (write starts the timer)
+#define M6522_REG_T1LL  0x06     // timer 1 latch low
+#define M6522_REG_T1LH  0x07     // timer 1 latch high
+#define M6522_REG_T2CL  0x08     // timer 2 counter low (write to latch low)
+#define M6522_REG_T2CH  0x09     // timer 2 counter high (write starts the timer)
+#define M6522_REG_SR    0x0a
+#define M6522_REG_ACR   0x0b
+#define M6522_REG_PCR   0x0c
+#define M6522_REG_IFR   0x0d
+#define M6522_REG_IER   0x0e
+#define M6522_REG_ORA_NH 0x0f    // port A, no handshake
+
+// interrupt flags
+#define M6522_INTERRUPT_CA2 (1 << 0)
+#define M6522_INTERRUPT_CA1 (1 << 1)
+#define M6522_INTERRUPT_SR  (1 << 2)
+#define M6522_INTERRUPT_CB2 (1 << 3)
+#define M6522_INTERRUPT_CB1 (1 << 4)
+#define M6522_INTERRUPT_T2  (1 << 5)
+#define M6522_INTERRUPT_T1  (1 << 6)
+
+typedef struct m6522_s m6522_t;
+
+// read the input pins of a port, write is called with the output pins (inputs read as 1)
+typedef uint8_t (*m6522_read_function)(m6522_t *m6522);
+typedef void (*m6522_write_function)(m6522_t *m6522, uint8_t data);
+typedef void (*m6522_interrupt)(m6522_t *m6522, bool_t state);
+
+struct m6522_s {
+  clock_t *clock;
+
+  uint8_t regs[16];
+  uint8_t ifr;
+  uint8_t ier;
+  bool_t irq;
+
+  // timer 1: the counter was t1Value at cycle t1Start, it reaches zero in the event
+  uint16_t t1Latch;
+  uint16_t t1Value;
+  uint64_t t1Start;
+  bool_t t1Armed;
+  event_t t1Event;
+
+  uint16_t t2Value;
+  uint64_t t2Start;
+  bool_t t2Armed;
+  event_t t2Event;
+
+  bool_t ca1;
+
+  m6522_read_function readPA;
+  m6522_read_function readPB;
+  m6522_write_function writePA;
+  m6522_write_function writePB;
+  m6522_interrupt interrupt;
+
+  void *context;
+};
+
+void m6522_init(m6522_t *m6522, clock_t *clock);
+void m6522_reset(m6522_t *m6522);
+void m6522_serialize(state_t *state, m6522_t *m6522);
+
+uint8_t m6522_read(m6522_t *m6522, uint8_t reg);
+void m6522_write(m6522_t *m6522, uint8_t reg, uint8_t data);
+
+void m6522_setCA1(m6522_t *m6522, bool_t state);
+
+uint8_t m6522_getPA(m6522_t *m6522);
+uint8_t m6522_getPB(m6522_t *m6522);
+
+#endif
@@ -21,60 +21,199 @@
 
 #include "../m64.h"
 
-uint8_t iecBus_drvBus[IECBUS_NUM];
-uint8_t iecBus_drvData[IECBUS_NUM];
-
-uint8_t iecBus_drvPort;
+// lines driven by the c64 (cia 2 port a) and the bus as seen by everyone (cpu lines and'ed with all devices)
 uint8_t iecBus_cpuBus;
 uint8_t iecBus_cpuPort;
 
-uint32_t iecBus_driveCount;
-
+iecDevice_t *iecBus_devices[IECBUS_NUM];
 uint32_t iecBus_serialDeviceCount;
 
 void iecBus_init() {
-
-  iecBus_drvPort = 0;
   iecBus_cpuBus = 0;
   iecBus_cpuPort = 0;
 
-  iecBus_driveCount = 1;
   iecBus_serialDeviceCount = 0;
   iecBus_reset();
 
 }
 
 void iecBus_reset() {
-  memset(iecBus_drvBus, 0xff, IECBUS_NUM);
-  memset(iecBus_drvData, 0xff, IECBUS_NUM);
+  uint32_t i = 0;
+
+  iecBus_cpuBus = IECBUS_RELEASED;
+
+  for(i = 0; i < iecBus_serialDeviceCount; i++) {
+    iecBus_devices[i]->lines = IECBUS_RELEASED;
+    if(iecBus_devices[i]->reset) {
+      iecBus_devices[i]->reset(iecBus_devices[i]);
+    }
+  }
 
-  iecBus_cpuBus = 0xff;
-  iecBus_cpuPort = 0xff;
-  iecBus_drvPort = 133;
+  iecBus_updatePorts();
 }
 
-uint8_t iecBus_readFromIECBus() {
+// devices is every device that can be on the bus, attached devices are saved as indexes into it
+// (in the order they were attached, which is the order they are told about changes)
+void iecBus_serialize(state_t *state, iecDevice_t **devices, uint32_t deviceCount) {
+  uint8_t attached[IECBUS_NUM];
+  uint32_t count = iecBus_serialDeviceCount;
+  uint32_t i, j;
+
+  STATE_VALUE(state, iecBus_cpuBus);
+  STATE_VALUE(state, iecBus_cpuPort);
+
+  for(i = 0; i < deviceCount; i++) {
+    STATE_VALUE(state, devices[i]->number);
+    STATE_VALUE(state, devices[i]->lines);
+  }
+
+  for(i = 0; i < count; i++) {
+    attached[i] = 0xff;
+    for(j = 0; j < deviceCount; j++) {
+      if(iecBus_devices[i] == devices[j]) {
+        attached[i] = j;
+      }
+    }
+  }
+
+  STATE_VALUE(state, count);
+  if(count > IECBUS_NUM) {
+    state->error = true;
+    return;
+  }
+  state_value(state, attached, count);
+
+  if(state->loading && !state->error) {
+    for(i = 0; i < count; i++) {
+      if(attached[i] >= deviceCount) {
+        state->error = true;
+        return;
+      }
+      iecBus_devices[i] = devices[attached[i]];
+    }
+    iecBus_serialDeviceCount = count;
+  } else if(!state->loading) {
+    for(i = 0; i < count; i++) {
+      if(attached[i] == 0xff) {
+        // a device that can't be saved
+        state->error = true;
+      }
+    }
+  }
+}
+
+int32_t iecBus_attachDevice(iecDevice_t *device) {
   uint32_t i = 0;
 
-  // clock all the serial devices..
+  for(i = 0; i < iecBus_serialDeviceCount; i++) {
+    if(iecBus_devices[i] == device) {
+      return 0;
+    }
+  }
+
+  if(iecBus_serialDeviceCount >= IECBUS_NUM) {
+    return -1;
+  }
+
+  device->lines = IECBUS_RELEASED;
+  iecBus_devices[iecBus_serialDeviceCount++] = device;
+  iecBus_updatePorts();
+  return 0;
+}
+
+void iecBus_detachDevice(iecDevice_t *device) {
+  uint32_t i = 0;
+
+  for(i = 0; i < iecBus_serialDeviceCount; i++) {
+    if(iecBus_devices[i] == device) {
+      iecBus_devices[i] = iecBus_devices[--iecBus_serialDeviceCount];
+      device->lines = IECBUS_RELEASED;
+      iecBus_updatePorts();
+      return;
+    }
+  }
+}
+
+// the attached device with a device number, NULL if there isn't one
+iecDevice_t *iecBus_getDevice(uint32_t number) {
+  uint32_t i = 0;
+
+  for(i = 0; i < iecBus_serialDeviceCount; i++) {
+    if(iecBus_devices[i]->number == number) {
+      return iecBus_devices[i];
+    }
+  }
+  return NULL;
+}
+
+// clock all the serial devices except the one making a change (NULL for the c64) up to now
+static void iecBus_syncDevices(iecDevice_t *source) {
+  uint32_t i = 0;
+
+  for(i = 0; i < iecBus_serialDeviceCount; i++) {
+    if(iecBus_devices[i] != source && iecBus_devices[i]->sync) {
+      iecBus_devices[i]->sync(iecBus_devices[i]);
+    }
+  }
+}
+
+// tell every device except the one that made the change that the lines have changed
+static void iecBus_notifyDevices(iecDevice_t *source, uint8_t oldLines) {
+  uint32_t i = 0;
+
+  if(iecBus_cpuPort == oldLines) {
+    return;
+  }
+
+  for(i = 0; i < iecBus_serialDeviceCount; i++) {
+    if(iecBus_devices[i] != source && iecBus_devices[i]->busChanged) {
+      iecBus_devices[i]->busChanged(iecBus_devices[i], iecBus_cpuPort);
+    }
+  }
+}
+
+void iecBus_setDeviceLines(iecDevice_t *device, uint8_t lines) {
+  uint8_t oldLines;
+
+  // the other devices have to run up to the change before they see it, as they do for the c64's writes
+  iecBus_syncDevices(device);
+  oldLines = iecBus_cpuPort;
+
+  device->lines = lines | ~IECBUS_RELEASED;
+  iecBus_updatePorts();
+  iecBus_notifyDevices(device, oldLines);
+}
+
+uint8_t iecBus_getLines() {
+  return iecBus_cpuPort;
+}
+
+uint8_t iecBus_readFromIECBus() {
+  // devices update their lines as they change, so once they have caught up the port holds the current state of the bus
+  iecBus_syncDevices(NULL);
 
   return iecBus_cpuPort;
 }
 
 void iecBus_writeToIECBus(uint8_t data) {
-  uint32_t i = 0;
+  uint8_t oldLines;
 
-  // clock all the serial devices
+  iecBus_syncDevices(NULL);
+  oldLines = iecBus_cpuPort;
 
-  uint8_t oldCpuBus = iecBus_cpuBus;
   iecBus_cpuBus = (( ((data & 255) << 2 & 128) | ((data & 255) << 2 & 64) | ((data & 255) << 1 & 16) ) | 0);
 
   iecBus_updatePorts();
+  iecBus_notifyDevices(NULL, oldLines);
 }
 
 void iecBus_updatePorts() {
-  iecBus_cpuPort = iecBus_cpuBus;
-  iecBus_drvPort = ( ((iecBus_cpuPort & 255) >> 4 & 4) | (iecBus_cpuPort & 255) >> 7 | ((iecBus_cpuBus & 255) << 3 & 128) ) ;
-}
+  uint32_t i = 0;
+  uint8_t lines = iecBus_cpuBus | ~IECBUS_RELEASED;
 
+  for(i = 0; i < iecBus_serialDeviceCount; i++) {
+    lines &= iecBus_devices[i]->lines;
+  }
 
+  iecBus_cpuPort = lines;
+}
@@ -23,8 +23,45 @@
 
 #define IECBUS_NUM 16
 
+// the serial bus lines, in the bit positions cia 2 port a reads them (1 = high/released, 0 = low/pulled)
+// the lines are open collector, any participant pulling a line low wins
+#define IECBUS_DATA 0x80
+#define IECBUS_CLK  0x40
+#define IECBUS_ATN  0x10
+#define IECBUS_RELEASED (IECBUS_DATA | IECBUS_CLK | IECBUS_ATN)
+
+typedef struct iecDevice_s iecDevice_t;
+
+// called when the bus lines change because of another participant, bus is the new state of the lines
+typedef void (*iecDevice_busChanged)(iecDevice_t *device, uint8_t bus);
+typedef void (*iecDevice_reset)(iecDevice_t *device);
+// called before the c64 reads or writes the bus, so a device running on its own clock can catch up
+typedef void (*iecDevice_sync)(iecDevice_t *device);
+
+// a device on the serial bus
+struct iecDevice_s {
+  // device number on the bus (8-11 for drives)
+  uint32_t number;
+
+  // the lines this device drives, a 0 bit pulls the line low. set with iecBus_setDeviceLines
+  uint8_t lines;
+
+  iecDevice_busChanged busChanged;
+  iecDevice_reset reset;
+  iecDevice_sync sync;
+
+  void *context;
+};
+
 void iecBus_init();
 void iecBus_reset();
+void iecBus_serialize(state_t *state, iecDevice_t **devices, uint32_t deviceCount);
+
+int32_t iecBus_attachDevice(iecDevice_t *device);
+void iecBus_detachDevice(iecDevice_t *device);
+iecDevice_t *iecBus_getDevice(uint32_t number);
+void iecBus_setDeviceLines(iecDevice_t *device, uint8_t lines);
+uint8_t iecBus_getLines();
 
 uint8_t iecBus_readFromIECBus();
 void iecBus_writeToIECBus(uint8_t data);
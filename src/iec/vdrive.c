@@ -0,0 +1,1067 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+// the serial bus protocol, as seen from the drive:
+// - when ATN is pulled, every device pulls DATA and listens for command bytes
+// - a byte starts when the talker releases CLK, the listener releases DATA when it's ready
+// - the talker pulls CLK and clocks out 8 bits (lsb first), each bit is valid on the rising edge of CLK
+// - if the talker waits more than 200us before the first bit, it's the last byte (EOI), the listener
+//   acknowledges by pulling DATA for 60us
+// - the listener pulls DATA after the 8th bit to acknowledge the byte
+// - after TALK, the c64 and the drive swap roles (turnaround) when ATN is released
+// the drive reacts to line changes immediately and uses one clock event for its own timings
+
+#include "../m64.h"
+
+iecDevice_t vdrive_device;
+event_t vdrive_event;
+bool_t vdrive_timerPending = false;
+bool_t vdrive_attached = false;
+
+// the disk: an optional d64 image and a table of files added by the host (or saved by the c64)
+uint8_t *vdrive_d64 = NULL;
+uint32_t vdrive_d64Tracks = 0;
+
+// offsets of the used directory entries in the d64
+#define VDRIVE_MAX_DIR_ENTRIES 144
+uint32_t vdrive_dirEntries[VDRIVE_MAX_DIR_ENTRIES];
+uint32_t vdrive_dirEntryCount = 0;
+
+vdrive_file_t vdrive_files[VDRIVE_MAX_FILES];
+uint32_t vdrive_fileCount = 0;
+
+vdrive_channel_t vdrive_channels[VDRIVE_CHANNELS];
+
+// the file name or command sent after OPEN, or the command sent to channel 15
+#define VDRIVE_COMMAND_LENGTH 42
+uint8_t vdrive_command[VDRIVE_COMMAND_LENGTH];
+uint32_t vdrive_commandLength = 0;
+
+char vdrive_status[VDRIVE_STATUS_LENGTH];
+
+// protocol state
+uint32_t vdrive_state = VDRIVE_IDLE;
+uint8_t vdrive_bus = IECBUS_RELEASED;
+bool_t vdrive_atn = false;
+bool_t vdrive_listening = false;
+bool_t vdrive_talking = false;
+bool_t vdrive_opening = false;
+uint32_t vdrive_secondary = 0;
+
+// the byte being received or sent
+uint8_t vdrive_byte = 0;
+uint32_t vdrive_bitCount = 0;
+bool_t vdrive_eoi = false;
+
+void vdrive_eventFunction(void *context);
+void vdrive_busChanged(iecDevice_t *device, uint8_t bus);
+
+static void vdrive_setTimer(uint32_t cycles) {
+  if(vdrive_timerPending) {
+    clock_cancelEvent(&m64_clock, &vdrive_event);
+  }
+  vdrive_timerPending = true;
+  clock_scheduleEvent(&m64_clock, &vdrive_event, cycles, PHASE_PHI1);
+}
+
+static void vdrive_cancelTimer() {
+  if(vdrive_timerPending) {
+    clock_cancelEvent(&m64_clock, &vdrive_event);
+    vdrive_timerPending = false;
+  }
+}
+
+// pull and release the drive's lines
+static void vdrive_setLines(uint8_t pull, uint8_t release) {
+  iecBus_setDeviceLines(&vdrive_device, (vdrive_device.lines & ~pull) | release);
+}
+
+
+// --- channels ---
+
+// returns -1 if the channel can't grow, it keeps what it had
+static int32_t vdrive_append(vdrive_channel_t *channel, uint8_t *data, uint32_t length) {
+  uint8_t *grown;
+
+  if(channel->length + length > channel->capacity) {
+    uint32_t capacity = channel->capacity ? channel->capacity : 256;
+    while(capacity < channel->length + length) {
+      capacity *= 2;
+    }
+    grown = realloc(channel->data, sizeof(uint8_t) * capacity);
+    if(grown == NULL) {
+      return -1;
+    }
+    channel->data = grown;
+    channel->capacity = capacity;
+  }
+  memcpy(channel->data + channel->length, data, length);
+  channel->length += length;
+  return 0;
+}
+
+static void vdrive_clearChannel(vdrive_channel_t *channel) {
+  channel->open = false;
+  channel->writing = false;
+  channel->length = 0;
+  channel->position = 0;
+  channel->nameLength = 0;
+}
+
+static void vdrive_setStatus(char *status) {
+  strcpy(vdrive_status, status);
+  vdrive_clearChannel(&vdrive_channels[VDRIVE_COMMAND_CHANNEL]);
+}
+
+// convert a host (ascii) name to the upper case petscii the c64 sends
+static uint32_t vdrive_petsciiName(char *name, uint8_t *dest) {
+  uint32_t length = 0;
+  while(name[length] && length < VDRIVE_NAME_LENGTH) {
+    uint8_t c = name[length];
+    if(c >= 'a' && c <= 'z') {
+      c -= 0x20;
+    }
+    dest[length++] = c;
+  }
+  return length;
+}
+
+// pattern can use ? for any character and * for the rest of the name
+static bool_t vdrive_matchName(uint8_t *pattern, uint32_t patternLength, uint8_t *name, uint32_t nameLength) {
+  uint32_t i;
+  for(i = 0; i < patternLength; i++) {
+    if(pattern[i] == '*') {
+      return true;
+    }
+    if(i >= nameLength || (pattern[i] != '?' && pattern[i] != name[i])) {
+      return false;
+    }
+  }
+  return patternLength == nameLength;
+}
+
+static int32_t vdrive_findHostFile(uint8_t *name, uint32_t nameLength) {
+  uint32_t i;
+  for(i = 0; i < vdrive_fileCount; i++) {
+    if(vdrive_matchName(name, nameLength, vdrive_files[i].name, vdrive_files[i].nameLength)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// returns -1 if the table is full or there's no memory for the data, a file being replaced is kept
+static int32_t vdrive_storeFile(uint8_t *name, uint32_t nameLength, uint8_t *data, uint32_t length) {
+  vdrive_file_t *file;
+  uint8_t *copy;
+  int32_t i;
+
+  // replace a file with exactly the same name
+  for(i = 0; i < (int32_t)vdrive_fileCount; i++) {
+    if(vdrive_files[i].nameLength == nameLength && memcmp(vdrive_files[i].name, name, nameLength) == 0) {
+      break;
+    }
+  }
+
+  if(i == (int32_t)vdrive_fileCount && vdrive_fileCount >= VDRIVE_MAX_FILES) {
+    return -1;
+  }
+
+  copy = malloc(sizeof(uint8_t) * (length ? length : 1));
+  if(copy == NULL) {
+    return -1;
+  }
+  memcpy(copy, data, length);
+
+  if(i == (int32_t)vdrive_fileCount) {
+    vdrive_fileCount++;
+  } else {
+    free(vdrive_files[i].data);
+  }
+
+  file = &vdrive_files[i];
+  memcpy(file->name, name, nameLength);
+  file->nameLength = nameLength;
+  file->data = copy;
+  file->length = length;
+  return 0;
+}
+
+// scratch the host files matching pattern, returns how many went
+static uint32_t vdrive_scratchFiles(uint8_t *pattern, uint32_t patternLength) {
+  uint32_t scratched = 0;
+  uint32_t i = 0;
+
+  while(i < vdrive_fileCount) {
+    if(vdrive_matchName(pattern, patternLength, vdrive_files[i].name, vdrive_files[i].nameLength)) {
+      free(vdrive_files[i].data);
+      memmove(&vdrive_files[i], &vdrive_files[i + 1], sizeof(vdrive_file_t) * (vdrive_fileCount - i - 1));
+      vdrive_fileCount--;
+      scratched++;
+    } else {
+      i++;
+    }
+  }
+  return scratched;
+}
+
+
+// --- d64 ---
+
+static uint32_t vdrive_sectorsPerTrack(uint32_t track) {
+  if(track <= 17) {
+    return 21;
+  }
+  if(track <= 24) {
+    return 19;
+  }
+  if(track <= 30) {
+    return 18;
+  }
+  return 17;
+}
+
+static int32_t vdrive_d64Offset(uint32_t track, uint32_t sector) {
+  uint32_t t;
+  uint32_t offset = 0;
+
+  if(track < 1 || track > vdrive_d64Tracks || sector >= vdrive_sectorsPerTrack(track)) {
+    return -1;
+  }
+
+  for(t = 1; t < track; t++) {
+    offset += vdrive_sectorsPerTrack(t);
+  }
+  return (offset + sector) * 256;
+}
+
+// length of a name padded with shifted spaces
+static uint32_t vdrive_d64NameLength(uint8_t *name) {
+  uint32_t length = 0;
+  while(length < VDRIVE_NAME_LENGTH && name[length] != 0xa0) {
+    length++;
+  }
+  return length;
+}
+
+static void vdrive_d64ReadDirectory() {
+  uint32_t track = 18;
+  uint32_t sector = 1;
+  uint32_t sectors = 0;
+  uint32_t i;
+
+  vdrive_dirEntryCount = 0;
+
+  while(track != 0 && sectors++ < 19) {
+    int32_t offset = vdrive_d64Offset(track, sector);
+    if(offset < 0) {
+      break;
+    }
+
+    for(i = 0; i < 8 && vdrive_dirEntryCount < VDRIVE_MAX_DIR_ENTRIES; i++) {
+      uint32_t entry = offset + i * 32;
+      // skip scratched entries
+      if((vdrive_d64[entry + 2] & 7) != 0) {
+        vdrive_dirEntries[vdrive_dirEntryCount++] = entry;
+      }
+    }
+
+    track = vdrive_d64[offset];
+    sector = vdrive_d64[offset + 1];
+  }
+}
+
+// follow a file's track/sector chain, returns -1 if the chain is broken or VDRIVE_NO_MEMORY
+static int32_t vdrive_d64ReadFile(uint32_t track, uint32_t sector, vdrive_channel_t *channel) {
+  uint32_t sectors = 0;
+
+  while(track != 0) {
+    int32_t offset = vdrive_d64Offset(track, sector);
+    if(offset < 0 || sectors++ > 800) {
+      return -1;
+    }
+
+    track = vdrive_d64[offset];
+    sector = vdrive_d64[offset + 1];
+
+    if(track == 0) {
+      // last sector, sector is the index of the last byte
+      if(sector >= 2 && vdrive_append(channel, vdrive_d64 + offset + 2, sector - 1) != 0) {
+        return VDRIVE_NO_MEMORY;
+      }
+    } else if(vdrive_append(channel, vdrive_d64 + offset + 2, 254) != 0) {
+      return VDRIVE_NO_MEMORY;
+    }
+  }
+  return 0;
+}
+
+static uint32_t vdrive_d64BlocksFree() {
+  uint32_t blocksFree = 0;
+  uint32_t track;
+  int32_t bam = vdrive_d64Offset(18, 0);
+
+  for(track = 1; track <= 35; track++) {
+    if(track != 18) {
+      blocksFree += vdrive_d64[bam + 4 + (track - 1) * 4];
+    }
+  }
+  return blocksFree;
+}
+
+
+// --- files ---
+
+// read a file into channel, from the host files first, then the d64
+// returns -1 if it isn't there, VDRIVE_NO_MEMORY if the channel can't hold it
+static int32_t vdrive_readFile(uint8_t *name, uint32_t nameLength, vdrive_channel_t *channel) {
+  int32_t index = vdrive_findHostFile(name, nameLength);
+  uint32_t i;
+
+  channel->length = 0;
+  channel->position = 0;
+
+  if(index >= 0) {
+    return vdrive_append(channel, vdrive_files[index].data, vdrive_files[index].length) == 0 ? 0 : VDRIVE_NO_MEMORY;
+  }
+
+  for(i = 0; i < vdrive_dirEntryCount; i++) {
+    uint8_t *entry = vdrive_d64 + vdrive_dirEntries[i];
+    uint32_t type = entry[2] & 7;
+
+    // seq, prg and usr files
+    if(type >= 1 && type <= 3 && vdrive_matchName(name, nameLength, entry + 5, vdrive_d64NameLength(entry + 5))) {
+      return vdrive_d64ReadFile(entry[3], entry[4], channel);
+    }
+  }
+
+  return -1;
+}
+
+static int32_t vdrive_directoryLine(vdrive_channel_t *channel, uint32_t number, uint8_t *text, uint32_t length) {
+  // the link address is fixed up by the basic loader
+  uint8_t header[4] = { 0x01, 0x01, number & 0xff, number >> 8 };
+  uint8_t end = 0;
+
+  if(vdrive_append(channel, header, 4) != 0 || vdrive_append(channel, text, length) != 0) {
+    return -1;
+  }
+  return vdrive_append(channel, &end, 1);
+}
+
+static int32_t vdrive_directoryEntry(vdrive_channel_t *channel, uint32_t blocks, uint8_t *name, uint32_t nameLength, char *type) {
+  uint8_t line[32];
+  uint32_t length = 0;
+  uint32_t i;
+
+  for(i = blocks < 10 ? 3 : blocks < 100 ? 2 : 1; i > 0; i--) {
+    line[length++] = ' ';
+  }
+  line[length++] = '"';
+  memcpy(line + length, name, nameLength);
+  length += nameLength;
+  line[length++] = '"';
+  for(i = nameLength; i < VDRIVE_NAME_LENGTH + 1; i++) {
+    line[length++] = ' ';
+  }
+  memcpy(line + length, type, 3);
+  length += 3;
+
+  return vdrive_directoryLine(channel, blocks, line, length);
+}
+
+// the directory as a basic program, pattern filters the files listed. returns 0 or VDRIVE_NO_MEMORY
+static int32_t vdrive_loadDirectory(uint8_t *pattern, uint32_t patternLength, vdrive_channel_t *channel) {
+  static char *types[8] = { "DEL", "SEQ", "PRG", "USR", "REL", "???", "???", "???" };
+  uint8_t loadAddress[2] = { 0x01, 0x04 };
+  uint8_t line[32];
+  uint32_t blocksFree = 664;
+  uint32_t length = 0;
+  int32_t error = 0;
+  uint32_t i;
+
+  channel->length = 0;
+  channel->position = 0;
+  error |= vdrive_append(channel, loadAddress, 2);
+
+  // header: reverse on, disk name and id
+  line[length++] = 0x12;
+  line[length++] = '"';
+  if(vdrive_d64) {
+    uint8_t *bam = vdrive_d64 + vdrive_d64Offset(18, 0);
+    for(i = 0; i < VDRIVE_NAME_LENGTH; i++) {
+      line[length++] = bam[0x90 + i] == 0xa0 ? ' ' : bam[0x90 + i];
+    }
+    line[length++] = '"';
+    line[length++] = ' ';
+    for(i = 0; i < 5; i++) {
+      line[length++] = bam[0xa2 + i] == 0xa0 ? ' ' : bam[0xa2 + i];
+    }
+    blocksFree = vdrive_d64BlocksFree();
+  } else {
+    memcpy(line + length, "M64             \" 00 2A", 23);
+    length += 23;
+  }
+  error |= vdrive_directoryLine(channel, 0, line, length);
+
+  for(i = 0; i < vdrive_fileCount; i++) {
+    vdrive_file_t *file = &vdrive_files[i];
+    uint32_t blocks = (file->length + 253) / 254;
+
+    if(patternLength == 0 || vdrive_matchName(pattern, patternLength, file->name, file->nameLength)) {
+      error |= vdrive_directoryEntry(channel, blocks, file->name, file->nameLength, "PRG");
+    }
+    if(!vdrive_d64) {
+      blocksFree = blocksFree > blocks ? blocksFree - blocks : 0;
+    }
+  }
+
+  for(i = 0; i < vdrive_dirEntryCount; i++) {
+    uint8_t *entry = vdrive_d64 + vdrive_dirEntries[i];
+    uint32_t nameLength = vdrive_d64NameLength(entry + 5);
+
+    if(patternLength == 0 || vdrive_matchName(pattern, patternLength, entry + 5, nameLength)) {
+      error |= vdrive_directoryEntry(channel, entry[30] | (entry[31] << 8), entry + 5, nameLength, types[entry[2] & 7]);
+    }
+  }
+
+  error |= vdrive_directoryLine(channel, blocksFree, (uint8_t *)"BLOCKS FREE.             ", 25);
+
+  // end of program
+  line[0] = 0;
+  line[1] = 0;
+  error |= vdrive_append(channel, line, 2);
+  return error ? VDRIVE_NO_MEMORY : 0;
+}
+
+// file names look like "0:NAME,P,R", "@0:NAME,S,W" or "NAME"
+// returns where the name starts, sets nameLength to its length and writing if a write mode is given
+static uint32_t vdrive_parseName(uint8_t *name, uint32_t *nameLength, bool_t *writing) {
+  uint32_t length = *nameLength;
+  uint32_t start = 0;
+  uint32_t end;
+  uint32_t i;
+
+  // skip @ (save with replace) and the drive number
+  for(i = 0; i < length; i++) {
+    if(name[i] == ':') {
+      start = i + 1;
+      break;
+    }
+  }
+  if(start == 0 && length > 0 && name[0] == '@') {
+    start = 1;
+  }
+
+  // name ends at the first comma, look for a write mode after it
+  for(end = start; end < length && name[end] != ','; end++);
+  for(i = end; i + 1 < length; i++) {
+    if(name[i] == ',' && (name[i + 1] == 'W' || name[i + 1] == 'A')) {
+      *writing = true;
+    }
+  }
+
+  *nameLength = end - start < VDRIVE_NAME_LENGTH ? end - start : VDRIVE_NAME_LENGTH;
+  return start;
+}
+
+// load the file named in an OPEN or a LOAD into channel, "$" or "$0:PATTERN" loads the directory
+// returns 0, -1 if there's no such file or VDRIVE_NO_MEMORY
+int32_t vdrive_loadFile(uint8_t *name, uint32_t nameLength, vdrive_channel_t *channel) {
+  bool_t writing = false;
+  uint32_t start;
+  uint32_t i;
+
+  if(nameLength > 0 && name[0] == '$') {
+    for(i = 1; i < nameLength && name[i] != ':'; i++);
+    start = i < nameLength ? i + 1 : nameLength;
+    return vdrive_loadDirectory(name + start, nameLength - start, channel);
+  }
+
+  start = vdrive_parseName(name, &nameLength, &writing);
+  return vdrive_readFile(name + start, nameLength, channel);
+}
+
+uint32_t vdrive_getDeviceNumber() {
+  return vdrive_device.number;
+}
+
+bool_t vdrive_isAttached() {
+  return vdrive_attached;
+}
+
+// a command sent on the command channel, or as the name when it's opened
+static void vdrive_runCommand(uint8_t *command, uint32_t length) {
+  bool_t writing = false;
+  uint32_t start;
+  char status[VDRIVE_STATUS_LENGTH];
+
+  // PRINT# ends the command with a return
+  while(length > 0 && command[length - 1] == '\r') {
+    length--;
+  }
+  if(length == 0) {
+    return;
+  }
+
+  switch(command[0]) {
+    case 'S':
+      // scratch, only the host's files, the d64 is read only
+      start = vdrive_parseName(command, &length, &writing);
+      sprintf(status, "01, FILES SCRATCHED,%02u,00\r", (unsigned)vdrive_scratchFiles(command + start, length));
+      vdrive_setStatus(status);
+      break;
+    case 'U':
+      // UJ and UI reset the drive
+      if(length > 1 && (command[1] == 'J' || command[1] == 'I' || command[1] == ':')) {
+        vdrive_setStatus("73,CBM DOS V2.6 1541,00,00\r");
+      } else {
+        vdrive_setStatus("00, OK,00,00\r");
+      }
+      break;
+    default:
+      // initialize, validate and the rest have nothing to do, memory commands aren't run (there's no drive cpu)
+      vdrive_setStatus("00, OK,00,00\r");
+      break;
+  }
+}
+
+// OPEN with a secondary address and a file name
+static void vdrive_open(uint32_t secondary, uint8_t *name, uint32_t nameLength) {
+  vdrive_channel_t *channel = &vdrive_channels[secondary];
+  bool_t writing = secondary == 1;
+  uint32_t fileNameLength = nameLength;
+  uint32_t start;
+  int32_t result;
+
+  if(secondary == VDRIVE_COMMAND_CHANNEL) {
+    // the name is a command
+    vdrive_setStatus("00, OK,00,00\r");
+    vdrive_runCommand(name, nameLength);
+    return;
+  }
+
+  vdrive_clearChannel(channel);
+
+  start = vdrive_parseName(name, &fileNameLength, &writing);
+  if(writing && !(nameLength > 0 && name[0] == '$')) {
+    memcpy(channel->name, name + start, fileNameLength);
+    channel->nameLength = fileNameLength;
+    channel->open = true;
+    channel->writing = true;
+    vdrive_setStatus("00, OK,00,00\r");
+    return;
+  }
+
+  result = vdrive_loadFile(name, nameLength, channel);
+  if(result == VDRIVE_NO_MEMORY) {
+    vdrive_setStatus("70,NO CHANNEL,00,00\r");
+    return;
+  }
+  if(result != 0) {
+    vdrive_setStatus("62,FILE NOT FOUND,00,00\r");
+    return;
+  }
+
+  channel->open = true;
+  vdrive_setStatus("00, OK,00,00\r");
+}
+
+static void vdrive_close(uint32_t secondary) {
+  vdrive_channel_t *channel = &vdrive_channels[secondary];
+
+  if(channel->open && channel->writing) {
+    if(vdrive_storeFile(channel->name, channel->nameLength, channel->data, channel->length) != 0) {
+      vdrive_clearChannel(channel);
+      vdrive_setStatus("72,DISK FULL,00,00\r");
+      return;
+    }
+  }
+  vdrive_clearChannel(channel);
+}
+
+
+// --- protocol ---
+
+static void vdrive_releaseBus() {
+  vdrive_cancelTimer();
+  vdrive_setLines(0, IECBUS_RELEASED);
+  vdrive_state = VDRIVE_IDLE;
+}
+
+// a command byte sent under ATN
+static void vdrive_receiveCommand(uint8_t byte) {
+  uint32_t secondary = byte & 0x0f;
+  bool_t addressed = vdrive_listening || vdrive_talking;
+
+  if(byte == 0x3f) {
+    // UNLISTEN, an OPEN is complete when the name has been sent
+    if(vdrive_listening && vdrive_opening) {
+      vdrive_open(vdrive_secondary, vdrive_command, vdrive_commandLength);
+    } else if(vdrive_listening && vdrive_secondary == VDRIVE_COMMAND_CHANNEL && vdrive_commandLength > 0) {
+      vdrive_runCommand(vdrive_command, vdrive_commandLength);
+    }
+    vdrive_listening = false;
+    vdrive_opening = false;
+    vdrive_commandLength = 0;
+  } else if(byte == 0x5f) {
+    // UNTALK
+    vdrive_talking = false;
+  } else if((byte & 0xe0) == 0x20) {
+    // LISTEN
+    if((byte & 0x1f) == vdrive_device.number) {
+      vdrive_listening = true;
+      vdrive_talking = false;
+    }
+  } else if((byte & 0xe0) == 0x40) {
+    // TALK, there's only ever one talker
+    vdrive_talking = (byte & 0x1f) == vdrive_device.number;
+    if(vdrive_talking) {
+      vdrive_listening = false;
+    }
+  } else if(addressed && (byte & 0xf0) == 0x60) {
+    // SECOND, data for a channel
+    vdrive_secondary = secondary;
+    vdrive_opening = false;
+    vdrive_commandLength = 0;
+  } else if(addressed && (byte & 0xf0) == 0xe0) {
+    // CLOSE
+    vdrive_close(secondary);
+  } else if(addressed && (byte & 0xf0) == 0xf0) {
+    // OPEN, the file name follows
+    vdrive_secondary = secondary;
+    vdrive_opening = true;
+    vdrive_commandLength = 0;
+  }
+}
+
+// a data byte sent to the drive while it's listening
+static void vdrive_receiveData(uint8_t byte) {
+  vdrive_channel_t *channel = &vdrive_channels[vdrive_secondary];
+
+  if(vdrive_opening || vdrive_secondary == VDRIVE_COMMAND_CHANNEL) {
+    if(vdrive_commandLength < VDRIVE_COMMAND_LENGTH) {
+      vdrive_command[vdrive_commandLength++] = byte;
+    }
+  } else if(channel->open && channel->writing) {
+    if(vdrive_append(channel, &byte, 1) != 0) {
+      // what was written is dropped when it's closed
+      vdrive_clearChannel(channel);
+      vdrive_setStatus("72,DISK FULL,00,00\r");
+    }
+  }
+}
+
+// start sending the next byte of the channel, if there is one
+static void vdrive_sendNextByte() {
+  vdrive_channel_t *channel = &vdrive_channels[vdrive_secondary];
+
+  if(vdrive_secondary == VDRIVE_COMMAND_CHANNEL && channel->position >= channel->length) {
+    // reading the command channel gives the status, then resets it
+    channel->length = 0;
+    channel->position = 0;
+    // with no room for the status there's nothing to send, like a channel that isn't open
+    channel->open = vdrive_append(channel, (uint8_t *)vdrive_status, strlen(vdrive_status)) == 0;
+    strcpy(vdrive_status, "00, OK,00,00\r");
+  }
+
+  // ready to send
+  vdrive_setLines(0, IECBUS_CLK);
+
+  if(!channel->open || channel->writing || channel->position >= channel->length) {
+    // nothing to send, the c64 will time out (file not found)
+    vdrive_state = VDRIVE_TX_DONE;
+    return;
+  }
+
+  vdrive_byte = channel->data[channel->position];
+  vdrive_eoi = channel->position == channel->length - 1;
+  vdrive_state = VDRIVE_TX_WAIT_LISTENER;
+  vdrive_busChanged(&vdrive_device, vdrive_bus);
+}
+
+void vdrive_busChanged(iecDevice_t *device, uint8_t bus) {
+  uint8_t fell = vdrive_bus & ~bus;
+  uint8_t rose = ~vdrive_bus & bus;
+
+  vdrive_bus = bus;
+
+  if(fell & IECBUS_ATN) {
+    // every device pulls DATA to show it's there, then listens for commands
+    vdrive_cancelTimer();
+    vdrive_atn = true;
+    vdrive_eoi = false;
+    vdrive_setLines(IECBUS_DATA, IECBUS_CLK);
+    vdrive_state = VDRIVE_RX_WAIT_READY;
+    return;
+  }
+
+  if(rose & IECBUS_ATN) {
+    vdrive_atn = false;
+    if(vdrive_talking) {
+      vdrive_state = VDRIVE_TX_TURNAROUND;
+    } else if(!vdrive_listening) {
+      vdrive_releaseBus();
+      return;
+    }
+  }
+
+  switch(vdrive_state) {
+    case VDRIVE_RX_WAIT_READY:
+      // the talker is ready to send, show we're ready for data
+      if(rose & IECBUS_CLK) {
+        vdrive_setLines(0, IECBUS_DATA);
+        vdrive_state = VDRIVE_RX_READY;
+        vdrive_setTimer(VDRIVE_EOI_TIMEOUT);
+      }
+      break;
+    case VDRIVE_RX_READY:
+    case VDRIVE_RX_EOI_ACK:
+      // first bit
+      if(fell & IECBUS_CLK) {
+        vdrive_cancelTimer();
+        vdrive_setLines(0, IECBUS_DATA);
+        vdrive_byte = 0;
+        vdrive_bitCount = 0;
+        vdrive_state = VDRIVE_RX_BITS;
+      }
+      break;
+    case VDRIVE_RX_BITS:
+      if((rose & IECBUS_CLK) && vdrive_bitCount < 8) {
+        vdrive_byte = (vdrive_byte >> 1) | (bus & IECBUS_DATA);
+        vdrive_bitCount++;
+      } else if((fell & IECBUS_CLK) && vdrive_bitCount == 8) {
+        // acknowledge the byte
+        vdrive_setLines(IECBUS_DATA, 0);
+        vdrive_state = VDRIVE_RX_WAIT_READY;
+        vdrive_eoi = false;
+
+        if(vdrive_atn) {
+          vdrive_receiveCommand(vdrive_byte);
+        } else {
+          vdrive_receiveData(vdrive_byte);
+        }
+      }
+      break;
+    case VDRIVE_TX_TURNAROUND:
+      // the c64 has released CLK and is holding DATA, swap roles
+      if(bus & IECBUS_CLK) {
+        vdrive_setLines(IECBUS_CLK, IECBUS_DATA);
+        vdrive_state = VDRIVE_TX_START;
+        vdrive_setTimer(VDRIVE_TURNAROUND_DELAY);
+      }
+      break;
+    case VDRIVE_TX_WAIT_LISTENER:
+      // the listener is ready for data
+      if(bus & IECBUS_DATA) {
+        if(vdrive_eoi) {
+          // wait for the listener to acknowledge the EOI
+          vdrive_state = VDRIVE_TX_EOI_WAIT_ACK;
+        } else {
+          vdrive_bitCount = 0;
+          vdrive_state = VDRIVE_TX_BITS;
+          vdrive_setTimer(VDRIVE_BIT_START_DELAY);
+        }
+      }
+      break;
+    case VDRIVE_TX_EOI_WAIT_ACK:
+      if(fell & IECBUS_DATA) {
+        vdrive_state = VDRIVE_TX_EOI_WAIT_RELEASE;
+      }
+      break;
+    case VDRIVE_TX_EOI_WAIT_RELEASE:
+      if(rose & IECBUS_DATA) {
+        vdrive_bitCount = 0;
+        vdrive_state = VDRIVE_TX_BITS;
+        vdrive_setTimer(VDRIVE_BIT_START_DELAY);
+      }
+      break;
+    case VDRIVE_TX_WAIT_FRAME_ACK:
+      if(fell & IECBUS_DATA) {
+        vdrive_cancelTimer();
+        vdrive_channels[vdrive_secondary].position++;
+
+        if(vdrive_eoi) {
+          // that was the last byte
+          vdrive_setLines(0, IECBUS_RELEASED);
+          vdrive_state = VDRIVE_TX_DONE;
+        } else {
+          vdrive_state = VDRIVE_TX_START;
+          vdrive_setTimer(VDRIVE_BYTE_DELAY);
+        }
+      }
+      break;
+  }
+}
+
+void vdrive_eventFunction(void *context) {
+  vdrive_timerPending = false;
+
+  switch(vdrive_state) {
+    case VDRIVE_RX_READY:
+      // the talker hasn't started the byte, it's the last one. acknowledge by pulling DATA
+      vdrive_eoi = true;
+      vdrive_setLines(IECBUS_DATA, 0);
+      vdrive_state = VDRIVE_RX_EOI_ACK;
+      vdrive_setTimer(VDRIVE_EOI_ACK_LENGTH);
+      break;
+    case VDRIVE_RX_EOI_ACK:
+      vdrive_setLines(0, IECBUS_DATA);
+      vdrive_state = VDRIVE_RX_READY;
+      break;
+    case VDRIVE_TX_START:
+      vdrive_sendNextByte();
+      break;
+    case VDRIVE_TX_BITS:
+      if(vdrive_bitCount == 16) {
+        // all bits sent, release DATA and wait for the listener to acknowledge
+        vdrive_setLines(IECBUS_CLK, IECBUS_DATA);
+        vdrive_state = VDRIVE_TX_WAIT_FRAME_ACK;
+        vdrive_setTimer(VDRIVE_FRAME_ACK_TIMEOUT);
+      } else if((vdrive_bitCount & 1) == 0) {
+        // set the bit on DATA (released for 1), with CLK low
+        uint8_t bit = (vdrive_byte >> (vdrive_bitCount >> 1)) & 1;
+        vdrive_setLines(IECBUS_CLK | (bit ? 0 : IECBUS_DATA), bit ? IECBUS_DATA : 0);
+        vdrive_bitCount++;
+        vdrive_setTimer(VDRIVE_BIT_LOW);
+      } else {
+        // bit is valid
+        vdrive_setLines(0, IECBUS_CLK);
+        vdrive_bitCount++;
+        vdrive_setTimer(VDRIVE_BIT_HIGH);
+      }
+      break;
+    case VDRIVE_TX_WAIT_FRAME_ACK:
+      // the listener has gone away
+      vdrive_releaseBus();
+      vdrive_state = VDRIVE_TX_DONE;
+      break;
+  }
+}
+
+void vdrive_init() {
+  uint32_t i;
+
+  vdrive_device.number = 8;
+  vdrive_device.lines = IECBUS_RELEASED;
+  vdrive_device.busChanged = &vdrive_busChanged;
+  vdrive_device.reset = &vdrive_reset;
+  vdrive_device.sync = NULL;
+  vdrive_device.context = NULL;
+
+  vdrive_event.event = &vdrive_eventFunction;
+  vdrive_event.context = NULL;
+  vdrive_timerPending = false;
+  vdrive_attached = false;
+
+  for(i = 0; i < VDRIVE_CHANNELS; i++) {
+    vdrive_channels[i].data = NULL;
+    vdrive_channels[i].capacity = 0;
+    vdrive_clearChannel(&vdrive_channels[i]);
+  }
+
+  vdrive_reset(&vdrive_device);
+}
+
+void vdrive_reset(iecDevice_t *device) {
+  uint32_t i;
+
+  // the clock may just have been reset, so the event may not be scheduled any more
+  vdrive_cancelTimer();
+
+  vdrive_state = VDRIVE_IDLE;
+  vdrive_bus = iecBus_getLines();
+  vdrive_atn = false;
+  vdrive_listening = false;
+  vdrive_talking = false;
+  vdrive_opening = false;
+  vdrive_secondary = 0;
+  vdrive_eoi = false;
+  vdrive_commandLength = 0;
+
+  for(i = 0; i < VDRIVE_CHANNELS; i++) {
+    vdrive_clearChannel(&vdrive_channels[i]);
+  }
+  strcpy(vdrive_status, "73,CBM DOS V2.6 1541,00,00\r");
+}
+
+// the protocol and the open channels, the d64 image and the host's files have to be loaded again
+// (the device number and lines are saved with the bus)
+void vdrive_serialize(state_t *state) {
+  vdrive_channel_t *channel;
+  uint32_t length;
+  uint32_t i;
+
+  state_event(state, &vdrive_event);
+
+  STATE_VALUE(state, vdrive_timerPending);
+  STATE_VALUE(state, vdrive_attached);
+  STATE_VALUE(state, vdrive_command);
+  STATE_VALUE(state, vdrive_commandLength);
+  STATE_VALUE(state, vdrive_status);
+  STATE_VALUE(state, vdrive_state);
+  STATE_VALUE(state, vdrive_bus);
+  STATE_VALUE(state, vdrive_atn);
+  STATE_VALUE(state, vdrive_listening);
+  STATE_VALUE(state, vdrive_talking);
+  STATE_VALUE(state, vdrive_opening);
+  STATE_VALUE(state, vdrive_secondary);
+  STATE_VALUE(state, vdrive_byte);
+  STATE_VALUE(state, vdrive_bitCount);
+  STATE_VALUE(state, vdrive_eoi);
+
+  for(i = 0; i < VDRIVE_CHANNELS && !state->error; i++) {
+    channel = &vdrive_channels[i];
+    STATE_VALUE(state, channel->open);
+    STATE_VALUE(state, channel->writing);
+    STATE_VALUE(state, channel->position);
+    STATE_VALUE(state, channel->name);
+    STATE_VALUE(state, channel->nameLength);
+
+    length = channel->length;
+    STATE_VALUE(state, length);
+    if(state->loading && !state->error) {
+      if(length > state->length) {
+        state->error = true;
+        return;
+      }
+      channel->length = 0;
+      if(length > channel->capacity) {
+        uint8_t *grown = realloc(channel->data, sizeof(uint8_t) * length);
+        if(grown == NULL) {
+          state->error = true;
+          return;
+        }
+        channel->data = grown;
+        channel->capacity = length;
+      }
+      channel->length = length;
+    }
+    state_value(state, channel->data, length);
+  }
+}
+
+
+// attach the drive to the serial bus as deviceNumber (usually 8)
+// the true drive is detached if it has the same number
+static void vdrive_attach(uint32_t deviceNumber) {
+  if(vdrive_attached) {
+    iecBus_detachDevice(&vdrive_device);
+  }
+  if(iecBus_getDevice(deviceNumber) != NULL) {
+    drive_detach();
+  }
+  vdrive_device.number = deviceNumber;
+  iecBus_attachDevice(&vdrive_device);
+  vdrive_attached = true;
+  vdrive_reset(&vdrive_device);
+}
+
+void m64_vdriveAttach(uint32_t deviceNumber) {
+  movie_record(MOVIE_VDRIVE_ATTACH, deviceNumber, 0, 0, 0, NULL, 0);
+  vdrive_attach(deviceNumber);
+}
+
+// take the drive off the bus, without recording it in a movie (for the other device taking its number)
+void vdrive_detach() {
+  if(vdrive_attached) {
+    vdrive_cancelTimer();
+    iecBus_detachDevice(&vdrive_device);
+    vdrive_attached = false;
+  }
+}
+
+void m64_vdriveDetach() {
+  movie_record(MOVIE_VDRIVE_DETACH, 0, 0, 0, 0, NULL, 0);
+  vdrive_detach();
+}
+
+static void vdrive_eject() {
+  if(vdrive_d64) {
+    free(vdrive_d64);
+    vdrive_d64 = NULL;
+  }
+  vdrive_d64Tracks = 0;
+  vdrive_dirEntryCount = 0;
+}
+
+// insert a d64 image (35 or 40 tracks, with or without error bytes), the data is copied
+// attaches the drive as device 8 if it isn't attached and nothing else is device 8
+// returns -1 if it's too short or there's no memory for the copy (the drive is left empty)
+int32_t m64_vdriveInsertD64(uint8_t *data, uint32_t dataLength) {
+  movie_record(MOVIE_VDRIVE_INSERT_D64, 0, 0, 0, 0, data, dataLength);
+  if(dataLength < VDRIVE_D64_LENGTH) {
+    return -1;
+  }
+
+  vdrive_eject();
+
+  dataLength = dataLength >= VDRIVE_D64_LENGTH_40 ? VDRIVE_D64_LENGTH_40 : VDRIVE_D64_LENGTH;
+  vdrive_d64 = malloc(sizeof(uint8_t) * dataLength);
+  if(vdrive_d64 == NULL) {
+    return -1;
+  }
+  vdrive_d64Tracks = dataLength == VDRIVE_D64_LENGTH_40 ? 40 : 35;
+  memcpy(vdrive_d64, data, dataLength);
+  vdrive_d64ReadDirectory();
+
+  if(!vdrive_attached && iecBus_getDevice(8) == NULL) {
+    vdrive_attach(8);
+  }
+  return 0;
+}
+
+void m64_vdriveEject() {
+  movie_record(MOVIE_VDRIVE_EJECT, 0, 0, 0, 0, NULL, 0);
+  vdrive_eject();
+}
+
+// add a file with a petscii name, what m64_vdriveAddFile does after converting the name (and what a movie plays back)
+int32_t vdrive_addFile(uint8_t *name, uint32_t nameLength, uint8_t *data, uint32_t dataLength) {
+  if(vdrive_storeFile(name, nameLength, data, dataLength) != 0) {
+    return -1;
+  }
+
+  if(!vdrive_attached && iecBus_getDevice(8) == NULL) {
+    vdrive_attach(8);
+  }
+  return 0;
+}
+
+// add a file (eg a prg including its load address) to the drive, the data is copied
+// name is ascii, it's converted to upper case petscii. replaces a file with the same name
+// attaches the drive as device 8 if it isn't attached and nothing else is device 8
+int32_t m64_vdriveAddFile(char *name, uint8_t *data, uint32_t dataLength) {
+  uint8_t petsciiName[VDRIVE_NAME_LENGTH];
+  uint32_t nameLength = vdrive_petsciiName(name, petsciiName);
+  uint8_t *record;
+
+  // the movie gets the converted name followed by the file
+  if(movie_status == MOVIE_RECORDING) {
+    record = malloc(sizeof(uint8_t) * (nameLength + dataLength));
+    if(record != NULL) {
+      memcpy(record, petsciiName, nameLength);
+      memcpy(record + nameLength, data, dataLength);
+      movie_record(MOVIE_VDRIVE_ADD_FILE, nameLength, 0, 0, 0, record, nameLength + dataLength);
+      free(record);
+    } else {
+      m64_movieStop();
+    }
+  }
+
+  return vdrive_addFile(petsciiName, nameLength, data, dataLength);
+}
+
+void m64_vdriveClearFiles() {
+  uint32_t i;
+
+  movie_record(MOVIE_VDRIVE_CLEAR, 0, 0, 0, 0, NULL, 0);
+  for(i = 0; i < vdrive_fileCount; i++) {
+    free(vdrive_files[i].data);
+  }
+  vdrive_fileCount = 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ *
+ */
+
+#ifndef VDRIVE_H
+#define VDRIVE_H
+
+// a virtual disk drive on the serial bus
+// it speaks the standard serial bus protocol (the one the kernal routines use) directly on the lines,
+// and serves files from an in-memory d64 image and/or a table of files added by the host
+// there is no 1541 cpu, so fast loaders that upload their own drive code won't work
+//
+// commands, sent on channel 15 or as the name it's opened with: S: scratches host files (the d64 is read only),
+// UI and UJ reset the status to the drive's version, the rest (I, V, M-W, M-E...) are answered with 00, OK and
+// otherwise ignored. running out of memory for a file gives 70, NO CHANNEL when reading and 72, DISK FULL when writing
+
+#define VDRIVE_MAX_FILES        64
+#define VDRIVE_NAME_LENGTH      16
+#define VDRIVE_CHANNELS         16
+#define VDRIVE_COMMAND_CHANNEL  15
+#define VDRIVE_STATUS_LENGTH    40
+
+// what vdrive_loadFile returns when the channel can't hold the file
+#define VDRIVE_NO_MEMORY        -2
+
+#define VDRIVE_D64_LENGTH       174848
+#define VDRIVE_D64_LENGTH_40    196608
+
+// protocol timings in cycles. a real 1541 is much slower to respond, the bit timings are
+// kept long enough that the kernal still sees every edge when badlines/sprites stall the cpu
+#define VDRIVE_EOI_TIMEOUT      200
+#define VDRIVE_EOI_ACK_LENGTH   60
+#define VDRIVE_TURNAROUND_DELAY 80
+#define VDRIVE_BYTE_DELAY       40
+#define VDRIVE_BIT_START_DELAY  20
+#define VDRIVE_BIT_LOW          80
+#define VDRIVE_BIT_HIGH         80
+#define VDRIVE_FRAME_ACK_TIMEOUT 1000
+
+// protocol states
+#define VDRIVE_IDLE               0
+#define VDRIVE_RX_WAIT_READY      1
+#define VDRIVE_RX_READY           2
+#define VDRIVE_RX_EOI_ACK         3
+#define VDRIVE_RX_BITS            4
+#define VDRIVE_TX_TURNAROUND      5
+#define VDRIVE_TX_START           6
+#define VDRIVE_TX_WAIT_LISTENER   7
+#define VDRIVE_TX_EOI_WAIT_ACK    8
+#define VDRIVE_TX_EOI_WAIT_RELEASE 9
+#define VDRIVE_TX_BITS            10
+#define VDRIVE_TX_WAIT_FRAME_ACK  11
+#define VDRIVE_TX_DONE            12
+
+struct vdrive_file_s {
+  uint8_t name[VDRIVE_NAME_LENGTH];
+  uint32_t nameLength;
+  uint8_t *data;
+  uint32_t length;
+};
+typedef struct vdrive_file_s vdrive_file_t;
+
+struct vdrive_channel_s {
+  bool_t open;
+  bool_t writing;
+
+  // bytes to send to the c64, or bytes received from it
+  uint8_t *data;
+  uint32_t length;
+  uint32_t capacity;
+  uint32_t position;
+
+  // the file name used when a write channel is closed
+  uint8_t name[VDRIVE_NAME_LENGTH];
+  uint32_t nameLength;
+};
+typedef struct vdrive_channel_s vdrive_channel_t;
+
+void vdrive_init();
+void vdrive_reset(iecDevice_t *device);
+void vdrive_serialize(state_t *state);
+
+int32_t vdrive_loadFile(uint8_t *name, uint32_t nameLength, vdrive_channel_t *channel);
+uint32_t vdrive_getDeviceNumber();
+bool_t vdrive_isAttached();
+void vdrive_detach();
+int32_t vdrive_addFile(uint8_t *name, uint32_t nameLength, uint8_t *data, uint32_t dataLength);
+
+void m64_vdriveAttach(uint32_t deviceNumber);
+void m64_vdriveDetach();
+int32_t m64_vdriveInsertD64(uint8_t *data, uint32_t dataLength);
+void m64_vdriveEject();
+int32_t m64_vdriveAddFile(char *name, uint8_t *data, uint32_t dataLength);
+void m64_vdriveClearFiles();
+
+#endif
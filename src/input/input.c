@@ -0,0 +1,176 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#include "../m64.h"
+
+// queued input, sorted by cycle, events for the same cycle stay in the order they were queued
+input_event_t input_queue[INPUT_QUEUE_LENGTH];
+uint32_t input_queueLength = 0;
+
+// one clock event, scheduled for the first input in the queue
+event_t input_clockEvent;
+
+static void input_apply(input_event_t *input) {
+  switch(input->type) {
+    case INPUT_KEY_DOWN:
+      keyboard_setKey(input->code, true);
+      break;
+    case INPUT_KEY_UP:
+      keyboard_setKey(input->code, false);
+      break;
+    case INPUT_JOYSTICK_PUSH:
+      joystick_push(&m64_joysticks[input->code & 1], input->value);
+      break;
+    case INPUT_JOYSTICK_RELEASE:
+      joystick_release(&m64_joysticks[input->code & 1], input->value);
+      break;
+    case INPUT_MOUSE_MOVE:
+      pot_mouseMove(input->code, (int16_t)(input->value & 0xffff), (int16_t)(input->value >> 16));
+      break;
+    case INPUT_PADDLE:
+      pot_setPaddle(input->code >> 1, input->code & 1, input->value);
+      break;
+  }
+}
+
+static void input_schedule() {
+  clock_cancelEvent(&m64_clock, &input_clockEvent);
+
+  if(input_queueLength > 0) {
+    clock_scheduleEventAt(&m64_clock, &input_clockEvent, input_queue[0].cycle, PHASE_PHI1);
+  }
+}
+
+// apply all the input that is due, then wait for the next
+void input_eventFunction(void *context) {
+  uint64_t now = clock_getTime(&m64_clock, PHASE_PHI2);
+  uint32_t count = 0;
+
+  while(count < input_queueLength && input_queue[count].cycle <= now) {
+    input_apply(&input_queue[count]);
+    count++;
+  }
+
+  if(count > 0) {
+    input_queueLength -= count;
+    memmove(input_queue, input_queue + count, sizeof(input_event_t) * input_queueLength);
+  }
+
+  if(input_queueLength > 0) {
+    clock_scheduleEventAt(&m64_clock, &input_clockEvent, input_queue[0].cycle, PHASE_PHI1);
+  }
+}
+
+void input_init() {
+  input_clockEvent.context = NULL;
+  input_clockEvent.event = &input_eventFunction;
+  input_queueLength = 0;
+}
+
+// cycles count from reset, so anything queued is thrown away
+// (the clock reset has already dropped the event)
+void input_reset() {
+  input_queueLength = 0;
+}
+
+// only the queued input is saved
+void input_serialize(state_t *state) {
+  uint32_t i;
+
+  state_event(state, &input_clockEvent);
+
+  STATE_VALUE(state, input_queueLength);
+  if(input_queueLength > INPUT_QUEUE_LENGTH) {
+    input_queueLength = 0;
+    state->error = true;
+    return;
+  }
+  // field by field, the struct has padding
+  for(i = 0; i < input_queueLength; i++) {
+    STATE_VALUE(state, input_queue[i].cycle);
+    STATE_VALUE(state, input_queue[i].type);
+    STATE_VALUE(state, input_queue[i].code);
+    STATE_VALUE(state, input_queue[i].value);
+  }
+}
+
+// queue input for a cycle (since reset), if the cycle has passed it's applied on the next cycle
+// returns 0 if queued, -1 if the queue is full
+int32_t input_add(uint64_t cycle, uint32_t type, uint32_t code, uint32_t value) {
+  int32_t i;
+
+  if(input_queueLength >= INPUT_QUEUE_LENGTH) {
+    return -1;
+  }
+
+  // insert after any input for the same cycle
+  i = input_queueLength;
+  while(i > 0 && input_queue[i - 1].cycle > cycle) {
+    input_queue[i] = input_queue[i - 1];
+    i--;
+  }
+
+  input_queue[i].cycle = cycle;
+  input_queue[i].type = type;
+  input_queue[i].code = code;
+  input_queue[i].value = value;
+  input_queueLength++;
+
+  if(i == 0) {
+    input_schedule();
+  }
+
+  return 0;
+}
+
+void input_clear() {
+  input_queueLength = 0;
+  clock_cancelEvent(&m64_clock, &input_clockEvent);
+}
+
+// input_add for the host, the call is recorded into a movie
+int32_t m64_queueInput(uint64_t cycle, uint32_t type, uint32_t code, uint32_t value) {
+  if(input_queueLength >= INPUT_QUEUE_LENGTH) {
+    return -1;
+  }
+  movie_record(MOVIE_QUEUE_INPUT, cycle, type, code, value, NULL, 0);
+  return input_add(cycle, type, code, value);
+}
+
+// queue input for cycles from now
+int32_t m64_queueInputAfter(uint32_t cycles, uint32_t type, uint32_t code, uint32_t value) {
+  return m64_queueInput(clock_getTime(&m64_clock, PHASE_PHI2) + cycles, type, code, value);
+}
+
+// queue input for when the beam reaches lineCycle (1 - cycles per line) of rasterLine
+// frames = 0 is the next time the beam gets there, 1 the frame after that etc
+int32_t m64_queueInputAtRaster(uint32_t frames, uint32_t rasterLine, uint32_t lineCycle, uint32_t type, uint32_t code, uint32_t value) {
+  int64_t cyclesPerFrame = vic_CYCLES_PER_LINE * vic_MAX_RASTERS;
+  int64_t position = vic_rasterY * vic_CYCLES_PER_LINE + (vic_cycle - 1);
+  int64_t target = 0;
+
+  if(rasterLine >= vic_MAX_RASTERS || lineCycle < 1 || lineCycle > vic_CYCLES_PER_LINE) {
+    return -1;
+  }
+
+  target = rasterLine * vic_CYCLES_PER_LINE + (lineCycle - 1) - position;
+  if(target <= 0) {
+    target += cyclesPerFrame;
+  }
+  target += frames * cyclesPerFrame;
+
+  return m64_queueInput(clock_getTime(&m64_clock, PHASE_PHI2) + target, type, code, value);
+}
+
+uint32_t m64_getInputQueueLength() {
+  return input_queueLength;
+}
+
+void m64_clearInputQueue() {
+  movie_record(MOVIE_CLEAR_INPUT_QUEUE, 0, 0, 0, 0, NULL, 0);
+  input_clear();
+}
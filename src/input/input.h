@@ -0,0 +1,50 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+// input events can be queued to happen at a certain cycle instead of when m64_keyPush etc are called,
+// so runs are reproducible and input can be sent ahead in batches
+
+// the types of input event
+// INPUT_KEY_DOWN/UP: code is the keyCode
+// INPUT_JOYSTICK_PUSH/RELEASE: code is the joystick port (0 or 1), value is the direction bits
+// INPUT_MOUSE_MOVE: code is the port, value is dx in the low 16 bits and dy in the high 16 bits (signed)
+// INPUT_PADDLE: code is the port * 2 + the paddle, value is the paddle value (0-255)
+#define INPUT_KEY_DOWN          0
+#define INPUT_KEY_UP            1
+#define INPUT_JOYSTICK_PUSH     2
+#define INPUT_JOYSTICK_RELEASE  3
+#define INPUT_MOUSE_MOVE        4
+#define INPUT_PADDLE            5
+
+#define INPUT_QUEUE_LENGTH 256
+
+struct input_event_s {
+  // the cycle (since reset) to apply the input, at phi1 so the cpu sees it in the same cycle
+  uint64_t cycle;
+  uint32_t type;
+  uint32_t code;
+  uint32_t value;
+};
+
+typedef struct input_event_s input_event_t;
+
+void input_init();
+void input_reset();
+void input_serialize(state_t *state);
+int32_t input_add(uint64_t cycle, uint32_t type, uint32_t code, uint32_t value);
+void input_clear();
+
+int32_t m64_queueInput(uint64_t cycle, uint32_t type, uint32_t code, uint32_t value);
+int32_t m64_queueInputAfter(uint32_t cycles, uint32_t type, uint32_t code, uint32_t value);
+int32_t m64_queueInputAtRaster(uint32_t frames, uint32_t rasterLine, uint32_t lineCycle, uint32_t type, uint32_t code, uint32_t value);
+uint32_t m64_getInputQueueLength();
+void m64_clearInputQueue();
+
+#endif
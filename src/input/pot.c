@@ -0,0 +1,151 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#include "../m64.h"
+
+uint32_t pot_device[2] = { POT_DEVICE_NONE, POT_DEVICE_NONE };
+
+// paddle values for each port, as the sid would count them
+uint8_t pot_paddles[2][2] = { { 0xff, 0xff }, { 0xff, 0xff } };
+
+// the 1351 keeps a position counter for each axis and puts bits 0-5 of it on the pot lines
+uint16_t pot_mouseX[2];
+uint16_t pot_mouseY[2];
+
+// the values latched at the end of the last window
+uint8_t pot_x = 0xff;
+uint8_t pot_y = 0xff;
+
+event_t pot_windowEvent;
+bool_t pot_windowScheduled = false;
+
+// the value a control port puts on the pot lines
+static uint8_t pot_portValue(uint32_t port, uint32_t axis) {
+  uint16_t position;
+
+  switch(pot_device[port]) {
+    case POT_DEVICE_PADDLES:
+      return pot_paddles[port][axis];
+    case POT_DEVICE_MOUSE:
+      // bits 1-6 are the position, bit 0 is noise (kept at 0 so runs are reproducible)
+      position = axis == 0 ? pot_mouseX[port] : pot_mouseY[port];
+      return (position & 0x3f) << 1;
+  }
+
+  // nothing connected, the capacitor never charges
+  return 0xff;
+}
+
+// the end of a measuring window, latch what the selected port(s) put on the lines
+void pot_windowEventFunction(void *context) {
+  uint8_t select = (cia1.regs[M6526_REG_PRA] | ~cia1.regs[M6526_REG_DDRA]) >> 6;
+  uint8_t x = 0xff;
+  uint8_t y = 0xff;
+  uint32_t port;
+
+  // with both ports selected the lower resistance charges the capacitor first
+  for(port = 0; port < 2; port++) {
+    if(select & (1 << port)) {
+      uint8_t px = pot_portValue(port, 0);
+      uint8_t py = pot_portValue(port, 1);
+      if(px < x) {
+        x = px;
+      }
+      if(py < y) {
+        y = py;
+      }
+    }
+  }
+
+  pot_x = x;
+  pot_y = y;
+
+  clock_scheduleEvent(&m64_clock, &pot_windowEvent, POT_WINDOW_CYCLES, PHASE_PHI2);
+}
+
+// windows are only timed while something is plugged in
+static void pot_schedule() {
+  bool_t needed = pot_device[0] != POT_DEVICE_NONE || pot_device[1] != POT_DEVICE_NONE;
+
+  if(needed && !pot_windowScheduled) {
+    clock_scheduleEvent(&m64_clock, &pot_windowEvent, POT_WINDOW_CYCLES, PHASE_PHI2);
+  } else if(!needed && pot_windowScheduled) {
+    clock_cancelEvent(&m64_clock, &pot_windowEvent);
+    pot_x = 0xff;
+    pot_y = 0xff;
+  }
+  pot_windowScheduled = needed;
+}
+
+void pot_init() {
+  pot_windowEvent.event = &pot_windowEventFunction;
+  pot_windowEvent.context = NULL;
+  pot_windowScheduled = false;
+}
+
+// called after the clock has been reset
+void pot_reset() {
+  pot_x = 0xff;
+  pot_y = 0xff;
+  pot_mouseX[0] = pot_mouseX[1] = 0;
+  pot_mouseY[0] = pot_mouseY[1] = 0;
+
+  pot_windowScheduled = false;
+  pot_schedule();
+}
+
+void pot_serialize(state_t *state) {
+  state_event(state, &pot_windowEvent);
+
+  STATE_VALUE(state, pot_device);
+  STATE_VALUE(state, pot_paddles);
+  STATE_VALUE(state, pot_mouseX);
+  STATE_VALUE(state, pot_mouseY);
+  STATE_VALUE(state, pot_x);
+  STATE_VALUE(state, pot_y);
+  STATE_VALUE(state, pot_windowScheduled);
+}
+
+// reg is $19 (POTX) or $1a (POTY)
+uint8_t pot_read(uint16_t reg) {
+  return reg == SID_POT_X ? pot_x : pot_y;
+}
+
+// move the mouse by host deltas (y is down the screen), the 1351 counts up for up
+void pot_mouseMove(uint32_t port, int32_t dx, int32_t dy) {
+  port &= 1;
+  pot_mouseX[port] += dx;
+  pot_mouseY[port] -= dy;
+}
+
+void pot_setPaddle(uint32_t port, uint32_t paddle, uint8_t value) {
+  pot_paddles[port & 1][paddle & 1] = value;
+}
+
+// plug paddles or a mouse into a control port (0 or 1), or unplug with POT_DEVICE_NONE
+// the paddle fire buttons are joystick left (paddle 0) and right (paddle 1),
+// the mouse buttons are joystick fire (left) and up (right), see m64_joystickPush
+void m64_setPotDevice(uint32_t port, uint32_t device) {
+  if(port > 1 || device > POT_DEVICE_MOUSE) {
+    return;
+  }
+  movie_record(MOVIE_POT_DEVICE, port, device, 0, 0, NULL, 0);
+  pot_device[port] = device;
+  pot_schedule();
+}
+
+// set a paddle (0 or 1) on a port, value is the count the sid reads (0-255)
+void m64_setPaddle(uint32_t port, uint32_t paddle, uint32_t value) {
+  movie_record(MOVIE_PADDLE, port, paddle, value, 0, NULL, 0);
+  pot_setPaddle(port, paddle, value > 0xff ? 0xff : value);
+}
+
+// move the mouse straight away, to move it at a particular cycle use the input queue (INPUT_MOUSE_MOVE)
+void m64_mouseMove(uint32_t port, int32_t dx, int32_t dy) {
+  movie_record(MOVIE_MOUSE_MOVE, port, (uint32_t)dx, (uint32_t)dy, 0, NULL, 0);
+  pot_mouseMove(port, dx, dy);
+}
@@ -0,0 +1,35 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#ifndef POT_H
+#define POT_H
+
+// paddles and the 1351 mouse, read through the POTX/POTY registers of the first sid
+// the sid measures the pots in 512 cycle windows and latches the result at the end of each window,
+// so there is one clock event per window (and none when nothing is plugged in).
+// bits 6 and 7 of cia1 port A choose which control port is connected to the sid (%01 = port 1, %10 = port 2)
+
+#define POT_WINDOW_CYCLES 512
+
+// what is plugged into a control port
+#define POT_DEVICE_NONE     0
+#define POT_DEVICE_PADDLES  1
+#define POT_DEVICE_MOUSE    2
+
+void pot_init();
+void pot_reset();
+uint8_t pot_read(uint16_t reg);
+void pot_serialize(state_t *state);
+
+void pot_mouseMove(uint32_t port, int32_t dx, int32_t dy);
+void pot_setPaddle(uint32_t port, uint32_t paddle, uint8_t value);
+
+void m64_setPotDevice(uint32_t port, uint32_t device);
+void m64_setPaddle(uint32_t port, uint32_t paddle, uint32_t value);
+void m64_mouseMove(uint32_t port, int32_t dx, int32_t dy);
+
+#endif
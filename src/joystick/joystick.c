@@ -13,15 +13,30 @@ void joystick_reset(joystick_t *joystick) {
   joystick->value = 0xff;
 }
 
+void joystick_serialize(state_t *state) {
+  STATE_VALUE(state, m64_joysticks[0].value);
+  STATE_VALUE(state, m64_joysticks[1].value);
+}
+
 uint8_t joystick_getValue(joystick_t *joystick) {
   return joystick->value;
 }
 
+void joystick_push(joystick_t *joystick, uint8_t direction) {
+  joystick->value = joystick->value | direction;
+  joystick->value = joystick->value ^ direction;
+}
+
+void joystick_release(joystick_t *joystick, uint8_t direction) {
+  joystick->value = joystick->value | direction;
+}
+
 void m64_joystickPush(uint32_t joystick, uint32_t direction) {
-  m64_joysticks[joystick].value = m64_joysticks[joystick].value | direction;
-  m64_joysticks[joystick].value = m64_joysticks[joystick].value ^ direction;
+  movie_record(MOVIE_JOYSTICK_PUSH, joystick, direction, 0, 0, NULL, 0);
+  joystick_push(&m64_joysticks[joystick], direction);
 }
 
 void m64_joystickRelease(uint32_t joystick, uint32_t direction) {
-  m64_joysticks[joystick].value = m64_joysticks[joystick].value | direction;
+  movie_record(MOVIE_JOYSTICK_RELEASE, joystick, direction, 0, 0, NULL, 0);
+  joystick_release(&m64_joysticks[joystick], direction);
 }
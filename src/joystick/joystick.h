@@ -22,9 +22,13 @@ struct joystick {
 typedef struct joystick joystick_t;
 
 void joystick_reset(joystick_t *joystick);
+void joystick_serialize(state_t *state);
 uint8_t joystick_getValue(joystick_t *joystick);
 void joystick_push(joystick_t *joystick, uint8_t direction);
 void joystick_release(joystick_t *joystick, uint8_t direction);
 
+void m64_joystickPush(uint32_t joystick, uint32_t direction);
+void m64_joystickRelease(uint32_t joystick, uint32_t direction);
+
 
 #endif
\ No newline at end of file
@@ -10,12 +10,27 @@
 key_t keyboard_keys[65];
 bool_t keyboard_keyDown[65];
 
+// the matrix as bitmasks, kept up to date as keys go up and down
+// keyboard_rowsDown[col] has a bit set for the row of each key down in that column,
+// keyboard_colsDown[row] has a bit set for the column of each key down in that row
+uint8_t keyboard_rowsDown[8];
+uint8_t keyboard_colsDown[8];
+
 void keyboard_reset() {
   uint32_t i;
 
   for(i = 0; i < 65; i++) {
     keyboard_keyDown[i] = false;
   }
+
+  memset(keyboard_rowsDown, 0, sizeof(keyboard_rowsDown));
+  memset(keyboard_colsDown, 0, sizeof(keyboard_colsDown));
+}
+
+void keyboard_serialize(state_t *state) {
+  STATE_VALUE(state, keyboard_keyDown);
+  STATE_VALUE(state, keyboard_rowsDown);
+  STATE_VALUE(state, keyboard_colsDown);
 }
 
 void keyboard_init() {
@@ -218,33 +233,75 @@ void keyboard_init() {
 
 }
 
+// set a key up or down and update the matrix
+// restore isn't in the matrix, it only has keyboard_keyDown
+void keyboard_setKey(uint32_t key, bool_t down) {
+  if(key > KEY_RESTORE) {
+    return;
+  }
+
+  keyboard_keyDown[key] = down;
+
+  if(key == KEY_RESTORE) {
+    return;
+  }
+
+  uint32_t row = keyboard_keys[key].row;
+  uint32_t col = keyboard_keys[key].col;
+
+  if(down) {
+    keyboard_rowsDown[col] |= 1 << row;
+    keyboard_colsDown[row] |= 1 << col;
+  } else {
+    keyboard_rowsDown[col] &= ~(1 << row);
+    keyboard_colsDown[row] &= ~(1 << col);
+  }
+}
+
 void m64_keyPush(uint32_t key) {
-  keyboard_keyDown[key] = true;
+  movie_record(MOVIE_KEY_DOWN, key, 0, 0, 0, NULL, 0);
+  keyboard_setKey(key, true);
 }
 
 void m64_keyRelease(uint32_t key) {
-  keyboard_keyDown[key] = false;
+  movie_record(MOVIE_KEY_UP, key, 0, 0, 0, NULL, 0);
+  keyboard_setKey(key, false);
 }
 
-uint8_t keyboard_readMatrix(uint8_t selected, bool_t wantRow) {
-  uint8_t result = 0xff;
+// set the state of every key in the matrix at once, bit n of keys is for key n (KEY_ARROW_LEFT to KEY_F7)
+// 1 = down, restore is left as it is
+void m64_setKeyboardState(uint64_t keys) {
   uint32_t i;
-  for(i = 0; i < 65; i++) {
-    if(keyboard_keyDown[i]) {
-      if(wantRow) {
-        if((selected & 1 << keyboard_keys[i].col) == 0) {
-          result &= ~(1 << keyboard_keys[i].row);
-        }
-      } else {
-        if((selected & 1 << keyboard_keys[i].row) == 0) {
-          result &= ~(1 << keyboard_keys[i].col);
-        }
-
-      }
-
-    }
+
+  movie_record(MOVIE_KEYBOARD_STATE, keys, 0, 0, 0, NULL, 0);
+  for(i = 0; i < KEY_RESTORE; i++) {
+    keyboard_setKey(i, (keys >> i) & 1);
   }
-  return result;
+}
+
+// m64_setKeyboardState with the 64 bits split in two, for hosts that can't pass 64 bit values
+void m64_setKeyboardState32(uint32_t keysLow, uint32_t keysHigh) {
+  m64_setKeyboardState(((uint64_t)keysHigh << 32) | keysLow);
+}
+
+// selected is the value on the lines driving the matrix, 0 = selected
+// if wantRow, selected is columns and the rows with a key down in a selected column are returned as 0
+// otherwise selected is rows and the columns are returned
+// (the joysticks pull lines low, so they are anded into selected and the result by cia1)
+uint8_t keyboard_readMatrix(uint8_t selected, bool_t wantRow) {
+  uint8_t *down = wantRow ? keyboard_rowsDown : keyboard_colsDown;
+  uint8_t result = 0;
+
+  if((selected & 0x01) == 0) result |= down[0];
+  if((selected & 0x02) == 0) result |= down[1];
+  if((selected & 0x04) == 0) result |= down[2];
+  if((selected & 0x08) == 0) result |= down[3];
+  if((selected & 0x10) == 0) result |= down[4];
+  if((selected & 0x20) == 0) result |= down[5];
+  if((selected & 0x40) == 0) result |= down[6];
+  if((selected & 0x80) == 0) result |= down[7];
+
+  return ~result;
 }
 
 uint8_t keyboard_readColumn(uint8_t selected) {
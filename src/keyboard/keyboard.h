@@ -84,9 +84,13 @@ typedef struct key key_t;
 
 void m64_keyPush(uint32_t key);
 void m64_keyRelease(uint32_t key);
+void m64_setKeyboardState(uint64_t keys);
+void m64_setKeyboardState32(uint32_t keysLow, uint32_t keysHigh);
+void keyboard_setKey(uint32_t key, bool_t down);
 
 void keyboard_init();
 void keyboard_reset();
+void keyboard_serialize(state_t *state);
 uint8_t keyboard_readMatrix(uint8_t selected, bool_t wantRow);
 uint8_t keyboard_readColumn(uint8_t selected);
 uint8_t keyboard_readRow(uint8_t selected);
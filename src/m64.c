@@ -4,6 +4,15 @@ int32_t m64_model;
 m6510_t m64_cpu;
 clock_t m64_clock;
 
+// set when the frame at raster line 0 has been copied to the pixel buffer by m64_update or m64_runForSamples
+int32_t m64_screenDrawn = 0;
+
+// called after every clock step of m64_update and m64_runForSamples, the call returns straight away when it
+// returns true. for hosts that stop on a condition, like the command line runner
+bool_t (*m64_stepHook)() = NULL;
+
+static void m64_resetMachine(uint32_t runUntilKernalIsReady);
+
 #define PAL_CPU_FREQUENCY  985248
 #define NTSC_CPU_FREQUENCY 1022727
 
@@ -47,7 +56,11 @@ void m64_init(int32_t model, int32_t sidModel) {
   pla_setCpu(&m64_cpu);
 
   iecBus_init();
+  vdrive_init();
+  drive_init();
   keyboard_init();
+  input_init();
+  pot_init();
 
   cia1_init(M6526_MODEL_6526);
   cia2_init(M6526_MODEL_6526);
@@ -59,7 +72,7 @@ void m64_init(int32_t model, int32_t sidModel) {
 
   sid_init(SID_8580_DIGIBOOST, clock_getCyclesPerSecond(&m64_clock));
 
-  m64_reset(0);
+  m64_resetMachine(0);
 }
 
 
@@ -86,6 +99,12 @@ void m64_runUntilKernalReady() {
       endConditionPC = 0xe0c2;
       
     }
+
+    // the state this startup gets to may have been kept from an earlier one
+    if(boot_restore()) {
+      return;
+    }
+
     while(true) {
       // run one frame (or approx 1 frame)
       // pal has 63 (cycles per line) * 312 (lines)= 19656 cycles per frame, 
@@ -97,6 +116,7 @@ void m64_runUntilKernalReady() {
           pc = m64_cpu.nextOpcodeLocation;
           // e5cd is where the kernal loops waiting for keyboard entry
           if(pc == endConditionPC) {
+            boot_save();
             return;
           }
         }
@@ -112,11 +132,13 @@ void m64_runUntilKernalReady() {
   }  
 }
 
-// hard reset, soft reset not implemented
-void m64_reset(uint32_t runUntilKernalIsReady) {
+// the calls the host can make are recorded into a movie, the machine's own resets and prg copies aren't
+static void m64_resetMachine(uint32_t runUntilKernalIsReady) {
 
   clock_reset(&m64_clock);
   keyboard_reset();
+  input_reset();
+  pot_reset();
   pla_reset();
 
   iecBus_reset();
@@ -133,14 +155,22 @@ void m64_reset(uint32_t runUntilKernalIsReady) {
   colorram_reset();
 
   sid_reset();
+  seek_discard();
+  rollback_discard();
+  rewind_discard();
 
   if(runUntilKernalIsReady) {
     m64_runUntilKernalReady();
   }
 }
 
+// hard reset, soft reset not implemented
+void m64_reset(uint32_t runUntilKernalIsReady) {
+  movie_record(MOVIE_RESET, runUntilKernalIsReady, 0, 0, 0, NULL, 0);
+  m64_resetMachine(runUntilKernalIsReady);
+}
 
-void m64_injectPrg(uint8_t *data, uint32_t dataLength) {
+static void m64_copyPrg(uint8_t *data, uint32_t dataLength) {
   uint32_t i;
   uint32_t address;
   uint32_t baseAddress = data[0];
@@ -151,6 +181,7 @@ void m64_injectPrg(uint8_t *data, uint32_t dataLength) {
     address = baseAddress + i;
     ram[address] = data[i + 2];
   }
+  systemram_setDirty();
 
   if(!kernal_getIsM64Kernal()) {
     if(baseAddress == 0x801) {
@@ -168,6 +199,12 @@ void m64_injectPrg(uint8_t *data, uint32_t dataLength) {
   }
 
 }
+
+void m64_injectPrg(uint8_t *data, uint32_t dataLength) {
+  movie_record(MOVIE_INJECT_PRG, 0, 0, 0, 0, data, dataLength);
+  m64_copyPrg(data, dataLength);
+}
+
 // just write a prg direct to system ram
 // address the prg is written is in the first 2 bytes
 // load "*",8 loads to start of basic
@@ -178,14 +215,15 @@ void m64_injectAndRunPrg(uint8_t *data, uint32_t dataLength, uint32_t delay) {
   uint32_t baseAddress = data[0];
   baseAddress += (data[1] << 8);
 
-  m64_reset(1);
+  movie_record(MOVIE_INJECT_AND_RUN, delay, 0, 0, 0, data, dataLength);
+  m64_resetMachine(1);
 
   delay = delay * 2;
   for(i = 0; i < delay; i++) {
     clock_step(&m64_clock);
   }
 
-  m64_injectPrg(data, dataLength);
+  m64_copyPrg(data, dataLength);
 
   uint8_t *ram = systemram_array();
 
@@ -245,13 +283,15 @@ void m64_injectAndRunPrg(uint8_t *data, uint32_t dataLength, uint32_t delay) {
 }
 
 void m64_loadCartridge(uint8_t *data, uint32_t dataLength) {
+  movie_record(MOVIE_LOAD_CARTRIDGE, 0, 0, 0, 0, data, dataLength);
 
   if(cartridge_read(data, dataLength) != 0) {
-    m64_reset(0);
+    m64_resetMachine(0);
   }
 }
 
 void m64_removeCartridge() {
+  movie_record(MOVIE_REMOVE_CARTRIDGE, 0, 0, 0, 0, NULL, 0);
   // cartridge init sets it to a null cartridge
   cartridge_init();  
 }
@@ -273,9 +313,43 @@ uint32_t m64_getPixelBufferHeight() {
   return 284;
 }
 
+void m64_setStepHook(bool_t (*hook)()) {
+  m64_stepHook = hook;
+}
+
+// cycles since reset
+uint64_t m64_getCycle() {
+  return clock_getTime(&m64_clock, PHASE_PHI2);
+}
+
+// m64_getCycle in two halves, for hosts that can't take 64 bit values
+uint32_t m64_getCycleLow() {
+  return m64_getCycle() & 0xffffffff;
+}
+
+uint32_t m64_getCycleHigh() {
+  return m64_getCycle() >> 32;
+}
+
+// the end of a frame, for everything that counts frames. a drawn frame goes to the pixel buffer, gets a rewind
+// snapshot and is checked or recorded by a movie, a headless one only counts for rewind
+static void m64_frameDone(bool_t drawn) {
+  if(drawn) {
+    memcpy(vic_pixelBuffer, vic_pixels, sizeof(uint32_t) * VIC_PIXELS_LENGTH);
+    rewind_frame();
+  } else {
+    rewind_skipFrame();
+  }
+  hash_frame();
+  if(drawn) {
+    movie_frame();
+  }
+  seek_frame();
+  rollback_frame();
+}
+
 int32_t m64_update(int32_t deltaTime) {
 
-  int32_t screenDrawn = 0;
   int32_t screenDrawnInUpdate = 0;
 
   uint32_t i = 0;
@@ -295,22 +369,101 @@ int32_t m64_update(int32_t deltaTime) {
   }
   endTime += clock_getTimeAndPhase(&m64_clock);
 
+  sid_updateRateControl();
+
   while(clock_getTimeAndPhase(&m64_clock) < endTime) {
     clock_step(&m64_clock);
     sid_update();
     
     if(vic_rasterY == 0 ) {
-      if(!screenDrawn) {
-        screenDrawn = 1;
+      // the flag is kept between calls, so a frame isn't counted twice when a call ends on raster line 0
+      if(!m64_screenDrawn) {
+        m64_screenDrawn = 1;
         screenDrawnInUpdate = 1;
+        m64_frameDone(true);
+      }
+    } else {
+      m64_screenDrawn = 0;
+    }
 
-        // draw the screen
-        memcpy(vic_pixelBuffer, vic_pixels, sizeof(uint32_t) * VIC_PIXELS_LENGTH);
+    if(movie_status == MOVIE_PLAYING) {
+      movie_poll();
+    }
 
+    if(m64_stepHook != NULL && m64_stepHook()) {
+      break;
+    }
+  }
+  return screenDrawnInUpdate;
+}
+
+// run to time (in half cycles, see clock_getTimeAndPhase) as fast as possible for seeking and rollback:
+// frames that end before time aren't drawn at all, the one time is in is, as it's the next to be shown
+// the sids only catch up when they are read or written or the frame is hashed
+// their samples are dropped, so the ring's write index doesn't move and the consumer doesn't hear the skipped time
+// the frames count for rewind but no rewind snapshots are taken
+void m64_runHeadless(uint64_t time) {
+  uint64_t frameLength = (uint64_t)vic_CYCLES_PER_LINE * vic_MAX_RASTERS * 2;
+
+  sid_setSilent(true);
+  vic_setSkipPixels(time > clock_getTimeAndPhase(&m64_clock) + frameLength);
+  while(clock_getTimeAndPhase(&m64_clock) < time) {
+    clock_step(&m64_clock);
+
+    if(vic_rasterY == 0) {
+      if(!m64_screenDrawn) {
+        m64_screenDrawn = 1;
+        vic_setSkipPixels(time > clock_getTimeAndPhase(&m64_clock) + frameLength);
+        m64_frameDone(false);
       }
     } else {
-      screenDrawn = 0;
+      m64_screenDrawn = 0;
     }
   }
-  return screenDrawnInUpdate;
+  sid_update();
+  sid_setSilent(false);
+  vic_setSkipPixels(false);
+}
+
+// audio driven pacing: run until the sids have written another samples frames into the ring buffer
+// so the emulation is paced by the audio output instead of wall clock time
+// samples is limited to the free space in the ring so it never overruns
+// returns the number of video frames completed along the way, the last one is in the pixel buffer
+int32_t m64_runForSamples(uint32_t samples) {
+  int32_t framesCompleted = 0;
+  uint32_t space = m64_getAudioRingBufferLength() - m64_getAudioSamplesAvailable();
+  uint32_t endIndex = 0;
+
+  if(samples > space) {
+    samples = space;
+  }
+
+  sid_updateRateControl();
+
+  endIndex = m64_getAudioWriteIndex() + samples;
+
+  while((int32_t)(endIndex - m64_getAudioWriteIndex()) > 0) {
+    clock_step(&m64_clock);
+    sid_update();
+
+    if(vic_rasterY == 0) {
+      if(!m64_screenDrawn) {
+        m64_screenDrawn = 1;
+        framesCompleted++;
+        m64_frameDone(true);
+      }
+    } else {
+      m64_screenDrawn = 0;
+    }
+
+    if(movie_status == MOVIE_PLAYING) {
+      movie_poll();
+    }
+
+    if(m64_stepHook != NULL && m64_stepHook()) {
+      break;
+    }
+  }
+
+  return framesCompleted;
 }
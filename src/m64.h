@@ -16,6 +16,15 @@ typedef uint8_t bool_t;
 #define M64_MODEL_PAL   1
 
 #include "clock/clock.h"
+#include "state/state.h"
+#include "state/hash.h"
+#include "state/rewind.h"
+#include "state/movie.h"
+#include "state/seek.h"
+#include "state/fork.h"
+#include "state/rollback.h"
+#include "state/boot.h"
+#include "state/archive.h"
 #include "cpu/m6510.h"
 #include "memory/banks.h"
 #include "memory/pla.h"
@@ -25,8 +34,13 @@ typedef uint8_t bool_t;
 #include "cartridge/cartridge.h"
 
 #include "iec/iecBus.h"
+#include "iec/vdrive.h"
+#include "drive/m6522.h"
+#include "drive/drive.h"
 #include "joystick/joystick.h"
 #include "keyboard/keyboard.h"
+#include "input/input.h"
+#include "input/pot.h"
 
 #include "cia/timer.h"
 #include "cia/m6526.h"
@@ -38,14 +52,24 @@ extern m6510_t m64_cpu;
 extern clock_t m64_clock;
 extern joystick_t m64_joysticks[2];
 extern cartridge_t m64_cartridge;
+extern int32_t m64_screenDrawn;
 
 void m64_init(int32_t model, int32_t sidModel);
 
 void m64_injectAndRunPrg(uint8_t *data, uint32_t dataLength, uint32_t delay);
 void m64_injectPrg(uint8_t *data, uint32_t dataLength);
 void m64_loadCartridge(uint8_t *data, uint32_t dataLength);
+void m64_removeCartridge();
 unsigned char *m64_getPixelBuffer();
+uint32_t m64_getPixelBufferWidth();
+uint32_t m64_getPixelBufferHeight();
+uint64_t m64_getCycle();
+uint32_t m64_getCycleLow();
+uint32_t m64_getCycleHigh();
 int32_t m64_update(int32_t deltaTime);
+int32_t m64_runForSamples(uint32_t samples);
+void m64_runHeadless(uint64_t time);
+void m64_setStepHook(bool_t (*hook)());
 
 void m64_reset(uint32_t runUntilKernalIsReady);
 
@@ -11,6 +11,12 @@ typedef void (*bank_write_function)(uint16_t address, uint8_t value);
 #define CHAR_ROM_LENGTH 0x1000
 #define KERNAL_ROM_LENGTH 0x2000
 #define BASIC_ROM_LENGTH 0x2000
+#define SYSTEM_RAM_LENGTH 0x10000
+#define COLOR_RAM_LENGTH 0x400
+
+// writes to system ram mark the page they are in, see hash.c
+#define SYSTEM_RAM_PAGE_LENGTH 0x100
+#define SYSTEM_RAM_PAGES (SYSTEM_RAM_LENGTH / SYSTEM_RAM_PAGE_LENGTH)
 
 extern uint8_t BASICROM[BASIC_ROM_LENGTH];
 extern uint8_t CHARROM[CHAR_ROM_LENGTH];
@@ -25,7 +31,9 @@ uint8_t charrom_read(uint16_t address);
 void charrom_write(uint16_t address, uint8_t value);
 
 
+uint8_t *colorram_array();
 void colorram_reset();
+void colorram_serialize(state_t *state);
 uint8_t colorram_read(uint16_t address);
 void colorram_write(uint16_t address, uint8_t value);
 
@@ -33,25 +41,40 @@ void io_setBank(uint8_t bank, bank_read_function readFunction, bank_write_functi
 uint8_t io_read(uint16_t address);
 void io_write(uint16_t address, uint8_t value);
 
+void m64_setBASICROM(uint8_t *data, uint32_t dataLength);
+void m64_setCharacterROM(uint8_t *data, uint32_t dataLength);
+void m64_setKernalROM(uint8_t *data, uint32_t dataLength);
+
 void kernal_reset();
 void kernal_init();
 bool_t kernal_getIsM64Kernal();
+void m64_setKernalLoadTrap(bool_t enabled);
 void kernal_write(uint16_t address, uint8_t value);
 uint8_t kernal_read(uint16_t address);
 
 void sidbank_reset();
+void sidbank_updateMap();
+void sidbank_serialize(state_t *state);
 void sidbank_write(uint16_t address, uint8_t value);
 uint8_t sidbank_read(uint16_t address);
+void sidbank_io1Write(uint16_t address, uint8_t value);
+uint8_t sidbank_io1Read(uint16_t address);
+void sidbank_io2Write(uint16_t address, uint8_t value);
+uint8_t sidbank_io2Read(uint16_t address);
+void m64_setSIDAddress(uint32_t index, uint32_t address);
+uint32_t m64_getSIDAddress(uint32_t index);
 
-void sidbank_setMousePortEnabled(int32_t port, uint8_t enabled);
-void sidbank_setPaddleX(uint8_t value);
-void sidbank_setPaddleY(uint8_t value);
+extern bool_t systemram_dirty[SYSTEM_RAM_PAGES];
 
 uint8_t *systemram_array();
+void systemram_setDirty();
 
 void systemram_reset();
+void systemram_serialize(state_t *state);
 void systemram_write(uint16_t address, uint8_t value);
 uint8_t systemram_read(uint16_t address);
+void m64_ramWrite(uint16_t address, uint8_t value);
+uint8_t m64_ramRead(uint16_t address);
 
 void disconnectedbus_write(uint16_t address, uint8_t value);
 uint8_t disconnectedbus_read(uint16_t address);
@@ -60,6 +83,7 @@ void colorramdisconnectedbus_write(uint16_t address, uint8_t value);
 uint8_t colorramdisconnectedbus_read(uint16_t address);
 
 void zeroram_reset();
+void zeroram_serialize(state_t *state);
 uint8_t zeroram_read(uint16_t address);
 void zeroram_write(uint16_t address, uint8_t value);
 
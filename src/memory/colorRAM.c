@@ -1,8 +1,6 @@
 
 #include "../m64.h"
 
-#define COLOR_RAM_LENGTH 0x400
-
 uint8_t COLORRAM[COLOR_RAM_LENGTH];
 
 void colorram_reset() {
@@ -12,6 +10,14 @@ void colorram_reset() {
   }
 }
 
+void colorram_serialize(state_t *state) {
+  STATE_VALUE(state, COLORRAM);
+}
+
+uint8_t *colorram_array() {
+  return COLORRAM;
+}
+
 uint8_t colorram_read(uint16_t address) {
   return COLORRAM[address & (COLOR_RAM_LENGTH - 1)];
 }
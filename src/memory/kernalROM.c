@@ -7,6 +7,11 @@ uint8_t KERNALROM[KERNAL_ROM_LENGTH];
 
 bool_t kernal_isM64Kernal = true;
 
+// LOAD is served from the virtual drive's files without running the kernal serial bus routines
+#define KERNAL_LOAD 0xffd5
+#define KERNAL_LOAD_MAX_NAME 40
+vdrive_channel_t kernal_loadChannel;
+
 void m64_setKernalROM(uint8_t *data, uint32_t dataLength) {
   if(dataLength > KERNAL_ROM_LENGTH) {
     dataLength = KERNAL_ROM_LENGTH;
@@ -324,3 +329,79 @@ void kernal_write(uint16_t address, uint8_t value) {
 uint8_t kernal_read(uint16_t address) {
   return KERNALROM[address & (KERNAL_ROM_LENGTH - 1)];
 }
+
+
+// the kernal LOAD routine ($ffd5), called with A = 0 to load or 1 to verify, X/Y = load address,
+// the file name at ($bb) with length in $b7, the device in $ba and the secondary address in $b9
+// if the virtual drive has the file, do what the kernal would and return to the caller with rts.
+// otherwise leave it to the kernal, which will report the error
+void kernal_loadTrap(m6510_t *cpu) {
+  uint8_t name[KERNAL_LOAD_MAX_NAME];
+  uint32_t nameLength = pla_cpuRead(0xb7);
+  uint32_t nameAddress = pla_cpuRead(0xbb) | (pla_cpuRead(0xbc) << 8);
+  uint32_t address;
+  uint32_t returnAddress;
+  uint8_t status = 0x40;
+  bool_t verify = cpu->registerA != 0;
+  uint32_t i;
+
+  if(kernal_isM64Kernal || !pla_isKernalMapped() || nameLength == 0 || !vdrive_isAttached() || pla_cpuRead(0xba) != vdrive_getDeviceNumber()) {
+    return;
+  }
+
+  if(nameLength > KERNAL_LOAD_MAX_NAME) {
+    nameLength = KERNAL_LOAD_MAX_NAME;
+  }
+  for(i = 0; i < nameLength; i++) {
+    name[i] = pla_cpuRead((nameAddress + i) & 0xffff);
+  }
+
+  if(vdrive_loadFile(name, nameLength, &kernal_loadChannel) != 0 || kernal_loadChannel.length < 2) {
+    return;
+  }
+
+  // secondary address 0 loads to X/Y, otherwise to the address in the file
+  if(pla_cpuRead(0xb9) == 0) {
+    address = cpu->registerX | (cpu->registerY << 8);
+  } else {
+    address = kernal_loadChannel.data[0] | (kernal_loadChannel.data[1] << 8);
+  }
+
+  pla_cpuWrite(0xc3, address & 0xff);
+  pla_cpuWrite(0xc4, address >> 8);
+
+  for(i = 2; i < kernal_loadChannel.length; i++) {
+    if(verify) {
+      if(pla_cpuRead(address) != kernal_loadChannel.data[i]) {
+        status |= 0x10;
+      }
+    } else {
+      pla_cpuWrite(address, kernal_loadChannel.data[i]);
+    }
+    address = (address + 1) & 0xffff;
+  }
+
+  // end address, status, verify flag
+  pla_cpuWrite(0xae, address & 0xff);
+  pla_cpuWrite(0xaf, address >> 8);
+  pla_cpuWrite(0x90, status);
+  pla_cpuWrite(0x93, cpu->registerA);
+
+  // returns with carry clear and the end address in X/Y
+  cpu->registerX = address & 0xff;
+  cpu->registerY = address >> 8;
+  cpu->flagC = false;
+
+  // rts
+  cpu->registerSP++;
+  returnAddress = pla_cpuRead(0x100 | cpu->registerSP);
+  cpu->registerSP++;
+  returnAddress |= pla_cpuRead(0x100 | cpu->registerSP) << 8;
+  cpu->Register_ProgramCounter = (returnAddress + 1) & 0xffff;
+}
+
+// serve LOADs from the virtual drive's device number instantly while it is on the bus, only works with a real kernal
+void m64_setKernalLoadTrap(bool_t enabled) {
+  movie_record(MOVIE_KERNAL_LOAD_TRAP, enabled, 0, 0, 0, NULL, 0);
+  m6510_setTrap(&m64_cpu, KERNAL_LOAD, enabled ? &kernal_loadTrap : NULL);
+}
@@ -238,8 +238,8 @@ void pla_updateCPUMaps() {
     } 
   }
   
-  io_setBank(14, &cartridge_io1Read, &cartridge_io1Write);
-  io_setBank(15, &cartridge_io2Read, &cartridge_io2Write);
+  io_setBank(14, &sidbank_io1Read, &sidbank_io1Write);
+  io_setBank(15, &sidbank_io2Read, &sidbank_io2Write);
 }
 
 void pla_updateVICMaps() {
@@ -297,6 +297,30 @@ void pla_reset() {
 }
 
 
+// the memory maps aren't saved, they are rebuilt from the lines
+void pla_serialize(state_t *state) {
+  state_event(state, &PLA.aecDisableEvent);
+
+  STATE_VALUE(state, PLA.LORAM);
+  STATE_VALUE(state, PLA.HIRAM);
+  STATE_VALUE(state, PLA.CHAREN);
+  STATE_VALUE(state, PLA.vicMemBase);
+  STATE_VALUE(state, PLA.ba);
+  STATE_VALUE(state, PLA.aec);
+  STATE_VALUE(state, PLA.gamePHI1);
+  STATE_VALUE(state, PLA.gamePHI2);
+  STATE_VALUE(state, PLA.exromPHI1);
+  STATE_VALUE(state, PLA.exromPHI2);
+  STATE_VALUE(state, PLA.nmiCount);
+  STATE_VALUE(state, PLA.irqCount);
+  STATE_VALUE(state, PLA.cartridgeDma);
+
+  if(state->loading) {
+    pla_updateVICMaps();
+    pla_updateCPUMaps();
+  }
+}
+
 void  pla_setCpuPort(uint8_t state) {
   PLA.LORAM = (state & 1) != 0;
   PLA.HIRAM = (state & 2) != 0;
@@ -311,10 +335,16 @@ uint8_t m64_cpuRead(uint16_t address) {
 }
 
 void m64_cpuWrite(uint16_t address, uint8_t value) {
+  movie_record(MOVIE_CPU_WRITE, address, value, 0, 0, NULL, 0);
   (PLA.cpuWriteMap[address >> 12])(address, value);
 }
 
 
+// is the kernal rom visible to the cpu at $e000-$ffff
+bool_t pla_isKernalMapped() {
+  return PLA.cpuReadMap[15] == &kernal_read;
+}
+
 uint8_t pla_cpuRead(uint16_t address) {
   return (PLA.cpuReadMap[address >> 12])(address);
 }
@@ -11,6 +11,7 @@ typedef struct cartridge cartridge_t;
 
 void pla_init();
 void pla_reset();
+void pla_serialize(state_t *state);
 
 void pla_updateVICMaps();
 void pla_updateCPUMaps();
@@ -23,8 +24,11 @@ void pla_setNMI(bool_t state);
 void pla_setIRQ(bool_t state);
 
 void pla_setCpu(m6510_t *cpu);
+bool_t pla_isKernalMapped();
 uint8_t pla_cpuRead(uint16_t address);
 void pla_cpuWrite(uint16_t address, uint8_t value);
+uint8_t m64_cpuRead(uint16_t address);
+void m64_cpuWrite(uint16_t address, uint8_t value);
 
 void pla_setVicMemBase(uint16_t base);
 
@@ -3,47 +3,124 @@
 #define SID_DEF_BASE_ADDRESS 0xd400
 #define SID_REG_COUNT 32
 
-uint8_t paddleX;
-uint8_t paddleY;
+// sid registers are 32 bytes apart, so there are 32 slots in $d400-$d7ff and 16 in $de00-$dfff
+#define SIDBANK_D400_SLOTS 32
+#define SIDBANK_SLOTS      48
+#define SIDBANK_NONE       0xff
 
-uint8_t mousePortEnabled[2];
+// address of each sid, sid 0 is always at $d400
+uint16_t sidbank_address[SID_MAX_COUNT] = { 0xd400, 0xd420, 0xd500, 0xde00 };
 
-void sidbank_setMousePortEnabled(int32_t port, uint8_t enabled) {
-  if(port < 0 || port > 1) {
-    return;
+// which sid each slot goes to
+// sid 0 is mirrored in all of $d400-$d7ff not used by another sid, $de00-$dfff slots default to the cartridge
+uint8_t sidbank_map[SIDBANK_SLOTS];
+
+void sidbank_reset() {
+  sidbank_updateMap();
+}
+
+void sidbank_serialize(state_t *state) {
+  STATE_VALUE(state, sidbank_address);
+
+  if(state->loading) {
+    sidbank_updateMap();
   }
-  mousePortEnabled[port] = enabled;
 }
 
-void sidbank_setPaddleX(uint8_t value) {
-  paddleX = value;
+// get the slot for an address in $d400-$d7ff or $de00-$dfff
+static uint32_t sidbank_slot(uint16_t address) {
+  if (address >= 0xde00) {
+    return SIDBANK_D400_SLOTS + ((address - 0xde00) >> 5);
+  }
+  return (address - SID_DEF_BASE_ADDRESS) >> 5;
 }
 
-void sidbank_setPaddleY(uint8_t value) {
-  paddleY = value;
+// rebuild the slot map from the addresses of the active sids
+void sidbank_updateMap() {
+  uint32_t i;
+
+  for (i = 0; i < SIDBANK_SLOTS; i++) {
+    sidbank_map[i] = i < SIDBANK_D400_SLOTS ? 0 : SIDBANK_NONE;
+  }
+
+  for (i = 1; i < sidCount; i++) {
+    sidbank_map[sidbank_slot(sidbank_address[i])] = i;
+  }
 }
 
-void sidbank_reset() {
+// set the address of one of the extra sids
+// address must be a multiple of $20 in $d420-$d7e0 or $de00-$dfe0
+void m64_setSIDAddress(uint32_t index, uint32_t address) {
+  if (index == 0 || index >= SID_MAX_COUNT || (address & (SID_REG_COUNT - 1))) {
+    return;
+  }
 
+  if ( (address > SID_DEF_BASE_ADDRESS && address < 0xd800) || (address >= 0xde00 && address < 0xe000) ) {
+    sidbank_address[index] = address;
+    sidbank_updateMap();
+  }
+}
+
+uint32_t m64_getSIDAddress(uint32_t index) {
+  if (index >= SID_MAX_COUNT) {
+    return 0;
+  }
+  return sidbank_address[index];
 }
 
 void sidbank_write(uint16_t address, uint8_t value) {
-  sid_write(address & (SID_REG_COUNT - 1), value);
+  sid_write(&m64_sids[sidbank_map[sidbank_slot(address)]], address & (SID_REG_COUNT - 1), value);
 }
 
 uint8_t sidbank_read(uint16_t address) {
+  uint8_t index = sidbank_map[sidbank_slot(address)];
   address = address & (SID_REG_COUNT - 1);
 
-  if(mousePortEnabled[0] || mousePortEnabled[1]) {
-    if(address == 0x19) {
-      return paddleX;
-    }
+  // paddles and the mouse are connected to the first sid
+  if(index == 0 && (address == SID_POT_X || address == SID_POT_Y)) {
+    sid_read(&m64_sids[0], address);
+    return pot_read(address);
+  }
+
+  return sid_read(&m64_sids[index], address);
+}
+
+// io1 and io2 go to the cartridge unless a sid has been mapped there
+void sidbank_io1Write(uint16_t address, uint8_t value) {
+  uint8_t index = sidbank_map[sidbank_slot(address)];
+
+  if (index == SIDBANK_NONE) {
+    cartridge_io1Write(address, value);
+  } else {
+    sid_write(&m64_sids[index], address & (SID_REG_COUNT - 1), value);
+  }
+}
+
+uint8_t sidbank_io1Read(uint16_t address) {
+  uint8_t index = sidbank_map[sidbank_slot(address)];
+
+  if (index == SIDBANK_NONE) {
+    return cartridge_io1Read(address);
+  }
+  return sid_read(&m64_sids[index], address & (SID_REG_COUNT - 1));
+}
+
+void sidbank_io2Write(uint16_t address, uint8_t value) {
+  uint8_t index = sidbank_map[sidbank_slot(address)];
 
-    if(address == 0x1a) {
-      return paddleY;
-    }
+  if (index == SIDBANK_NONE) {
+    cartridge_io2Write(address, value);
+  } else {
+    sid_write(&m64_sids[index], address & (SID_REG_COUNT - 1), value);
   }
+}
 
-  return sid_read(address & (SID_REG_COUNT - 1) );
+uint8_t sidbank_io2Read(uint16_t address) {
+  uint8_t index = sidbank_map[sidbank_slot(address)];
+
+  if (index == SIDBANK_NONE) {
+    return cartridge_io2Read(address);
+  }
+  return sid_read(&m64_sids[index], address & (SID_REG_COUNT - 1));
 }
 
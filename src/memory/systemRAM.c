@@ -1,8 +1,15 @@
 #include "../m64.h"
 
-#define SYSTEM_RAM_LENGTH 0x10000
 uint8_t SYSTEMRAM[SYSTEM_RAM_LENGTH];
 
+// pages written since the state hash last looked
+bool_t systemram_dirty[SYSTEM_RAM_PAGES];
+
+// mark every page, for when ram is changed without systemram_write
+void systemram_setDirty() {
+  memset(systemram_dirty, true, sizeof(systemram_dirty));
+}
+
 void systemram_reset() {
   int i, j;
 
@@ -14,10 +21,22 @@ void systemram_reset() {
       SYSTEMRAM[j] = 0xff;
     }
   }
+  systemram_setDirty();
+}
+
+void systemram_serialize(state_t *state) {
+  if(state->withoutSystemRam) {
+    return;
+  }
+  STATE_VALUE(state, SYSTEMRAM);
+  if(state->loading) {
+    systemram_setDirty();
+  }
 }
 
 void systemram_write(uint16_t address, uint8_t value) {
   SYSTEMRAM[address & (SYSTEM_RAM_LENGTH - 1)] = value;
+  systemram_dirty[(address & (SYSTEM_RAM_LENGTH - 1)) / SYSTEM_RAM_PAGE_LENGTH] = true;
 }
 
 uint8_t systemram_read(uint16_t address) {
@@ -25,7 +44,8 @@ uint8_t systemram_read(uint16_t address) {
 }
 
 void m64_ramWrite(uint16_t address, uint8_t value) {
-  SYSTEMRAM[address & (SYSTEM_RAM_LENGTH - 1)] = value;
+  movie_record(MOVIE_RAM_WRITE, address, value, 0, 0, NULL, 0);
+  systemram_write(address, value);
 }
 
 uint8_t m64_ramRead(uint16_t address) {
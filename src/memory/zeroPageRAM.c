@@ -129,3 +129,18 @@ void zeroram_reset() {
   ZERORAM.dataFalloffBit7 = false;
   zeroram_updateCpuPort();
 }
+
+void zeroram_serialize(state_t *state) {
+  STATE_VALUE(state, ZERORAM.dir);
+  STATE_VALUE(state, ZERORAM.data);
+  STATE_VALUE(state, ZERORAM.dataRead);
+  STATE_VALUE(state, ZERORAM.dataOut);
+  STATE_VALUE(state, ZERORAM.dataSetClkBit6);
+  STATE_VALUE(state, ZERORAM.dataSetClkBit7);
+  STATE_VALUE(state, ZERORAM.dataSetBit6);
+  STATE_VALUE(state, ZERORAM.dataSetBit7);
+  STATE_VALUE(state, ZERORAM.dataFalloffBit6);
+  STATE_VALUE(state, ZERORAM.dataFalloffBit7);
+  STATE_VALUE(state, ZERORAM.oldPortDataOut);
+  STATE_VALUE(state, ZERORAM.oldPortWriteBit);
+}
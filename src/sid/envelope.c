@@ -27,8 +27,13 @@
 
 //see notes/04-envelope.txt
 
-// Digital to Analog converter used to convert envelopeDigital to envelope
-float sid_envDAC[256]; 
+// Digital to Analog converter used to convert envelopeDigital to envelope, for each model
+float sid_envDAC[2][256]; 
+
+#ifdef SID_FIXEDPOINT
+// sid_envDAC rounded to SID_LEVEL_SHIFT fixed point
+int32_t sid_envDACFixed[2][256];
+#endif
 
 // number of cycles between increments of envelope rate counter
 // see envelope rates in programmers reference guide
@@ -62,11 +67,14 @@ uint16_t sid_envelope_rate_periods[16] = {
 // digital envelope goes from 0 to 0xff
 // BOB YANNES: The 8-bit output of the Envelope Generator was then sent to the Multiplying D/A converter to modulate the amplitude of  the selected Oscillator Waveform
 // use sid_envDAC to convert from voice->envelopeDigital to voice->envelope
-void sid_envelope_buildDAC(float nonlinearity) {
+void sid_envelope_buildDAC(uint32_t model, float nonlinearity) {
   uint32_t i;
 
   for (i = 0; i < 256; i++) {
-    sid_envDAC[i] = sid_kinkedDac(i, nonlinearity, 8);
+    sid_envDAC[model][i] = sid_kinkedDac(i, nonlinearity, 8);
+#ifdef SID_FIXEDPOINT
+    sid_envDACFixed[model][i] = SID_TO_LEVEL(sid_envDAC[model][i]);
+#endif
   }
 }
 
@@ -159,7 +167,7 @@ void sid_voice_envelope_clock(sid_voice_t *voice) {
       }
 
       // convert it through the dac
-      voice->envelope = voice->muted ? 0 : sid_envDAC[voice->envelopeDigital & 0xff];
+      voice->envelope = voice->muted ? 0 : SID_ENVDAC[voice->model][voice->envelopeDigital & 0xff];
     }
   }
 }
@@ -26,91 +26,95 @@
 #include "../m64.h"
 
 
-extern sid_t m64_sid;
 extern float sid_cpuCyclesPerSecond;
 
 // 6581
 float sid_nonlinearity = 3.3e6;
 
-float low_pass;	// previous low pass output
-float band_pass;	// previous band pass output
-	
 float cutoff_ratio_8580;
 float cutoff_ratio_6581;
 float cutoff_bias_6581;
 
-float cutoff;
-float resonance; 	// convenience calculated from the above
-
-	// is set in resetFilter..
-float sid_nlvoice = 0;// 0.96;
-
 // settings for type 4
 float sid_type4k       = 5.7;
 float sid_type4b       = 20;
-float sid_type4cache = 0;
-float sid_oneDivQ4   = 0;
 
 // both
 float sid_resfactor    = 1.0;
 
-void sid_resetFilter() {
-
-  int32_t i = 0;
+#ifdef SID_FIXEDPOINT
+// 6581 resonance, pow(2.0, (4.0 - res) / 8) for each res
+const int32_t sid_resonanceTable[16] = {
+  1482910, 1359835, 1246974, 1143480, 1048576, 961548, 881744, 808563, 
+  741455, 679917, 623487, 571740, 524288, 480774, 440872, 404281 
+};
 
-  low_pass = 0;
-  band_pass = 0;
+#define SID_FIXED_MUL(a, b) ((int32_t)(((int64_t)(a) * (b)) >> SID_FIXED_SHIFT))
 
-  cutoff_ratio_8580 = 0;
-  cutoff_ratio_6581 = 0;
-  cutoff_bias_6581 = 0;
+// convert a coefficient to fixed point
+static int32_t sid_toFixed(double value) {
+  return (int32_t)(value * (1 << SID_FIXED_SHIFT) + 0.5);
+}
 
-  cutoff = 0;
-  resonance = 0;
+// 1 - exp(x) for the small negative x used by the 6581 cutoff
+// a series instead of exp(), libm results differ between platforms
+static double sid_oneMinusExp(double x) {
+  double term = x;
+  double sum = 0;
+  int32_t i;
 
-  // put this into sid set model?
-  float nonlinearity = sid_nlvoice;
-  if (m64_sid.sid_model == SID_8580) {
-    sid_nlvoice = 1.0;
-  } else {
-    sid_nlvoice = 0.96;
-  }
-  if (sid_nlvoice != nonlinearity) {
-    sid_setNonlinearity(sid_nlvoice);
+  for (i = 2; i < 10; i++) {
+    sum -= term;
+    term = term * x / i;
   }
 
+  return sum;
+}
+#endif
+
+void sid_resetFilter(sid_t *sid) {
+
+  sid->sid_f_lowPass = 0;
+  sid->sid_f_bandPass = 0;
+
+  sid->sid_f_cutoff = 0;
+  sid->sid_f_resonance = 0;
+
   sid_recalculate();
-  sid_updateCenter();
-  sid_updateResonance();
+  sid_updateCenter(sid);
+  sid_updateResonance(sid);
 
 }
 
-float sid_clock6581(float v1, float v2, float v3, int32_t inp) {
+#ifndef SID_FIXEDPOINT
+
+float sid_clock6581(sid_t *sid, float v1, float v2, float v3, int32_t inp) {
   
   float di = 0;
   float output = 0;  // final
   float filterInput = 0;  // input to filter
+  float filterOutput = 0;  // just the filter's part of the output, for the stems
 
-  if (m64_sid.sid_filt1) { 
+  if (sid->sid_filt1) { 
     filterInput += v1;
   } else { 
     output += v1; 
   }
 
-  if (m64_sid.sid_filt2) { 
+  if (sid->sid_filt2) { 
     filterInput += v2; 
   } else { 
     output += v2; 
   }
 
-  if (m64_sid.sid_filt3) {
+  if (sid->sid_filt3) {
     // voice 3 not silenced by voice 3 off if routed through filter
     filterInput += v3;
-  } else if (m64_sid.sid_voice3off) {
+  } else if (sid->sid_voice3off) {
     output += v3;
   }
 
-  if (m64_sid.sid_filtE) { 
+  if (sid->sid_filtE) { 
     filterInput += inp; 
   } else { 
     output += inp; 
@@ -124,28 +128,32 @@ Vbp -= w0 * Vhp
 Vhp = Vbp / Q - Vlp - Vi
 */
 
-  float tmp = filterInput + band_pass * resonance + low_pass;
+  float tmp = filterInput + sid->sid_f_bandPass * sid->sid_f_resonance + sid->sid_f_lowPass;
 		
-	if (m64_sid.sid_f_hp) { 
+	if (sid->sid_f_hp) { 
     output -= tmp;
+    filterOutput -= tmp;
   } 
 		
-  tmp = band_pass - tmp * cutoff;
-  band_pass = tmp;
+  tmp = sid->sid_f_bandPass - tmp * sid->sid_f_cutoff;
+  sid->sid_f_bandPass = tmp;
 		
-	if (m64_sid.sid_f_bp) { 
+	if (sid->sid_f_bp) { 
     output += tmp; 
+    filterOutput += tmp;
   }	// make it look like reSID (even if it might be wrong) fixme: check if 6581 and 8580 do this differently
 		
-	tmp = low_pass + tmp * cutoff;
-	low_pass = tmp;
+	tmp = sid->sid_f_lowPass + tmp * sid->sid_f_cutoff;
+	sid->sid_f_lowPass = tmp;
 		
-	if (m64_sid.sid_f_lp) { 
+	if (sid->sid_f_lp) { 
     output += tmp; 
+    filterOutput += tmp;
   }
+  sid->sid_f_output = filterOutput;
 
 
-  output *= m64_sid.sid_f_vol;
+  output *= sid->sid_f_vol;
 
   if (output > sid_nonlinearity) {
     output -= ((output - sid_nonlinearity) * 0.5);
@@ -154,19 +162,20 @@ Vhp = Vbp / Q - Vlp - Vi
   return output;
 }
 
-float sid_clock8580(float v1, float v2, float v3, int32_t inp) {
+float sid_clock8580(sid_t *sid, float v1, float v2, float v3, int32_t inp) {
   float output = 0;  // final
   float filterInput = 0;  // input to the filter
+  float filterOutput = 0;  // just the filter's part of the output, for the stems
 
 
-  if (m64_sid.sid_filt1) { 
+  if (sid->sid_filt1) { 
     filterInput += v1;
   } else { 
     output += v1; 
 
   }
 
-  if (m64_sid.sid_filt2) { 
+  if (sid->sid_filt2) { 
     filterInput += v2; 
 
   } else { 
@@ -174,15 +183,15 @@ float sid_clock8580(float v1, float v2, float v3, int32_t inp) {
 
   }
 
-  if (m64_sid.sid_filt3) {
+  if (sid->sid_filt3) {
     // voice 3 not silenced by voice 3 off if routed through filter
     filterInput += v3;
-  } else if (m64_sid.sid_voice3off) {
+  } else if (sid->sid_voice3off) {
     output += v3;
   }
 
 
-  if (m64_sid.sid_filtE) { 
+  if (sid->sid_filtE) { 
     filterInput += inp; 
   } else { 
     output += inp; 
@@ -197,26 +206,152 @@ Vbp -= w0 * Vhp
 Vhp = Vbp / Q - Vlp - Vi
 */
 
-  m64_sid.sid_f_vlp += (m64_sid.sid_f_vbp * sid_type4cache);
-  m64_sid.sid_f_vbp += (m64_sid.sid_f_vhp * sid_type4cache);
-  m64_sid.sid_f_vhp = ((-m64_sid.sid_f_vbp * sid_oneDivQ4) - m64_sid.sid_f_vlp - filterInput);
+  sid->sid_f_vlp += (sid->sid_f_vbp * sid->sid_f_type4cache);
+  sid->sid_f_vbp += (sid->sid_f_vhp * sid->sid_f_type4cache);
+  sid->sid_f_vhp = ((-sid->sid_f_vbp * sid->sid_f_oneDivQ4) - sid->sid_f_vlp - filterInput);
+
+  if (sid->sid_f_lp) { 
+    output += sid->sid_f_vlp; 
+    filterOutput += sid->sid_f_vlp;
+  }
+
+  if (sid->sid_f_bp) { 
+    output += sid->sid_f_vbp; 
+    filterOutput += sid->sid_f_vbp;
+  }
+
+  if (sid->sid_f_hp) { 
+    output += sid->sid_f_vhp; 
+    filterOutput += sid->sid_f_vhp;
+  }
+  sid->sid_f_output = filterOutput;
+
+
+  return output * sid->sid_f_vol;
+}
+
+#else
+
+int32_t sid_clock6581(sid_t *sid, int32_t v1, int32_t v2, int32_t v3, int32_t inp) {
+  
+  int32_t output = 0;  // final
+  int32_t filterInput = 0;  // input to filter
+  int32_t filterOutput = 0;  // just the filter's part of the output, for the stems
+
+  if (sid->sid_filt1) { 
+    filterInput += v1;
+  } else { 
+    output += v1; 
+  }
+
+  if (sid->sid_filt2) { 
+    filterInput += v2; 
+  } else { 
+    output += v2; 
+  }
+
+  if (sid->sid_filt3) {
+    // voice 3 not silenced by voice 3 off if routed through filter
+    filterInput += v3;
+  } else if (sid->sid_voice3off) {
+    output += v3;
+  }
+
+  if (sid->sid_filtE) { 
+    filterInput += inp; 
+  } else { 
+    output += inp; 
+  }
+
+  // same as the float version
+  int32_t tmp = filterInput + SID_FIXED_MUL(sid->sid_f_bandPass, sid->sid_f_resonanceFixed) + sid->sid_f_lowPass;
+
+  if (sid->sid_f_hp) { 
+    output -= tmp;
+    filterOutput -= tmp;
+  } 
+
+  tmp = sid->sid_f_bandPass - SID_FIXED_MUL(tmp, sid->sid_f_cutoffFixed);
+  sid->sid_f_bandPass = tmp;
+
+  if (sid->sid_f_bp) { 
+    output += tmp; 
+    filterOutput += tmp;
+  }
+
+  tmp = sid->sid_f_lowPass + SID_FIXED_MUL(tmp, sid->sid_f_cutoffFixed);
+  sid->sid_f_lowPass = tmp;
+
+  if (sid->sid_f_lp) { 
+    output += tmp; 
+    filterOutput += tmp;
+  }
+  sid->sid_f_output = filterOutput;
+
+  output = (int32_t)(((int64_t)output * sid->sid_volume) / 15);
+
+  if (output > (int32_t)sid_nonlinearity) {
+    output -= ((output - (int32_t)sid_nonlinearity) >> 1);
+  }
+
+  return output;
+}
+
+int32_t sid_clock8580(sid_t *sid, int32_t v1, int32_t v2, int32_t v3, int32_t inp) {
+  int32_t output = 0;  // final
+  int32_t filterInput = 0;  // input to the filter
+  int32_t filterOutput = 0;  // just the filter's part of the output, for the stems
 
-  if (m64_sid.sid_f_lp) { 
-    output += m64_sid.sid_f_vlp; 
+  if (sid->sid_filt1) { 
+    filterInput += v1;
+  } else { 
+    output += v1; 
   }
 
-  if (m64_sid.sid_f_bp) { 
-    output += m64_sid.sid_f_vbp; 
+  if (sid->sid_filt2) { 
+    filterInput += v2; 
+  } else { 
+    output += v2; 
   }
 
-  if (m64_sid.sid_f_hp) { 
-    output += m64_sid.sid_f_vhp; 
+  if (sid->sid_filt3) {
+    // voice 3 not silenced by voice 3 off if routed through filter
+    filterInput += v3;
+  } else if (sid->sid_voice3off) {
+    output += v3;
   }
 
+  if (sid->sid_filtE) { 
+    filterInput += inp; 
+  } else { 
+    output += inp; 
+  }
+
+  sid->sid_f_vlp += SID_FIXED_MUL(sid->sid_f_vbp, sid->sid_f_type4cacheFixed);
+  sid->sid_f_vbp += SID_FIXED_MUL(sid->sid_f_vhp, sid->sid_f_type4cacheFixed);
+  sid->sid_f_vhp = SID_FIXED_MUL(-sid->sid_f_vbp, sid->sid_f_oneDivQ4Fixed) - sid->sid_f_vlp - filterInput;
+
+  if (sid->sid_f_lp) { 
+    output += sid->sid_f_vlp; 
+    filterOutput += sid->sid_f_vlp;
+  }
 
-  return output * m64_sid.sid_f_vol;
+  if (sid->sid_f_bp) { 
+    output += sid->sid_f_vbp; 
+    filterOutput += sid->sid_f_vbp;
+  }
+
+  if (sid->sid_f_hp) { 
+    output += sid->sid_f_vhp; 
+    filterOutput += sid->sid_f_vhp;
+  }
+  sid->sid_f_output = filterOutput;
+
+  return (int32_t)(((int64_t)output * sid->sid_volume) / 15);
 }
 
+#endif
+
 void sid_recalculate() {
   
   // 8580 
@@ -224,31 +359,49 @@ void sid_recalculate() {
 
   // 6581: old cSID impl
   cutoff_ratio_6581 = ((double)-2.0) * 3.1415926535897932385 * (20000.0 / 2048) / sid_cpuCyclesPerSecond;
+#ifdef SID_FIXEDPOINT
+  cutoff_bias_6581 = sid_oneMinusExp(-2 * 3.14 * 220 / sid_cpuCyclesPerSecond);
+#else
   cutoff_bias_6581 = 1 - exp(-2 * 3.14 * 220 / sid_cpuCyclesPerSecond); //around 220Hz below threshold
+#endif
 }
 
-void sid_updateCenter() {
+void sid_updateCenter(sid_t *sid) {
 
-  if (m64_sid.sid_model == SID_6581) {
-    cutoff = m64_sid.sid_f_cut + 1;
-    cutoff = (cutoff_bias_6581 + ((cutoff < 192) ? 0 : 1 - exp((cutoff - 192) * cutoff_ratio_6581)));
+  if (sid->sid_model == SID_6581) {
+    sid->sid_f_cutoff = sid->sid_f_cut + 1;
+#ifdef SID_FIXEDPOINT
+    sid->sid_f_cutoff = (cutoff_bias_6581 + ((sid->sid_f_cutoff < 192) ? 0 : sid_oneMinusExp((sid->sid_f_cutoff - 192) * cutoff_ratio_6581)));
+    sid->sid_f_cutoffFixed = sid_toFixed(sid->sid_f_cutoff);
+#else
+    sid->sid_f_cutoff = (cutoff_bias_6581 + ((sid->sid_f_cutoff < 192) ? 0 : 1 - exp((sid->sid_f_cutoff - 192) * cutoff_ratio_6581)));
+#endif
     
   } else {
     // +1 is meant to model that even a 0 cutoff will still let through some signal..
-    cutoff = m64_sid.sid_f_cut + 1;		
-    cutoff = 1.0 - exp(cutoff * cutoff_ratio_8580);
+    sid->sid_f_cutoff = sid->sid_f_cut + 1;		
+    sid->sid_f_cutoff = 1.0 - exp(sid->sid_f_cutoff * cutoff_ratio_8580);
 
-    sid_type4cache = (6.283185307179586 * ((sid_type4k * (float)m64_sid.sid_f_cut) + sid_type4b)) / sid_cpuCyclesPerSecond;    
+    sid->sid_f_type4cache = (6.283185307179586 * ((sid_type4k * (float)sid->sid_f_cut) + sid_type4b)) / sid_cpuCyclesPerSecond;    
+#ifdef SID_FIXEDPOINT
+    sid->sid_f_type4cacheFixed = sid_toFixed(sid->sid_f_type4cache);
+#endif
   }
 
 }
   
-void sid_updateResonance() {
+void sid_updateResonance(sid_t *sid) {
 
-  if(m64_sid.sid_model == SID_6581) {
-  	resonance = pow(2.0, ((4.0 - m64_sid.sid_f_res) / 8));				// i.e. 1.41 to 0.39
+  if(sid->sid_model == SID_6581) {
+  	sid->sid_f_resonance = pow(2.0, ((4.0 - sid->sid_f_res) / 8));				// i.e. 1.41 to 0.39
+#ifdef SID_FIXEDPOINT
+    sid->sid_f_resonanceFixed = sid_resonanceTable[(int32_t)sid->sid_f_res & 15];
+#endif
   } else {
-    sid_oneDivQ4 = 1 / (0.707 + ((m64_sid.sid_f_res * sid_resfactor) / 15));
+    sid->sid_f_oneDivQ4 = 1 / (0.707 + ((sid->sid_f_res * sid_resfactor) / 15));
+#ifdef SID_FIXEDPOINT
+    sid->sid_f_oneDivQ4Fixed = sid_toFixed(sid->sid_f_oneDivQ4);
+#endif
 
 //    resonance = ((m64_sid.sid_f_res > 0x5) ? 8.0 / (m64_sid.sid_f_res) : 1.41);
   }
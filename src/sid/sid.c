@@ -32,7 +32,7 @@
 //  waveforms are generated digitally and then converted to an analog signal through a 12 bit R–2R Ladder.
 // https://en.wikipedia.org/wiki/Resistor_ladder
 // In the MOS 6581 the DACs are far from perfect, unbalanced resistors and missing terminator, giving a non-linear conversion while in the 8580 the quality has been improved.
-float sid_waveDac[12];
+float sid_waveDac[2][12];
 
 
 
@@ -54,47 +54,106 @@ float sid_externalHighPassFilter_w0 = 0;
 // external lowpass cutoff freq
 float sid_externalLowPassFilter_w0 = 0;
 
-// external highpass voltage
-float sid_externalHighPassFilter_v = 0;
+#ifdef SID_FIXEDPOINT
+// fixed point versions of the external filter cutoffs, in SID_FIXED_SHIFT fixed point
+int32_t sid_externalHighPassFilter_w0Fixed = 0;
+int32_t sid_externalLowPassFilter_w0Fixed = 0;
+#endif
 
-// external lowpass voltage
-float sid_externalLowPassFilter_v = 0;
+// scale from sid output to the -1 to 1 range of the audio buffer
+#define SID_AUDIOSCALE 0.00006  //0.000030517578125
 
 uint32_t SIDAUDIOBUFFERLENGTH = 4096;
 
-// the output audio buffer, m64_getAudioBuffer will copy samples into this buffer
-float sid_audioBuffer[SIDAUDIOBUFFERLENGTHMAX];
+// SID_AUDIOFORMAT_FLOAT32 or SID_AUDIOFORMAT_INT16
+uint32_t sid_audioFormat = SID_AUDIOFORMAT_FLOAT32;
 
-// number of cycles per sample * 1024  (m64 freq/sample freq * 1024)
-float sid_cycles    = 0;
+// the output audio buffer, m64_getAudioBuffer will copy samples into this buffer
+union {
+  float f[SIDAUDIOBUFFERLENGTHMAX * SID_MAX_COUNT];
+  int16_t s[SIDAUDIOBUFFERLENGTHMAX * SID_MAX_COUNT];
+} sid_audioBuffer;
+
+// ring buffer of samples written by all the sids, interleaved, sid n is channel n
+union {
+  float f[SIDBUFFERLENGTH * SID_MAX_COUNT];
+  int16_t s[SIDBUFFERLENGTH * SID_MAX_COUNT];
+} sid_buffer;
+
+// ring buffer indexes in frames, only the emulator writes sid_writeIndex, only the consumer writes sid_readIndex
+sid_ringIndex_t sid_writeIndex;
+sid_ringIndex_t sid_readIndex;
+
+// planar stem buffer, NULL when stems are off
+float *sid_stemBuffer = NULL;
+
+// number of frames dropped because the ring was full
+uint32_t sid_overruns;
+
+// while set the sids run but their samples are dropped without touching the ring (running headless),
+// only the voices are clocked, the output and filters wait for the sound to come back
+bool_t sid_silent = false;
+
+// resampler position, shared so all the sids write the same number of samples
+sid_value_t sid_s_offset;
+
+// last time sid clock was called..
+int64_t sid_lastUpdate;
+
+// the resampler counts in 1/SID_RESAMPLE_ONE of a cycle
+// in fixed point it counts in smaller steps so the integer ratio is as precise as the float one
+#ifdef SID_FIXEDPOINT
+#define SID_RESAMPLE_SHIFT 20
+#else
+#define SID_RESAMPLE_SHIFT 10
+#endif
+#define SID_RESAMPLE_ONE (1 << SID_RESAMPLE_SHIFT)
+
+// number of cycles per sample * SID_RESAMPLE_ONE  (m64 freq/sample freq * SID_RESAMPLE_ONE)
+sid_value_t sid_cycles    = 0;
+// sid_cycles before any adjustment by the rate control
+sid_value_t sid_cyclesNominal = 0;
+
+// dynamic rate control: number of frames to keep waiting in the ring buffer, 0 = off
+uint32_t sid_targetLatency = 0;
 float sid_cpuCyclesPerSecond = 0;
 
 // samples per second for audio output
 // this value should be overridden on setup
 float sid_samplesPerSecond = 48000;
 
-sid_t m64_sid;
+sid_t m64_sids[SID_MAX_COUNT];
 uint32_t sidCount = 1;
 
+// the tables for each model only need to be built once
+bool_t sid_tablesBuilt = false;
 
-void sid_init(int model, float cpuCyclesPerSecond) {
-
+void sid_initInstance(sid_t *sid, int model) {
   // init to -1 so setModel will detect the change
-  m64_sid.sid_model = -1;
+  sid->sid_model = -1;
 
-  sid_enableFilter(true);
+  sid_enableFilter(sid, true);
 
+  sid_mute(sid, 0, false);
+  sid_mute(sid, 1, false);
+  sid_mute(sid, 2, false);
+  sid_mute(sid, 3, false);
 
-  sid_mute(0, false);
-  sid_mute(1, false);
-  sid_mute(2, false);
-  sid_mute(3, false);
+  m64_setSIDModelAt(sid - m64_sids, model);
+  sid_resetInstance(sid);
+}
 
-  m64_setSIDModel(model);
-  sid_reset();
+void sid_init(int model, float cpuCyclesPerSecond) {
+  uint32_t i;
 
   sid_cpuCyclesPerSecond = cpuCyclesPerSecond;
 
+  if (!sid_tablesBuilt) {
+    sid_setNonlinearity(SID_6581, 0.96);
+    sid_setNonlinearity(SID_8580, 1.0);
+    sid_tablesBuilt = true;
+  }
+
 /*
 		w0hp = (float) (100 / frequency);
 		w0lp = (float) (LOWPASS_FREQUENCY * 2.f * Math.PI / frequency);
@@ -107,158 +166,369 @@ void sid_init(int model, float cpuCyclesPerSecond) {
   sid_externalHighPassFilter_w0 = 100 / sid_cpuCyclesPerSecond;
   sid_externalLowPassFilter_w0 = 100000 / sid_cpuCyclesPerSecond; //1000 * sid_externalHighPassFilter_w0;
 
+#ifdef SID_FIXEDPOINT
+  sid_externalHighPassFilter_w0Fixed = (int32_t)(sid_externalHighPassFilter_w0 * (1 << SID_FIXED_SHIFT) + 0.5);
+  sid_externalLowPassFilter_w0Fixed = (int32_t)(sid_externalLowPassFilter_w0 * (1 << SID_FIXED_SHIFT) + 0.5);
+#endif
+
   sid_recalculate();
-  sid_updateCenter();
 
+  for (i = 0; i < SID_MAX_COUNT; i++) {
+    sid_initInstance(&m64_sids[i], model);
+  }
+
+  sid_reset();
 }
-  
-void sid_reset() {
-  m64_sid.sid_bus    = 0;
-  m64_sid.sid_busTTL = 0;
+
+void sid_resetInstance(sid_t *sid) {
+  sid->sid_bus    = 0;
+  sid->sid_busTTL = 0;
 
   // external output
-  sid_externalHighPassFilter_v = 0;
-  sid_externalLowPassFilter_v = 0;
+  sid->sid_externalHighPassFilter_v = 0;
+  sid->sid_externalLowPassFilter_v = 0;
+#ifdef SID_FIXEDPOINT
+  sid->sid_externalHighPassFilter_vFixed = 0;
+  sid->sid_externalLowPassFilter_vFixed = 0;
+#endif
 
-  int32_t i;
-  for(i = 0; i < SIDBUFFERLENGTH; i++) {
-    m64_sid.sid_buffer[i] = 0;
+  sid->sid_s_cached  = 0;
+  memset(sid->sid_stem_cached, 0, sizeof(sid->sid_stem_cached));
+
+  sid_voice_reset(&(sid->sid_voice[0]));
+  sid_voice_reset(&(sid->sid_voice[1]));
+  sid_voice_reset(&(sid->sid_voice[2]));
+
+
+  sid->sid_filter = 0;
+  sid->sid_filt1 = 0;
+  sid->sid_filt2 = 0;
+  sid->sid_filt3 = 0;
+  sid->sid_filtE = 0;
+
+  sid->sid_f_bp  = 0;
+  sid->sid_f_hp  = 0;
+  sid->sid_f_lp  = 0;
+
+  sid->sid_f_vlp = 0;
+  sid->sid_f_vbp = 0;
+  sid->sid_f_vhp = 0;
+  sid->sid_f_output = 0;
+
+  sid->sid_f_cut = 0;
+  sid->sid_f_res = 0;
+  sid->sid_f_vol = 0;
+  sid->sid_volume = 0;
+
+  sid->sid_voice3off = 1;
+
+  sid_updateCenter(sid);
+  sid_updateResonance(sid);
+
+}
+
+// clear the output buffer and line up the resampler of every sid
+void sid_resetBuffer() {
+  uint32_t i;
+
+  memset(&sid_buffer, 0, sizeof(sid_buffer));
+  SID_RING_STORE(sid_writeIndex, 0);
+  SID_RING_STORE(sid_readIndex, 0);
+  sid_overruns = 0;
+  sid_s_offset  = 0;
+
+  if (sid_stemBuffer) {
+    memset(sid_stemBuffer, 0, sizeof(float) * SID_MAX_COUNT * SID_STEM_COUNT * SIDBUFFERLENGTH);
   }
-  m64_sid.sid_bufferPos = 0;
-  m64_sid.sid_s_cached  = 0;
-  m64_sid.sid_s_offset  = 0;
 
-  
-  m64_sid.sid_lastUpdate = clock_getTime(&m64_clock, 1);
+  for (i = 0; i < SID_MAX_COUNT; i++) {
+    m64_sids[i].sid_s_cached = 0;
+    memset(m64_sids[i].sid_stem_cached, 0, sizeof(m64_sids[i].sid_stem_cached));
+  }
+}
 
-  sid_voice_reset(&(m64_sid.sid_voice[0]));
-  sid_voice_reset(&(m64_sid.sid_voice[1]));
-  sid_voice_reset(&(m64_sid.sid_voice[2]));
+void sid_reset() {
+  uint32_t i;
 
+  for (i = 0; i < SID_MAX_COUNT; i++) {
+    sid_resetInstance(&m64_sids[i]);
+  }
 
-  m64_sid.sid_f_bp  = 0;
-  m64_sid.sid_f_hp  = 0;
-  m64_sid.sid_f_lp  = 0;
+  sid_resetBuffer();
 
-  m64_sid.sid_f_vlp = 0;
-  m64_sid.sid_f_vbp = 0;
-  m64_sid.sid_f_vhp = 0;
+  sid_lastUpdate = clock_getTime(&m64_clock, 1);
+}
 
-  m64_sid.sid_f_cut = 0;
-  m64_sid.sid_f_res = 0;
-  m64_sid.sid_f_vol = 0;
+static void sid_serializeInstance(state_t *state, sid_t *sid) {
+  uint32_t i;
 
-  m64_sid.sid_voice3off = 1;
+  STATE_VALUE(state, sid->sid_s_cached);
+  STATE_VALUE(state, sid->sid_stem_cached);
+  STATE_VALUE(state, sid->sid_bus);
+  STATE_VALUE(state, sid->sid_busTTL);
 
-  sid_updateCenter();
-  sid_updateResonance();
+  for (i = 0; i < 3; i++) {
+    sid_voice_serialize(state, &(sid->sid_voice[i]));
+  }
 
+  STATE_VALUE(state, sid->sid_filter);
+  STATE_VALUE(state, sid->sid_filt1);
+  STATE_VALUE(state, sid->sid_filt2);
+  STATE_VALUE(state, sid->sid_filt3);
+  STATE_VALUE(state, sid->sid_filtE);
+  STATE_VALUE(state, sid->sid_filterEnabled);
+  STATE_VALUE(state, sid->sid_s_muted);
+  STATE_VALUE(state, sid->sid_extinp);
+
+  STATE_VALUE(state, sid->sid_f_lp);
+  STATE_VALUE(state, sid->sid_f_bp);
+  STATE_VALUE(state, sid->sid_f_hp);
+  STATE_VALUE(state, sid->sid_f_cut);
+  STATE_VALUE(state, sid->sid_f_vol);
+  STATE_VALUE(state, sid->sid_volume);
+  STATE_VALUE(state, sid->sid_f_res);
+
+  STATE_VALUE(state, sid->sid_f_vlp);
+  STATE_VALUE(state, sid->sid_f_vbp);
+  STATE_VALUE(state, sid->sid_f_vhp);
+  STATE_VALUE(state, sid->sid_f_lowPass);
+  STATE_VALUE(state, sid->sid_f_bandPass);
+  STATE_VALUE(state, sid->sid_f_output);
+
+  STATE_VALUE(state, sid->sid_f_cutoff);
+  STATE_VALUE(state, sid->sid_f_resonance);
+  STATE_VALUE(state, sid->sid_f_type4cache);
+  STATE_VALUE(state, sid->sid_f_oneDivQ4);
+#ifdef SID_FIXEDPOINT
+  STATE_VALUE(state, sid->sid_f_cutoffFixed);
+  STATE_VALUE(state, sid->sid_f_resonanceFixed);
+  STATE_VALUE(state, sid->sid_f_type4cacheFixed);
+  STATE_VALUE(state, sid->sid_f_oneDivQ4Fixed);
+  STATE_VALUE(state, sid->sid_externalHighPassFilter_vFixed);
+  STATE_VALUE(state, sid->sid_externalLowPassFilter_vFixed);
+#endif
+  STATE_VALUE(state, sid->sid_externalHighPassFilter_v);
+  STATE_VALUE(state, sid->sid_externalLowPassFilter_v);
+
+  STATE_VALUE(state, sid->sid_voice3off);
+  STATE_VALUE(state, sid->sid_model);
+  STATE_VALUE(state, sid->sid_modelTTL);
+  STATE_VALUE(state, sid->sid_zero);
+
+  if(state->loading) {
+    // the filter function follows the model
+    sid->sid_filterClock = sid->sid_model == SID_6581 ? &sid_clock6581 : &sid_clock8580;
+  }
 }
 
-void m64_setSampleRate(int32_t samplesPerSecond) {
+// the chips and where the resampler is up to, the output ring isn't saved
+// call sid_update before saving so the chips have caught up with the clock
+void sid_serialize(state_t *state) {
+  uint32_t count = sidCount;
+#ifdef SID_FIXEDPOINT
+  uint8_t fixedPoint = 1;
+#else
+  uint8_t fixedPoint = 0;
+#endif
+  uint8_t savedFixedPoint = fixedPoint;
   uint32_t i;
 
+  // the fixed point and float builds keep different fields
+  STATE_VALUE(state, savedFixedPoint);
+  if(savedFixedPoint != fixedPoint) {
+    state->error = true;
+    return;
+  }
+
+  STATE_VALUE(state, count);
+  STATE_VALUE(state, sid_lastUpdate);
+  STATE_VALUE(state, sid_s_offset);
+
+  if(state->loading && !state->error && (count < 1 || count > SID_MAX_COUNT)) {
+    state->error = true;
+  }
+
+  for (i = 0; i < SID_MAX_COUNT && !state->error; i++) {
+    sid_serializeInstance(state, &m64_sids[i]);
+  }
+
+  if(state->loading && !state->error && count != sidCount) {
+    // the channel layout of the ring has changed
+    sidCount = count;
+    sid_resetBuffer();
+  }
+}
+
+void m64_setSampleRate(int32_t samplesPerSecond) {
   sid_samplesPerSecond = samplesPerSecond;
 
   // sid_cycles used in zero order resampler
-  sid_cycles = ((sid_cpuCyclesPerSecond / sid_samplesPerSecond) * 1024);
+  sid_cyclesNominal = ((sid_cpuCyclesPerSecond / sid_samplesPerSecond) * SID_RESAMPLE_ONE);
+  sid_cycles = sid_cyclesNominal;
 
 //  m64_setFrequency(sid_cpuCyclesPerSecond, samplesPerSecond);
 
-  m64_sid.sid_bufferPos = 0;
-  for(i = 0; i < SIDBUFFERLENGTH; i++) {
-    m64_sid.sid_buffer[i] = 0;
-  }
-  m64_sid.sid_s_cached  = 0;
-  m64_sid.sid_s_offset  = 0;
-
+  sid_resetBuffer();
 }
   
-void sid_enableFilter(bool_t value) {
-  if (value == m64_sid.sid_filterEnabled) { 
+void sid_enableFilter(sid_t *sid, bool_t value) {
+  if (value == sid->sid_filterEnabled) { 
     return; 
   }
   
-  m64_sid.sid_filterEnabled = value;
+  sid->sid_filterEnabled = value;
   
   if (value)  {
-    m64_sid.sid_f_res = (m64_sid.sid_filter >> 4) & 15;
-    sid_updateResonance();
+    sid->sid_f_res = (sid->sid_filter >> 4) & 15;
+    sid_updateResonance(sid);
 
-    m64_sid.sid_filt1 = m64_sid.sid_filter & 1;
-    m64_sid.sid_filt2 = m64_sid.sid_filter & 2;
-    m64_sid.sid_filt3 = m64_sid.sid_filter & 4;
-    m64_sid.sid_filtE = m64_sid.sid_filter & 8;
+    sid->sid_filt1 = sid->sid_filter & 1;
+    sid->sid_filt2 = sid->sid_filter & 2;
+    sid->sid_filt3 = sid->sid_filter & 4;
+    sid->sid_filtE = sid->sid_filter & 8;
   } else {
-    m64_sid.sid_filt1 = 0;
-    m64_sid.sid_filt2 = 0;
-    m64_sid.sid_filt3 = 0;
-    m64_sid.sid_filtE = 0;
+    sid->sid_filt1 = 0;
+    sid->sid_filt2 = 0;
+    sid->sid_filt3 = 0;
+    sid->sid_filtE = 0;
   }
 }
   
-void sid_input(int32_t value) {
-  m64_sid.sid_extinp = (value << 4) * 3;
+void sid_input(sid_t *sid, int32_t value) {
+  sid->sid_extinp = (value << 4) * 3;
 }
 
-void sid_mute(uint32_t voiceIndex, bool_t value) {
+void sid_mute(sid_t *sid, uint32_t voiceIndex, bool_t value) {
   if (voiceIndex < 3) {
-    m64_sid.sid_voice[voiceIndex].muted = value;
+    sid->sid_voice[voiceIndex].muted = value;
   } else {
-    m64_sid.sid_s_muted = value;
+    sid->sid_s_muted = value;
   }
 }
-  
+
+// set the model of the sid at $d400
 void m64_setSIDModel(uint32_t model) {
+  m64_setSIDModelAt(0, model);
+}
 
-  if (model == m64_sid.sid_model) { 
+// set the model of one of the sids
+void m64_setSIDModelAt(uint32_t index, uint32_t model) {
+  if (index >= SID_MAX_COUNT) {
+    return;
+  }
+
+  sid_t *sid = &m64_sids[index];
+
+  if (model == sid->sid_model) { 
     return; 
   }
 
   if(model == SID_8580_DIGIBOOST) {
     model = SID_8580;
-    sid_input(SID_INPUTDIGIBOOST);
+    sid_input(sid, SID_INPUTDIGIBOOST);
   } else {
-    sid_input(0);
+    sid_input(sid, 0);
   }
 
   if (model == SID_8580) {
-    m64_sid.sid_model    = SID_8580;
-    m64_sid.sid_modelTTL = 663552;
-    m64_sid.sid_zero     = -65280;
-    m64_sid.sid_filterClock = &sid_clock8580;
+    sid->sid_model    = SID_8580;
+    sid->sid_modelTTL = 663552;
+    sid->sid_zero     = -65280;
+    sid->sid_filterClock = &sid_clock8580;
   } else {
-    m64_sid.sid_model    = SID_6581;
-    m64_sid.sid_modelTTL = 7424;
-    m64_sid.sid_zero     = 522240;
-    m64_sid.sid_filterClock = &sid_clock6581;
+    sid->sid_model    = SID_6581;
+    sid->sid_modelTTL = 7424;
+    sid->sid_zero     = 522240;
+    sid->sid_filterClock = &sid_clock6581;
   }
 
-  sid_resetFilter();
+  sid->sid_voice[0].model = sid->sid_model;
+  sid->sid_voice[1].model = sid->sid_model;
+  sid->sid_voice[2].model = sid->sid_model;
+
+  sid_resetFilter(sid);
+}
+
+// set the number of sids, the audio buffer has one channel per sid
+void m64_setSIDCount(uint32_t count) {
+  uint32_t i;
+
+  if (count < 1) {
+    count = 1;
+  }
+  if (count > SID_MAX_COUNT) {
+    count = SID_MAX_COUNT;
+  }
+
+  if (count == sidCount) {
+    return;
+  }
+
+  // sync before the channel layout changes
+  sid_update();
+
+  for (i = sidCount; i < count; i++) {
+    sid_resetInstance(&m64_sids[i]);
+  }
+
+  sidCount = count;
+  sid_resetBuffer();
+  sidbank_updateMap();
+}
+
+uint32_t m64_getSIDCount() {
+  return sidCount;
 }
 
    
-void sid_setNonlinearity(float nonlinearity) {
+void sid_setNonlinearity(uint32_t model, float nonlinearity) {
 
-  waveformCalculator_build(m64_sid.sid_model, nonlinearity);
+  waveformCalculator_build(model, nonlinearity);
 
-  sid_envelope_buildDAC(nonlinearity);
+  sid_envelope_buildDAC(model, nonlinearity);
 
 }
   
 
-// run the sid for a certain number of cycles
-void sid_clock(uint64_t cycles) {
+// convert a sample to 16 bit
+static int16_t sid_toInt16(sid_value_t sample) {
+#ifdef SID_FIXEDPOINT
+  // SID_AUDIOSCALE * 32767 is 1.96602
+  int32_t value = (int32_t)(((int64_t)sample * 196602) / 100000);
+#else
+  int32_t value = (int32_t)(sample * (SID_AUDIOSCALE * 32767));
+#endif
+
+  if (value > 32767) {
+    return 32767;
+  }
+  if (value < -32768) {
+    return -32768;
+  }
+  return value;
+}
 
-  float output, externalFilterOutput, v1, v2, v3;
+// run a sid for a certain number of cycles
+// samples are written to channel of the ring buffer starting at frame sid_writeIndex
+// if the ring is full (readIndex is where the consumer is up to) or sid_silent is set, the samples are dropped
+// the write index and resampler offset after the last sample are returned in bufferPos and offset
+void sid_clock(sid_t *sid, uint32_t channel, uint64_t cycles, uint32_t readIndex, uint32_t *bufferPos, sid_value_t *offset) {
+
+  sid_value_t output, externalFilterOutput, v1, v2, v3;
+  sid_value_t sample;
+  float stemSample;
+  float stems[SID_STEM_COUNT];
+  float *stemBuffer = sid_stemBuffer;
+  uint32_t j;
   
-  float *sampleBuffer = m64_sid.sid_buffer;
+  uint32_t sampleBufferPos = sid_writeIndex;
+  sid_value_t sampleOffset = sid_s_offset;
+  uint32_t channels = sidCount;
+  bool_t int16 = sid_audioFormat == SID_AUDIOFORMAT_INT16;
 
-  int32_t sampleBufferPos = m64_sid.sid_bufferPos;
-
-  sid_voice_t *voice0 = &(m64_sid.sid_voice[0]);
-  sid_voice_t *voice1 = &(m64_sid.sid_voice[1]);
-  sid_voice_t *voice2 = &(m64_sid.sid_voice[2]);
+  sid_voice_t *voice0 = &(sid->sid_voice[0]);
+  sid_voice_t *voice1 = &(sid->sid_voice[1]);
+  sid_voice_t *voice2 = &(sid->sid_voice[2]);
 
   int32_t i;
   for (i = 0; i < cycles; i++) {
@@ -286,16 +556,26 @@ void sid_clock(uint64_t cycles) {
       voice0->accumulator = 0; 
     }
 
+    if (sid_silent) {
+      // running headless: the voices are clocked for the oscillator and envelope the cpu can read back, but the
+      // samples are dropped, so their output, the filters and the resampler's samples are skipped. the filters
+      // carry on from where they were when the sound comes back
+      if (sampleOffset < SID_RESAMPLE_ONE) {
+        sampleOffset += sid_cycles;
+      }
+      sampleOffset -= SID_RESAMPLE_ONE;
+      continue;
+    }
 
     // get output from each of the voices
-    v1 = (sid_output(voice0, voice2) * voice0->envelope) + m64_sid.sid_zero;
+    v1 = SID_VOICE_OUTPUT(sid_output(voice0, voice2), voice0->envelope) + sid->sid_zero;
 
-    v2 = (sid_output(voice1, voice0) * voice1->envelope) + m64_sid.sid_zero;
+    v2 = SID_VOICE_OUTPUT(sid_output(voice1, voice0), voice1->envelope) + sid->sid_zero;
 
-    v3 = (sid_output(voice2, voice1) * voice2->envelope) + m64_sid.sid_zero;
+    v3 = SID_VOICE_OUTPUT(sid_output(voice2, voice1), voice2->envelope) + sid->sid_zero;
 
     // send it through the filter
-    output = m64_sid.sid_filterClock(v1, v2, v3, m64_sid.sid_extinp);
+    output = sid->sid_filterClock(sid, v1, v2, v3, sid->sid_extinp);
 
 
     /*
@@ -309,62 +589,125 @@ void sid_clock(uint64_t cycles) {
 		Vlp += w0lp * (Vi - Vlp);
 
     */
-    externalFilterOutput = sid_externalLowPassFilter_v - sid_externalHighPassFilter_v;
-    sid_externalHighPassFilter_v += (sid_externalHighPassFilter_w0 * externalFilterOutput);
-    sid_externalLowPassFilter_v += (sid_externalLowPassFilter_w0 * (output - sid_externalLowPassFilter_v));
+#ifdef SID_FIXEDPOINT
+    int64_t externalFilterFixed = sid->sid_externalLowPassFilter_vFixed - sid->sid_externalHighPassFilter_vFixed;
+    sid->sid_externalHighPassFilter_vFixed += (externalFilterFixed * sid_externalHighPassFilter_w0Fixed) >> SID_FIXED_SHIFT;
+    sid->sid_externalLowPassFilter_vFixed += 
+      ((((int64_t)output << SID_EXTERNAL_SHIFT) - sid->sid_externalLowPassFilter_vFixed) * sid_externalLowPassFilter_w0Fixed) >> SID_FIXED_SHIFT;
+
+    // scale it by the output level
+    externalFilterOutput = (int32_t)((externalFilterFixed >> SID_EXTERNAL_SHIFT) / 100);
+#else
+    externalFilterOutput = sid->sid_externalLowPassFilter_v - sid->sid_externalHighPassFilter_v;
+    sid->sid_externalHighPassFilter_v += (sid_externalHighPassFilter_w0 * externalFilterOutput);
+    sid->sid_externalLowPassFilter_v += (sid_externalLowPassFilter_w0 * (output - sid->sid_externalLowPassFilter_v));
 
     // scale it by the output level
     externalFilterOutput *= SID_OUTPUTLEVEL; 
+#endif
+
+    if (stemBuffer) {
+      // the voices without the dc offset, and the filter before the volume, at the same level as the mix
+      stems[SID_STEM_VOICE1] = (float)(v1 - sid->sid_zero) * SID_OUTPUTLEVEL;
+      stems[SID_STEM_VOICE2] = (float)(v2 - sid->sid_zero) * SID_OUTPUTLEVEL;
+      stems[SID_STEM_VOICE3] = (float)(v3 - sid->sid_zero) * SID_OUTPUTLEVEL;
+      stems[SID_STEM_FILTER] = (float)sid->sid_f_output * SID_OUTPUTLEVEL;
+      stems[SID_STEM_MIX]    = (float)externalFilterOutput;
+    }
 
     // zero order resampler
     // need to resample from the cpu clock freq to the output sample freq
-    if (m64_sid.sid_s_offset < 1024) {
-      // enters here every (sid_cycles / 1024) cycles
-
-      if(sampleBufferPos >= SIDBUFFERLENGTH) {
-        // uh oh, wrap around, maybe m64_getAudioBuffer isnt being called
-        // prob should shift backwards by some amount rather than wrap around
-        sampleBufferPos = 0;
-        m64_sid.sid_s_cached  = 0;
-        m64_sid.sid_s_offset  = 0;        
+    if (sampleOffset < SID_RESAMPLE_ONE) {
+      // enters here every (sid_cycles / SID_RESAMPLE_ONE) cycles
+
+      if(sampleBufferPos - readIndex < SIDBUFFERLENGTH) {
+        // last sample plus difference between this and last sample multiply by offset divide by SID_RESAMPLE_ONE
+        // >> 10 is divide by 1024
+#ifdef SID_FIXEDPOINT
+        sample = sid->sid_s_cached + (int32_t)(((int64_t)sampleOffset * (externalFilterOutput - sid->sid_s_cached)) >> SID_RESAMPLE_SHIFT);
+#else
+        sample = sid->sid_s_cached + ( (int32_t)( sampleOffset * (externalFilterOutput - sid->sid_s_cached)) >> 10);
+#endif
+
+        uint32_t index = (sampleBufferPos & (SIDBUFFERLENGTH - 1)) * channels + channel;
+        if (int16) {
+          sid_buffer.s[index] = sid_toInt16(sample);
+        } else {
+          sid_buffer.f[index] = (float)sample * SID_AUDIOSCALE;
+        }
+
+        if (stemBuffer) {
+          // same resampling as the mix, into this sid's planes
+          float *plane = stemBuffer + (channel * SID_STEM_COUNT) * SIDBUFFERLENGTH + (sampleBufferPos & (SIDBUFFERLENGTH - 1));
+          // the stems are float, they interpolate with the offset in 1024ths of a cycle
+#ifdef SID_FIXEDPOINT
+          float stemOffset = sampleOffset >> (SID_RESAMPLE_SHIFT - 10);
+#else
+          float stemOffset = sampleOffset;
+#endif
+          for (j = 0; j < SID_STEM_COUNT; j++) {
+            stemSample = sid->sid_stem_cached[j] + ( (int32_t)( stemOffset * (stems[j] - sid->sid_stem_cached[j])) >> 10);
+            plane[j * SIDBUFFERLENGTH] = stemSample * SID_AUDIOSCALE;
+          }
+        }
+        sampleBufferPos++;
+      } else if (channel == 0) {
+        // uh oh, ring is full, maybe m64_getAudioBuffer isnt being called
+        // every sid drops the same frames as they all start from the same offset
+        sid_overruns++;
       }
-      // last sample plus difference between this and last sample multiply by offset divide by 1024
-      // >> 10 is divide by 1024
-      sampleBuffer[sampleBufferPos++] = m64_sid.sid_s_cached + ( (int32_t)( m64_sid.sid_s_offset * (externalFilterOutput - m64_sid.sid_s_cached)) >> 10);
-      m64_sid.sid_s_offset += sid_cycles;
+      sampleOffset += sid_cycles;
     }
 
-    m64_sid.sid_s_offset -= 1024;
-    m64_sid.sid_s_cached = externalFilterOutput;
+    sampleOffset -= SID_RESAMPLE_ONE;
+    sid->sid_s_cached = externalFilterOutput;
+
+    if (stemBuffer) {
+      memcpy(sid->sid_stem_cached, stems, sizeof(stems));
+    }
   }
 
-  m64_sid.sid_bufferPos = sampleBufferPos;
+  *bufferPos = sampleBufferPos;
+  *offset = sampleOffset;
 }
 
 
-// run the sid for the number of cycles since the last run
+// run the sids for the number of cycles since the last run
 void sid_update() {
 
   // get number of cycles since sid_clock last called
   uint64_t time = clock_getTime(&m64_clock, PHASE_PHI2);
-  int32_t deltaCycles = (int32_t)(time - m64_sid.sid_lastUpdate);
+  int32_t deltaCycles = (int32_t)(time - sid_lastUpdate);
+  uint32_t readIndex = SID_RING_LOAD(sid_readIndex);
+  uint32_t bufferPos = sid_writeIndex;
+  sid_value_t offset = sid_s_offset;
+  uint32_t i;
 
-  m64_sid.sid_lastUpdate = time;
+  sid_lastUpdate = time;
 
   if(deltaCycles == 0) {
     return;
   }
 
-  if (m64_sid.sid_busTTL) {
-    m64_sid.sid_busTTL -= deltaCycles;
+  for (i = 0; i < sidCount; i++) {
+    sid_t *sid = &m64_sids[i];
+
+    if (sid->sid_busTTL) {
+      sid->sid_busTTL -= deltaCycles;
 
-    if (m64_sid.sid_busTTL <= 0) {
-      m64_sid.sid_bus = 0;
-      m64_sid.sid_busTTL = 0;
+      if (sid->sid_busTTL <= 0) {
+        sid->sid_bus = 0;
+        sid->sid_busTTL = 0;
+      }
     }
+
+    sid_clock(sid, i, deltaCycles, readIndex, &bufferPos, &offset);
   }
 
-  sid_clock(deltaCycles);
+  // every sid starts from the same position and offset, so they all end up at the same place
+  // samples are in the ring before the consumer sees the new write index
+  sid_s_offset = offset;
+  SID_RING_STORE(sid_writeIndex, bufferPos);
 }
 
 
@@ -392,15 +735,126 @@ void m64_audioInit(uint32_t bufferLength, uint32_t sampleRate) {
   m64_setSampleRate(sampleRate);
 }
 
+// number of frames in the ring buffer waiting to be read
 int32_t m64_getAudioSamplesAvailable() {
-  return m64_sid.sid_bufferPos;
+  return SID_RING_LOAD(sid_writeIndex) - SID_RING_LOAD(sid_readIndex);
+}
+
+// turn the stems on or off, the stem buffer is only allocated while they are on
+// clears the ring buffer so the stems and the mix start at the same frame
+void m64_setAudioStems(uint32_t enabled) {
+  if (enabled && !sid_stemBuffer) {
+    sid_update();
+    sid_stemBuffer = malloc(sizeof(float) * SID_MAX_COUNT * SID_STEM_COUNT * SIDBUFFERLENGTH);
+    if (!sid_stemBuffer) {
+      return;
+    }
+    sid_resetBuffer();
+  } else if (!enabled && sid_stemBuffer) {
+    free(sid_stemBuffer);
+    sid_stemBuffer = NULL;
+  }
 }
 
+// the planar stem buffer, 0 if stems are off
+// stem s of sid n for frame f is at ((n * SID_STEM_COUNT + s) * ringLength + (f & (ringLength - 1)))
+float *m64_getAudioStemBuffer() {
+  return sid_stemBuffer;
+}
 
+// dynamic rate control, nudge the resampling ratio so the ring buffer stays near the target latency
+// below the target, make a few more samples per cycle, above it make a few less
+// the change is at most SID_RATECONTROL_MAX so the pitch change can't be heard
+void sid_updateRateControl() {
+  if(sid_targetLatency == 0) {
+    sid_cycles = sid_cyclesNominal;
+    return;
+  }
+
+#ifdef SID_FIXEDPOINT
+  int32_t error = (int32_t)sid_targetLatency - m64_getAudioSamplesAvailable();
+  if(error > (int32_t)sid_targetLatency) {
+    error = sid_targetLatency;
+  } else if(error < -(int32_t)sid_targetLatency) {
+    error = -(int32_t)sid_targetLatency;
+  }
+
+  // SID_RATECONTROL_MAX is 1/200
+  sid_cycles = sid_cyclesNominal - (int32_t)(((int64_t)sid_cyclesNominal * error) / (200 * (int64_t)sid_targetLatency));
+#else
+  float error = ((float)sid_targetLatency - (float)m64_getAudioSamplesAvailable()) / (float)sid_targetLatency;
+  if(error > 1) {
+    error = 1;
+  } else if(error < -1) {
+    error = -1;
+  }
+
+  sid_cycles = sid_cyclesNominal * (1 - SID_RATECONTROL_MAX * error);
+#endif
+}
+
+// target number of frames waiting in the ring buffer for the dynamic rate control, 0 turns it off
+void m64_setAudioTargetLatency(uint32_t frames) {
+  if(frames > SIDBUFFERLENGTH) {
+    frames = SIDBUFFERLENGTH;
+  }
+  sid_targetLatency = frames;
+  sid_updateRateControl();
+}
+
+// set the sample format of the ring buffer and the audio buffer, clears the ring buffer
+void m64_setAudioFormat(uint32_t format) {
+  if (format != SID_AUDIOFORMAT_INT16) {
+    format = SID_AUDIOFORMAT_FLOAT32;
+  }
+
+  sid_audioFormat = format;
+  sid_resetBuffer();
+}
+
+// the ring buffer, SIDBUFFERLENGTH frames of float32 or int16 samples, interleaved if more than one sid
+unsigned char *m64_getAudioRingBuffer() {
+  return (unsigned char *)&sid_buffer;
+}
+
+uint32_t m64_getAudioRingBufferLength() {
+  return SIDBUFFERLENGTH;
+}
+
+uint32_t m64_getAudioReadIndex() {
+  return SID_RING_LOAD(sid_readIndex);
+}
+
+uint32_t m64_getAudioWriteIndex() {
+  return SID_RING_LOAD(sid_writeIndex);
+}
+
+// the consumer calls this after it has read the samples up to index
+void m64_setAudioReadIndex(uint32_t index) {
+  SID_RING_STORE(sid_readIndex, index);
+}
+
+// drop the sids' samples instead of writing them to the ring, the write index stays where it is
+void sid_setSilent(bool_t silent) {
+  sid_silent = silent;
+}
+
+// pointers to the indexes, so a consumer in another thread (eg an AudioWorklet) can read them from memory
+uint32_t *m64_getAudioReadIndexPointer() {
+  return (uint32_t *)&sid_readIndex;
+}
+
+uint32_t *m64_getAudioWriteIndexPointer() {
+  return (uint32_t *)&sid_writeIndex;
+}
+
+
+// copy the next SIDAUDIOBUFFERLENGTH frames out of the ring buffer into the audio buffer
+// the audio buffer has one interleaved channel for each sid
 unsigned char *m64_getAudioBuffer() {
   uint32_t i = 0;
 
-  while(m64_sid.sid_bufferPos < SIDAUDIOBUFFERLENGTH) {
+  while(m64_getAudioSamplesAvailable() < SIDAUDIOBUFFERLENGTH) {
     // dont have enough samples, step the clock until buffer is full
     clock_step(&m64_clock);
     sid_update();
@@ -411,28 +865,35 @@ unsigned char *m64_getAudioBuffer() {
     }    
   }
 
-  for (i = 0; i < SIDAUDIOBUFFERLENGTH; i++) {
-    sid_audioBuffer[i] = m64_sid.sid_buffer[i] * 0.00006;//0.000030517578125;
+  uint32_t readIndex = SID_RING_LOAD(sid_readIndex);
+  uint32_t start = readIndex & (SIDBUFFERLENGTH - 1);
+  uint32_t frames = SIDAUDIOBUFFERLENGTH;
+  uint32_t sampleSize = sid_audioFormat == SID_AUDIOFORMAT_INT16 ? sizeof(int16_t) : sizeof(float);
+  uint32_t frameSize = sampleSize * sidCount;
+  uint8_t *ring = (uint8_t *)&sid_buffer;
+  uint8_t *out = (uint8_t *)&sid_audioBuffer;
+
+  if (m64_getAudioSamplesAvailable() < frames) {
+    // clock didnt produce enough, pad with silence rather than read past the write index
+    frames = m64_getAudioSamplesAvailable();
+    memset(out + frames * frameSize, 0, (SIDAUDIOBUFFERLENGTH - frames) * frameSize);
   }
 
-  // shift data back by SIDAUDIOBUFFERLENGTH, if there are more than SIDAUDIOBUFFERLENGTH in the buffer
-  float *buf = m64_sid.sid_buffer;
-  int32_t pos = m64_sid.sid_bufferPos;
-  if (pos > SIDAUDIOBUFFERLENGTH) {
-    // output of audio is lagging calls to get buffer
-    memcpy(buf, &(buf[SIDAUDIOBUFFERLENGTH]), sizeof(float) * (pos - SIDAUDIOBUFFERLENGTH));
-
-    pos -= SIDAUDIOBUFFERLENGTH;
+  // copy up to the end of the ring, then the rest from the start
+  if (start + frames > SIDBUFFERLENGTH) {
+    uint32_t firstPart = SIDBUFFERLENGTH - start;
+    memcpy(out, ring + start * frameSize, firstPart * frameSize);
+    memcpy(out + firstPart * frameSize, ring, (frames - firstPart) * frameSize);
   } else {
-    pos = 0;
+    memcpy(out, ring + start * frameSize, frames * frameSize);
   }
 
-  m64_sid.sid_bufferPos = pos; 
+  SID_RING_STORE(sid_readIndex, readIndex + frames);
 
-  return (unsigned char *)sid_audioBuffer;
+  return (unsigned char *)&sid_audioBuffer;
 }
 
-uint8_t sid_read(uint16_t addr) {
+uint8_t sid_read(sid_t *sid, uint16_t addr) {
   // sync sid and cpu clocks
   sid_update();
 
@@ -440,50 +901,50 @@ uint8_t sid_read(uint16_t addr) {
     // paddle x and y
     case SID_POT_X: //0x19
     case SID_POT_Y: //0x1a
-      m64_sid.sid_bus = 0xff;
-      m64_sid.sid_busTTL = m64_sid.sid_modelTTL;
+      sid->sid_bus = 0xff;
+      sid->sid_busTTL = sid->sid_modelTTL;
       break;
     case SID_OSC3RAND: //0x1b
       // reading output of oscillator voice 3
-      m64_sid.sid_bus = sid_osc(&(m64_sid.sid_voice[2]), &(m64_sid.sid_voice[0]));
-      m64_sid.sid_busTTL = m64_sid.sid_modelTTL;
+      sid->sid_bus = sid_osc(&(sid->sid_voice[2]), &(sid->sid_voice[0]));
+      sid->sid_busTTL = sid->sid_modelTTL;
       break;
     case SID_ENV3: // 0x1c
-      m64_sid.sid_bus = m64_sid.sid_voice[2].envelopeDigital;
-      m64_sid.sid_busTTL = m64_sid.sid_modelTTL;
+      sid->sid_bus = sid->sid_voice[2].envelopeDigital;
+      sid->sid_busTTL = sid->sid_modelTTL;
       break;
     default:
-      m64_sid.sid_busTTL >>= 1;
+      sid->sid_busTTL >>= 1;
       break;
   }
-  return m64_sid.sid_bus;
+  return sid->sid_bus;
 }
 
-void sid_write(uint16_t address, uint8_t value) {
+void sid_write(sid_t *sid, uint16_t address, uint8_t value) {
   // sync sid and cpu clocks
   sid_update();
 
   // is bus shared by all sids?
-  m64_sid.sid_bus = value;
-  m64_sid.sid_busTTL = m64_sid.sid_modelTTL;
+  sid->sid_bus = value;
+  sid->sid_busTTL = sid->sid_modelTTL;
 
   int32_t reg = address & 0x1f;
 
   int32_t mod = 1;
-  sid_voice_t *voice = m64_sid.sid_voice;
+  sid_voice_t *voice = sid->sid_voice;
 
   if (reg >= 7 && reg <= 13) {
     // voice 2
     reg -= 7;
 
     mod = 2;
-    voice = &(m64_sid.sid_voice[1]);
+    voice = &(sid->sid_voice[1]);
   } else if (reg >= 14 && reg <= 20) {
     // voice 3
     reg -= 14;
 
     mod = 0;
-    voice = &(m64_sid.sid_voice[2]);
+    voice = &(sid->sid_voice[2]);
   }
 
   switch (reg) {
@@ -504,7 +965,7 @@ void sid_write(uint16_t address, uint8_t value) {
       break;
     case SID_CTRL: // 0x04
       // control register voice 
-      sid_writeControl(voice, &( m64_sid.sid_voice[mod]) , value);
+      sid_writeControl(voice, &( sid->sid_voice[mod]) , value);
 
       // update envelope
       bool_t gateNext = (value & 0x1) != 0;
@@ -548,24 +1009,24 @@ void sid_write(uint16_t address, uint8_t value) {
     // --- end voice specific registers  
     case SID_FC_LO: // 0x15
       // filter cutoff frequency low byte
-      m64_sid.sid_f_cut = (m64_sid.sid_f_cut & 2040) | (value & 7);
-      sid_updateCenter();
+      sid->sid_f_cut = (sid->sid_f_cut & 2040) | (value & 7);
+      sid_updateCenter(sid);
       break;
     case SID_FC_HI: // 0x16
       // filter cutoff frequency high byte
-      m64_sid.sid_f_cut = ((value << 3) & 2040) | (m64_sid.sid_f_cut & 7);
-      sid_updateCenter();
+      sid->sid_f_cut = ((value << 3) & 2040) | (sid->sid_f_cut & 7);
+      sid_updateCenter(sid);
       break;
     case SID_RES_FILT: // 0x17
-      m64_sid.sid_filter = value;
-      m64_sid.sid_f_res = (value >> 4) & 15;
-      sid_updateResonance();
-
-      if (m64_sid.sid_filterEnabled) {
-        m64_sid.sid_filt1 = value & 1;
-        m64_sid.sid_filt2 = value & 2;
-        m64_sid.sid_filt3 = value & 4;
-        m64_sid.sid_filtE = value & 8;
+      sid->sid_filter = value;
+      sid->sid_f_res = (value >> 4) & 15;
+      sid_updateResonance(sid);
+
+      if (sid->sid_filterEnabled) {
+        sid->sid_filt1 = value & 1;
+        sid->sid_filt2 = value & 2;
+        sid->sid_filt3 = value & 4;
+        sid->sid_filtE = value & 8;
       }
       break;
     case SID_MODE_VOL:  // 0x18:
@@ -574,14 +1035,15 @@ void sid_write(uint16_t address, uint8_t value) {
       int32_t vol = (value & 15);
 
       // s_mute is to mute digi
-      if (!m64_sid.sid_s_muted || ( (float)vol / 15.0) >= m64_sid.sid_f_vol) {
-        m64_sid.sid_f_vol = (float)vol / 15.0;
+      if (!sid->sid_s_muted || ( (float)vol / 15.0) >= sid->sid_f_vol) {
+        sid->sid_f_vol = (float)vol / 15.0;
+        sid->sid_volume = vol;
 
-        m64_sid.sid_f_lp = value & 0x10;
-        m64_sid.sid_f_bp = value & 0x20;
-        m64_sid.sid_f_hp = value & 0x40;
+        sid->sid_f_lp = value & 0x10;
+        sid->sid_f_bp = value & 0x20;
+        sid->sid_f_hp = value & 0x40;
 
-        m64_sid.sid_voice3off = !(value & 0x80);
+        sid->sid_voice3off = !(value & 0x80);
         }
       }
       break;
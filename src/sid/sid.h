@@ -31,6 +31,9 @@
 #define SID_8580           1
 #define SID_8580_DIGIBOOST 2
 
+// maximum number of sids, sid 0 is at $d400, the others can be mapped at $d420-$d7e0 and $de00-$dfe0
+#define SID_MAX_COUNT      4
+
 #define SID_INPUTDIGIBOOST -0x9500
 
 #define SID_ATTACK        1
@@ -83,21 +86,89 @@
 #define SID_FILTER_3OFF   (1<<3)
 
 
-// there are two buffers
-// the sid writes to larger buffer (SIDBUFFER), 
-// when program wants sample data, SIDAUDIOBUFFERLENGTH samples are copied to the smaller buffer (SIDAUDIOBUFFER)
-// and data in lager buffer is shifted forwards
-#define SIDAUDIOBUFFERLENGTHMAX 4096
+// the sids write samples into a single producer/single consumer ring buffer, SIDBUFFERLENGTH frames long
+// the emulator only moves the write index and the consumer only moves the read index, 
+// indexes are in frames and count up forever, (index & (SIDBUFFERLENGTH - 1)) is the position in the ring
+// with more than one sid, samples are interleaved, one channel per sid
+// m64_getAudioBuffer copies SIDAUDIOBUFFERLENGTH frames out of the ring into a smaller buffer (SIDAUDIOBUFFER)
+#define SIDAUDIOBUFFERLENGTHMAX 8192
 #define SIDBUFFERLENGTH 32768
 
-
-extern float sid_waveDac[12];
-
-extern float sid_wavetable_samples[11][4096];
-extern uint8_t sid_wavetable_digital[11][4096];
+// sample formats for the ring buffer and audio buffer
+#define SID_AUDIOFORMAT_FLOAT32 0
+#define SID_AUDIOFORMAT_INT16   1
+
+// stems: the voices (before the filter), the filter output and the final mix of each sid
+// written as float32 in the same pass as the mix, into a planar buffer with SID_STEM_COUNT planes per sid
+// each plane is SIDBUFFERLENGTH frames and uses the same indexes as the ring buffer
+// plane for a stem is (sidIndex * SID_STEM_COUNT + stem)
+#define SID_STEM_VOICE1 0
+#define SID_STEM_VOICE2 1
+#define SID_STEM_VOICE3 2
+#define SID_STEM_FILTER 3
+#define SID_STEM_MIX    4
+#define SID_STEM_COUNT  5
+
+// maximum change to the resampling ratio made by the dynamic rate control (0.5%)
+#define SID_RATECONTROL_MAX 0.005f
+
+// ring indexes are atomic when the compiler supports it so another thread can consume the samples
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+typedef _Atomic uint32_t sid_ringIndex_t;
+#define SID_RING_LOAD(index) atomic_load_explicit(&(index), memory_order_acquire)
+#define SID_RING_STORE(index, value) atomic_store_explicit(&(index), (value), memory_order_release)
+#else
+typedef volatile uint32_t sid_ringIndex_t;
+#define SID_RING_LOAD(index) (index)
+#define SID_RING_STORE(index, value) ((index) = (value))
+#endif
+
+
+// the tables are built for both models, first index is SID_6581 or SID_8580
+extern float sid_waveDac[2][12];
+
+extern float sid_wavetable_samples[2][11][4096];
+extern uint8_t sid_wavetable_digital[2][11][4096];
 
 extern uint16_t sid_envelope_rate_periods[16];
-extern float sid_envDAC[256]; 
+extern float sid_envDAC[2][256]; 
+
+// define SID_FIXEDPOINT when building (-DSID_FIXEDPOINT) to use the integer path.
+// the voices, filters, external filter and resampler then run on integers, the wave and envelope dac levels
+// in SID_LEVEL_SHIFT fixed point and the filter coefficients in SID_FIXED_SHIFT fixed point,
+// so the output is the same on every compiler and platform (float is still used to build the tables
+// and coefficients, but only with basic arithmetic, so don't build with -ffast-math)
+#ifdef SID_FIXEDPOINT
+#define SID_FIXED_SHIFT 20
+// fractional bits of the external filter voltages, the highpass moves too slowly to be kept as an integer
+#define SID_EXTERNAL_SHIFT 12
+// fractional bits of the wave and envelope levels
+#define SID_LEVEL_SHIFT 4
+typedef int32_t sid_value_t;
+
+// the voice output is the wave level times the envelope level
+#define SID_VOICE_OUTPUT(wave, envelope) (((wave) * (envelope)) >> (2 * SID_LEVEL_SHIFT))
+
+// round a dac level to SID_LEVEL_SHIFT fixed point
+#define SID_TO_LEVEL(value) ((int32_t)((value) * (1 << SID_LEVEL_SHIFT) + ((value) < 0 ? -0.5f : 0.5f)))
+
+// the wave and envelope dac levels the voices use
+extern int32_t sid_waveDacFixed[2][12];
+extern int32_t sid_wavetable_samplesFixed[2][11][4096];
+extern int32_t sid_envDACFixed[2][256];
+#define SID_WAVEDAC sid_waveDacFixed
+#define SID_WAVETABLE_SAMPLES sid_wavetable_samplesFixed
+#define SID_ENVDAC sid_envDACFixed
+#else
+typedef float sid_value_t;
+
+#define SID_VOICE_OUTPUT(wave, envelope) ((wave) * (envelope))
+
+#define SID_WAVEDAC sid_waveDac
+#define SID_WAVETABLE_SAMPLES sid_wavetable_samples
+#define SID_ENVDAC sid_envDAC
+#endif
 
 struct sid_voice_s {
 
@@ -115,7 +186,7 @@ struct sid_voice_s {
   int32_t freq;
   int32_t pw;
   
-  float oscDac;
+  sid_value_t oscDac;
   uint8_t oscDigital;
 
   int32_t waveform;
@@ -129,7 +200,7 @@ struct sid_voice_s {
 
   // envelopeDigital is converted to envelope using sid_envDAC
   uint8_t envelopeDigital;
-  float envelope;
+  sid_value_t envelope;
 
   int32_t attack;
   int32_t decay;
@@ -140,6 +211,9 @@ struct sid_voice_s {
   bool_t gate;
   bool_t freezeZero;
 
+  // model of the sid the voice belongs to, selects the wave and envelope tables
+  int32_t model;
+
   int32_t expoCounter;
   int32_t expoPeriod;
 
@@ -161,17 +235,16 @@ struct sid_config_s {
 typedef struct sid_config_s sid_config_t;
 
 
-typedef float (*sid_filterClockFunction)(float v1, float v2, float v3, int32_t inp);
+struct sid_s;
 
-struct sid_s {
-  // samples written into sid_buffer
-  float sid_buffer[SIDBUFFERLENGTH]; 
-  int32_t sid_bufferPos;
+typedef sid_value_t (*sid_filterClockFunction)(struct sid_s *sid, sid_value_t v1, sid_value_t v2, sid_value_t v3, int32_t inp);
 
+struct sid_s {
   // the last sample generated
-  float sid_s_cached;
+  sid_value_t sid_s_cached;
 
-  float sid_s_offset;
+  // the last value of each stem, for the resampler
+  float sid_stem_cached[SID_STEM_COUNT];
 
   // sid bus is last value sent to write to a register
   // or gets set to 0xff sometimes on register read
@@ -196,9 +269,6 @@ struct sid_s {
 
   bool_t sid_filterEnabled;
 
-  // last time sid clock was called..
-  int64_t sid_lastUpdate;
-
   // digi muted
   int32_t sid_s_muted;
 
@@ -219,12 +289,43 @@ struct sid_s {
   // volume divided by 15
   //int32_t sid_f_vol = 0;
   float sid_f_vol;
+  // volume 0-15
+  int32_t sid_volume;
   // filter resonance
   float sid_f_res;
 
-  float sid_f_vlp;
-  float sid_f_vbp;
-  float sid_f_vhp;
+  // 8580 filter state
+  sid_value_t sid_f_vlp;
+  sid_value_t sid_f_vbp;
+  sid_value_t sid_f_vhp;
+
+  // 6581 filter state, previous low pass and band pass outputs
+  sid_value_t sid_f_lowPass;
+  sid_value_t sid_f_bandPass;
+
+  // the filter's part of the last output (before the volume), for the filter stem
+  sid_value_t sid_f_output;
+
+  // filter coefficients, calculated from the cutoff and resonance registers
+  float sid_f_cutoff;
+  float sid_f_resonance;
+  float sid_f_type4cache;
+  float sid_f_oneDivQ4;
+
+#ifdef SID_FIXEDPOINT
+  int32_t sid_f_cutoffFixed;
+  int32_t sid_f_resonanceFixed;
+  int32_t sid_f_type4cacheFixed;
+  int32_t sid_f_oneDivQ4Fixed;
+
+  // external filter voltages with SID_EXTERNAL_SHIFT fractional bits
+  int64_t sid_externalHighPassFilter_vFixed;
+  int64_t sid_externalLowPassFilter_vFixed;
+#endif
+
+  // external filter voltages
+  float sid_externalHighPassFilter_v;
+  float sid_externalLowPassFilter_v;
 
   sid_filterClockFunction sid_filterClock;
 
@@ -244,39 +345,60 @@ struct sid_s {
 
 typedef struct sid_s sid_t;
 
-extern sid_t m64_sid;
+extern sid_t m64_sids[SID_MAX_COUNT];
+extern uint32_t sidCount;
 
 
 
+void m64_audioInit(uint32_t bufferLength, uint32_t sampleRate);
 unsigned char *m64_getAudioBuffer();
+unsigned char *m64_getAudioRingBuffer();
+uint32_t m64_getAudioRingBufferLength();
+uint32_t m64_getAudioReadIndex();
+uint32_t m64_getAudioWriteIndex();
+void m64_setAudioReadIndex(uint32_t index);
+uint32_t *m64_getAudioReadIndexPointer();
+uint32_t *m64_getAudioWriteIndexPointer();
+void m64_setAudioFormat(uint32_t format);
+int32_t m64_getAudioSamplesAvailable();
+void m64_setAudioStems(uint32_t enabled);
+float *m64_getAudioStemBuffer();
 
 void sid_reset();
+void sid_setSilent(bool_t silent);
+void sid_serialize(state_t *state);
+void sid_resetInstance(sid_t *sid);
 void sid_init(int model, float cpuCyclesPerSecond);
 void sid_updateConfig(sid_config_t *config);
 void m64_setSIDModel(uint32_t model);
+void m64_setSIDModelAt(uint32_t index, uint32_t model);
+void m64_setSIDCount(uint32_t count);
+uint32_t m64_getSIDCount();
 
-void sid_enableFilter(bool_t value);
-void sid_input(int32_t value);
-void sid_mute(uint32_t voice, bool_t value);
+void sid_enableFilter(sid_t *sid, bool_t value);
+void sid_input(sid_t *sid, int32_t value);
+void sid_mute(sid_t *sid, uint32_t voice, bool_t value);
 
 void m64_setFrequency(float clock, float freq);
-void sid_setNonlinearity(float nonlinearity);
+void sid_setNonlinearity(uint32_t model, float nonlinearity);
 void sid_update();
+void sid_updateRateControl();
+void m64_setAudioTargetLatency(uint32_t frames);
 
-void sid_resetFilter();
+void sid_resetFilter(sid_t *sid);
 
-uint8_t sid_read(uint16_t addr);
-void sid_write(uint16_t addr, uint8_t value);
+uint8_t sid_read(sid_t *sid, uint16_t addr);
+void sid_write(sid_t *sid, uint16_t addr, uint8_t value);
                    
-float sid_clock6581(float v1, float v2, float v3, int32_t inp);
-float sid_clock8580(float v1, float v2, float v3, int32_t inp);
+sid_value_t sid_clock6581(sid_t *sid, sid_value_t v1, sid_value_t v2, sid_value_t v3, int32_t inp);
+sid_value_t sid_clock8580(sid_t *sid, sid_value_t v1, sid_value_t v2, sid_value_t v3, int32_t inp);
 void sid_recalculate();
-void sid_updateCenter();
-void sid_updateResonance();
+void sid_updateCenter(sid_t *sid);
+void sid_updateResonance(sid_t *sid);
 
 void sid_updatePeriod(sid_voice_t *env, int32_t value);
 int32_t sid_osc(sid_voice_t *wave, sid_voice_t *modulator);
-float sid_output(sid_voice_t *wave, sid_voice_t *modulator);
+sid_value_t sid_output(sid_voice_t *wave, sid_voice_t *modulator);
 void sid_writeControl(sid_voice_t *wave, sid_voice_t *modulator, int32_t control);
 
 uint8_t sid_updateOsc(sid_voice_t *wave, sid_voice_t *modulator, int32_t accum);
@@ -286,9 +408,10 @@ float sid_kinkedDac(int32_t inp, float nonlinearity, int32_t bits);
 void sid_voice_init(sid_voice_t *waveformGenerator);
 void sid_voice_clock(sid_voice_t *wave);
 void sid_voice_reset(sid_voice_t *waveformGenerator);
+void sid_voice_serialize(state_t *state, sid_voice_t *voice);
 
 void sid_voice_envelope_clock(sid_voice_t *voice);
-void sid_envelope_buildDAC(float nonlinearity);
+void sid_envelope_buildDAC(uint32_t model, float nonlinearity);
 
 void sid_voice_updateNoise(sid_voice_t *wave, bool_t clock);
 
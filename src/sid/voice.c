@@ -72,6 +72,37 @@ void sid_voice_reset(sid_voice_t *voice) {
   sid_writeControl(voice, voice, 0);
 }
   
+void sid_voice_serialize(state_t *state, sid_voice_t *voice) {
+  STATE_VALUE(state, voice->accumulator);
+  STATE_VALUE(state, voice->accumulatorPrev);
+  STATE_VALUE(state, voice->noiseShiftRegister);
+  STATE_VALUE(state, voice->noiseShiftRegisterTTL);
+  STATE_VALUE(state, voice->freq);
+  STATE_VALUE(state, voice->pw);
+  STATE_VALUE(state, voice->oscDac);
+  STATE_VALUE(state, voice->oscDigital);
+  STATE_VALUE(state, voice->waveform);
+  STATE_VALUE(state, voice->test);
+  STATE_VALUE(state, voice->ring);
+  STATE_VALUE(state, voice->sync);
+
+  STATE_VALUE(state, voice->muted);
+  STATE_VALUE(state, voice->envelopeDigital);
+  STATE_VALUE(state, voice->envelope);
+  STATE_VALUE(state, voice->attack);
+  STATE_VALUE(state, voice->decay);
+  STATE_VALUE(state, voice->sustain);
+  STATE_VALUE(state, voice->release);
+  STATE_VALUE(state, voice->state);
+  STATE_VALUE(state, voice->gate);
+  STATE_VALUE(state, voice->freezeZero);
+  STATE_VALUE(state, voice->model);
+  STATE_VALUE(state, voice->expoCounter);
+  STATE_VALUE(state, voice->expoPeriod);
+  STATE_VALUE(state, voice->rateCounter);
+  STATE_VALUE(state, voice->rateCounterPeriod);
+}
+
 // called when setting the gate or adsr registers
 void sid_updatePeriod(sid_voice_t *voice, int32_t value) {
   int32_t newRateCounterPeriod = sid_envelope_rate_periods[value & 0xf];
@@ -122,7 +153,7 @@ void sid_voice_updateNoise(sid_voice_t *voice, bool_t clock) {
     }
 
     // get the zero level
-    voice->oscDac = sid_wavetable_samples[0][0];
+    voice->oscDac = SID_WAVETABLE_SAMPLES[voice->model][0][0];
 
     // the 8 selected bits..
     // The output from bits 0, 2, 5, 9, 11, 14, 18 and 20 is sent to the waveform selector. 
@@ -140,7 +171,7 @@ void sid_voice_updateNoise(sid_voice_t *voice, bool_t clock) {
     int32_t i;
     for (i = 0; i < 8; i++) {
       if (voice->oscDigital & (1 << i)) {
-        voice->oscDac += sid_waveDac[i + 4];
+        voice->oscDac += SID_WAVEDAC[voice->model][i + 4];
       }
     }
 
@@ -194,12 +225,12 @@ uint8_t sid_updateOsc(sid_voice_t *voice, sid_voice_t *modulator, int32_t accumu
   phase ^= voice->ring && (modulator->accumulator & 0x800000) ? 0x800 : 0;
   index += voice->waveform;
 
-  return sid_wavetable_digital[index][phase];
+  return sid_wavetable_digital[voice->model][index][phase];
 }
 
 
 
-float sid_output(sid_voice_t *voice, sid_voice_t *modulator) {
+sid_value_t sid_output(sid_voice_t *voice, sid_voice_t *modulator) {
   if (!voice->waveform || voice->waveform > 7) {
     return voice->oscDac;
   }
@@ -217,14 +248,14 @@ float sid_output(sid_voice_t *voice, sid_voice_t *modulator) {
   phase ^= voice->ring && (modulator->accumulator & 0x800000) ? 0x800 : 0;
 
   index += voice->waveform;
-  return sid_wavetable_samples[index][phase];
+  return SID_WAVETABLE_SAMPLES[voice->model][index][phase];
 }
 
 // get the digital value from the oscillator
 // used for reading the value for register d41b
 int32_t sid_osc(sid_voice_t *voice, sid_voice_t *modulator) {
 
-  if (m64_sid.sid_model == 1) {
+  if (voice->model == SID_8580) {
     // 8580 is one cycle behind
     return sid_updateOsc(voice, modulator, voice->accumulatorPrev);
   } else {
@@ -26,10 +26,16 @@
 
 // digital versions of the waves
 // digital version is only used when reading register d41b for oscillator 3
-uint8_t sid_wavetable_digital[11][4096];
+uint8_t sid_wavetable_digital[2][11][4096];
 
 // waves converted to samples by the wave dac, each value in wavedac is multiplied by wave amount and summed to make the sample
-float sid_wavetable_samples[11][4096];
+float sid_wavetable_samples[2][11][4096];
+
+#ifdef SID_FIXEDPOINT
+// the dac and wave tables rounded to SID_LEVEL_SHIFT fixed point
+int32_t sid_waveDacFixed[2][12];
+int32_t sid_wavetable_samplesFixed[2][11][4096];
+#endif
 
 
 float waveformCalculatorConfig[2][5][5] = 
@@ -198,7 +204,10 @@ void waveformCalculator_build(uint32_t model, float nonlinearity) {
   uint32_t w, a;
 
   for(i = 0; i < 12; i++) {
-    sid_waveDac[i] = sid_kinkedDac((1 << i), nonlinearity, 12);
+    sid_waveDac[model][i] = sid_kinkedDac((1 << i), nonlinearity, 12);
+#ifdef SID_FIXEDPOINT
+    sid_waveDacFixed[model][i] = SID_TO_LEVEL(sid_waveDac[model][i]);
+#endif
   }
 
   float bitarray[12];
@@ -213,15 +222,21 @@ void waveformCalculator_build(uint32_t model, float nonlinearity) {
       // convert 12 bit bitarray to 8 bit number for form digital values 
       waveformCalculator_fill(bitarray, model, w, a, 0x1000);
 
-      sid_wavetable_samples[w - 1][a] = waveformCalculator_makeSample(bitarray, sid_waveDac) + z;
-      sid_wavetable_digital[w - 1][a] = waveformCalculator_makeDigital(bitarray);
+      sid_wavetable_samples[model][w - 1][a] = waveformCalculator_makeSample(bitarray, sid_waveDac[model]) + z;
+      sid_wavetable_digital[model][w - 1][a] = waveformCalculator_makeDigital(bitarray);
+#ifdef SID_FIXEDPOINT
+      sid_wavetable_samplesFixed[model][w - 1][a] = SID_TO_LEVEL(sid_wavetable_samples[model][w - 1][a]);
+#endif
 
       if (w >= 4) {
         // make a bit array for waveform 4 where accumulator is less than pulse width (all bits are 1)/
         // and combinations of pulse and other waveforms
         waveformCalculator_fill(bitarray, model, w, a, 0);
-        sid_wavetable_samples[w + 3][a] = waveformCalculator_makeSample(bitarray, sid_waveDac) + z;
-        sid_wavetable_digital[w + 3][a] = waveformCalculator_makeDigital(bitarray);
+        sid_wavetable_samples[model][w + 3][a] = waveformCalculator_makeSample(bitarray, sid_waveDac[model]) + z;
+        sid_wavetable_digital[model][w + 3][a] = waveformCalculator_makeDigital(bitarray);
+#ifdef SID_FIXEDPOINT
+        sid_wavetable_samplesFixed[model][w + 3][a] = SID_TO_LEVEL(sid_wavetable_samples[model][w + 3][a]);
+#endif
       }
     }
   }
@@ -0,0 +1,288 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#include "../m64.h"
+
+extern int32_t m64_model;
+
+static void archive_writeCPU(uint8_t *data) {
+  m6510_t *cpu = &m64_cpu;
+
+  data[0] = cpu->Register_ProgramCounter & 0xff;
+  data[1] = (cpu->Register_ProgramCounter >> 8) & 0xff;
+  data[2] = cpu->registerA;
+  data[3] = cpu->registerX;
+  data[4] = cpu->registerY;
+  data[5] = cpu->registerSP;
+  data[6] = m6510_getStatusRegister(cpu);
+}
+
+// the sid keeps its registers decoded, they're put back together
+static void archive_writeSID(uint8_t *data, sid_t *sid) {
+  sid_voice_t *voice;
+  uint32_t i;
+
+  for(i = 0; i < 3; i++) {
+    voice = &sid->sid_voice[i];
+    data[i * 7 + SID_FREQ_LO] = voice->freq & 0xff;
+    data[i * 7 + SID_FREQ_HI] = (voice->freq >> 8) & 0xff;
+    data[i * 7 + SID_PW_LO] = voice->pw & 0xff;
+    data[i * 7 + SID_PW_HI] = (voice->pw >> 8) & 0x0f;
+    data[i * 7 + SID_CTRL] = (voice->waveform << 4) | (voice->test ? 8 : 0) | (voice->ring ? 4 : 0)
+                           | (voice->sync ? 2 : 0) | (voice->gate ? 1 : 0);
+    data[i * 7 + SID_ATKDEC] = (voice->attack << 4) | voice->decay;
+    data[i * 7 + SID_SUSREL] = (voice->sustain << 4) | voice->release;
+  }
+
+  data[SID_FC_LO] = sid->sid_f_cut & 7;
+  data[SID_FC_HI] = (sid->sid_f_cut >> 3) & 0xff;
+  data[SID_RES_FILT] = sid->sid_filter;
+  data[SID_MODE_VOL] = sid->sid_volume | (sid->sid_f_lp ? 0x10 : 0) | (sid->sid_f_bp ? 0x20 : 0)
+                     | (sid->sid_f_hp ? 0x40 : 0) | (sid->sid_voice3off ? 0 : 0x80);
+  data[SID_ENV3] = sid->sid_voice[2].envelopeDigital;
+}
+
+// the registers a host has changed in a record's blocks are written to the chips, as if the cpu had written them.
+// a block as it was saved matches the state, so nothing is written and the machine is the one saved
+static void archive_readCPU(uint8_t *data) {
+  m6510_t *cpu = &m64_cpu;
+
+  cpu->Register_ProgramCounter = data[0] | (data[1] << 8);
+  cpu->registerA = data[2];
+  cpu->registerX = data[3];
+  cpu->registerY = data[4];
+  cpu->registerSP = data[5];
+  if(data[6] != m6510_getStatusRegister(cpu)) {
+    m6510_setStatusRegister(cpu, data[6]);
+  }
+}
+
+static void archive_readVIC(uint8_t *data) {
+  uint32_t i;
+
+  for(i = 0; i < sizeof(vic_registers); i++) {
+    if(data[i] != vic_registers[i]) {
+      vic_write(i, data[i]);
+    }
+  }
+}
+
+// envelope 3 is read only, it's left alone
+static void archive_readSID(uint8_t *data, sid_t *sid) {
+  uint8_t registers[ARCHIVE_SID_LENGTH];
+  uint32_t i;
+
+  memset(registers, 0, sizeof(registers));
+  archive_writeSID(registers, sid);
+  for(i = 0; i <= SID_MODE_VOL; i++) {
+    if(data[i] != registers[i]) {
+      sid_write(sid, i, data[i]);
+    }
+  }
+}
+
+static void archive_readCIA(uint8_t *data, m6526_t *m6526) {
+  uint32_t i;
+
+  for(i = 0; i < sizeof(m6526->regs); i++) {
+    if(data[i] != m6526->regs[i]) {
+      m6526_write(m6526, i, data[i]);
+    }
+  }
+}
+
+// the length of a record big enough for the machine as it is now, a whole number of pages
+uint32_t m64_archiveGetRecordLength() {
+  uint32_t length = ARCHIVE_STATE_OFFSET + state_length(false) + ARCHIVE_STATE_SLACK;
+
+  return (length + ARCHIVE_PAGE_LENGTH - 1) & ~(ARCHIVE_PAGE_LENGTH - 1);
+}
+
+// write the machine into a record of recordLength bytes (from m64_archiveGetRecordLength), the bytes not used are zeroed.
+// tag is kept in the record for the host. returns 0, or -1 if the record isn't big enough
+int32_t m64_archiveSaveRecord(uint8_t *record, uint32_t recordLength, uint32_t tag) {
+  archive_record_t header;
+  int32_t saved;
+  uint32_t i;
+
+  if(recordLength < ARCHIVE_STATE_OFFSET || recordLength % ARCHIVE_PAGE_LENGTH != 0) {
+    return -1;
+  }
+
+  saved = state_save(record + ARCHIVE_STATE_OFFSET, recordLength - ARCHIVE_STATE_OFFSET, false);
+  if(saved < 0) {
+    return -1;
+  }
+
+  memset(record, 0, ARCHIVE_RAM_OFFSET);
+  memset(record + ARCHIVE_STATE_OFFSET + saved, 0, recordLength - ARCHIVE_STATE_OFFSET - saved);
+
+  header.magic = ARCHIVE_MAGIC;
+  header.version = ARCHIVE_VERSION;
+  header.model = m64_model;
+  header.recordLength = recordLength;
+  header.stateLength = saved;
+  header.tag = tag;
+  header.sidCount = sidCount;
+  header.reserved = 0;
+  header.cycle = clock_getTime(&m64_clock, PHASE_PHI2);
+  header.stateHash = hash_machine();
+  memcpy(record, &header, sizeof(header));
+
+  archive_writeCPU(record + ARCHIVE_CPU_OFFSET);
+  memcpy(record + ARCHIVE_VIC_OFFSET, vic_registers, sizeof(vic_registers));
+  for(i = 0; i < sidCount; i++) {
+    archive_writeSID(record + ARCHIVE_SID_OFFSET + i * ARCHIVE_SID_LENGTH, &m64_sids[i]);
+  }
+  memcpy(record + ARCHIVE_CIA1_OFFSET, cia1.regs, sizeof(cia1.regs));
+  memcpy(record + ARCHIVE_CIA2_OFFSET, cia2.regs, sizeof(cia2.regs));
+  memcpy(record + ARCHIVE_COLOR_RAM_OFFSET, colorram_array(), COLOR_RAM_LENGTH);
+
+  memcpy(record + ARCHIVE_RAM_OFFSET, systemram_array(), SYSTEM_RAM_LENGTH);
+  return 0;
+}
+
+// make the machine the one in the record: the chips' insides come from the state, then the ram and colour ram are
+// copied from their pages and the registers from their blocks, so a host can change a record by changing those.
+// returns 0, or -1 if it isn't a record, or is for another model or version
+int32_t m64_archiveLoadRecord(uint8_t *record, uint32_t recordLength) {
+  archive_record_t header;
+  uint32_t i;
+
+  if(recordLength < ARCHIVE_STATE_OFFSET) {
+    return -1;
+  }
+
+  memcpy(&header, record, sizeof(header));
+  if(header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION || header.model != (uint32_t)m64_model) {
+    return -1;
+  }
+  if(header.stateLength > recordLength - ARCHIVE_STATE_OFFSET) {
+    return -1;
+  }
+
+  if(state_load(record + ARCHIVE_STATE_OFFSET, header.stateLength, false) != 0) {
+    return -1;
+  }
+  memcpy(systemram_array(), record + ARCHIVE_RAM_OFFSET, SYSTEM_RAM_LENGTH);
+  systemram_setDirty();
+  memcpy(colorram_array(), record + ARCHIVE_COLOR_RAM_OFFSET, COLOR_RAM_LENGTH);
+
+  archive_readCPU(record + ARCHIVE_CPU_OFFSET);
+  archive_readVIC(record + ARCHIVE_VIC_OFFSET);
+  for(i = 0; i < sidCount && i < header.sidCount; i++) {
+    archive_readSID(record + ARCHIVE_SID_OFFSET + i * ARCHIVE_SID_LENGTH, &m64_sids[i]);
+  }
+  archive_readCIA(record + ARCHIVE_CIA1_OFFSET, &cia1);
+  archive_readCIA(record + ARCHIVE_CIA2_OFFSET, &cia2);
+
+  state_jumped(0);
+  return 0;
+}
+
+// write the header page of an empty archive for records of recordLength bytes
+// returns 0, or -1 if recordLength isn't a whole number of pages
+int32_t m64_archiveInit(uint8_t *archive, uint32_t recordLength) {
+  archive_header_t header;
+
+  if(recordLength < ARCHIVE_STATE_OFFSET || recordLength % ARCHIVE_PAGE_LENGTH != 0) {
+    return -1;
+  }
+
+  header.magic = ARCHIVE_MAGIC;
+  header.version = ARCHIVE_VERSION;
+  header.model = m64_model;
+  header.recordLength = recordLength;
+  header.recordCount = 0;
+
+  memset(archive, 0, ARCHIVE_PAGE_LENGTH);
+  memcpy(archive, &header, sizeof(header));
+  return 0;
+}
+
+// where record is in the archive, the records aren't checked
+uint8_t *m64_archiveGetRecord(uint8_t *archive, uint64_t record) {
+  archive_header_t header;
+
+  memcpy(&header, archive, sizeof(header));
+  return archive + ARCHIVE_PAGE_LENGTH + record * header.recordLength;
+}
+
+// add the machine to the end of an archive of archiveLength bytes (eg a file mapped bigger than it needs to be)
+// returns the record's number, or -1 if the archive is full or the state doesn't fit in its records
+int64_t m64_archiveAppend(uint8_t *archive, uint64_t archiveLength, uint32_t tag) {
+  archive_header_t header;
+
+  memcpy(&header, archive, sizeof(header));
+  if(header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION || header.model != (uint32_t)m64_model) {
+    return -1;
+  }
+  if(ARCHIVE_PAGE_LENGTH + (header.recordCount + 1) * header.recordLength > archiveLength) {
+    return -1;
+  }
+
+  if(m64_archiveSaveRecord(m64_archiveGetRecord(archive, header.recordCount), header.recordLength, tag) != 0) {
+    return -1;
+  }
+
+  header.recordCount++;
+  memcpy(archive, &header, sizeof(header));
+  return header.recordCount - 1;
+}
+
+static int archive_compare(const void *a, const void *b) {
+  const archive_index_t *indexA = a;
+  const archive_index_t *indexB = b;
+
+  if(indexA->stateHash != indexB->stateHash) {
+    return indexA->stateHash < indexB->stateHash ? -1 : 1;
+  }
+  return indexA->record < indexB->record ? -1 : indexA->record > indexB->record;
+}
+
+// fill index (room for the archive's record count) with the records' hashes, sorted so m64_archiveFind can search it.
+// only the first page of each record is read. returns the number of entries, or -1 if it isn't an archive
+int64_t m64_archiveIndex(uint8_t *archive, archive_index_t *index) {
+  archive_header_t header;
+  archive_record_t record;
+  uint64_t i;
+
+  memcpy(&header, archive, sizeof(header));
+  if(header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION) {
+    return -1;
+  }
+
+  for(i = 0; i < header.recordCount; i++) {
+    memcpy(&record, m64_archiveGetRecord(archive, i), sizeof(record));
+    index[i].stateHash = record.stateHash;
+    index[i].record = i;
+  }
+
+  qsort(index, header.recordCount, sizeof(archive_index_t), archive_compare);
+  return header.recordCount;
+}
+
+// the first record with the hash in an index from m64_archiveIndex, or -1 if there isn't one
+int64_t m64_archiveFind(archive_index_t *index, uint64_t count, uint64_t stateHash) {
+  uint64_t low = 0;
+  uint64_t high = count;
+  uint64_t middle;
+
+  while(low < high) {
+    middle = low + (high - low) / 2;
+    if(index[middle].stateHash < stateHash) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  if(low < count && index[low].stateHash == stateHash) {
+    return index[low].record;
+  }
+  return -1;
+}
@@ -0,0 +1,94 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+// snapshot archives, for keeping a great many states in one file the host can map into memory.
+// an archive is a header page followed by records that are all the same length, a whole number of pages,
+// so record n is at ARCHIVE_PAGE_LENGTH + n * recordLength and nothing has to be read to find it.
+// in each record the 64k of system ram, the colour ram and the registers of the cpu and the chips are at fixed
+// page aligned offsets, so a host can read them (or copy the ram's pages) straight from the mapping.
+// the rest of the machine (the chips' insides, the drives, the clock's events) is a save state without the system
+// ram, at ARCHIVE_STATE_OFFSET. loading a record loads the state, then takes the ram, colour ram and registers
+// from their pages, so a record can be changed in place (a register that differs is written to its chip).
+//
+// the fields are in the host's byte order, as save states are. roms and media aren't in the records,
+// the same ones have to be loaded before loading one
+
+#define ARCHIVE_MAGIC   0x4134364d    // "M64A"
+#define ARCHIVE_VERSION 1
+
+#define ARCHIVE_PAGE_LENGTH 0x1000
+
+// offsets in a record
+#define ARCHIVE_CPU_OFFSET        0x100
+#define ARCHIVE_VIC_OFFSET        0x200
+#define ARCHIVE_SID_OFFSET        0x300
+#define ARCHIVE_CIA1_OFFSET       0x400
+#define ARCHIVE_CIA2_OFFSET       0x410
+#define ARCHIVE_COLOR_RAM_OFFSET  0x800
+#define ARCHIVE_RAM_OFFSET        0x1000
+#define ARCHIVE_STATE_OFFSET      (ARCHIVE_RAM_OFFSET + 0x10000)
+
+// the registers are as the chips keep them, so they can be searched without loading the record
+// cpu: pc low, pc high, a, x, y, sp, status
+#define ARCHIVE_CPU_LENGTH 7
+// sid: $00-$18 as last written and envelope 3 at $1c, 0x20 for each sid
+#define ARCHIVE_SID_LENGTH 0x20
+
+// room for the state to grow (eg when the 1541 is attached) in records made for the machine as it is now
+#define ARCHIVE_STATE_SLACK 8192
+
+// the archive's first page
+struct archive_header_s {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t model;
+  uint32_t recordLength;
+  uint64_t recordCount;
+};
+
+typedef struct archive_header_s archive_header_t;
+
+// at the start of each record
+struct archive_record_s {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t model;
+  uint32_t recordLength;
+  uint32_t stateLength;
+  // the host's own value for the record
+  uint32_t tag;
+  uint32_t sidCount;
+  uint32_t reserved;
+  // cycle since reset, and m64_getStateHash's hash of the machine, when the record was made
+  uint64_t cycle;
+  uint64_t stateHash;
+};
+
+typedef struct archive_record_s archive_record_t;
+
+// m64_archiveIndex, sorted by hash
+struct archive_index_s {
+  uint64_t stateHash;
+  uint64_t record;
+};
+
+typedef struct archive_index_s archive_index_t;
+
+uint32_t m64_archiveGetRecordLength();
+int32_t m64_archiveSaveRecord(uint8_t *record, uint32_t recordLength, uint32_t tag);
+int32_t m64_archiveLoadRecord(uint8_t *record, uint32_t recordLength);
+
+int32_t m64_archiveInit(uint8_t *archive, uint32_t recordLength);
+uint8_t *m64_archiveGetRecord(uint8_t *archive, uint64_t record);
+int64_t m64_archiveAppend(uint8_t *archive, uint64_t archiveLength, uint32_t tag);
+int64_t m64_archiveIndex(uint8_t *archive, archive_index_t *index);
+int64_t m64_archiveFind(archive_index_t *index, uint64_t count, uint64_t stateHash);
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#include "../m64.h"
+
+bool_t boot_enabled = true;
+
+boot_entry_t boot_entries[BOOT_CACHE_ENTRIES];
+uint32_t boot_count = 0;
+
+// the entry replaced when the cache is full
+uint32_t boot_next = 0;
+
+// key of the reset boot_restore didn't find, for boot_save
+uint64_t boot_key = 0;
+bool_t boot_missed = false;
+
+// the state just after the reset, to work out the key from
+uint8_t *boot_buffer = NULL;
+uint32_t boot_bufferLength = 0;
+
+static void boot_free() {
+  uint32_t i;
+
+  for(i = 0; i < boot_count; i++) {
+    free(boot_entries[i].data);
+    boot_entries[i].data = NULL;
+  }
+  boot_count = 0;
+  boot_next = 0;
+
+  free(boot_buffer);
+  boot_buffer = NULL;
+  boot_bufferLength = 0;
+  boot_missed = false;
+}
+
+static bool_t boot_getKey(uint64_t *key) {
+  uint32_t length = state_length(true);
+  uint64_t seed;
+  uint8_t *buffer;
+  int32_t saved;
+
+  if(length > boot_bufferLength) {
+    buffer = realloc(boot_buffer, length);
+    if(buffer == NULL) {
+      return false;
+    }
+    boot_buffer = buffer;
+    boot_bufferLength = length;
+  }
+
+  saved = state_save(boot_buffer, boot_bufferLength, true);
+  if(saved < 0) {
+    return false;
+  }
+
+  seed = kernal_getIsM64Kernal();
+  seed = hash_xxh64(KERNALROM, KERNAL_ROM_LENGTH, seed);
+  seed = hash_xxh64(BASICROM, BASIC_ROM_LENGTH, seed);
+  seed = hash_xxh64(CHARROM, CHAR_ROM_LENGTH, seed);
+  seed = hash_xxh64(drive_rom, DRIVE_ROM_LENGTH, seed);
+  *key = hash_xxh64(boot_buffer, saved, seed);
+  return true;
+}
+
+// called by m64_runUntilKernalReady before running the startup
+// returns true if a cached state has been loaded and the startup doesn't need to run
+bool_t boot_restore() {
+  uint32_t i;
+
+  boot_missed = false;
+  if(!boot_enabled || !boot_getKey(&boot_key)) {
+    return false;
+  }
+
+  for(i = 0; i < boot_count; i++) {
+    if(boot_entries[i].key == boot_key) {
+      if(state_load(boot_entries[i].data, boot_entries[i].length, true) == 0) {
+        return true;
+      }
+      break;
+    }
+  }
+
+  boot_missed = true;
+  return false;
+}
+
+// called by m64_runUntilKernalReady when the startup has got to the kernal's loop
+void boot_save() {
+  boot_entry_t *entry;
+  uint32_t i;
+  uint32_t length;
+  uint8_t *data;
+  int32_t saved;
+
+  if(!boot_missed) {
+    return;
+  }
+  boot_missed = false;
+
+  // an entry with the key is one that couldn't be loaded, it's saved over
+  entry = NULL;
+  for(i = 0; i < boot_count; i++) {
+    if(boot_entries[i].key == boot_key) {
+      entry = &boot_entries[i];
+    }
+  }
+
+  if(entry == NULL) {
+    if(boot_count < BOOT_CACHE_ENTRIES) {
+      entry = &boot_entries[boot_count++];
+      entry->data = NULL;
+    } else {
+      entry = &boot_entries[boot_next];
+      boot_next = (boot_next + 1) % BOOT_CACHE_ENTRIES;
+    }
+    entry->length = 0;
+  }
+  entry->key = boot_key;
+
+  length = state_length(true);
+  data = realloc(entry->data, length);
+  if(data == NULL) {
+    entry->length = 0;
+    return;
+  }
+  entry->data = data;
+
+  saved = state_save(entry->data, length, true);
+  entry->length = saved < 0 ? 0 : saved;
+}
+
+// the cache is on by default, turning it off frees the states kept
+void m64_setBootCache(uint32_t enabled) {
+  boot_free();
+  boot_enabled = enabled != 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#ifndef BOOT_H
+#define BOOT_H
+
+// the boot cache: m64_runUntilKernalReady runs up to 200 frames of kernal startup every time a prg is started.
+// the state the kernal gets to is saved, and the next time the machine starts from the same place it's loaded
+// instead of running the startup again.
+//
+// the key is a hash of the whole state just after the reset (so it covers the model, the sids and their models,
+// the drives and anything else that's in a save state) seeded with a hash of the roms, which aren't in the state.
+// a state that's loaded is the same bit for bit as the one running the startup would get to. the key only matches
+// when the resets put every chip's saved registers and latches back to power on (vic_reset, sprite_reset,
+// m6526_reset, sid_reset), a field one of them misses makes every reset after a program has run a miss, which
+// costs the hash and the save on top of the startup. test/test.c checks a reset after a program hits.
+
+#define BOOT_CACHE_ENTRIES 4
+
+struct boot_entry_s {
+  uint64_t key;
+  uint8_t *data;
+  uint32_t length;
+};
+
+typedef struct boot_entry_s boot_entry_t;
+
+bool_t boot_restore();
+void boot_save();
+
+void m64_setBootCache(uint32_t enabled);
+
+#endif
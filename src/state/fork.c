@@ -0,0 +1,159 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#include "../m64.h"
+
+// room for the state to grow before a fork's buffer has to be reallocated
+#define FORK_STATE_SLACK 8192
+
+fork_t fork_forks[FORK_MAX_FORKS];
+
+// the fork the machine was made from or last loaded, its pages are the ones to share, -1 for none
+int32_t fork_base = -1;
+
+// pages held by all the forks
+uint32_t fork_pageCount = 0;
+
+static void fork_releasePage(fork_page_t *page) {
+  if(page == NULL) {
+    return;
+  }
+  page->references--;
+  if(page->references == 0) {
+    free(page);
+    fork_pageCount--;
+  }
+}
+
+static void fork_releasePages(fork_t *fork) {
+  uint32_t i;
+
+  for(i = 0; i < FORK_PAGES; i++) {
+    fork_releasePage(fork->pages[i]);
+    fork->pages[i] = NULL;
+  }
+}
+
+// share the base's page if ram is the same, otherwise copy it
+static fork_page_t *fork_page(fork_t *base, uint32_t index, uint8_t *ram) {
+  fork_page_t *page;
+
+  if(base != NULL && memcmp(base->pages[index]->data, ram, FORK_PAGE_LENGTH) == 0) {
+    page = base->pages[index];
+    page->references++;
+    return page;
+  }
+
+  page = malloc(sizeof(fork_page_t));
+  if(page == NULL) {
+    return NULL;
+  }
+  page->references = 1;
+  memcpy(page->data, ram, FORK_PAGE_LENGTH);
+  fork_pageCount++;
+  return page;
+}
+
+// fork the machine as it is now, the machine carries on as it was
+// returns the fork's id, or -1 if there is no room
+int32_t m64_fork() {
+  fork_t *fork = NULL;
+  fork_t *base = fork_base >= 0 ? &fork_forks[fork_base] : NULL;
+  uint8_t *ram = systemram_array();
+  uint8_t *data;
+  uint32_t length, i;
+  int32_t id, saved;
+
+  for(id = 0; id < FORK_MAX_FORKS; id++) {
+    if(!fork_forks[id].used) {
+      fork = &fork_forks[id];
+      break;
+    }
+  }
+  if(fork == NULL) {
+    return -1;
+  }
+
+  saved = fork->state ? state_save(fork->state, fork->stateCapacity, false) : -1;
+  if(saved < 0) {
+    length = state_length(false) + FORK_STATE_SLACK;
+    data = realloc(fork->state, length);
+    if(data == NULL) {
+      return -1;
+    }
+    fork->state = data;
+    fork->stateCapacity = length;
+    saved = state_save(fork->state, fork->stateCapacity, false);
+    if(saved < 0) {
+      return -1;
+    }
+  }
+  fork->stateLength = saved;
+
+  for(i = 0; i < FORK_PAGES; i++) {
+    fork->pages[i] = fork_page(base, i, ram + i * FORK_PAGE_LENGTH);
+    if(fork->pages[i] == NULL) {
+      fork_releasePages(fork);
+      return -1;
+    }
+  }
+
+  fork->used = true;
+  fork_base = id;
+  return id;
+}
+
+// make the machine a copy of a fork, the fork is kept so it can be loaded again
+// returns 0, or -1 if there is no fork with that id
+int32_t m64_forkLoad(uint32_t id) {
+  fork_t *fork;
+  uint8_t *ram = systemram_array();
+  uint32_t i;
+
+  if(id >= FORK_MAX_FORKS || !fork_forks[id].used) {
+    return -1;
+  }
+  fork = &fork_forks[id];
+
+  if(state_load(fork->state, fork->stateLength, false) != 0) {
+    return -1;
+  }
+  for(i = 0; i < FORK_PAGES; i++) {
+    memcpy(ram + i * FORK_PAGE_LENGTH, fork->pages[i]->data, FORK_PAGE_LENGTH);
+  }
+  systemram_setDirty();
+  state_jumped(0);
+
+  fork_base = id;
+  return 0;
+}
+
+// let a fork go, pages the other forks share are kept
+void m64_forkFree(uint32_t id) {
+  fork_t *fork;
+
+  if(id >= FORK_MAX_FORKS || !fork_forks[id].used) {
+    return;
+  }
+  fork = &fork_forks[id];
+
+  fork_releasePages(fork);
+  free(fork->state);
+  fork->state = NULL;
+  fork->stateLength = 0;
+  fork->stateCapacity = 0;
+  fork->used = false;
+
+  if(fork_base == (int32_t)id) {
+    fork_base = -1;
+  }
+}
+
+// the number of ram pages (FORK_PAGE_LENGTH bytes each) all the forks hold between them
+uint32_t m64_forkGetPageCount() {
+  return fork_pageCount;
+}
@@ -0,0 +1,48 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#ifndef FORK_H
+#define FORK_H
+
+// forks: copies of the machine to try different things from. there is one machine, a fork is kept as a save state
+// without the system ram, and the ram as 256 pages that are shared with other forks. when a fork is made, each page
+// that is the same as the page the machine was last forked from or loaded from is shared instead of copied, so
+// forks of forks only hold the pages that were written in between.
+// roms and cartridge banks aren't in the state so are never copied, every fork runs with the ones loaded now
+
+#define FORK_MAX_FORKS 64
+
+#define FORK_PAGE_LENGTH 256
+#define FORK_PAGES       (0x10000 / FORK_PAGE_LENGTH)    // the 64k of system ram
+
+struct fork_page_s {
+  // the number of forks using the page
+  uint32_t references;
+  uint8_t data[FORK_PAGE_LENGTH];
+};
+
+typedef struct fork_page_s fork_page_t;
+
+struct fork_s {
+  bool_t used;
+
+  // the machine without the system ram
+  uint8_t *state;
+  uint32_t stateLength;
+  uint32_t stateCapacity;
+
+  fork_page_t *pages[FORK_PAGES];
+};
+
+typedef struct fork_s fork_t;
+
+int32_t m64_fork();
+int32_t m64_forkLoad(uint32_t id);
+void m64_forkFree(uint32_t id);
+uint32_t m64_forkGetPageCount();
+
+#endif
@@ -0,0 +1,208 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#include "../m64.h"
+
+// the hash of each page of system ram, as of the last frame
+uint64_t hash_pages[SYSTEM_RAM_PAGES];
+
+uint64_t hash_state = 0;
+
+// the registers are copied one after another into a buffer, then hashed
+uint8_t hash_registers[HASH_REGISTERS_LENGTH];
+uint32_t hash_registersLength = 0;
+
+#define HASH_VALUE(value) hash_value(&(value), sizeof(value))
+
+static void hash_value(void *value, uint32_t length) {
+  if(hash_registersLength + length > HASH_REGISTERS_LENGTH) {
+    return;
+  }
+  memcpy(hash_registers + hash_registersLength, value, length);
+  hash_registersLength += length;
+}
+
+static uint64_t hash_rotate(uint64_t value, uint32_t bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t hash_round(uint64_t accumulator, uint64_t input) {
+  accumulator += input * HASH_PRIME2;
+  accumulator = hash_rotate(accumulator, 31);
+  return accumulator * HASH_PRIME1;
+}
+
+static uint64_t hash_mergeRound(uint64_t accumulator, uint64_t value) {
+  accumulator ^= hash_round(0, value);
+  return accumulator * HASH_PRIME1 + HASH_PRIME4;
+}
+
+// xxhash64 of length bytes
+uint64_t hash_xxh64(uint8_t *data, uint32_t length, uint64_t seed) {
+  uint8_t *end = data + length;
+  uint64_t v1, v2, v3, v4, hash, word;
+  uint32_t word32;
+
+  if(length >= 32) {
+    v1 = seed + HASH_PRIME1 + HASH_PRIME2;
+    v2 = seed + HASH_PRIME2;
+    v3 = seed;
+    v4 = seed - HASH_PRIME1;
+
+    while(data + 32 <= end) {
+      memcpy(&word, data, 8);
+      v1 = hash_round(v1, word);
+      memcpy(&word, data + 8, 8);
+      v2 = hash_round(v2, word);
+      memcpy(&word, data + 16, 8);
+      v3 = hash_round(v3, word);
+      memcpy(&word, data + 24, 8);
+      v4 = hash_round(v4, word);
+      data += 32;
+    }
+
+    hash = hash_rotate(v1, 1) + hash_rotate(v2, 7) + hash_rotate(v3, 12) + hash_rotate(v4, 18);
+    hash = hash_mergeRound(hash, v1);
+    hash = hash_mergeRound(hash, v2);
+    hash = hash_mergeRound(hash, v3);
+    hash = hash_mergeRound(hash, v4);
+  } else {
+    hash = seed + HASH_PRIME5;
+  }
+
+  hash += length;
+
+  while(data + 8 <= end) {
+    memcpy(&word, data, 8);
+    hash ^= hash_round(0, word);
+    hash = hash_rotate(hash, 27) * HASH_PRIME1 + HASH_PRIME4;
+    data += 8;
+  }
+  if(data + 4 <= end) {
+    memcpy(&word32, data, 4);
+    hash ^= (uint64_t)word32 * HASH_PRIME1;
+    hash = hash_rotate(hash, 23) * HASH_PRIME2 + HASH_PRIME3;
+    data += 4;
+  }
+  while(data < end) {
+    hash ^= (*data) * HASH_PRIME5;
+    hash = hash_rotate(hash, 11) * HASH_PRIME1;
+    data++;
+  }
+
+  hash ^= hash >> 33;
+  hash *= HASH_PRIME2;
+  hash ^= hash >> 29;
+  hash *= HASH_PRIME3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+// the registers that make up the rest of the hash, field by field so padding isn't hashed
+static void hash_addRegisters() {
+  m6510_t *cpu = &m64_cpu;
+  sid_voice_t *voice;
+  sid_t *sid;
+  uint32_t i, j;
+
+  hash_registersLength = 0;
+
+  HASH_VALUE(cpu->registerA);
+  HASH_VALUE(cpu->registerX);
+  HASH_VALUE(cpu->registerY);
+  HASH_VALUE(cpu->registerSP);
+  HASH_VALUE(cpu->Register_ProgramCounter);
+  HASH_VALUE(cpu->nextOpcodeLocation);
+  HASH_VALUE(cpu->cycleCount);
+  HASH_VALUE(cpu->flagN);
+  HASH_VALUE(cpu->flagC);
+  HASH_VALUE(cpu->flagD);
+  HASH_VALUE(cpu->flagZ);
+  HASH_VALUE(cpu->flagV);
+  HASH_VALUE(cpu->flagI);
+  HASH_VALUE(cpu->irqAssertedOnPin);
+
+  HASH_VALUE(vic_registers);
+  HASH_VALUE(vic_rasterY);
+  HASH_VALUE(vic_cycle);
+
+  HASH_VALUE(cia1.regs);
+  HASH_VALUE(cia2.regs);
+
+  // the sid's registers are kept decoded, and the oscillators and envelopes can be read back by the cpu
+  for(i = 0; i < sidCount; i++) {
+    sid = &m64_sids[i];
+    for(j = 0; j < 3; j++) {
+      voice = &sid->sid_voice[j];
+      HASH_VALUE(voice->freq);
+      HASH_VALUE(voice->pw);
+      HASH_VALUE(voice->waveform);
+      HASH_VALUE(voice->test);
+      HASH_VALUE(voice->ring);
+      HASH_VALUE(voice->sync);
+      HASH_VALUE(voice->gate);
+      HASH_VALUE(voice->attack);
+      HASH_VALUE(voice->decay);
+      HASH_VALUE(voice->sustain);
+      HASH_VALUE(voice->release);
+      HASH_VALUE(voice->accumulator);
+      HASH_VALUE(voice->noiseShiftRegister);
+      HASH_VALUE(voice->envelopeDigital);
+    }
+    HASH_VALUE(sid->sid_filt1);
+    HASH_VALUE(sid->sid_filt2);
+    HASH_VALUE(sid->sid_filt3);
+    HASH_VALUE(sid->sid_filtE);
+    HASH_VALUE(sid->sid_f_lp);
+    HASH_VALUE(sid->sid_f_bp);
+    HASH_VALUE(sid->sid_f_hp);
+    HASH_VALUE(sid->sid_f_cut);
+    HASH_VALUE(sid->sid_volume);
+  }
+}
+
+// the hash of the machine as it is now, the pages written since the last time are hashed again
+uint64_t hash_machine() {
+  uint8_t *ram = systemram_array();
+  uint32_t i;
+  uint64_t hash;
+
+  // the sids only catch up when they are touched
+  sid_update();
+
+  for(i = 0; i < SYSTEM_RAM_PAGES; i++) {
+    if(systemram_dirty[i]) {
+      systemram_dirty[i] = false;
+      hash_pages[i] = hash_xxh64(ram + i * SYSTEM_RAM_PAGE_LENGTH, SYSTEM_RAM_PAGE_LENGTH, i);
+    }
+  }
+
+  hash = hash_xxh64((uint8_t *)hash_pages, sizeof(hash_pages), 0);
+  hash = hash_xxh64(colorram_array(), COLOR_RAM_LENGTH, hash);
+
+  hash_addRegisters();
+  return hash_xxh64(hash_registers, hash_registersLength, hash);
+}
+
+// called at the end of every frame
+void hash_frame() {
+  hash_state = hash_machine();
+}
+
+// the hash as of the end of the last frame
+uint64_t m64_getStateHash() {
+  return hash_state;
+}
+
+// m64_getStateHash in two halves, for hosts that can't take 64 bit values
+uint32_t m64_getStateHashLow() {
+  return hash_state & 0xffffffff;
+}
+
+uint32_t m64_getStateHashHigh() {
+  return hash_state >> 32;
+}
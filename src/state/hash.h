@@ -0,0 +1,38 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+// a 64 bit hash of the machine, worked out at the end of every frame, so two machines that should be running
+// in step can check they are by comparing one value a frame. it covers the system ram, the colour ram, the cpu
+// registers and the chips' registers (and the sid oscillators and envelopes the cpu can read back).
+// the system ram is hashed in pages of SYSTEM_RAM_PAGE_LENGTH, only the pages written since the last frame are hashed
+// again (systemram_write marks them), so it is cheap enough to leave on.
+//
+// the sid's filter and output, the pixel and audio buffers, and timing the host picks (the audio rate control)
+// are left out, so machines with different audio setups still match
+
+// xxhash64
+#define HASH_PRIME1 0x9e3779b185ebca87ULL
+#define HASH_PRIME2 0xc2b2ae3d27d4eb4fULL
+#define HASH_PRIME3 0x165667b19e3779f9ULL
+#define HASH_PRIME4 0x85ebca77c2b2ae63ULL
+#define HASH_PRIME5 0x27d4eb2f165667c5ULL
+
+// room for the cpu and chip registers
+#define HASH_REGISTERS_LENGTH 1024
+
+uint64_t hash_xxh64(uint8_t *data, uint32_t length, uint64_t seed);
+uint64_t hash_machine();
+void hash_frame();
+
+uint64_t m64_getStateHash();
+uint32_t m64_getStateHashLow();
+uint32_t m64_getStateHashHigh();
+
+#endif
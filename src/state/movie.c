@@ -0,0 +1,443 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#include "../m64.h"
+
+extern int32_t m64_model;
+
+uint32_t movie_status = MOVIE_IDLE;
+
+// the movie being recorded, or a copy of the one being played
+uint8_t *movie_data = NULL;
+uint32_t movie_length = 0;
+uint32_t movie_capacity = 0;
+
+// time of the last record written or read
+uint64_t movie_lastTime = 0;
+uint32_t movie_frameCount = 0;
+
+// playback: where the next record starts, and the next record
+uint32_t movie_position = 0;
+uint32_t movie_nextType;
+uint64_t movie_nextTime;
+uint64_t movie_nextArguments[MOVIE_MAX_ARGUMENTS];
+uint8_t *movie_nextData;
+uint32_t movie_nextDataLength;
+
+// number of arguments for each type of record
+static const uint8_t movie_argumentCounts[MOVIE_RECORD_TYPES] = {
+  1,    // MOVIE_KEY_DOWN: key
+  1,    // MOVIE_KEY_UP: key
+  1,    // MOVIE_KEYBOARD_STATE: keys
+  2,    // MOVIE_JOYSTICK_PUSH: port, direction
+  2,    // MOVIE_JOYSTICK_RELEASE: port, direction
+  3,    // MOVIE_MOUSE_MOVE: port, dx, dy
+  3,    // MOVIE_PADDLE: port, paddle, value
+  2,    // MOVIE_POT_DEVICE: port, device
+  3,    // MOVIE_LIGHTPEN: x, y, button
+  4,    // MOVIE_QUEUE_INPUT: cycle, type, code, value
+  0,    // MOVIE_CLEAR_INPUT_QUEUE
+  1,    // MOVIE_RESET: runUntilKernalIsReady
+  0,    // MOVIE_INJECT_PRG: data
+  1,    // MOVIE_INJECT_AND_RUN: delay, data
+  0,    // MOVIE_LOAD_CARTRIDGE: data
+  0,    // MOVIE_REMOVE_CARTRIDGE
+  2,    // MOVIE_RAM_WRITE: address, value
+  2,    // MOVIE_CPU_WRITE: address, value
+  1,    // MOVIE_FRAME: hash
+  2,    // MOVIE_SDR_ATTACH: cia, cyclesPerBit
+  2,    // MOVIE_SDR_WRITE: cia, byte
+  1,    // MOVIE_SDR_READ: cia
+  1,    // MOVIE_DRIVE_ATTACH: device number
+  0,    // MOVIE_DRIVE_DETACH
+  0,    // MOVIE_DRIVE_INSERT_D64: data
+  0,    // MOVIE_DRIVE_EJECT
+  1,    // MOVIE_VDRIVE_ATTACH: device number
+  0,    // MOVIE_VDRIVE_DETACH
+  0,    // MOVIE_VDRIVE_INSERT_D64: data
+  0,    // MOVIE_VDRIVE_EJECT
+  1,    // MOVIE_VDRIVE_ADD_FILE: name length, data (the petscii name then the file)
+  0,    // MOVIE_VDRIVE_CLEAR
+  1     // MOVIE_KERNAL_LOAD_TRAP: enabled
+};
+
+static bool_t movie_hasData(uint32_t type) {
+  return type == MOVIE_INJECT_PRG || type == MOVIE_INJECT_AND_RUN || type == MOVIE_LOAD_CARTRIDGE
+      || type == MOVIE_DRIVE_INSERT_D64 || type == MOVIE_VDRIVE_INSERT_D64 || type == MOVIE_VDRIVE_ADD_FILE;
+}
+
+
+// --- writing ---
+
+static bool_t movie_reserve(uint32_t length) {
+  uint32_t capacity = movie_capacity ? movie_capacity : 65536;
+  uint8_t *data;
+
+  if(movie_length + length <= movie_capacity) {
+    return true;
+  }
+  while(capacity < movie_length + length) {
+    capacity *= 2;
+  }
+  data = realloc(movie_data, capacity);
+  if(data == NULL) {
+    return false;
+  }
+  movie_data = data;
+  movie_capacity = capacity;
+  return true;
+}
+
+static void movie_writeVarint(uint64_t value) {
+  while(value >= 0x80) {
+    movie_data[movie_length++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  movie_data[movie_length++] = value;
+}
+
+// hash of the ram and the last frame, a word at a time
+static uint64_t movie_frameHash() {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  uint8_t *ram = systemram_array();
+  uint64_t word;
+  uint32_t i;
+
+  for(i = 0; i < SYSTEM_RAM_LENGTH; i += 8) {
+    memcpy(&word, ram + i, 8);
+    hash = (hash ^ word) * 0x100000001b3ULL;
+    hash ^= hash >> 29;
+  }
+  for(i = 0; i < VIC_PIXELS_LENGTH; i += 2) {
+    memcpy(&word, vic_pixelBuffer + i, 8);
+    hash = (hash ^ word) * 0x100000001b3ULL;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+// add a call to the movie being recorded, arguments past the type's count are ignored
+void movie_record(uint32_t type, uint64_t a, uint64_t b, uint64_t c, uint64_t d, uint8_t *data, uint32_t dataLength) {
+  uint64_t arguments[MOVIE_MAX_ARGUMENTS] = { a, b, c, d };
+  uint64_t time = clock_getTimeAndPhase(&m64_clock);
+  int64_t delta = (int64_t)(time - movie_lastTime);
+  uint32_t i;
+
+  if(movie_status != MOVIE_RECORDING) {
+    return;
+  }
+
+  // type, time, arguments and data are at most 10 bytes each
+  if(!movie_reserve(1 + 10 * (2 + MOVIE_MAX_ARGUMENTS) + dataLength)) {
+    movie_status = MOVIE_IDLE;
+    return;
+  }
+
+  movie_data[movie_length++] = type;
+  movie_writeVarint(((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+  for(i = 0; i < movie_argumentCounts[type]; i++) {
+    movie_writeVarint(arguments[i]);
+  }
+  if(movie_hasData(type)) {
+    movie_writeVarint(dataLength);
+    memcpy(movie_data + movie_length, data, dataLength);
+    movie_length += dataLength;
+  }
+
+  movie_lastTime = time;
+}
+
+
+// --- reading ---
+
+static bool_t movie_readVarint(uint64_t *value) {
+  uint32_t shift = 0;
+  uint8_t byte;
+
+  *value = 0;
+  do {
+    if(movie_position >= movie_length || shift > 63) {
+      return false;
+    }
+    byte = movie_data[movie_position++];
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    shift += 7;
+  } while(byte & 0x80);
+
+  return true;
+}
+
+// decode the next record, the movie is finished when there isn't one
+static void movie_readNext() {
+  uint64_t zigzag, length;
+  uint32_t i;
+
+  if(movie_position >= movie_length) {
+    movie_status = MOVIE_FINISHED;
+    return;
+  }
+
+  movie_nextType = movie_data[movie_position++];
+  if(movie_nextType >= MOVIE_RECORD_TYPES || !movie_readVarint(&zigzag)) {
+    movie_status = MOVIE_DESYNC;
+    return;
+  }
+  movie_nextTime = movie_lastTime + (uint64_t)((int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1));
+  movie_lastTime = movie_nextTime;
+
+  for(i = 0; i < movie_argumentCounts[movie_nextType]; i++) {
+    if(!movie_readVarint(&movie_nextArguments[i])) {
+      movie_status = MOVIE_DESYNC;
+      return;
+    }
+  }
+
+  movie_nextData = NULL;
+  movie_nextDataLength = 0;
+  if(movie_hasData(movie_nextType)) {
+    if(!movie_readVarint(&length) || length > movie_length - movie_position) {
+      movie_status = MOVIE_DESYNC;
+      return;
+    }
+    movie_nextData = movie_data + movie_position;
+    movie_nextDataLength = length;
+    movie_position += length;
+  }
+}
+
+// make the call again, recording is off while playing so it isn't logged twice
+static void movie_apply() {
+  uint64_t *arguments = movie_nextArguments;
+
+  switch(movie_nextType) {
+    case MOVIE_KEY_DOWN:
+      m64_keyPush(arguments[0]);
+      break;
+    case MOVIE_KEY_UP:
+      m64_keyRelease(arguments[0]);
+      break;
+    case MOVIE_KEYBOARD_STATE:
+      m64_setKeyboardState(arguments[0]);
+      break;
+    case MOVIE_JOYSTICK_PUSH:
+      m64_joystickPush(arguments[0], arguments[1]);
+      break;
+    case MOVIE_JOYSTICK_RELEASE:
+      m64_joystickRelease(arguments[0], arguments[1]);
+      break;
+    case MOVIE_MOUSE_MOVE:
+      m64_mouseMove(arguments[0], (int32_t)arguments[1], (int32_t)arguments[2]);
+      break;
+    case MOVIE_PADDLE:
+      m64_setPaddle(arguments[0], arguments[1], arguments[2]);
+      break;
+    case MOVIE_POT_DEVICE:
+      m64_setPotDevice(arguments[0], arguments[1]);
+      break;
+    case MOVIE_LIGHTPEN:
+      m64_setLightpen((int32_t)arguments[0], (int32_t)arguments[1], arguments[2]);
+      break;
+    case MOVIE_QUEUE_INPUT:
+      m64_queueInput(arguments[0], arguments[1], arguments[2], arguments[3]);
+      break;
+    case MOVIE_CLEAR_INPUT_QUEUE:
+      m64_clearInputQueue();
+      break;
+    case MOVIE_RESET:
+      m64_reset(arguments[0]);
+      break;
+    case MOVIE_INJECT_PRG:
+      m64_injectPrg(movie_nextData, movie_nextDataLength);
+      break;
+    case MOVIE_INJECT_AND_RUN:
+      m64_injectAndRunPrg(movie_nextData, movie_nextDataLength, arguments[0]);
+      break;
+    case MOVIE_LOAD_CARTRIDGE:
+      m64_loadCartridge(movie_nextData, movie_nextDataLength);
+      break;
+    case MOVIE_REMOVE_CARTRIDGE:
+      m64_removeCartridge();
+      break;
+    case MOVIE_RAM_WRITE:
+      m64_ramWrite(arguments[0], arguments[1]);
+      break;
+    case MOVIE_CPU_WRITE:
+      m64_cpuWrite(arguments[0], arguments[1]);
+      break;
+    case MOVIE_SDR_ATTACH:
+      m64_sdrAttach(arguments[0], arguments[1]);
+      break;
+    case MOVIE_SDR_WRITE:
+      m64_sdrWrite(arguments[0], arguments[1]);
+      break;
+    case MOVIE_SDR_READ:
+      m64_sdrRead(arguments[0]);
+      break;
+    case MOVIE_DRIVE_ATTACH:
+      m64_driveAttach(arguments[0]);
+      break;
+    case MOVIE_DRIVE_DETACH:
+      m64_driveDetach();
+      break;
+    case MOVIE_DRIVE_INSERT_D64:
+      m64_driveInsertD64(movie_nextData, movie_nextDataLength);
+      break;
+    case MOVIE_DRIVE_EJECT:
+      m64_driveEject();
+      break;
+    case MOVIE_VDRIVE_ATTACH:
+      m64_vdriveAttach(arguments[0]);
+      break;
+    case MOVIE_VDRIVE_DETACH:
+      m64_vdriveDetach();
+      break;
+    case MOVIE_VDRIVE_INSERT_D64:
+      m64_vdriveInsertD64(movie_nextData, movie_nextDataLength);
+      break;
+    case MOVIE_VDRIVE_EJECT:
+      m64_vdriveEject();
+      break;
+    case MOVIE_VDRIVE_ADD_FILE:
+      if(arguments[0] <= movie_nextDataLength) {
+        vdrive_addFile(movie_nextData, arguments[0], movie_nextData + arguments[0], movie_nextDataLength - arguments[0]);
+      }
+      break;
+    case MOVIE_VDRIVE_CLEAR:
+      m64_vdriveClearFiles();
+      break;
+    case MOVIE_KERNAL_LOAD_TRAP:
+      m64_setKernalLoadTrap(arguments[0]);
+      break;
+  }
+}
+
+// called between clock steps while playing, makes the calls that are due
+void movie_poll() {
+  uint64_t now = clock_getTimeAndPhase(&m64_clock);
+
+  while(movie_status == MOVIE_PLAYING && movie_nextTime <= now) {
+    if(movie_nextType == MOVIE_FRAME) {
+      // the frame should have ended by now
+      if(movie_nextTime < now) {
+        movie_status = MOVIE_DESYNC;
+      }
+      return;
+    }
+    movie_apply();
+    movie_readNext();
+    now = clock_getTimeAndPhase(&m64_clock);
+  }
+}
+
+// called at the end of every frame, after the pixel buffer has been updated
+void movie_frame() {
+  uint64_t hash;
+
+  if(movie_status == MOVIE_RECORDING) {
+    movie_frameCount++;
+    movie_record(MOVIE_FRAME, movie_frameHash(), 0, 0, 0, NULL, 0);
+  } else if(movie_status == MOVIE_PLAYING) {
+    movie_frameCount++;
+    hash = movie_frameHash();
+    if(movie_nextType != MOVIE_FRAME || movie_nextTime != clock_getTimeAndPhase(&m64_clock) || movie_nextArguments[0] != hash) {
+      movie_status = MOVIE_DESYNC;
+      return;
+    }
+    movie_readNext();
+  }
+}
+
+
+// --- api ---
+
+// start recording from now, the movie starts with a save state
+// returns -1 if the state can't be saved
+int32_t m64_movieRecord() {
+  uint32_t stateLength = m64_getStateLength();
+  uint32_t header[4] = { MOVIE_MAGIC, MOVIE_VERSION, m64_model, stateLength };
+
+  m64_movieStop();
+  movie_length = 0;
+  if(!movie_reserve(MOVIE_HEADER_LENGTH + stateLength)) {
+    return -1;
+  }
+
+  memcpy(movie_data, header, MOVIE_HEADER_LENGTH);
+  if(m64_saveState(movie_data + MOVIE_HEADER_LENGTH, stateLength) < 0) {
+    return -1;
+  }
+  movie_length = MOVIE_HEADER_LENGTH + stateLength;
+
+  movie_lastTime = clock_getTimeAndPhase(&m64_clock);
+  movie_frameCount = 0;
+  movie_status = MOVIE_RECORDING;
+  return 0;
+}
+
+// stop recording or playing, a recorded movie stays in m64_movieGetData until the next one is started
+void m64_movieStop() {
+  if(movie_status != MOVIE_RECORDING) {
+    movie_length = 0;
+  }
+  movie_status = MOVIE_IDLE;
+}
+
+uint8_t *m64_movieGetData() {
+  return movie_data;
+}
+
+uint32_t m64_movieGetLength() {
+  return movie_length;
+}
+
+// load the movie's state and play it back (the movie is copied)
+// returns -1 if it isn't a movie or its state can't be loaded (a different model or version)
+int32_t m64_moviePlay(uint8_t *data, uint32_t length) {
+  uint32_t header[4];
+
+  m64_movieStop();
+  if(length < MOVIE_HEADER_LENGTH) {
+    return -1;
+  }
+  memcpy(header, data, MOVIE_HEADER_LENGTH);
+  if(header[0] != MOVIE_MAGIC || header[1] != MOVIE_VERSION || header[2] != (uint32_t)m64_model
+     || header[3] > length - MOVIE_HEADER_LENGTH) {
+    return -1;
+  }
+
+  movie_length = 0;
+  if(!movie_reserve(length)) {
+    return -1;
+  }
+  memcpy(movie_data, data, length);
+  movie_length = length;
+
+  if(m64_loadState(movie_data + MOVIE_HEADER_LENGTH, header[3]) != 0) {
+    movie_length = 0;
+    return -1;
+  }
+
+  movie_position = MOVIE_HEADER_LENGTH + header[3];
+  movie_lastTime = clock_getTimeAndPhase(&m64_clock);
+  movie_frameCount = 0;
+  movie_status = MOVIE_PLAYING;
+
+  // calls made straight after recording started
+  movie_readNext();
+  movie_poll();
+  return 0;
+}
+
+// MOVIE_IDLE, MOVIE_RECORDING, MOVIE_PLAYING, MOVIE_FINISHED (played to the end) or MOVIE_DESYNC
+uint32_t m64_movieGetStatus() {
+  return movie_status;
+}
+
+// frames since recording or playing started, when a movie desyncs it is the frame it went wrong on
+uint32_t m64_movieGetFrame() {
+  return movie_frameCount;
+}
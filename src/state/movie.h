@@ -0,0 +1,89 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#ifndef MOVIE_H
+#define MOVIE_H
+
+// movies: a save state followed by a log of every call the host made that changes the machine (keys, joysticks,
+// queued input, prgs, cartridges, resets...) stamped with the half cycle it was made at, and a hash of the ram
+// and the frame at the end of every frame. playing a movie loads the state and makes the same calls at the same
+// half cycles, so the run is the same bit for bit, and the hashes are checked to catch it if it isn't.
+//
+// the calls are applied between clock steps in m64_update and m64_runForSamples, the same place the host made them.
+// roms, and the disks and files the drives had when recording started, aren't in the movie, the same have to be
+// loaded before playing it. disks and files given to the drives while recording are in it
+//
+// anything that puts the machine somewhere it didn't run to (loading a state, a rewind, fork or archive record,
+// a seek or a rollback) stops the movie, see state_jumped
+
+#define MOVIE_MAGIC   0x4d34364d    // "M64M"
+#define MOVIE_VERSION 2
+
+// header: magic, version, model, state length, then the state and the records
+#define MOVIE_HEADER_LENGTH 16
+
+// records are a type byte, the change in time since the last record (zigzag varint, the clock goes back on reset),
+// the type's arguments (varints) and, for prgs, cartridges, disks and files, a varint length and the data
+#define MOVIE_KEY_DOWN          0
+#define MOVIE_KEY_UP            1
+#define MOVIE_KEYBOARD_STATE    2
+#define MOVIE_JOYSTICK_PUSH     3
+#define MOVIE_JOYSTICK_RELEASE  4
+#define MOVIE_MOUSE_MOVE        5
+#define MOVIE_PADDLE            6
+#define MOVIE_POT_DEVICE        7
+#define MOVIE_LIGHTPEN          8
+#define MOVIE_QUEUE_INPUT       9
+#define MOVIE_CLEAR_INPUT_QUEUE 10
+#define MOVIE_RESET             11
+#define MOVIE_INJECT_PRG        12
+#define MOVIE_INJECT_AND_RUN    13
+#define MOVIE_LOAD_CARTRIDGE    14
+#define MOVIE_REMOVE_CARTRIDGE  15
+#define MOVIE_RAM_WRITE         16
+#define MOVIE_CPU_WRITE         17
+#define MOVIE_FRAME             18
+#define MOVIE_SDR_ATTACH        19
+#define MOVIE_SDR_WRITE         20
+#define MOVIE_SDR_READ          21
+#define MOVIE_DRIVE_ATTACH      22
+#define MOVIE_DRIVE_DETACH      23
+#define MOVIE_DRIVE_INSERT_D64  24
+#define MOVIE_DRIVE_EJECT       25
+#define MOVIE_VDRIVE_ATTACH     26
+#define MOVIE_VDRIVE_DETACH     27
+#define MOVIE_VDRIVE_INSERT_D64 28
+#define MOVIE_VDRIVE_EJECT      29
+#define MOVIE_VDRIVE_ADD_FILE   30
+#define MOVIE_VDRIVE_CLEAR      31
+#define MOVIE_KERNAL_LOAD_TRAP  32
+#define MOVIE_RECORD_TYPES      33
+
+#define MOVIE_MAX_ARGUMENTS 4
+
+// m64_movieGetStatus
+#define MOVIE_IDLE      0
+#define MOVIE_RECORDING 1
+#define MOVIE_PLAYING   2
+#define MOVIE_FINISHED  3
+#define MOVIE_DESYNC    4
+
+extern uint32_t movie_status;
+
+void movie_record(uint32_t type, uint64_t a, uint64_t b, uint64_t c, uint64_t d, uint8_t *data, uint32_t dataLength);
+void movie_frame();
+void movie_poll();
+
+int32_t m64_movieRecord();
+void m64_movieStop();
+uint8_t *m64_movieGetData();
+uint32_t m64_movieGetLength();
+int32_t m64_moviePlay(uint8_t *data, uint32_t length);
+uint32_t m64_movieGetStatus();
+uint32_t m64_movieGetFrame();
+
+#endif
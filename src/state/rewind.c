@@ -0,0 +1,329 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#include "../m64.h"
+
+// room for the state to grow (the input queue, vdrive channels) before the buffers have to be reallocated
+#define REWIND_STATE_SLACK 8192
+
+uint32_t rewind_framesPerSnapshot = 0;
+uint32_t rewind_frameCount = 0;
+
+// the encoded deltas
+uint8_t *rewind_ring = NULL;
+uint32_t rewind_budget = 0;
+uint32_t rewind_head = 0;
+
+// oldest first
+rewind_snapshot_t rewind_snapshots[REWIND_MAX_SNAPSHOTS];
+uint32_t rewind_first = 0;
+uint32_t rewind_count = 0;
+
+// the newest state whole, and a buffer to save/rebuild states in
+// both are kept zeroed past the end of their state, so states of different lengths xor as if zero padded
+uint8_t *rewind_latest = NULL;
+uint8_t *rewind_current = NULL;
+uint32_t rewind_latestLength = 0;
+uint32_t rewind_currentLength = 0;
+uint32_t rewind_stateCapacity = 0;
+
+static rewind_snapshot_t *rewind_snapshot(uint32_t index) {
+  return &rewind_snapshots[(rewind_first + index) % REWIND_MAX_SNAPSHOTS];
+}
+
+// the most bytes rewind_encode can write for length bytes
+static uint32_t rewind_encodedBound(uint32_t length) {
+  return length + REWIND_TOKEN_LENGTH * (length / REWIND_MAX_RUN + 2);
+}
+
+// the number of bytes from position that are the same in a and b, up to max
+static uint32_t rewind_sameLength(uint8_t *a, uint8_t *b, uint32_t position, uint32_t max) {
+  uint32_t count = 0;
+  uint64_t wordA, wordB;
+
+  // a word at a time through the long runs
+  while(count + 8 <= max) {
+    memcpy(&wordA, a + position + count, 8);
+    memcpy(&wordB, b + position + count, 8);
+    if(wordA != wordB) {
+      break;
+    }
+    count += 8;
+  }
+  while(count < max && a[position + count] == b[position + count]) {
+    count++;
+  }
+  return count;
+}
+
+// encode a xor b (length bytes) into out, returns the encoded length
+static uint32_t rewind_encode(uint8_t *a, uint8_t *b, uint32_t length, uint8_t *out) {
+  uint32_t position = 0;
+  uint32_t outLength = 0;
+  uint32_t zeros, literals, same, max, i;
+  uint16_t token;
+
+  while(position < length) {
+    max = length - position;
+    zeros = rewind_sameLength(a, b, position, max < REWIND_MAX_RUN ? max : REWIND_MAX_RUN);
+    position += zeros;
+
+    // literals run until there are enough zeros in a row to be worth a token
+    literals = 0;
+    while(position + literals < length && literals < REWIND_MAX_RUN) {
+      max = length - position - literals;
+      if(max > REWIND_MAX_RUN - literals) {
+        max = REWIND_MAX_RUN - literals;
+      }
+      if(max > REWIND_MIN_ZERO_RUN) {
+        max = REWIND_MIN_ZERO_RUN;
+      }
+      same = rewind_sameLength(a, b, position + literals, max);
+      if(same == REWIND_MIN_ZERO_RUN || (same > 0 && position + literals + same == length)) {
+        break;
+      }
+      literals += same ? same : 1;
+    }
+
+    token = zeros;
+    memcpy(out + outLength, &token, 2);
+    token = literals;
+    memcpy(out + outLength + 2, &token, 2);
+    outLength += REWIND_TOKEN_LENGTH;
+
+    for(i = 0; i < literals; i++) {
+      out[outLength++] = a[position + i] ^ b[position + i];
+    }
+    position += literals;
+  }
+
+  return outLength;
+}
+
+// xor an encoded delta into data
+static void rewind_apply(uint8_t *data, uint8_t *encoded, uint32_t encodedLength) {
+  uint32_t position = 0;
+  uint32_t offset = 0;
+  uint16_t zeros, literals;
+  uint32_t i;
+
+  while(offset < encodedLength) {
+    memcpy(&zeros, encoded + offset, 2);
+    memcpy(&literals, encoded + offset + 2, 2);
+    offset += REWIND_TOKEN_LENGTH;
+    position += zeros;
+    for(i = 0; i < literals; i++) {
+      data[position + i] ^= encoded[offset + i];
+    }
+    position += literals;
+    offset += literals;
+  }
+}
+
+static void rewind_free() {
+  free(rewind_ring);
+  free(rewind_latest);
+  free(rewind_current);
+  rewind_ring = NULL;
+  rewind_latest = NULL;
+  rewind_current = NULL;
+  rewind_budget = 0;
+  rewind_stateCapacity = 0;
+}
+
+// make room for a state of length bytes, the contents are kept
+static bool_t rewind_growState(uint32_t length) {
+  uint32_t capacity = length + REWIND_STATE_SLACK;
+  uint8_t *latest = realloc(rewind_latest, capacity);
+  uint8_t *current;
+
+  if(latest == NULL) {
+    return false;
+  }
+  rewind_latest = latest;
+
+  current = realloc(rewind_current, capacity);
+  if(current == NULL) {
+    return false;
+  }
+  rewind_current = current;
+
+  memset(rewind_latest + rewind_stateCapacity, 0, capacity - rewind_stateCapacity);
+  memset(rewind_current + rewind_stateCapacity, 0, capacity - rewind_stateCapacity);
+  rewind_stateCapacity = capacity;
+  return true;
+}
+
+// save the machine into the ring as a delta against the newest state
+static void rewind_takeSnapshot() {
+  rewind_snapshot_t *snapshot;
+  rewind_snapshot_t *oldest;
+  uint8_t *swap;
+  uint32_t length, bound;
+  int32_t saved;
+
+  saved = m64_saveState(rewind_current, rewind_stateCapacity);
+  if(saved < 0) {
+    if(!rewind_growState(m64_getStateLength())) {
+      return;
+    }
+    saved = m64_saveState(rewind_current, rewind_stateCapacity);
+    if(saved < 0) {
+      return;
+    }
+  }
+  if((uint32_t)saved < rewind_currentLength) {
+    memset(rewind_current + saved, 0, rewind_currentLength - saved);
+  }
+  rewind_currentLength = saved;
+
+  length = rewind_currentLength > rewind_latestLength ? rewind_currentLength : rewind_latestLength;
+  bound = rewind_encodedBound(length);
+  if(bound > rewind_budget) {
+    return;
+  }
+  if(rewind_head + bound > rewind_budget) {
+    rewind_head = 0;
+  }
+
+  // drop the oldest snapshots until there is room
+  while(rewind_count > 0) {
+    oldest = rewind_snapshot(0);
+    if(rewind_count < REWIND_MAX_SNAPSHOTS
+       && (oldest->offset >= rewind_head + bound || oldest->offset + oldest->length <= rewind_head)) {
+      break;
+    }
+    rewind_first = (rewind_first + 1) % REWIND_MAX_SNAPSHOTS;
+    rewind_count--;
+  }
+
+  snapshot = rewind_snapshot(rewind_count);
+  snapshot->offset = rewind_head;
+  snapshot->length = rewind_encode(rewind_current, rewind_latest, length, rewind_ring + rewind_head);
+  snapshot->frame = rewind_frameCount;
+  snapshot->stateLength = rewind_currentLength;
+  snapshot->previousLength = rewind_latestLength;
+  rewind_head += snapshot->length;
+  rewind_count++;
+
+  // the state just saved is now the newest
+  swap = rewind_latest;
+  rewind_latest = rewind_current;
+  rewind_current = swap;
+  length = rewind_latestLength;
+  rewind_latestLength = rewind_currentLength;
+  rewind_currentLength = length;
+}
+
+// called when a frame has been completed
+void rewind_frame() {
+  if(rewind_framesPerSnapshot == 0) {
+    return;
+  }
+
+  rewind_frameCount++;
+  if(rewind_frameCount % rewind_framesPerSnapshot == 0) {
+    rewind_takeSnapshot();
+  }
+}
+
+// a frame run headless (seek, rollback) counts, so the frame numbers stay right,
+// but no snapshot is taken so headless runs stay fast
+void rewind_skipFrame() {
+  if(rewind_framesPerSnapshot == 0) {
+    return;
+  }
+  rewind_frameCount++;
+}
+
+// the machine has been reset or loaded, the snapshots aren't its past any more
+// (the deltas only go back from the newest state, which isn't the machine now)
+void rewind_discard() {
+  rewind_head = 0;
+  rewind_first = 0;
+  rewind_count = 0;
+}
+
+// keep a snapshot every framesPerSnapshot frames in budget bytes, 0 for either turns rewind off
+void m64_setRewind(uint32_t framesPerSnapshot, uint32_t budget) {
+  rewind_free();
+  rewind_framesPerSnapshot = 0;
+  rewind_frameCount = 0;
+  rewind_head = 0;
+  rewind_first = 0;
+  rewind_count = 0;
+  rewind_latestLength = 0;
+  rewind_currentLength = 0;
+
+  if(framesPerSnapshot == 0 || budget == 0) {
+    return;
+  }
+
+  rewind_ring = malloc(budget);
+  if(rewind_ring == NULL || !rewind_growState(m64_getStateLength())) {
+    rewind_free();
+    return;
+  }
+  rewind_budget = budget;
+  rewind_framesPerSnapshot = framesPerSnapshot;
+}
+
+// go back to the newest snapshot at least frames frames ago (or the oldest there is)
+// the snapshots after it are dropped. returns the number of frames gone back, -1 if there are no snapshots
+int32_t m64_rewind(uint32_t frames) {
+  rewind_snapshot_t *snapshot;
+  uint32_t target = frames > rewind_frameCount ? 0 : rewind_frameCount - frames;
+  uint32_t index = rewind_count;
+  uint32_t i, length;
+  int32_t rewound;
+  uint8_t *swap;
+
+  if(rewind_count == 0) {
+    return -1;
+  }
+
+  // the snapshot to go back to
+  while(index > 1 && rewind_snapshot(index - 1)->frame > target) {
+    index--;
+  }
+  index--;
+
+  // xor the deltas into the newest state, back to the snapshot
+  memcpy(rewind_current, rewind_latest, rewind_stateCapacity);
+  for(i = rewind_count - 1; i > index; i--) {
+    snapshot = rewind_snapshot(i);
+    rewind_apply(rewind_current, rewind_ring + snapshot->offset, snapshot->length);
+  }
+
+  snapshot = rewind_snapshot(index);
+  if(state_load(rewind_current, snapshot->stateLength, true) != 0) {
+    return -1;
+  }
+  state_jumped(STATE_KEEP_REWIND);
+
+  rewound = rewind_frameCount - snapshot->frame;
+  rewind_frameCount = snapshot->frame;
+  rewind_count = index + 1;
+  rewind_head = snapshot->offset + snapshot->length;
+
+  swap = rewind_latest;
+  rewind_latest = rewind_current;
+  rewind_current = swap;
+  length = rewind_latestLength;
+  rewind_latestLength = snapshot->stateLength;
+  rewind_currentLength = length;
+
+  return rewound;
+}
+
+// how many frames back the oldest snapshot is
+uint32_t m64_getRewindFrames() {
+  if(rewind_count == 0) {
+    return 0;
+  }
+  return rewind_frameCount - rewind_snapshot(0)->frame;
+}
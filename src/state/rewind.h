@@ -0,0 +1,53 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#ifndef REWIND_H
+#define REWIND_H
+
+// rewind: a save state is taken every few frames and kept in a ring inside a fixed memory budget.
+// only the newest state is kept whole, each snapshot in the ring is the xor of its state with the one
+// before it, run length encoded (most of the machine doesn't change between snapshots, so it is mostly zeros).
+// xor works both ways, so going back from the newest state is just xoring in the deltas one after another,
+// and the oldest snapshot can be dropped when the budget is full without keeping a key frame.
+//
+// the buffers are allocated by m64_setRewind, taking a snapshot doesn't allocate
+// (unless the state grows, eg when the 1541 is attached)
+
+// most snapshots the ring can index, whatever the budget
+#define REWIND_MAX_SNAPSHOTS 4096
+
+// a zero run shorter than this is kept in the literal bytes around it
+#define REWIND_MIN_ZERO_RUN 8
+
+// the encoding is a list of (uint16 zero count, uint16 literal count, literal bytes)
+#define REWIND_TOKEN_LENGTH 4
+#define REWIND_MAX_RUN      0xffff
+
+struct rewind_snapshot_s {
+  // where the encoded delta is in the ring, and how long it is
+  uint32_t offset;
+  uint32_t length;
+
+  // the frame the state was taken on
+  uint32_t frame;
+
+  // lengths of this snapshot's state and of the state before it
+  uint32_t stateLength;
+  uint32_t previousLength;
+};
+
+typedef struct rewind_snapshot_s rewind_snapshot_t;
+
+void rewind_frame();
+void rewind_skipFrame();
+void rewind_discard();
+
+void m64_setRewind(uint32_t framesPerSnapshot, uint32_t budget);
+int32_t m64_rewind(uint32_t frames);
+uint32_t m64_getRewindFrames();
+
+#endif
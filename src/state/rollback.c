@@ -0,0 +1,216 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#include "../m64.h"
+
+// room for the state to grow before the buffer has to be reallocated
+#define ROLLBACK_STATE_SLACK 8192
+
+// the frames' states, slotLength bytes each, oldest first from rollback_first
+uint8_t *rollback_buffer = NULL;
+uint32_t rollback_slotLength = 0;
+uint32_t rollback_slots = 0;
+
+rollback_frame_t *rollback_frames = NULL;
+uint32_t rollback_first = 0;
+uint32_t rollback_count = 0;
+
+// the input since the oldest frame, in the order it was given
+input_event_t rollback_inputs[ROLLBACK_MAX_INPUTS];
+uint32_t rollback_inputCount = 0;
+
+static uint32_t rollback_slot(uint32_t index) {
+  return (rollback_first + index) % rollback_slots;
+}
+
+static void rollback_free() {
+  free(rollback_buffer);
+  free(rollback_frames);
+  rollback_buffer = NULL;
+  rollback_frames = NULL;
+  rollback_slotLength = 0;
+  rollback_slots = 0;
+  rollback_first = 0;
+  rollback_count = 0;
+  rollback_inputCount = 0;
+}
+
+// make the slots big enough for the state as it is now, the frames kept are lost
+static bool_t rollback_allocate(uint32_t slots) {
+  uint32_t slotLength = m64_getStateLength() + ROLLBACK_STATE_SLACK;
+  uint8_t *buffer = realloc(rollback_buffer, (size_t)slotLength * slots);
+
+  if(buffer == NULL) {
+    return false;
+  }
+  rollback_buffer = buffer;
+  rollback_slotLength = slotLength;
+  rollback_slots = slots;
+  rollback_first = 0;
+  rollback_count = 0;
+  return true;
+}
+
+static void rollback_saveFrame() {
+  rollback_frame_t *frame;
+  uint32_t slot;
+  int32_t saved;
+
+  if(rollback_count == rollback_slots) {
+    rollback_first = rollback_slot(1);
+    rollback_count--;
+  }
+
+  slot = rollback_slot(rollback_count);
+  saved = state_save(rollback_buffer + (size_t)slot * rollback_slotLength, rollback_slotLength, true);
+  if(saved < 0) {
+    // the state has grown
+    if(!rollback_allocate(rollback_slots)) {
+      rollback_free();
+      return;
+    }
+    slot = 0;
+    saved = state_save(rollback_buffer, rollback_slotLength, true);
+    if(saved < 0) {
+      return;
+    }
+  }
+
+  frame = &rollback_frames[slot];
+  frame->cycle = clock_getTime(&m64_clock, PHASE_PHI2);
+  frame->length = saved;
+  rollback_count++;
+}
+
+// called when a frame has been completed
+void rollback_frame() {
+  if(rollback_slots == 0) {
+    return;
+  }
+  rollback_saveFrame();
+}
+
+// the machine has been reset or loaded, the frames aren't its past any more
+void rollback_discard() {
+  rollback_first = 0;
+  rollback_count = 0;
+  rollback_inputCount = 0;
+}
+
+// drop the input from before the oldest frame, it can't be run again
+static void rollback_pruneInputs() {
+  uint64_t oldest = rollback_count ? rollback_frames[rollback_slot(0)].cycle : 0;
+  uint32_t i, count = 0;
+
+  for(i = 0; i < rollback_inputCount; i++) {
+    if(rollback_inputs[i].cycle >= oldest) {
+      rollback_inputs[count++] = rollback_inputs[i];
+    }
+  }
+  rollback_inputCount = count;
+}
+
+// keep the states of the last maxFrames frames so up to maxFrames can be run again, 0 turns rollback off
+// while it is on, input should be given with m64_rollbackInput. returns 0, or -1 if the buffer can't be allocated
+int32_t m64_setRollback(uint32_t maxFrames) {
+  rollback_free();
+
+  if(maxFrames == 0) {
+    return 0;
+  }
+
+  // the frame the oldest input went in on, and the ones after it
+  rollback_frames = malloc(sizeof(rollback_frame_t) * (maxFrames + 1));
+  if(rollback_frames == NULL || !rollback_allocate(maxFrames + 1)) {
+    rollback_free();
+    return -1;
+  }
+
+  // so input for the frame being run now can go back
+  rollback_saveFrame();
+  return 0;
+}
+
+// input at cycle (since reset, see m64_queueInput for type, code and value), from this host or the other one
+// returns the number of frames that had to be run again, or -1 if the cycle is before the oldest frame kept
+// or there is too much input waiting
+int32_t m64_rollbackInput(uint64_t cycle, uint32_t type, uint32_t code, uint32_t value) {
+  uint64_t now = clock_getTime(&m64_clock, PHASE_PHI2);
+  uint64_t time = clock_getTimeAndPhase(&m64_clock);
+  rollback_frame_t *frame;
+  int32_t index;
+  uint32_t i;
+
+  if(rollback_slots == 0) {
+    return m64_queueInput(cycle, type, code, value);
+  }
+
+  rollback_pruneInputs();
+  if(rollback_inputCount == ROLLBACK_MAX_INPUTS) {
+    return -1;
+  }
+
+  if(cycle >= now) {
+    // through the same call as any other input, so a movie being recorded gets it
+    if(m64_queueInput(cycle, type, code, value) != 0) {
+      return -1;
+    }
+    rollback_inputs[rollback_inputCount].cycle = cycle;
+    rollback_inputs[rollback_inputCount].type = type;
+    rollback_inputs[rollback_inputCount].code = code;
+    rollback_inputs[rollback_inputCount].value = value;
+    rollback_inputCount++;
+    return 0;
+  }
+
+  // the newest frame before the input
+  index = rollback_count - 1;
+  while(index >= 0 && rollback_frames[rollback_slot(index)].cycle > cycle) {
+    index--;
+  }
+  if(index < 0) {
+    return -1;
+  }
+
+  frame = &rollback_frames[rollback_slot(index)];
+  if(state_load(rollback_buffer + (size_t)rollback_slot(index) * rollback_slotLength, frame->length, true) != 0) {
+    return -1;
+  }
+  seek_truncate(frame->cycle);
+  state_jumped(STATE_KEEP_SEEK | STATE_KEEP_ROLLBACK);
+
+  rollback_count = index + 1;
+
+  rollback_inputs[rollback_inputCount].cycle = cycle;
+  rollback_inputs[rollback_inputCount].type = type;
+  rollback_inputs[rollback_inputCount].code = code;
+  rollback_inputs[rollback_inputCount].value = value;
+  rollback_inputCount++;
+
+  // the queue is put back together from the input given, in the order it was given
+  input_clear();
+  for(i = 0; i < rollback_inputCount; i++) {
+    if(rollback_inputs[i].cycle >= frame->cycle) {
+      input_add(rollback_inputs[i].cycle, rollback_inputs[i].type, rollback_inputs[i].code, rollback_inputs[i].value);
+    }
+  }
+
+  // run the frames again, the audio already made for them is kept and the new audio is dropped
+  m64_runHeadless(time);
+
+  return rollback_count - 1 - index;
+}
+
+// m64_rollbackInput with the 64 bit cycle split in two, for hosts that can't pass 64 bit values
+int32_t m64_rollbackInput32(uint32_t cycleLow, uint32_t cycleHigh, uint32_t type, uint32_t code, uint32_t value) {
+  return m64_rollbackInput(((uint64_t)cycleHigh << 32) | cycleLow, type, code, value);
+}
+
+// how many frames back input can go
+uint32_t m64_getRollbackFrames() {
+  return rollback_count ? rollback_count - 1 : 0;
+}
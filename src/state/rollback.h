@@ -0,0 +1,43 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+// rollback, for two players on different hosts: each host runs ahead with the input it has, a state is saved at the
+// end of every frame, and input is passed to m64_rollbackInput stamped with the cycle it was made on. input for a
+// cycle that has already been run (the other player's, arriving late) sends the machine back to the newest frame
+// before it, and every frame since is run again with the input where it should have been, without drawing frames or
+// keeping the audio. input queued any other way is lost when frames are run again.
+//
+// input is recorded as changes (push/release) rather than a state every frame, so until new input arrives a player is
+// assumed to keep doing what they were doing and nothing has to be predicted. running 8 frames again stays within a
+// 16 ms frame (checked by test/test.c)
+//
+// the states are kept in one buffer allocated by m64_setRollback, saving a frame doesn't allocate
+// (unless the state grows, eg when the 1541 is attached)
+
+// input kept for running frames again
+#define ROLLBACK_MAX_INPUTS 1024
+
+struct rollback_frame_s {
+  // cycle the state was saved on
+  uint64_t cycle;
+  uint32_t length;
+};
+
+typedef struct rollback_frame_s rollback_frame_t;
+
+void rollback_frame();
+void rollback_discard();
+
+int32_t m64_setRollback(uint32_t maxFrames);
+int32_t m64_rollbackInput(uint64_t cycle, uint32_t type, uint32_t code, uint32_t value);
+int32_t m64_rollbackInput32(uint32_t cycleLow, uint32_t cycleHigh, uint32_t type, uint32_t code, uint32_t value);
+uint32_t m64_getRollbackFrames();
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#include "../m64.h"
+
+// room for the state to grow before a checkpoint's buffer has to be reallocated
+#define SEEK_STATE_SLACK 8192
+
+// oldest first
+seek_checkpoint_t *seek_checkpoints = NULL;
+uint32_t seek_maxCheckpoints = 0;
+uint32_t seek_count = 0;
+
+// frames between checkpoints as asked for, and now (doubled every time the checkpoints are thinned out)
+uint32_t seek_framesPerCheckpoint = 0;
+uint32_t seek_interval = 0;
+uint32_t seek_frameCount = 0;
+
+static void seek_free() {
+  uint32_t i;
+
+  if(seek_checkpoints != NULL) {
+    for(i = 0; i < seek_maxCheckpoints; i++) {
+      free(seek_checkpoints[i].data);
+    }
+  }
+  free(seek_checkpoints);
+  seek_checkpoints = NULL;
+  seek_maxCheckpoints = 0;
+  seek_count = 0;
+}
+
+// keep every other checkpoint, the buffers are swapped rather than freed so they can be used again
+static void seek_thin() {
+  seek_checkpoint_t swap;
+  uint32_t i;
+
+  for(i = 1; i * 2 < seek_count; i++) {
+    swap = seek_checkpoints[i];
+    seek_checkpoints[i] = seek_checkpoints[i * 2];
+    seek_checkpoints[i * 2] = swap;
+  }
+  seek_count = (seek_count + 1) / 2;
+  seek_interval *= 2;
+}
+
+static void seek_takeCheckpoint() {
+  seek_checkpoint_t *checkpoint;
+  uint32_t length;
+  uint8_t *data;
+  int32_t saved;
+
+  seek_frameCount = 0;
+  if(seek_count == seek_maxCheckpoints) {
+    seek_thin();
+  }
+
+  checkpoint = &seek_checkpoints[seek_count];
+  saved = checkpoint->data ? m64_saveState(checkpoint->data, checkpoint->capacity) : -1;
+  if(saved < 0) {
+    length = m64_getStateLength() + SEEK_STATE_SLACK;
+    data = realloc(checkpoint->data, length);
+    if(data == NULL) {
+      return;
+    }
+    checkpoint->data = data;
+    checkpoint->capacity = length;
+    saved = m64_saveState(checkpoint->data, checkpoint->capacity);
+    if(saved < 0) {
+      return;
+    }
+  }
+
+  checkpoint->length = saved;
+  checkpoint->cycle = clock_getTime(&m64_clock, PHASE_PHI2);
+  seek_count++;
+}
+
+// called when a frame has been completed
+void seek_frame() {
+  if(seek_framesPerCheckpoint == 0) {
+    return;
+  }
+
+  seek_frameCount++;
+  if(seek_count == 0 || seek_frameCount >= seek_interval) {
+    seek_takeCheckpoint();
+  }
+}
+
+// the machine has been reset or loaded, the checkpoints aren't its past any more
+void seek_discard() {
+  seek_count = 0;
+  seek_frameCount = 0;
+  seek_interval = seek_framesPerCheckpoint;
+}
+
+// the machine has gone back to cycle, the checkpoints after it aren't its past any more
+void seek_truncate(uint64_t cycle) {
+  while(seek_count > 0 && seek_checkpoints[seek_count - 1].cycle > cycle) {
+    seek_count--;
+  }
+}
+
+// keep a checkpoint every framesPerCheckpoint frames, at most maxCheckpoints of them (each is a whole state)
+// 0 for either turns checkpoints off. the first is taken straight away
+void m64_setSeekCheckpoints(uint32_t framesPerCheckpoint, uint32_t maxCheckpoints) {
+  seek_free();
+  seek_framesPerCheckpoint = 0;
+  seek_discard();
+
+  if(framesPerCheckpoint == 0 || maxCheckpoints == 0) {
+    return;
+  }
+
+  // thinning keeps the first one, there has to be room for one more
+  if(maxCheckpoints < 2) {
+    maxCheckpoints = 2;
+  }
+
+  seek_checkpoints = calloc(maxCheckpoints, sizeof(seek_checkpoint_t));
+  if(seek_checkpoints == NULL) {
+    return;
+  }
+  seek_maxCheckpoints = maxCheckpoints;
+  seek_framesPerCheckpoint = framesPerCheckpoint;
+  seek_interval = framesPerCheckpoint;
+
+  seek_takeCheckpoint();
+}
+
+// go to cycle (since reset, as m64_queueInput): a cycle behind the machine is reached from the newest checkpoint
+// at or before it, a cycle ahead of it from where the machine is now. frames aren't copied to the pixel buffer,
+// and the audio made on the way is dropped. a movie being recorded or played is stopped
+// returns 0, or -1 if the cycle is before the oldest checkpoint
+int32_t m64_seek(uint64_t cycle) {
+  seek_checkpoint_t *checkpoint;
+  int32_t index;
+
+  if(cycle < clock_getTime(&m64_clock, PHASE_PHI2)) {
+    index = seek_count - 1;
+    while(index >= 0 && seek_checkpoints[index].cycle > cycle) {
+      index--;
+    }
+    if(index < 0) {
+      return -1;
+    }
+
+    checkpoint = &seek_checkpoints[index];
+    if(state_load(checkpoint->data, checkpoint->length, true) != 0) {
+      return -1;
+    }
+    seek_count = index + 1;
+    seek_frameCount = 0;
+    state_jumped(STATE_KEEP_SEEK);
+  } else {
+    // the frames run on the way aren't recorded, the histories carry on through them
+    state_jumped(STATE_KEEP_SEEK | STATE_KEEP_ROLLBACK | STATE_KEEP_REWIND);
+  }
+
+  // the sids' samples are dropped on the way, the consumer carries on from where it is
+  m64_runHeadless(cycle * 2);
+  return 0;
+}
+
+// m64_seek with the 64 bit cycle split in two, for hosts that can't pass 64 bit values
+int32_t m64_seek32(uint32_t cycleLow, uint32_t cycleHigh) {
+  return m64_seek(((uint64_t)cycleHigh << 32) | cycleLow);
+}
+
+uint32_t m64_getSeekCheckpointCount() {
+  return seek_count;
+}
@@ -0,0 +1,39 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#ifndef SEEK_H
+#define SEEK_H
+
+// seeking: a whole save state is kept every few frames while the machine runs. m64_seek loads the newest one
+// at or before the cycle and runs forward to it without copying frames to the pixel buffer or keeping the audio.
+// when the checkpoints are full every other one is dropped and they are taken half as often, so they always
+// cover the whole run, closer together at the start.
+//
+// checkpoints are of the machine's own past, loading a state or resetting drops them,
+// and seeking back drops the ones after the checkpoint it goes back to
+
+struct seek_checkpoint_s {
+  // cycle the state was saved on
+  uint64_t cycle;
+
+  uint8_t *data;
+  uint32_t length;
+  uint32_t capacity;
+};
+
+typedef struct seek_checkpoint_s seek_checkpoint_t;
+
+void seek_frame();
+void seek_discard();
+void seek_truncate(uint64_t cycle);
+
+void m64_setSeekCheckpoints(uint32_t framesPerCheckpoint, uint32_t maxCheckpoints);
+int32_t m64_seek(uint64_t cycle);
+int32_t m64_seek32(uint32_t cycleLow, uint32_t cycleHigh);
+uint32_t m64_getSeekCheckpointCount();
+
+#endif
@@ -0,0 +1,265 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#include "../m64.h"
+
+extern int32_t m64_model;
+extern int32_t m64_screenDrawn;
+extern iecDevice_t vdrive_device;
+extern iecDevice_t drive_device;
+
+// the machine as it was before a load, to put back if the state turns out to be bad part way through
+uint8_t *state_backup = NULL;
+uint32_t state_backupCapacity = 0;
+
+// copy a value to the state, or from it when loading
+void state_value(state_t *state, void *value, uint32_t length) {
+  if(state->error) {
+    return;
+  }
+
+  if(state->data) {
+    if(state->position + length > state->length) {
+      state->error = true;
+      return;
+    }
+    if(state->loading) {
+      memcpy(value, state->data + state->position, length);
+    } else {
+      memcpy(state->data + state->position, value, length);
+    }
+  }
+  state->position += length;
+}
+
+// give an event its id, events have to be passed in the same order every time
+void state_event(state_t *state, event_t *event) {
+  if(state->eventCount >= STATE_MAX_EVENTS) {
+    state->error = true;
+    return;
+  }
+  state->events[state->eventCount++] = event;
+}
+
+// the clock's time and its list of events, call after every event on the clock has been passed to state_event
+void state_clock(state_t *state, clock_t *clock) {
+  uint64_t time = clock->clock_currentTime;
+  uint64_t triggerTime;
+  uint16_t id;
+  event_t *event;
+
+  STATE_VALUE(state, time);
+
+  if(state->loading) {
+    clock_reset(clock);
+    clock->clock_currentTime = time;
+
+    while(!state->error) {
+      STATE_VALUE(state, id);
+      if(id == 0xffff) {
+        break;
+      }
+      STATE_VALUE(state, triggerTime);
+      if(id >= state->eventCount) {
+        state->error = true;
+        return;
+      }
+      // events with the same trigger time go in after the ones already there, so the order is kept
+      clock_scheduleEventAt(clock, state->events[id], triggerTime >> 1, (triggerTime & 1) ? PHASE_PHI2 : PHASE_PHI1);
+    }
+    return;
+  }
+
+  for(event = clock->firstEvent.next; event != &(clock->lastEvent) && !state->error; event = event->next) {
+    for(id = 0; id < state->eventCount; id++) {
+      if(state->events[id] == event) {
+        break;
+      }
+    }
+    if(id == state->eventCount) {
+      // an event that hasn't been given an id
+      state->error = true;
+      return;
+    }
+    STATE_VALUE(state, id);
+    STATE_VALUE(state, event->triggerTime);
+  }
+
+  id = 0xffff;
+  STATE_VALUE(state, id);
+}
+
+// the whole machine, in a fixed order
+static void state_machine(state_t *state) {
+  // everything that can be attached to the serial bus
+  iecDevice_t *devices[2] = { &vdrive_device, &drive_device };
+
+  STATE_VALUE(state, m64_screenDrawn);
+
+  m6510_serialize(state, &m64_cpu);
+  pla_serialize(state);
+  zeroram_serialize(state);
+  systemram_serialize(state);
+  colorram_serialize(state);
+  cartridge_serialize(state);
+
+  m6526_serialize(state, &cia1);
+  m6526_serialize(state, &cia2);
+
+  vic_serialize(state);
+  sid_serialize(state);
+  sidbank_serialize(state);
+
+  keyboard_serialize(state);
+  joystick_serialize(state);
+  input_serialize(state);
+  pot_serialize(state);
+
+  iecBus_serialize(state, devices, 2);
+  vdrive_serialize(state);
+  drive_serialize(state);
+
+  state_clock(state, &m64_clock);
+}
+
+static void state_header(state_t *state, uint32_t length) {
+  uint32_t magic = STATE_MAGIC;
+  uint32_t version = STATE_VERSION;
+  uint32_t model = m64_model;
+
+  STATE_VALUE(state, magic);
+  STATE_VALUE(state, version);
+  STATE_VALUE(state, model);
+  STATE_VALUE(state, length);
+}
+
+// the number of bytes a state needs now (it changes with the input queue, drive, etc)
+uint32_t state_length(bool_t systemRam) {
+  state_t state;
+
+  memset(&state, 0, sizeof(state));
+  state.withoutSystemRam = !systemRam;
+  state_header(&state, 0);
+  state_machine(&state);
+  return state.position;
+}
+
+// save the machine into data, returns the number of bytes used or -1 if data is too short
+int32_t state_save(uint8_t *data, uint32_t length, bool_t systemRam) {
+  state_t state;
+
+  // catch the sids up so their state matches the clock
+  sid_update();
+
+  memset(&state, 0, sizeof(state));
+  state.data = data;
+  state.length = length;
+  state.loading = false;
+  state.withoutSystemRam = !systemRam;
+
+  state_header(&state, 0);
+  state_machine(&state);
+  if(state.error) {
+    return -1;
+  }
+
+  // now the length is known
+  memcpy(data + 12, &state.position, sizeof(uint32_t));
+  return state.position;
+}
+
+// restore the machine from a state saved with the same model (and the same roms, cartridge and disks)
+// returns -1 and leaves the machine alone if the state is from another version or model, or is cut short or corrupt
+// (the modules load straight into their fields, so the machine is saved first and put back if the body is bad)
+int32_t state_load(uint8_t *data, uint32_t length, bool_t systemRam) {
+  state_t state;
+  uint32_t magic, version, model, stateLength;
+  uint32_t backupLength;
+  int32_t saved;
+  uint8_t *backup;
+
+  if(length < STATE_HEADER_LENGTH) {
+    return -1;
+  }
+  memcpy(&magic, data, 4);
+  memcpy(&version, data + 4, 4);
+  memcpy(&model, data + 8, 4);
+  memcpy(&stateLength, data + 12, 4);
+  if(magic != STATE_MAGIC || version != STATE_VERSION || model != (uint32_t)m64_model || stateLength > length) {
+    return -1;
+  }
+
+  backupLength = state_length(systemRam);
+  if(backupLength > state_backupCapacity) {
+    backup = realloc(state_backup, backupLength);
+    if(backup == NULL) {
+      return -1;
+    }
+    state_backup = backup;
+    state_backupCapacity = backupLength;
+  }
+  saved = state_save(state_backup, state_backupCapacity, systemRam);
+  if(saved < 0) {
+    return -1;
+  }
+
+  memset(&state, 0, sizeof(state));
+  state.data = data;
+  state.length = stateLength;
+  state.position = STATE_HEADER_LENGTH;
+  state.loading = true;
+  state.withoutSystemRam = !systemRam;
+  state_machine(&state);
+  if(!state.error) {
+    return 0;
+  }
+
+  // put the machine back as it was
+  memset(&state, 0, sizeof(state));
+  state.data = state_backup;
+  state.length = saved;
+  state.position = STATE_HEADER_LENGTH;
+  state.loading = true;
+  state.withoutSystemRam = !systemRam;
+  state_machine(&state);
+  return -1;
+}
+
+// the machine has been put somewhere it didn't run to: a movie being recorded or played can't follow it, so it
+// stops, and the seek checkpoints, rollback frames and rewind snapshots that aren't in keep are no longer its past
+void state_jumped(uint32_t keep) {
+  if(movie_status == MOVIE_RECORDING || movie_status == MOVIE_PLAYING) {
+    m64_movieStop();
+  }
+  if(!(keep & STATE_KEEP_SEEK)) {
+    seek_discard();
+  }
+  if(!(keep & STATE_KEEP_ROLLBACK)) {
+    rollback_discard();
+  }
+  if(!(keep & STATE_KEEP_REWIND)) {
+    rewind_discard();
+  }
+}
+
+uint32_t m64_getStateLength() {
+  return state_length(true);
+}
+
+int32_t m64_saveState(uint8_t *data, uint32_t length) {
+  return state_save(data, length, true);
+}
+
+// the machine's past is lost, so are the seek checkpoints, rollback frames and rewind snapshots,
+// and a movie being recorded or played is stopped
+int32_t m64_loadState(uint8_t *data, uint32_t length) {
+  if(state_load(data, length, true) != 0) {
+    return -1;
+  }
+  state_jumped(0);
+  return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+#ifndef STATE_H
+#define STATE_H
+
+// save states
+// each module has a _serialize function that passes its fields to state_value, the same function saves and loads
+// so the two can't get out of step. pointers are never saved: events are saved as the clock's list of
+// (id, trigger time), where the id is the order the event was passed to state_event.
+// the format is the fields one after the other in the host's byte order, behind a header with a version,
+// it changes whenever a module's fields change so the version has to be bumped with them.
+//
+// roms, the cartridge image, d64 images and the virtual drive's files are not in the state,
+// the same ones have to be loaded before loading the state. the pixel and audio buffers aren't either
+
+#define STATE_MAGIC   0x5334364d    // "M64S"
+#define STATE_VERSION 3
+
+#define STATE_HEADER_LENGTH 16
+#define STATE_MAX_EVENTS    128
+
+struct state_s {
+  // NULL when just counting the length
+  uint8_t *data;
+  uint32_t length;
+  uint32_t position;
+
+  bool_t loading;
+  bool_t error;
+
+  // leave the 64k of system ram out, forks keep it in shared pages
+  bool_t withoutSystemRam;
+
+  // every event passed to state_event, the index is the id
+  event_t *events[STATE_MAX_EVENTS];
+  uint32_t eventCount;
+};
+
+typedef struct state_s state_t;
+
+void state_value(state_t *state, void *value, uint32_t length);
+#define STATE_VALUE(state, value) state_value((state), &(value), sizeof(value))
+
+void state_event(state_t *state, event_t *event);
+void state_clock(state_t *state, clock_t *clock);
+
+uint32_t state_length(bool_t systemRam);
+int32_t state_save(uint8_t *data, uint32_t length, bool_t systemRam);
+int32_t state_load(uint8_t *data, uint32_t length, bool_t systemRam);
+
+// what a jump keeps, the loader looks after its own history
+#define STATE_KEEP_SEEK     1
+#define STATE_KEEP_ROLLBACK 2
+#define STATE_KEEP_REWIND   4
+
+void state_jumped(uint32_t keep);
+
+uint32_t m64_getStateLength();
+int32_t m64_saveState(uint8_t *data, uint32_t length);
+int32_t m64_loadState(uint8_t *data, uint32_t length);
+
+#endif
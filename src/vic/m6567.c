@@ -421,6 +421,11 @@ void m6567_init() {
 }
 
 
+void m6567_serialize(state_t *state) {
+  state_event(state, &m6567_event);
+  STATE_VALUE(state, m6567_running);
+}
+
 void m6567_reset() {
   vic_cycle = vic_CYCLES_PER_LINE;
   m6567_start();
@@ -439,6 +439,11 @@ void m6569_init() {
   m6569_event.event = &m6569_cycle;
 }
 
+void m6569_serialize(state_t *state) {
+  state_event(state, &m6569_event);
+  STATE_VALUE(state, m6569_running);
+}
+
 void m6569_reset() {
   // set to end, first call to m6569_cycle will increment and then set to 1
   vic_cycle = vic_CYCLES_PER_LINE;
@@ -17,7 +17,19 @@
 
 void sprite_init(sprite_t *sprite, sprite_t *linkedListHead, uint32_t index) {
 
-  sprite->index = 0;
+  sprite_reset(sprite);
+
+  sprite->indexBits = (8 | index) * 0x11111111;
+  sprite->linkedListHead = linkedListHead;
+  sprite->index = index;
+
+
+  sprite->event.event = &sprite_event;
+  sprite->event.context = sprite;
+}
+
+// everything but the index and the list, as at power on
+void sprite_reset(sprite_t *sprite) {
   sprite->display = false;
   sprite->consuming = false;
   sprite->firstMultiColorRead = false;
@@ -48,14 +60,40 @@ void sprite_init(sprite_t *sprite, sprite_t *linkedListHead, uint32_t index) {
   sprite->allowDisplay = false;
   sprite->prevPriority = 0;
   sprite->colorBuffer = 0;
-
-  sprite->indexBits = (8 | index) * 0x11111111;
-  sprite->linkedListHead = linkedListHead;
-  sprite->index = index;
+  memset(sprite->color, 0, sizeof(sprite->color));
+}
 
 
-  sprite->event.event = &sprite_event;
-  sprite->event.context = sprite;
+// everything except the list pointers, which the vic saves as indexes
+void sprite_serialize(state_t *state, sprite_t *sprite) {
+  state_event(state, &(sprite->event));
+
+  STATE_VALUE(state, sprite->display);
+  STATE_VALUE(state, sprite->consuming);
+  STATE_VALUE(state, sprite->firstMultiColorRead);
+  STATE_VALUE(state, sprite->offsetPixels);
+  STATE_VALUE(state, sprite->lineData);
+  STATE_VALUE(state, sprite->consumedLineData);
+  STATE_VALUE(state, sprite->pointerByte);
+  STATE_VALUE(state, sprite->mc);
+  STATE_VALUE(state, sprite->mcBase);
+  STATE_VALUE(state, sprite->expandY);
+  STATE_VALUE(state, sprite->firstYRead);
+  STATE_VALUE(state, sprite->expandX);
+  STATE_VALUE(state, sprite->firstXRead);
+  STATE_VALUE(state, sprite->x);
+  STATE_VALUE(state, sprite->y);
+  STATE_VALUE(state, sprite->enabled);
+  STATE_VALUE(state, sprite->multiColor);
+  STATE_VALUE(state, sprite->priorityOverForegroundGraphics);
+  STATE_VALUE(state, sprite->priorityMask);
+  STATE_VALUE(state, sprite->multiColorLatched);
+  STATE_VALUE(state, sprite->expandXLatched);
+  STATE_VALUE(state, sprite->prevPixel);
+  STATE_VALUE(state, sprite->allowDisplay);
+  STATE_VALUE(state, sprite->color);
+  STATE_VALUE(state, sprite->prevPriority);
+  STATE_VALUE(state, sprite->colorBuffer);
 }
 
 
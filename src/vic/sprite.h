@@ -111,6 +111,8 @@ void sprite_event(void *context);
 
 
 void sprite_init(sprite_t *sprite, sprite_t *linkedListHead, uint32_t index);
+void sprite_reset(sprite_t *sprite);
+void sprite_serialize(state_t *state, sprite_t *sprite);
 void sprite_setDisplayStart(sprite_t *sprite, uint32_t offsetPixels);
 int32_t sprite_getX(sprite_t *sprite);
 void sprite_setX(sprite_t *sprite, int32_t x);
@@ -223,12 +223,21 @@ bool_t vic_startOfFrame = false;
 int32_t vic_MAX_RASTERS = 0;
 bool_t vic_lpAsserted = false;
 
+// a light pen/gun pointed at the screen (set with m64_setLightpen), it sees the beam once a frame
+event_t vic_lightpenEvent;
+int32_t vic_lightpenX = -1;
+int32_t vic_lightpenY = -1;
+bool_t vic_lightpenButton = false;
+
 // latched colour is the color in the colour buffer
 // for the current cycle
 uint8_t vic_latchedColor = 0;
 uint8_t vic_latchedVmd = 0;
 uint32_t vic_oldGraphicsData = 0;
 
+// while set the pixels aren't written (running headless), everything else, collisions included, still happens
+bool_t vic_skipPixels = false;
+
 /** Number of cycles per line. */
 int32_t vic_CYCLES_PER_LINE;
 
@@ -354,6 +363,8 @@ void vic_init(int32_t model) {
   vic_makeDisplayActive.event = &vic_makeDisplayActive_function;
   vic_badLineStateChange.event = &vic_badLineStateChange_function;
   vic_rasterYIRQEdgeDetector.event = &vic_rasterYIRQEdgeDetector_function;
+  vic_lightpenEvent.event = &vic_lightpenEvent_function;
+  vic_lightpenEvent.context = NULL;
 
   vic_model = model;
   if(model == VIC_MODEL6567R8) {
@@ -373,6 +384,94 @@ void vic_init(int32_t model) {
 
 }
 
+void vic_setSkipPixels(bool_t skip) {
+  vic_skipPixels = skip;
+}
+
+// the colour tables, palette and pixel buffers are left alone
+void vic_serialize(state_t *state) {
+  uint8_t next[VIC_SPRITECOUNT + 1];
+  sprite_t *sprite;
+  uint32_t i;
+
+  state_event(state, &vic_makeDisplayActive);
+  state_event(state, &vic_badLineStateChange);
+  state_event(state, &vic_rasterYIRQEdgeDetector);
+  state_event(state, &vic_lightpenEvent);
+  if(vic_model == VIC_MODEL6567R8) {
+    m6567_serialize(state);
+  } else {
+    m6569_serialize(state);
+  }
+
+  for(i = 0; i < VIC_SPRITECOUNT; i++) {
+    sprite_serialize(state, &(vic_sprites[i]));
+  }
+
+  // the list of visible sprites as indexes, the head is last, 0xff is the end
+  for(i = 0; i <= VIC_SPRITECOUNT; i++) {
+    sprite = i < VIC_SPRITECOUNT ? vic_sprites[i].nextVisibleSprite : vic_spriteLinkedListHead.nextVisibleSprite;
+    next[i] = sprite == NULL ? 0xff : sprite->index;
+  }
+  STATE_VALUE(state, next);
+  if(state->loading && !state->error) {
+    for(i = 0; i <= VIC_SPRITECOUNT; i++) {
+      sprite = next[i] < VIC_SPRITECOUNT ? &(vic_sprites[next[i]]) : NULL;
+      if(i < VIC_SPRITECOUNT) {
+        vic_sprites[i].nextVisibleSprite = sprite;
+      } else {
+        vic_spriteLinkedListHead.nextVisibleSprite = sprite;
+      }
+    }
+  }
+
+  STATE_VALUE(state, vic_registers);
+  STATE_VALUE(state, vic_videoModeColors);
+  STATE_VALUE(state, vic_colorData);
+  STATE_VALUE(state, vic_videoMatrixData);
+  STATE_VALUE(state, vic_borderColor);
+  STATE_VALUE(state, vic_phi1Data);
+  STATE_VALUE(state, vic_pixelColor);
+  STATE_VALUE(state, vic_mcFlip);
+  STATE_VALUE(state, vic_phi1DataPipe);
+
+  STATE_VALUE(state, vic_vc);
+  STATE_VALUE(state, vic_vcBase);
+  STATE_VALUE(state, vic_rc);
+  STATE_VALUE(state, vic_isDisplayActive);
+  STATE_VALUE(state, vic_areBadLinesEnabled);
+  STATE_VALUE(state, vic_rasterY);
+  STATE_VALUE(state, vic_rasterYIRQCondition);
+  STATE_VALUE(state, vic_showBorderVertical);
+  STATE_VALUE(state, vic_showBorderMain);
+  STATE_VALUE(state, vic_isBadLine);
+  STATE_VALUE(state, vic_videoMatrixBase);
+  STATE_VALUE(state, vic_charMemBase);
+  STATE_VALUE(state, vic_bitmapMemBase);
+  STATE_VALUE(state, vic_yscroll);
+  STATE_VALUE(state, vic_xscroll);
+  STATE_VALUE(state, vic_latchedXscroll);
+  STATE_VALUE(state, vic_irqFlags);
+  STATE_VALUE(state, vic_irqMask);
+  STATE_VALUE(state, vic_nextPixel);
+  STATE_VALUE(state, vic_cycle);
+  STATE_VALUE(state, vic_graphicsRendering);
+
+  STATE_VALUE(state, vic_lpx);
+  STATE_VALUE(state, vic_lpy);
+  STATE_VALUE(state, vic_lpTriggered);
+  STATE_VALUE(state, vic_lpAsserted);
+  STATE_VALUE(state, vic_lightpenX);
+  STATE_VALUE(state, vic_lightpenY);
+  STATE_VALUE(state, vic_lightpenButton);
+
+  STATE_VALUE(state, vic_startOfFrame);
+  STATE_VALUE(state, vic_latchedColor);
+  STATE_VALUE(state, vic_latchedVmd);
+  STATE_VALUE(state, vic_oldGraphicsData);
+  STATE_VALUE(state, vic_videoModeColorDecoderOffset);
+}
+
 // return sprite x coordinate
 int32_t vic_readSpriteXCoordinate(int32_t spriteIndex) {
   // the lower 8 bits of sprite x coordinates are stored in
@@ -771,6 +870,13 @@ void vic_drawSpritesAndGraphics() {
   // The unsigned right shift operator ">>>" shifts a zero into the leftmost position
   // a >>> b    Shifts a in binary representation b (< 32) bits to the right, discarding bits shifted off, and shifting in 0s from the left.
 
+  if (vic_skipPixels) {
+    // what the loop below leaves in the sequencer, the top half is shifted out
+    vic_oldGraphicsData = graphicsDataBuffer << 16;
+    vic_nextPixel += 8;
+    return;
+  }
+
   for (j = 0; j < 2; j++) {
     //vic_oldGraphicsData |= graphicsDataBuffer >>> 16;
     vic_oldGraphicsData |= graphicsDataBuffer >> 16;
@@ -1212,8 +1318,10 @@ void vic_reset() {
 
   vic_spriteLinkedListHead.nextVisibleSprite = NULL;
 
+  // the registers are cleared below, the sprites go back to match them
   for (i = 0; i < VIC_SPRITECOUNT; i++) {
-    vic_sprites[i].consuming = false;
+    sprite_reset(&vic_sprites[i]);
+    vic_sprites[i].nextVisibleSprite = NULL;
   }
 
   // set all pixels to black
@@ -1243,6 +1351,25 @@ void vic_reset() {
   vic_nextPixel = 0;
   vic_lpx = 0;
   vic_lpy = 0;
+  vic_lpTriggered = false;
+
+  // the sequencer and its latches, nothing the last program did is left for the boot cache's key to see
+  memset(vic_videoModeColors, 0, sizeof(vic_videoModeColors));
+  memset(vic_colorData, 0, sizeof(vic_colorData));
+  memset(vic_videoMatrixData, 0, sizeof(vic_videoMatrixData));
+  vic_borderColor = 0;
+  vic_pixelColor = 0;
+  vic_mcFlip = false;
+  vic_phi1DataPipe = 0;
+  vic_rasterYIRQCondition = false;
+  vic_showBorderMain = false;
+  vic_isBadLine = false;
+  vic_latchedXscroll = 0;
+  vic_startOfFrame = false;
+  vic_latchedColor = 0;
+  vic_latchedVmd = 0;
+  vic_oldGraphicsData = 0;
+  vic_videoModeColorDecoderOffset = 0;
   vic_determineVideoMemoryBaseAddresses();
 
 
@@ -1262,6 +1389,7 @@ void vic_reset() {
     m6567_reset();
   }
 
+  vic_scheduleLightpen();
 }
 
 
@@ -1274,6 +1402,61 @@ void vic_clearLightpen() {
   vic_lpAsserted = false;
 };
 
+// schedule the light pen to see the beam the next time the beam reaches its position
+// x and y are in the pixel buffer, which starts at the first display line, and at sprite cycle 0 (line cycle 14)
+void vic_scheduleLightpen() {
+  int32_t firstLine = vic_model == VIC_MODEL6567R8 ? M6567R8_FIRST_DISPLAY_LINE : M6569_FIRST_DISPLAY_LINE;
+  int32_t cyclesPerFrame = vic_CYCLES_PER_LINE * vic_MAX_RASTERS;
+  int32_t line, lineCycle, cycles;
+
+  clock_cancelEvent(&m64_clock, &vic_lightpenEvent);
+  if(vic_lightpenX < 0 || vic_lightpenY < 0) {
+    return;
+  }
+
+  line = (vic_lightpenY + firstLine) % vic_MAX_RASTERS;
+  lineCycle = 14 + (vic_lightpenX >> 3);
+
+  cycles = (line * vic_CYCLES_PER_LINE + lineCycle) - (vic_rasterY * vic_CYCLES_PER_LINE + vic_cycle);
+  if(cycles <= 0) {
+    cycles += cyclesPerFrame;
+  }
+
+  // the first 4 pixels of a cycle are drawn in phi1, the last 4 in phi2
+  clock_scheduleEvent(&m64_clock, &vic_lightpenEvent, cycles, (vic_lightpenX & 7) < 4 ? PHASE_PHI1 : PHASE_PHI2);
+}
+
+// the beam passes under the pen, it pulses the LP line
+void vic_lightpenEvent_function(void *context) {
+  bool_t asserted = vic_lpAsserted;
+
+  vic_triggerLightpen();
+  vic_lpAsserted = asserted;
+
+  vic_scheduleLightpen();
+}
+
+// point a light pen or light gun at pixel x, y of the pixel buffer (see m64_getPixelBufferWidth/Height),
+// or take it off the screen with x or y < 0. the pen latches $d013/$d014 and sets the light pen interrupt flag
+// when the beam reaches that pixel each frame (a light gun only sees bright pixels, leave that to the host)
+// button is the pen's button, on joystick port 1 up
+void m64_setLightpen(int32_t x, int32_t y, uint32_t button) {
+  movie_record(MOVIE_LIGHTPEN, (uint32_t)x, (uint32_t)y, button, 0, NULL, 0);
+  if(x >= (int32_t)m64_getPixelBufferWidth() || y >= (int32_t)m64_getPixelBufferHeight()) {
+    x = -1;
+  }
+  vic_lightpenX = x;
+  vic_lightpenY = y;
+  vic_scheduleLightpen();
+
+  if(button && !vic_lightpenButton) {
+    joystick_push(&m64_joysticks[0], JOYSTICK_UP);
+  } else if(!button && vic_lightpenButton) {
+    joystick_release(&m64_joysticks[0], JOYSTICK_UP);
+  }
+  vic_lightpenButton = button != 0;
+}
+
 //  if true, trigger the irq if not in it.
 void vic_interrupt(bool_t b) {
   pla_setIRQ(b);
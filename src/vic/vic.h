@@ -196,6 +196,8 @@ extern event_t m6567_event;
 
 void vic_init(int32_t model);
 void vic_reset();
+void vic_serialize(state_t *state);
+void vic_setSkipPixels(bool_t skip);
 
 void vic_write(uint16_t reg, uint8_t data);
 uint8_t vic_read(uint16_t reg);
@@ -215,6 +217,9 @@ int32_t vic_getCurrentSpriteCycle();
 int32_t vic_readSpriteXCoordinate(int32_t spriteIndex);
 void vic_triggerLightpen();
 void vic_clearLightpen();
+void vic_scheduleLightpen();
+void vic_lightpenEvent_function(void *context);
+void m64_setLightpen(int32_t x, int32_t y, uint32_t button);
 void vic_drawSpritesAndGraphics();
 void vic_spriteCollisionsOnly();
 void vic_fetchSpriteData(int32_t n);
@@ -228,11 +233,13 @@ bool_t vic_evaluateIsBadLine();
 
 void m6569_init();
 void m6569_reset();
+void m6569_serialize(state_t *state);
 void m6569_stop();
 void m6569_start();
 
 void m6567_init();
 void m6567_reset();
+void m6567_serialize(state_t *state);
 void m6567_stop();
 void m6567_start();
 
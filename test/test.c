@@ -0,0 +1,176 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+// regression tests for the machine's state hooks, run with make test
+//
+// each test starts from m64_init, prints what failed and the exit status is the number of tests that failed
+
+#include "../src/m64.h"
+
+#define TEST_STATE_LENGTH 0x80000
+
+extern uint32_t boot_count;
+
+// test/timer.c, apart as time.h's clock_t clashes with the machine's
+double test_cpuTime();
+
+uint8_t test_stateA[TEST_STATE_LENGTH];
+uint8_t test_stateB[TEST_STATE_LENGTH];
+
+uint32_t test_failed = 0;
+
+#define TEST_CHECK(condition) \
+  if(!(condition)) { \
+    printf("  %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+    return false; \
+  }
+
+// turns on sprites, the border and screen colours, a sid voice and the cia timers, then loops
+// incrementing the border colour, so a reset after it has run has plenty left to clear
+uint8_t test_prg[] = {
+  0x01, 0x08, 0x0b, 0x08, 0x0a, 0x00, 0x9e, 0x32, 0x30, 0x36, 0x31, 0x00, 0x00, 0x00,
+  0xa9, 0xff, 0x8d, 0x15, 0xd0,
+  0xa9, 0x80, 0x8d, 0x00, 0xd0, 0x8d, 0x01, 0xd0, 0x8d, 0x0e, 0xd0, 0x8d, 0x0f, 0xd0,
+  0x8d, 0x17, 0xd0, 0x8d, 0x1d, 0xd0,
+  0xa9, 0x3b, 0x8d, 0x11, 0xd0,
+  0xa9, 0x18, 0x8d, 0x16, 0xd0,
+  0xa9, 0x0f, 0x8d, 0x18, 0xd4, 0xa9, 0x21, 0x8d, 0x04, 0xd4,
+  0xa9, 0x11, 0x8d, 0x0e, 0xdc, 0x8d, 0x0f, 0xdd,
+  0xee, 0x20, 0xd0, 0x4c, 0x42, 0x08
+};
+
+static void test_init() {
+  m64_init(0, 0);
+  m64_audioInit(4096, 48000);
+  m64_setBootCache(1);
+}
+
+// a reset after a program has run finds the boot cache entry of the first boot,
+// and what it loads is the same as booting without the cache
+static bool_t test_bootCacheAfterProgram() {
+  int32_t lengthA, lengthB;
+  uint32_t i;
+
+  test_init();
+  m64_injectAndRunPrg(test_prg, sizeof(test_prg), 1);
+  TEST_CHECK(boot_count == 1);
+
+  for(i = 0; i < 50; i++) {
+    m64_update(20);
+  }
+
+  m64_reset(1);
+  TEST_CHECK(boot_count == 1);
+  lengthA = state_save(test_stateA, TEST_STATE_LENGTH, true);
+
+  m64_setBootCache(0);
+  m64_reset(1);
+  lengthB = state_save(test_stateB, TEST_STATE_LENGTH, true);
+
+  TEST_CHECK(lengthA > 0 && lengthA == lengthB);
+  TEST_CHECK(memcmp(test_stateA, test_stateB, lengthA) == 0);
+  return true;
+}
+
+static void test_frames(uint32_t frames) {
+  uint32_t i;
+  for(i = 0; i < frames; i++) {
+    m64_update(20);
+  }
+}
+
+// loading a state while recording stops the recording, so what was recorded before it plays back to the end.
+// the pixel buffer isn't in a state, the machine is booted again without the cache to play from the same frame
+static bool_t test_movieStopsOnLoad() {
+  int32_t length;
+  uint8_t *movie;
+  uint32_t movieLength;
+  uint32_t i;
+
+  test_init();
+  m64_setBootCache(0);
+  m64_injectAndRunPrg(test_prg, sizeof(test_prg), 1);
+  length = m64_saveState(test_stateA, TEST_STATE_LENGTH);
+  TEST_CHECK(length > 0);
+
+  TEST_CHECK(m64_movieRecord() == 0);
+  test_frames(5);
+  TEST_CHECK(m64_loadState(test_stateA, length) == 0);
+  TEST_CHECK(m64_movieGetStatus() == MOVIE_IDLE);
+  test_frames(5);
+
+  movieLength = m64_movieGetLength();
+  movie = malloc(movieLength);
+  TEST_CHECK(movie != NULL);
+  memcpy(movie, m64_movieGetData(), movieLength);
+
+  m64_injectAndRunPrg(test_prg, sizeof(test_prg), 1);
+  if(m64_moviePlay(movie, movieLength) != 0) {
+    free(movie);
+    TEST_CHECK(false);
+  }
+  free(movie);
+
+  for(i = 0; i < 20 && m64_movieGetStatus() == MOVIE_PLAYING; i++) {
+    m64_update(20);
+  }
+  TEST_CHECK(m64_movieGetStatus() == MOVIE_FINISHED);
+  TEST_CHECK(m64_movieGetFrame() >= 4);
+  return true;
+}
+
+// input 8 frames late sends a pal machine back 8 frames, running them again has to fit in 16 ms (one frame at 60 hz).
+// cpu time, the best of a few tries so a busy machine doesn't fail it, with the makefile's -O2
+#define TEST_ROLLBACK_FRAMES 8
+#define TEST_ROLLBACK_BUDGET 16.0
+#define TEST_ROLLBACK_TRIES 16
+
+static bool_t test_rollbackBudget() {
+  uint64_t frameCycles;
+  double start, elapsed, best = 1e9;
+  int32_t frames;
+  uint32_t i;
+
+  m64_init(M64_MODEL_PAL, SID_8580);
+  m64_audioInit(4096, 48000);
+  m64_injectAndRunPrg(test_prg, sizeof(test_prg), 1);
+  TEST_CHECK(m64_setRollback(TEST_ROLLBACK_FRAMES + 2) == 0);
+  frameCycles = (uint64_t)vic_CYCLES_PER_LINE * vic_MAX_RASTERS;
+
+  for(i = 0; i < TEST_ROLLBACK_TRIES; i++) {
+    test_frames(TEST_ROLLBACK_FRAMES + 2);
+
+    start = test_cpuTime();
+    frames = m64_rollbackInput(m64_getCycle() - TEST_ROLLBACK_FRAMES * frameCycles, INPUT_KEY_DOWN, i, 0);
+    elapsed = test_cpuTime() - start;
+
+    TEST_CHECK(frames >= TEST_ROLLBACK_FRAMES);
+    if(elapsed < best) {
+      best = elapsed;
+    }
+  }
+
+  printf("  %d frames again in %.1f ms\n", frames, best);
+  TEST_CHECK(best < TEST_ROLLBACK_BUDGET);
+  return true;
+}
+
+static void test_run(const char *name, bool_t (*test)()) {
+  if(test()) {
+    printf("ok   %s\n", name);
+  } else {
+    printf("FAIL %s\n", name);
+    test_failed++;
+  }
+}
+
+int main() {
+  test_run("boot cache after a program", test_bootCacheAfterProgram);
+  test_run("loading a state stops a movie", test_movieStopsOnLoad);
+  test_run("rollback of 8 frames in 16 ms", test_rollbackBudget);
+  return test_failed;
+}
@@ -0,0 +1,15 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation. For the full
+ * license text, see http://www.gnu.org/licenses/gpl.html.
+ */
+
+// cpu time for the timed tests, kept out of test.c as time.h's clock_t clashes with the machine's clock_t
+
+#include <time.h>
+
+// milliseconds of cpu time used so far, so a busy machine doesn't fail the tests
+double test_cpuTime() {
+  return (double)clock() * 1000 / CLOCKS_PER_SEC;
+}